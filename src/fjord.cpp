@@ -20,7 +20,11 @@
 
 #include <fjord/decoder.hpp>
 #include <fjord/format.hpp>
+#include <fjord/hash.hpp>
+#include <fjord/trace.hpp>
 
+#include "resources/disk_cache.hpp"
+#include "resources/frame_cache.hpp"
 #include "resources/gallery.hpp"
 
 using rtl::Application;
@@ -38,8 +42,21 @@ static fjord::Decoder g_decoder;
 static Gallery* g_gallery{ nullptr };
 static Picture* g_picture{ nullptr };
 
+#if FJORD_ENABLE_FRAME_CACHE
+static FrameCache*              g_frame_cache{ nullptr };
+static FrameCache::Key          g_frame_key;
+static const FrameCache::Frame* g_frame{ nullptr };
+#endif
+
+#if FJORD_ENABLE_DISK_CACHE
+static Picture*      g_snapshot{ nullptr };
+static rtl::uint64_t g_snapshot_key;
+static bool          g_snapshot_restored{ false };
+#endif
+
 static unsigned g_iteration{ 0 };
 static unsigned g_iteration_count{ 0 };
+static bool     g_sequence{ false };
 
 static thirds      g_image_time_to_change{ 0 };
 static fjord::Size g_image_size;
@@ -49,6 +66,77 @@ using TextLocation = Application::Output::OSD::Location;
 static constexpr seconds viewing_timeout{ 5 };
 static constexpr bool    stop_after_decoding = FJORD_ENABLE_STOP_AFTER_DECODING;
 
+#if FJORD_ENABLE_PROFILER
+static bool g_hud{ false };
+
+/**
+ * @brief Converts clock ticks to tenths of millisecond.
+ */
+static int duration( fjord::profiler::Ticks ticks )
+{
+    return static_cast<int>( ticks * 10000 / fjord::profiler::frequency() );
+}
+
+static int average_duration( const fjord::profiler::Counters& counters,
+                             fjord::profiler::Stage           stage )
+{
+    const auto calls = counters.calls[(int)stage];
+    return calls ? duration( counters.ticks[(int)stage] / calls ) : 0;
+}
+
+template<typename Text>
+static void print_hud( Text& text, const fjord::profiler::Counters& counters )
+{
+    using fjord::profiler::Stage;
+
+    const int load = duration( counters.load_ticks() );
+    const int headers = duration( counters.ticks[(int)Stage::load_headers] );
+    const int blocks = duration( counters.ticks[(int)Stage::load_blocks] );
+    const int quadtree = duration( counters.ticks[(int)Stage::load_quadtree] );
+    const int windows = duration( counters.ticks[(int)Stage::load_windows] );
+    const int mask = duration( counters.ticks[(int)Stage::load_mask] );
+
+    const int iteration = average_duration( counters, Stage::iterate );
+    const int yuv444 = average_duration( counters, Stage::convert_yuv420_to_yuv444 );
+    const int rgb888 = average_duration( counters, Stage::convert_yuv444_to_rgb888 );
+
+    const auto iteration_ticks = counters.ticks[(int)Stage::iterate];
+    const auto iteration_calls = counters.calls[(int)Stage::iterate];
+    const int  iterations_per_second
+        = iteration_ticks ? static_cast<int>( iteration_calls * fjord::profiler::frequency()
+                                              / iteration_ticks )
+                          : 0;
+
+    rtl::wsprintf_s( text,
+                     u8"Load: %i.%i ms · headers %i.%i · blocks %i.%i · quadtree %i.%i · "
+                     u8"windows %i.%i · mask %i.%i\n"
+                     u8"Iteration: %i.%i ms · %i it/s · YUV420→YUV444: %i.%i ms · "
+                     u8"YUV444→RGB888: %i.%i ms\n"
+                     u8"Memory: %i MiB · peak %i MiB",
+                     load / 10,
+                     load % 10,
+                     headers / 10,
+                     headers % 10,
+                     blocks / 10,
+                     blocks % 10,
+                     quadtree / 10,
+                     quadtree % 10,
+                     windows / 10,
+                     windows % 10,
+                     mask / 10,
+                     mask % 10,
+                     iteration / 10,
+                     iteration % 10,
+                     iterations_per_second,
+                     yuv444 / 10,
+                     yuv444 % 10,
+                     rgb888 / 10,
+                     rgb888 % 10,
+                     static_cast<int>( counters.allocated_bytes >> 20 ),
+                     static_cast<int>( counters.allocated_bytes_peak >> 20 ) );
+}
+#endif
+
 void main()
 {
     g_decoder.reset();
@@ -58,6 +146,9 @@ void main()
     // NOTE: We want to reduce binary size, so we don't care about memory leaks
     g_gallery = new Gallery;
     g_picture = new Picture( g_gallery->picture() );
+#if FJORD_ENABLE_FRAME_CACHE
+    g_frame_cache = new FrameCache( static_cast<size_t>( FJORD_FRAME_CACHE_BUDGET_MIB ) << 20 );
+#endif
 
     Application::instance().run(
         L"fjord",
@@ -68,8 +159,11 @@ void main()
         },
         []( const Application::Input& input, Application::Output& output )
         {
+            FJORD_TRACE_ZONE( "update" );
+
             bool reload_picture = false;
             bool next_picture = false;
+            bool previous_picture = false;
 
             if ( input.keys.pressed[Keys::escape] )
             {
@@ -86,6 +180,17 @@ void main()
                 next_picture = true;
                 reload_picture = true;
             }
+            else if ( input.keys.pressed[Keys::backspace] )
+            {
+                previous_picture = true;
+                reload_picture = true;
+            }
+#if FJORD_ENABLE_PROFILER
+            else if ( input.keys.pressed[Keys::tab] )
+            {
+                g_hud = !g_hud;
+            }
+#endif
 
             if ( g_image_time_to_change.count()
                  && thirds( input.clock.third_ticks ) >= g_image_time_to_change )
@@ -106,30 +211,105 @@ void main()
             {
                 g_gallery->next();
             }
+            else if ( previous_picture )
+            {
+                g_gallery->previous();
+            }
 
             if ( !g_picture->data )
             {
                 rtl::wsprintf_s( output.osd.text[(size_t)TextLocation::top_right], u8"· 𝐹𝐽𝑂𝑅𝐷 ·" );
                 rtl::wsprintf_s( output.osd.text[(size_t)TextLocation::bottom_right],
-                                 u8"⌨ · 𝑆𝑃𝐴𝐶𝐸 · 𝐸𝑆𝐶 · 𝑅𝐸𝑇𝑈𝑅𝑁 ·" );
+                                 u8"⌨ · 𝑆𝑃𝐴𝐶𝐸 · 𝐵𝐴𝐶𝐾𝑆𝑃𝐴𝐶𝐸 · 𝐸𝑆𝐶 · 𝑅𝐸𝑇𝑈𝑅𝑁 ·" );
 
                 *g_picture = g_gallery->picture();
                 if ( g_picture->data )
                 {
-                    // TODO: pass data size and check boundaries
-                    g_iteration_count = g_decoder.load(
-                        g_picture->data.get(),
-                        fjord::Size::create( input.screen.width, input.screen.height ),
-                        &g_image_size );
+                    const auto target_size
+                        = fjord::Size::create( input.screen.width, input.screen.height );
+
+                    // NOTE: Caches hold the single frame, so the sequences are always played
+                    g_sequence
+                        = fjord::Decoder::frame_count( g_picture->data.get(), g_picture->size ) > 1;
+
+#if FJORD_ENABLE_FRAME_CACHE
+                    g_frame_key.content_hash
+                        = fjord::hash::fnv1a( g_picture->data.get(), g_picture->size );
+                    g_frame_key.target_size = target_size;
+
+                    g_frame = g_sequence ? nullptr : g_frame_cache->find( g_frame_key );
+                    if ( g_frame )
+                    {
+                        g_image_size = g_frame->source_size;
+                        g_iteration_count = 0;
+                    }
+                    else
+#endif
+                    {
+#if FJORD_ENABLE_DISK_CACHE
+                        g_snapshot_key = fjord::Decoder::snapshot_key(
+                            g_picture->data.get(), g_picture->size, target_size );
+
+                        delete g_snapshot;
+                        g_snapshot = new Picture( DiskCache::load( g_snapshot_key ) );
+
+                        g_snapshot_restored = !g_sequence && g_snapshot->data
+                                              && g_decoder.restore( g_snapshot_key,
+                                                                    g_snapshot->data.get(),
+                                                                    g_snapshot->size,
+                                                                    target_size,
+                                                                    &g_image_size );
+
+                        // NOTE: The restored planes are the pages of the mapped snapshot,
+                        // otherwise it's unmapped, so the new one can replace the file
+                        if ( !g_snapshot_restored )
+                        {
+                            delete g_snapshot;
+                            g_snapshot = nullptr;
+                        }
+
+                        if ( g_snapshot_restored )
+                            g_iteration_count = 0;
+                        else
+#endif
+                            g_iteration_count = g_decoder.load( g_picture->data.get(),
+                                                                g_picture->size,
+                                                                target_size,
+                                                                &g_image_size );
+                    }
+
                     g_iteration = 0;
                     g_image_time_to_change = thirds( input.clock.third_ticks ) + viewing_timeout;
                 }
             }
 
-            if ( g_picture->data && ( !stop_after_decoding || g_iteration < g_iteration_count ) )
+            bool decode_picture
+                = g_picture->data && ( !stop_after_decoding || g_iteration < g_iteration_count );
+
+#if FJORD_ENABLE_FRAME_CACHE
+            if ( g_picture->data && g_frame )
             {
+                // NOTE: The frame is already converged, so it's cheaper to blit it every time
+                FrameCache::blit( *g_frame,
+                                  input.screen.pixels_buffer_pointer,
+                                  input.screen.pixels_buffer_pitch );
+
+                decode_picture = false;
+            }
+#endif
+
+            if ( decode_picture )
+            {
+                unsigned iterations_per_update = 1;
+
+#if FJORD_ENABLE_DISK_CACHE
+                // NOTE: Restored output planes are converged already
+                if ( g_snapshot_restored )
+                    iterations_per_update = 0;
+#endif
+
                 // TODO: run iterating stage in the separate thread, blit when ready
-                g_decoder.decode( 1,
+                g_decoder.decode( iterations_per_update,
                                   fjord::Decoder::PixelFormat::rgb888,
                                   input.screen.pixels_buffer_pointer,
                                   input.screen.width,
@@ -137,7 +317,34 @@ void main()
                                   input.screen.pixels_buffer_pitch );
 
                 if ( g_iteration < g_iteration_count )
+                {
                     g_iteration++;
+
+                    if ( g_sequence && g_iteration == g_iteration_count )
+                    {
+                        // NOTE: The next frame continues from the current one, the last frame
+                        // stays on the screen
+                        if ( const unsigned frame_iteration_count = g_decoder.next_frame() )
+                        {
+                            g_iteration = 0;
+                            g_iteration_count = frame_iteration_count;
+                        }
+                    }
+
+#if FJORD_ENABLE_FRAME_CACHE
+                    if ( !g_sequence && g_iteration == g_iteration_count )
+                    {
+                        g_frame_cache->insert( g_frame_key,
+                                               g_image_size,
+                                               input.screen.pixels_buffer_pointer,
+                                               input.screen.pixels_buffer_pitch );
+                    }
+#endif
+#if FJORD_ENABLE_DISK_CACHE
+                    if ( !g_sequence && g_iteration == g_iteration_count )
+                        DiskCache::store( g_snapshot_key, g_decoder );
+#endif
+                }
             }
 
             if ( g_image_time_to_change.count() )
@@ -164,6 +371,25 @@ void main()
                                  g_image_size.w,
                                  g_image_size.h,
                                  g_image_size.w * g_image_size.h * 3 / g_picture->size );
+
+#if FJORD_ENABLE_FRAME_CACHE
+                const auto& cache_statistics = g_frame_cache->statistics();
+
+                rtl::wsprintf_s( output.osd.text[(size_t)TextLocation::top_right],
+                                 u8"Cache: %i hits · %i misses · %i evictions · %i frames · %i MiB",
+                                 cache_statistics.hits,
+                                 cache_statistics.misses,
+                                 cache_statistics.evictions,
+                                 cache_statistics.frames,
+                                 cache_statistics.bytes >> 20 );
+#endif
+#if FJORD_ENABLE_PROFILER
+                if ( g_hud )
+                {
+                    print_hud( output.osd.text[(size_t)TextLocation::top_right],
+                               g_decoder.counters() );
+                }
+#endif
             }
             else
             {
@@ -173,4 +399,23 @@ void main()
             return Application::Action::none;
         },
         nullptr );
+
+#if FJORD_ENABLE_TRACE
+    {
+        using rtl::filesystem::file;
+
+        file f = file::open(
+            L"fjord.trace.json", file::access::write_only, file::mode::create_always );
+
+        if ( f )
+        {
+            fjord::trace::dump(
+                []( const char* data, size_t size, void* context )
+                {
+                    static_cast<file*>( context )->write( data, size );
+                },
+                &f );
+        }
+    }
+#endif
 }
@@ -17,8 +17,7 @@ namespace fjord
 {
     struct RangeBlock
     {
-        Image     original_image;
-        Image     bordered_image;
+        Rect      rect; // in the plane
         Image     window_image;
         Transform transform;
     };
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#if FJORD_ENABLE_C_API
+
+#include "c_api.h"
+#include "decoder.hpp"
+
+#include <new>
+
+using namespace fjord;
+
+struct fjord_context
+{
+    Decoder decoder;
+
+    const Image* decoded_image;
+    unsigned     iteration;
+    bool         loaded;
+    Size         source_size;
+    unsigned     frame_count;
+
+    // NOTE: Null for the memory of the host
+    void* allocated_memory;
+};
+
+namespace
+{
+    static_assert( FJORD_PIXEL_FORMAT_RGB888 == (int)Decoder::PixelFormat::rgb888 );
+    static_assert( FJORD_PIXEL_FORMAT_GRAY8 == (int)Decoder::PixelFormat::gray8 );
+    static_assert( FJORD_PIXEL_FORMAT_BGRA8888 == (int)Decoder::PixelFormat::bgra8888 );
+    static_assert( FJORD_PIXEL_FORMAT_RGBA8888 == (int)Decoder::PixelFormat::rgba8888 );
+    static_assert( FJORD_PIXEL_FORMAT_RGB565 == (int)Decoder::PixelFormat::rgb565 );
+    static_assert( FJORD_PIXEL_FORMAT_I420 == (int)Decoder::PixelFormat::i420 );
+    static_assert( FJORD_PIXEL_FORMAT_NV12 == (int)Decoder::PixelFormat::nv12 );
+
+    constexpr size_t context_alignment = alignof( fjord_context );
+
+    /**
+     * @brief Returns the number of bytes of the pixel of the packed format, 0 for the others.
+     */
+    [[nodiscard]] size_t pixel_size( fjord_pixel_format format )
+    {
+        switch ( format )
+        {
+        case FJORD_PIXEL_FORMAT_RGB888:
+            return 3;
+
+        case FJORD_PIXEL_FORMAT_BGRA8888:
+        case FJORD_PIXEL_FORMAT_RGBA8888:
+            return 4;
+
+        case FJORD_PIXEL_FORMAT_RGB565:
+            return 2;
+
+        case FJORD_PIXEL_FORMAT_GRAY8:
+            return 1;
+
+        case FJORD_PIXEL_FORMAT_I420:
+        case FJORD_PIXEL_FORMAT_NV12:
+            break;
+        }
+
+        return 0;
+    }
+
+    /**
+     * @brief Constructs the context at the aligned address of the memory, which is large enough.
+     */
+    [[nodiscard]] fjord_context* construct( void* memory, void* allocated_memory )
+    {
+        const auto address = reinterpret_cast<uintptr_t>( memory );
+        const auto aligned = ( address + context_alignment - 1 ) & ~( context_alignment - 1 );
+
+        // NOTE: The decoder is constructed as it is, the arenas are initialized by reset
+        auto* context = new ( reinterpret_cast<void*>( aligned ) ) fjord_context;
+
+        context->decoder.reset();
+        context->decoded_image = nullptr;
+        context->iteration = 0;
+        context->loaded = false;
+        context->source_size = Size::create( 0, 0 );
+        context->frame_count = 0;
+        context->allocated_memory = allocated_memory;
+
+        return context;
+    }
+
+    void describe( const fjord_context& context, unsigned iterations, fjord_image_info* info )
+    {
+        if ( !info )
+            return;
+
+        const Size& output_size = context.decoder.output_size();
+
+        info->source_width = context.source_size.w;
+        info->source_height = context.source_size.h;
+        info->output_width = output_size.w;
+        info->output_height = output_size.h;
+        info->iterations = iterations;
+        info->frame_count = context.frame_count;
+    }
+} // namespace
+
+uint32_t fjord_api_version( void )
+{
+    return FJORD_API_VERSION;
+}
+
+size_t fjord_context_size( void )
+{
+    return sizeof( fjord_context ) + context_alignment - 1;
+}
+
+fjord_status fjord_context_create( size_t memory_budget, fjord_context** context )
+{
+    if ( !context )
+        return FJORD_ERROR_ARGUMENT;
+
+    *context = nullptr;
+
+    if ( memory_budget < fjord_context_size() )
+        return FJORD_ERROR_MEMORY;
+
+    void* memory = ::operator new( fjord_context_size(), std::nothrow );
+    if ( !memory )
+        return FJORD_ERROR_MEMORY;
+
+    *context = construct( memory, memory );
+    return FJORD_OK;
+}
+
+fjord_status fjord_context_init( void* memory, size_t size, fjord_context** context )
+{
+    if ( !context )
+        return FJORD_ERROR_ARGUMENT;
+
+    *context = nullptr;
+
+    if ( !memory )
+        return FJORD_ERROR_ARGUMENT;
+
+    if ( size < fjord_context_size() )
+        return FJORD_ERROR_MEMORY;
+
+    *context = construct( memory, nullptr );
+    return FJORD_OK;
+}
+
+void fjord_context_destroy( fjord_context* context )
+{
+    if ( !context )
+        return;
+
+    void* allocated_memory = context->allocated_memory;
+
+    context->~fjord_context();
+
+    if ( allocated_memory )
+        ::operator delete( allocated_memory );
+}
+
+fjord_status fjord_load( fjord_context*    context,
+                         const void*       data,
+                         size_t            size,
+                         int32_t           target_width,
+                         int32_t           target_height,
+                         fjord_image_info* info )
+{
+    if ( !context || !data || target_width <= 0 || target_height <= 0 )
+        return FJORD_ERROR_ARGUMENT;
+
+    context->loaded = false;
+    context->decoded_image = nullptr;
+    context->iteration = 0;
+
+    const auto* bytes = static_cast<const rtl::uint8_t*>( data );
+
+    const unsigned iterations = context->decoder.load(
+        bytes, size, Size::create( target_width, target_height ), &context->source_size );
+
+    if ( !iterations )
+        return FJORD_ERROR_DATA;
+
+    // NOTE: The image doesn't morph from the one decoded before
+    context->decoder.rewind();
+    context->loaded = true;
+    context->frame_count = Decoder::frame_count( bytes, size );
+
+    describe( *context, iterations, info );
+    return FJORD_OK;
+}
+
+fjord_status fjord_next_frame( fjord_context* context, fjord_image_info* info )
+{
+    if ( !context )
+        return FJORD_ERROR_ARGUMENT;
+
+    if ( !context->loaded || !context->decoder.has_next_frame() )
+        return FJORD_ERROR_STATE;
+
+    const unsigned iterations = context->decoder.next_frame();
+    if ( !iterations )
+    {
+        context->loaded = false;
+        context->decoded_image = nullptr;
+        return FJORD_ERROR_DATA;
+    }
+
+    // NOTE: The last plane of the preceding frame is kept, the iterations start from it
+    context->iteration = 0;
+
+    describe( *context, iterations, info );
+    return FJORD_OK;
+}
+
+fjord_status fjord_step( fjord_context* context, uint32_t iterations )
+{
+    if ( !context )
+        return FJORD_ERROR_ARGUMENT;
+
+    if ( !context->loaded )
+        return FJORD_ERROR_STATE;
+
+    if ( iterations )
+    {
+        context->decoded_image = context->decoder.iterate( iterations );
+        context->iteration += iterations;
+    }
+
+    return FJORD_OK;
+}
+
+fjord_status fjord_iterate_until( fjord_context* context, uint32_t iteration )
+{
+    if ( !context )
+        return FJORD_ERROR_ARGUMENT;
+
+    if ( !context->loaded )
+        return FJORD_ERROR_STATE;
+
+    if ( iteration <= context->iteration )
+        return FJORD_OK;
+
+    return fjord_step( context, iteration - context->iteration );
+}
+
+uint32_t fjord_iteration( const fjord_context* context )
+{
+    return context ? context->iteration : 0;
+}
+
+size_t fjord_frame_size( fjord_pixel_format format, int32_t width, int32_t height, size_t pitch )
+{
+    if ( width <= 0 || height <= 0 )
+        return 0;
+
+    const auto w = static_cast<size_t>( width );
+    const auto h = static_cast<size_t>( height );
+
+    // NOTE: The layouts of image::convert_yuv444_to_i420 and image::convert_yuv444_to_nv12
+    switch ( format )
+    {
+    case FJORD_PIXEL_FORMAT_I420:
+        if ( pitch < w )
+            return 0;
+
+        return pitch * h + 2 * ( ( pitch + 1 ) / 2 ) * ( ( h + 1 ) / 2 );
+
+    case FJORD_PIXEL_FORMAT_NV12:
+        if ( pitch < image::nv12_min_stride( width ) )
+            return 0;
+
+        return pitch * ( h + ( h + 1 ) / 2 );
+
+    default:
+        break;
+    }
+
+    const size_t pixel_bytes = pixel_size( format );
+    if ( !pixel_bytes || pitch < pixel_bytes * w )
+        return 0;
+
+    return pitch * h;
+}
+
+fjord_status fjord_render( fjord_context*     context,
+                           fjord_pixel_format format,
+                           const fjord_rect*  region,
+                           void*              pixels,
+                           size_t             pitch )
+{
+    if ( !context || !pixels )
+        return FJORD_ERROR_ARGUMENT;
+
+    if ( !context->loaded || !context->decoded_image )
+        return FJORD_ERROR_STATE;
+
+    const Size& output_size = context->decoder.output_size();
+
+    const Rect rect = region ? Rect::create( region->x, region->y, region->width, region->height )
+                             : Rect::create( 0, 0, output_size.w, output_size.h );
+
+    // NOTE: The right and bottom edges of the untrusted region may overflow
+    if ( rect.size.w <= 0 || rect.size.h <= 0 || rect.left() < 0 || rect.top() < 0
+         || rect.size.w > output_size.w - rect.left() || rect.size.h > output_size.h - rect.top() )
+        return FJORD_ERROR_ARGUMENT;
+
+    // NOTE: Rejects the unknown formats too
+    if ( !fjord_frame_size( format, rect.size.w, rect.size.h, pitch ) )
+        return FJORD_ERROR_ARGUMENT;
+
+    // NOTE: The decoded plane is converted again for every region, it's unchanged until the step
+    context->decoder.present_region( context->decoded_image,
+                                     static_cast<Decoder::PixelFormat>( format ),
+                                     rect,
+                                     static_cast<rtl::uint8_t*>( pixels ),
+                                     pitch );
+
+    return FJORD_OK;
+}
+
+#endif // FJORD_ENABLE_C_API
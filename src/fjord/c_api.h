@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+/*
+ * The stable C interface of the decoder for embedding it into the hosts in other languages.
+ *
+ * The context holds the whole decoder, whose memory is fixed at its maximal image size, so it's
+ * either allocated once by fjord_context_create or placed into the memory of the host by
+ * fjord_context_init. Nothing is allocated after that: loading, iterating and rendering into the
+ * buffers of the caller work within the context. A context is used by one thread at a time.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define FJORD_API_VERSION 1
+
+    typedef struct fjord_context fjord_context;
+
+    typedef enum fjord_status
+    {
+        FJORD_OK = 0,
+        FJORD_ERROR_ARGUMENT, /* the null pointer, the size or the region out of range */
+        FJORD_ERROR_MEMORY,   /* the memory budget or the memory of the host is too small */
+        FJORD_ERROR_DATA,     /* the image is damaged or not supported */
+        FJORD_ERROR_STATE     /* no image is loaded or no iteration is done yet */
+    } fjord_status;
+
+    /* The values match fjord::Decoder::PixelFormat */
+    typedef enum fjord_pixel_format
+    {
+        FJORD_PIXEL_FORMAT_RGB888 = 0, /* the bytes are B, G, R */
+        FJORD_PIXEL_FORMAT_GRAY8,
+        FJORD_PIXEL_FORMAT_BGRA8888,
+        FJORD_PIXEL_FORMAT_RGBA8888,
+        FJORD_PIXEL_FORMAT_RGB565,
+        FJORD_PIXEL_FORMAT_I420, /* the U and V planes of the half size and pitch follow the Y */
+        FJORD_PIXEL_FORMAT_NV12  /* the plane of the interleaved U and V of the half height */
+
+        /*
+         * The frame of the width W, the height H and the pitch P takes P * H bytes, except:
+         *   I420  P >= W, P * H + 2 * ((P + 1) / 2) * ((H + 1) / 2)
+         *   NV12  P >= (W + 1) / 2 * 2, P * (H + (H + 1) / 2)
+         */
+    } fjord_pixel_format;
+
+    typedef struct fjord_rect
+    {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    } fjord_rect;
+
+    typedef struct fjord_image_info
+    {
+        int32_t  source_width;
+        int32_t  source_height;
+        int32_t  output_width; /* the image fitted to the target size, keeping its aspect ratio */
+        int32_t  output_height;
+        uint32_t iterations; /* the number of iterations stored in the image */
+        uint32_t frame_count;
+    } fjord_image_info;
+
+    /**
+     * @brief Returns FJORD_API_VERSION of the library, to check it against the header.
+     */
+    uint32_t fjord_api_version( void );
+
+    /**
+     * @brief Returns the number of bytes of the memory taken by the context, including the slack
+     * to align it, i.e. the least budget of fjord_context_create and size of fjord_context_init.
+     */
+    size_t fjord_context_size( void );
+
+    /**
+     * @brief Allocates the context, if it fits the memory budget.
+     */
+    fjord_status fjord_context_create( size_t memory_budget, fjord_context** context );
+
+    /**
+     * @brief Creates the context in the memory of the host, which must outlive it.
+     */
+    fjord_status fjord_context_init( void* memory, size_t size, fjord_context** context );
+
+    /**
+     * @brief Destroys the context and frees its memory, unless it's the memory of the host.
+     */
+    void fjord_context_destroy( fjord_context* context );
+
+    /**
+     * @brief Loads the image and fits it to the target size. The iterations start from scratch.
+     *
+     * The data is referenced, not copied, and must outlive the decoding of the image.
+     *
+     * @param info Receives the sizes of the image, may be NULL
+     */
+    fjord_status fjord_load( fjord_context*    context,
+                             const void*       data,
+                             size_t            size,
+                             int32_t           target_width,
+                             int32_t           target_height,
+                             fjord_image_info* info );
+
+    /**
+     * @brief Loads the next frame of the sequence, whose iterations continue from the preceding
+     * frame.
+     *
+     * @return FJORD_ERROR_STATE if there are no more frames
+     */
+    fjord_status fjord_next_frame( fjord_context* context, fjord_image_info* info );
+
+    /**
+     * @brief Runs the iterations of the loaded image.
+     */
+    fjord_status fjord_step( fjord_context* context, uint32_t iterations );
+
+    /**
+     * @brief Runs the iterations until their number since the image or the frame is loaded
+     * reaches the given one, e.g. the number stored in the image. Does nothing if it's reached.
+     */
+    fjord_status fjord_iterate_until( fjord_context* context, uint32_t iteration );
+
+    /**
+     * @brief Returns the number of iterations since the image or the frame is loaded.
+     */
+    uint32_t fjord_iteration( const fjord_context* context );
+
+    /**
+     * @brief Returns the number of bytes of the frame of the pixel format, see
+     * fjord_pixel_format, or 0 if the pitch is too small for the width.
+     */
+    size_t fjord_frame_size( fjord_pixel_format format,
+                             int32_t            width,
+                             int32_t            height,
+                             size_t             pitch );
+
+    /**
+     * @brief Converts the region of the last iterated image to the buffer of the caller, whose
+     * pixels start at the region origin, i.e. the buffer is of the region size.
+     *
+     * @param region In the coordinates of the output image, NULL for the whole image
+     * @param pitch The number of bytes between the rows of the buffer, the buffer takes
+     * fjord_frame_size of the region size and the pitch
+     */
+    fjord_status fjord_render( fjord_context*     context,
+                               fjord_pixel_format format,
+                               const fjord_rect*  region,
+                               void*              pixels,
+                               size_t             pitch );
+
+#ifdef __cplusplus
+}
+#endif
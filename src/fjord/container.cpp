@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "container.hpp"
+
+#include <rtl/sys/debug.hpp>
+
+using namespace fjord;
+
+namespace
+{
+    using ChunkHeader = format::headers::Chunk;
+
+    // NOTE: RIFF chunk header followed by the form type
+    constexpr rtl::size_t riff_header_size = sizeof( ChunkHeader ) + sizeof( rtl::uint32_t );
+    constexpr rtl::size_t contents_offset = riff_header_size + sizeof( ChunkHeader );
+} // namespace
+
+rtl::size_t Container::header_size( const rtl::uint8_t* data, rtl::size_t size )
+{
+    if ( size < contents_offset )
+        return 0;
+
+    const auto* riff = reinterpret_cast<const ChunkHeader*>( data );
+    const auto  form = *reinterpret_cast<const rtl::uint32_t*>( data + sizeof( ChunkHeader ) );
+    const auto* toc = reinterpret_cast<const ChunkHeader*>( data + riff_header_size );
+
+    if ( riff->id != format::signatures::riff || form != format::signatures::fjar )
+        return 0;
+
+    if ( toc->id != format::signatures::toc || toc->size % sizeof( Entry ) )
+        return 0;
+
+    return contents_offset + toc->size;
+}
+
+bool Container::open( const rtl::uint8_t* data, rtl::size_t size )
+{
+    m_data = data;
+    m_size = size;
+    m_entries = nullptr;
+    m_entry_count = 0;
+    m_image_count = 0;
+
+    const rtl::size_t contents_end = header_size( data, size );
+    if ( !contents_end || contents_end > size )
+        return false;
+
+    // NOTE: Offsets are checked against the declared container size, the data may be its prefix
+    const rtl::uint64_t container_size
+        = rtl::uint64_t( reinterpret_cast<const ChunkHeader*>( data )->size ) + sizeof( ChunkHeader );
+
+    const auto* entries = reinterpret_cast<const Entry*>( data + contents_offset );
+    const auto  entry_count = ( contents_end - contents_offset ) / sizeof( Entry );
+
+    rtl::uint32_t image_count = 0;
+
+    for ( rtl::size_t i = 0; i < entry_count; ++i )
+    {
+        const Entry& entry = entries[i];
+
+        if ( entry.offset < contents_end + sizeof( ChunkHeader ) )
+            return false;
+
+        if ( rtl::uint64_t( entry.offset ) + entry.size > container_size )
+            return false;
+
+        // NOTE: Images are listed in order, so their indices are contiguous
+        if ( entry.id == format::signatures::pifs )
+        {
+            if ( entry.image != image_count )
+                return false;
+
+            ++image_count;
+        }
+    }
+
+    RTL_LOG( "Container: %zu chunks, %u images", entry_count, image_count );
+
+    m_entries = entries;
+    m_entry_count = entry_count;
+    m_image_count = image_count;
+
+    return true;
+}
+
+rtl::size_t Container::find( rtl::uint32_t id, rtl::uint32_t image ) const
+{
+    for ( rtl::size_t i = 0; i < m_entry_count; ++i )
+    {
+        if ( m_entries[i].id == id && m_entries[i].image == image )
+            return i;
+    }
+
+    return m_entry_count;
+}
+
+const rtl::uint8_t* Container::chunk_data( rtl::size_t index ) const
+{
+    if ( index >= m_entry_count )
+        return nullptr;
+
+    const Entry& entry = m_entries[index];
+
+    if ( rtl::uint64_t( entry.offset ) + entry.size > m_size )
+        return nullptr;
+
+    const auto* header
+        = reinterpret_cast<const ChunkHeader*>( m_data + entry.offset - sizeof( ChunkHeader ) );
+
+    if ( header->id != entry.id || header->size != entry.size )
+        return nullptr;
+
+    return m_data + entry.offset;
+}
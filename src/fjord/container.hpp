@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <rtl/int.hpp>
+
+#include "format.hpp"
+
+namespace fjord
+{
+    /**
+     * @brief Reader of the RIFF container holding many images with their thumbnails and metadata.
+     *
+     * The table of contents is the first chunk of the container, it lists the offsets of all other
+     * chunks, so any chunk is located without walking the file:
+     *
+     * +------+------+------+------+------+---------+------+------+------+-----+-----
+     * | RIFF | size | FJAR | TOC  | size | entries | PIFS | size | data | pad | ...
+     * +------+------+------+------+------+---------+------+------+------+-----+-----
+     *
+     * The PIFS chunk data is the image as \Decoder::load expects it, the THMB chunk is the small
+     * image of the same format and the META chunk is the UTF-8 text of "key=value" lines.
+     */
+    class Container final
+    {
+    public:
+        using Entry = format::headers::ContentsEntry;
+
+        /**
+         * @brief Returns the size of the container prefix with the table of contents.
+         *
+         * @param data At least the RIFF header and the table of contents chunk header
+         *
+         * @return 0 if the data is not the container
+         */
+        [[nodiscard]] static rtl::size_t header_size( const rtl::uint8_t* data, rtl::size_t size );
+
+        /**
+         * @brief Validates the container and its table of contents.
+         *
+         * @param size Size of the available data, e.g. the prefix of \header_size bytes or the
+         * whole mapping. Chunks beyond the available data are only listed
+         *
+         * @return false if the container is damaged
+         */
+        bool open( const rtl::uint8_t* data, rtl::size_t size );
+
+        [[nodiscard]] rtl::size_t entry_count() const
+        {
+            return m_entry_count;
+        }
+
+        [[nodiscard]] const Entry& entry( rtl::size_t index ) const
+        {
+            return m_entries[index];
+        }
+
+        /**
+         * @brief Returns the number of the images, their indices are contiguous.
+         */
+        [[nodiscard]] rtl::uint32_t image_count() const
+        {
+            return m_image_count;
+        }
+
+        /**
+         * @brief Looks up the chunk of the image.
+         *
+         * @return Index of the entry or \entry_count if there is no such chunk
+         */
+        [[nodiscard]] rtl::size_t find( rtl::uint32_t id, rtl::uint32_t image ) const;
+
+        /**
+         * @brief Returns the data of the chunk.
+         *
+         * @return nullptr if the chunk is beyond the available data or its header doesn't match
+         * the entry
+         */
+        [[nodiscard]] const rtl::uint8_t* chunk_data( rtl::size_t index ) const;
+
+    private:
+        const rtl::uint8_t* m_data;
+        rtl::size_t         m_size;
+        const Entry*        m_entries;
+        rtl::size_t         m_entry_count;
+        rtl::uint32_t       m_image_count;
+    };
+} // namespace fjord
@@ -10,16 +10,17 @@
  */
 #pragma once
 
-#include <rtl/allocator.hpp>
-#include <rtl/random.hpp>
-
-#include "block.hpp"
 #include "format.hpp"
 #include "image.hpp"
-#include "windows.hpp"
+#include "profiler.hpp"
+#include "program.hpp"
+#include "session.hpp"
 
 namespace fjord
 {
+    /**
+     * @brief Decoder of the single image, the \Program with its own \Session.
+     */
     class Decoder final
     {
     public:
@@ -31,96 +32,265 @@ namespace fjord
          */
         Decoder() = default;
 
+        /**
+         * @brief Decoder version. Must be incremented whenever the decoding result changes, as it
+         * invalidates the stored snapshots.
+         */
+        static constexpr rtl::uint32_t version = 2;
+
         void reset();
 
-        unsigned load( const rtl::uint8_t* data, const Size& target_size, Size* source_size );
+        /**
+         * @brief Loads the image and fits it to the target size.
+         *
+         * @return The number of iterations stored in the image or 0 if the image is damaged or not
+         * supported
+         */
+        unsigned load( const rtl::uint8_t* data,
+                       rtl::size_t         size,
+                       const Size&         target_size,
+                       Size*               source_size );
+
+        /**
+         * @brief Returns the number of frames in the image data, 1 for the still image.
+         *
+         * @return 0 if the data is not the image
+         */
+        [[nodiscard]] static unsigned frame_count( const rtl::uint8_t* data, rtl::size_t size );
+
+        /**
+         * @brief Starts loading the image streamed by \feed, e.g. while it's being read.
+         */
+        void begin( const Size& target_size );
+
+        /**
+         * @brief Parses the next chunk of the streamed image.
+         *
+         * The blocks are prepared as they arrive, so the frame is ready to decode as soon as its
+         * last byte is fed. Feeding stops at the end of the frame, the rest of the chunk belongs
+         * to the next frame of the sequence and must be fed after the frame is decoded.
+         *
+         * @param consumed Receives the number of bytes parsed
+         *
+         * @return The number of iterations of the frame completed by the chunk, otherwise 0
+         */
+        unsigned feed( const rtl::uint8_t* data, rtl::size_t size, rtl::size_t* consumed );
 
-        enum class PixelFormat
+        /**
+         * @brief Returns the state of the streamed image, which is failed if it's damaged.
+         */
+        [[nodiscard]] Program::Status status() const
         {
-            rgb888
-        };
+            return m_status;
+        }
 
-        void decode( unsigned      num_iterations,
-                     PixelFormat   fmt,
-                     rtl::uint8_t* buffer_pixels,
-                     int           buffer_width,
-                     int           buffer_height,
-                     rtl::size_t   buffer_pitch );
+        /**
+         * @brief Returns the number of bytes to read for the streamed image to make progress.
+         */
+        [[nodiscard]] rtl::size_t required() const
+        {
+            return m_program.required();
+        }
 
-    private:
-        const Image* iterate( unsigned num_iterations );
+        [[nodiscard]] bool has_next_frame() const
+        {
+            return m_program.has_next_frame();
+        }
+
+        /**
+         * @brief Loads the next frame of the sequence loaded by \load.
+         *
+         * Iterations of the frame continue from the plane of the preceding one, so the temporally
+         * coherent frames need one or two iterations only. The frames sharing the partition with
+         * the preceding one reuse its range blocks and windows instead of rebuilding them.
+         *
+         * @return The number of iterations of the frame or 0 if there are no more frames or the
+         * frame doesn't match the sequence
+         */
+        unsigned next_frame();
 
-        static constexpr auto overlap_factor_denominator = 4; // ~ 1/4 = 25% block overlap
-        static constexpr auto noise_intensivity_log2 = 4;     // [0..7]
-        static constexpr auto random_cycle_length = 4096;
+        /**
+         * @brief Makes the iterations of the loaded image start from scratch.
+         *
+         * Iterations continue from the plane left by the previously decoded image, which morphs
+         * one picture into another in the viewer. Rewinding after \load makes the result
+         * independent of the decoding history.
+         */
+        void rewind();
+
+        using Mode = Session::Mode;
+
+        /**
+         * @brief Sets the channels being iterated, the luma mode is the fast grayscale preview.
+         *
+         * @note Switching from the luma mode to the full one needs \rewind, and the snapshot of
+         * the luma decoding holds the luma only
+         */
+        void set_mode( Mode mode )
+        {
+            m_session.set_mode( mode );
+        }
+
+        /**
+         * @brief Sets the filter resizing the decoded image to the output size, the bilinear one
+         * smooths the downscaled images.
+         *
+         * @note The snapshot holds the output of the filter it's taken with, see \snapshot_key
+         */
+        void set_filter( image::Filter filter )
+        {
+            m_session.set_filter( filter );
+        }
 
-        using RandomGenerator = rtl::random<random_cycle_length>;
-        using SmoothWindow = windows::Trapezoidal<overlap_factor_denominator>;
+        /**
+         * @brief Sets the number of the preceding iterations mixed into the next one, 0 for the
+         * plain iterations. Takes effect from the next load, see \Session::set_acceleration_depth.
+         */
+        void set_acceleration_depth( int depth )
+        {
+            m_session.set_acceleration_depth( depth );
+        }
 
-        using ImageInfo = format::headers::Image;
-        using ChannelInfo = format::headers::Channel;
-        using FractalInfo = format::headers::IteratedFunctionSystem;
+        /**
+         * @brief Returns the number of bytes of the history planes kept for the acceleration.
+         */
+        [[nodiscard]] rtl::size_t history_size() const
+        {
+            return m_session.history_size();
+        }
 
-        static constexpr auto max_regions_count{ format::constraints::max_regions_count };
-        static constexpr auto brightness_bits{ format::Block::bits_per_brightness };
-        static constexpr auto contrast_bits{ format::Block::bits_per_contrast };
+        /**
+         * @brief Makes the following loads prepare the frames on the executor, which shortens
+         * the time to the first iteration of the images with many blocks.
+         */
+        void set_executor( const Executor& executor )
+        {
+            m_program.set_executor( executor );
+        }
 
-        static constexpr auto max_blocks_count{ format::constraints::max_ifs_blocks_count };
-        static constexpr auto max_channels_count{ format::constraints::max_channels_count };
-        static constexpr auto max_image_size{ format::constraints::max_image_size };
+        /**
+         * @brief Performs the iterations of the function system.
+         *
+         * @return The plane with the decoded channels after the last iteration or nullptr if no
+         * iterations were performed
+         */
+        const Image* iterate( unsigned num_iterations );
 
-        enum Buffer
+        /**
+         * @brief Returns the size of the decoded image fitted to the target size.
+         */
+        [[nodiscard]] const Size& output_size() const
         {
-            buffer_ifs_1st,
-            buffer_ifs_2nd,
-            buffer_ifs_mask,
-            buffer_ifs_count,
+            return m_session.output_size();
+        }
 
-            buffer_output_channel_base = buffer_ifs_count,
-            buffer_output_channel_y = buffer_ifs_count,
-            buffer_output_channel_u,
-            buffer_output_channel_v,
+        using PixelFormat = Session::PixelFormat;
 
-            buffer_count,
-        };
+        void decode( unsigned      num_iterations,
+                     PixelFormat   fmt,
+                     rtl::uint8_t* buffer_pixels,
+                     int           buffer_width,
+                     int           buffer_height,
+                     rtl::size_t   buffer_pitch );
 
-        static constexpr auto buffer_page_size = max_image_size * max_image_size;
+        /**
+         * @brief Converts the plane returned by \iterate to the output pixels.
+         *
+         * Decoding is the same as iterating and presenting the result, the separate steps allow
+         * the caller to inspect the image after every iteration.
+         *
+         * @param decoded_image nullptr to convert the output planes as they are, e.g. restored
+         * from the snapshot
+         */
+        void present( const Image*  decoded_image,
+                      PixelFormat   fmt,
+                      rtl::uint8_t* buffer_pixels,
+                      int           buffer_width,
+                      int           buffer_height,
+                      rtl::size_t   buffer_pitch );
 
-        // Total pixel buffers size is the sum of the following components:
-        // - working buffers with size NxN each
-        // - original image buffers for range blocks with total size (NxN)
-        // - smooth window and bordered image buffers for range blocks - TODO: proove size
-        //
-        // where N - maximal image size
+        /**
+         * @brief Converts the region of the plane returned by \iterate to the buffer of the region
+         * size, see \Session::present_region.
+         */
+        void present_region( const Image*  decoded_image,
+                             PixelFormat   fmt,
+                             const Rect&   region,
+                             rtl::uint8_t* buffer_pixels,
+                             rtl::size_t   buffer_pitch );
 
-        static constexpr auto expand_factor
-            = overlap_factor_denominator * overlap_factor_denominator;
+        /**
+         * @brief Returns the key identifying the snapshot of the image data decoded to the target
+         * size with the filter by this version of the decoder.
+         */
+        [[nodiscard]] static rtl::uint64_t snapshot_key(
+            const rtl::uint8_t* data,
+            rtl::size_t         size,
+            const Size&         target_size,
+            image::Filter       filter = image::Filter::nearest );
 
-        // TODO: round up?
-        static constexpr auto allocator_size
-            = buffer_page_size * ( buffer_count + 1 + ( expand_factor + 4 ) / expand_factor );
+        /**
+         * @brief Returns the size of the buffer required to store the snapshot of the output
+         * planes of the loaded image.
+         */
+        [[nodiscard]] rtl::size_t snapshot_size() const;
 
-        using Allocator = rtl::allocators::grow_only<Pixel, allocator_size>;
+        /**
+         * @brief Stores the output planes produced by the last \decode call.
+         *
+         * @param key Caller defined key identifying the image data and the decoding parameters
+         *
+         * @return The number of bytes written or 0 if the buffer is too small
+         */
+        rtl::size_t snapshot( rtl::uint64_t key, rtl::uint8_t* buffer, rtl::size_t size ) const;
 
-        Allocator m_allocator;
+        /**
+         * @brief Restores the output planes from the snapshot instead of loading the image.
+         *
+         * After restoring, \decode with zero iterations converts the snapshot planes to the
+         * output pixels.
+         *
+         * @note The output planes refer to the snapshot data, so the data must be kept alive as
+         * long as the decoder is used, the same as the data passed to \load.
+         *
+         * @return false if the snapshot is damaged or doesn't match the key or the target size
+         */
+        bool restore( rtl::uint64_t       key,
+                      const rtl::uint8_t* data,
+                      rtl::size_t         size,
+                      const Size&         target_size,
+                      Size*               source_size );
+
+        /**
+         * @brief Returns the performance counters of the loaded image decoding stages.
+         *
+         * @note Counters are collected only if the decoder is built with FJORD_ENABLE_PROFILER
+         */
+        [[nodiscard]] profiler::Counters counters() const
+        {
+            profiler::Counters counters = m_program.counters();
+            counters.add( m_session.counters() );
 
-        const ImageInfo*   m_image_info;
-        const ChannelInfo* m_channels_info;
-        Rect               m_regions[max_regions_count];
+            return counters;
+        }
 
-        const FractalInfo* m_ifs_info;
-        Size               m_ifs_size;
-        RangeBlock         m_ifs_blocks[max_blocks_count];
-        unsigned           m_ifs_nodes[max_blocks_count];
-        int                m_ifs_block_size_ilog2;
+        /**
+         * @brief Returns the loaded image, which may be shared by other sessions.
+         */
+        [[nodiscard]] const Program& program() const
+        {
+            return m_program;
+        }
 
-        // NOTE: Merging different images into the single array is reducing the size of the code
-        Image m_buffer_images[buffer_count];
+    private:
+        static constexpr auto max_channels_count{ Program::max_channels_count };
 
-        Buffer m_ifs_last_output_buffer;
+        static constexpr rtl::size_t snapshot_alignment = 64;
 
-        Size m_output_image_size;
+        Program m_program;
+        Session m_session;
 
-        RandomGenerator m_random;
+        Size            m_target_size; // of the streamed image
+        Program::Status m_status;
     };
 } // namespace fjord
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+namespace fjord
+{
+    /**
+     * @brief Runs the independent tasks of the decoder on the threads of the caller.
+     *
+     * The decoder doesn't create threads itself, so the application plugs in its own pool. Without
+     * the function the tasks are run one by one on the calling thread.
+     */
+    struct Executor final
+    {
+        using Task = void ( * )( void* task_context, int index );
+
+        /**
+         * @brief Calls the task for every index in [0;count), possibly concurrently, and returns
+         * when all of them are done.
+         */
+        using Function = void ( * )( void* context, Task task, void* task_context, int count );
+
+        template<typename Body>
+        void for_each( int count, Body& body ) const
+        {
+            const Task task = []( void* task_context, int index )
+            { ( *static_cast<Body*>( task_context ) )( index ); };
+
+            if ( !function )
+            {
+                for ( int i = 0; i < count; ++i )
+                    task( &body, i );
+                return;
+            }
+
+            function( context, task, &body, count );
+        }
+
+        Function function;
+        void*    context;
+    };
+} // namespace fjord
@@ -23,6 +23,14 @@ namespace fjord
             constexpr rtl::uint32_t iyuv = rtl::make_fourcc( 'I', 'Y', 'U', 'V' );
             constexpr rtl::uint32_t fern = rtl::make_fourcc( 'F', 'E', 'R', 'N' );
             constexpr rtl::uint32_t fjrd = rtl::make_fourcc( 'F', 'J', 'R', 'D' );
+            constexpr rtl::uint32_t fjdc = rtl::make_fourcc( 'F', 'J', 'D', 'C' );
+
+            // Container chunks
+            constexpr rtl::uint32_t riff = rtl::make_fourcc( 'R', 'I', 'F', 'F' );
+            constexpr rtl::uint32_t fjar = rtl::make_fourcc( 'F', 'J', 'A', 'R' );
+            constexpr rtl::uint32_t toc = rtl::make_fourcc( 'T', 'O', 'C', ' ' );
+            constexpr rtl::uint32_t thumbnail = rtl::make_fourcc( 'T', 'H', 'M', 'B' );
+            constexpr rtl::uint32_t metadata = rtl::make_fourcc( 'M', 'E', 'T', 'A' );
         } // namespace signatures
 
         namespace versions
@@ -42,6 +50,21 @@ namespace fjord
             constexpr rtl::uintmax_t max_file_size = max_image_size * max_image_size;
         } // namespace constraints
 
+        /**
+         * @brief Flags of the function system of the sequence frame.
+         *
+         * The frames after the first one may reuse the tables of the preceding frame, which are
+         * omitted from the file then. The plane geometry is the same for all frames.
+         */
+        namespace frame_flags
+        {
+            // Regions and quadtree nodes of the preceding frame
+            constexpr rtl::uint8_t shared_partition = 0x01;
+
+            // Blocks of the preceding frame, implies the shared partition
+            constexpr rtl::uint8_t shared_blocks = 0x02;
+        } // namespace frame_flags
+
 #pragma pack( push, 1 )
         namespace headers
         {
@@ -76,7 +99,7 @@ namespace fjord
                 rtl::uint8_t  step;
                 rtl::uint8_t  depth;
                 rtl::uint8_t  iteration_count;
-                rtl::uint8_t  pad1;
+                rtl::uint8_t  frame_flags;
                 rtl::uint16_t region_count;
                 rtl::uint8_t  pad2;
                 rtl::uint8_t  pad3;
@@ -86,6 +109,61 @@ namespace fjord
 
             static_assert( sizeof( IteratedFunctionSystem ) == 28 );
 
+            /**
+             * @brief Header of the decoded output planes snapshot.
+             *
+             * The header is followed by \channels_count planes of the output size pixels. Each
+             * plane starts at 64-byte aligned offset, so the snapshot can be used directly from
+             * the memory mapped file.
+             */
+            struct Snapshot
+            {
+                rtl::uint32_t signature;
+                rtl::uint32_t decoder_version;
+                rtl::uint64_t key;
+                rtl::uint16_t source_width;
+                rtl::uint16_t source_height;
+                rtl::uint16_t target_width;
+                rtl::uint16_t target_height;
+                rtl::uint16_t output_width;
+                rtl::uint16_t output_height;
+                rtl::uint8_t  channels_count;
+                rtl::uint8_t  pad1;
+                rtl::uint16_t pad2;
+                rtl::uint32_t planes_offset;
+                rtl::uint32_t plane_size;
+                rtl::uint32_t checksum; // FNV-1a of the preceding header fields
+            };
+
+            static_assert( sizeof( Snapshot ) == 44 );
+
+            /**
+             * @brief Header of the container chunk.
+             *
+             * The chunk data is padded with a zero byte to the even size, the padding is not
+             * counted in the size.
+             */
+            struct Chunk
+            {
+                rtl::uint32_t id;
+                rtl::uint32_t size;
+            };
+
+            static_assert( sizeof( Chunk ) == 8 );
+
+            /**
+             * @brief Entry of the container table of contents.
+             */
+            struct ContentsEntry
+            {
+                rtl::uint32_t id;
+                rtl::uint32_t image;  // index of the image the chunk belongs to
+                rtl::uint32_t offset; // of the chunk data from the beginning of the container
+                rtl::uint32_t size;
+            };
+
+            static_assert( sizeof( ContentsEntry ) == 16 );
+
         } // namespace headers
 
         struct Block
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <rtl/int.hpp>
+
+namespace fjord
+{
+    namespace hash
+    {
+        constexpr rtl::uint64_t fnv1a_basis = 14695981039346656037ull;
+        constexpr rtl::uint64_t fnv1a_prime = 1099511628211ull;
+
+        /**
+         * @brief 64-bit FNV-1a hash of the data.
+         *
+         * @param seed Hash of the preceding data to chain several buffers together
+         */
+        [[nodiscard]] inline rtl::uint64_t fnv1a( const void*   data,
+                                                  rtl::size_t   size,
+                                                  rtl::uint64_t seed = fnv1a_basis )
+        {
+            const auto* bytes = static_cast<const rtl::uint8_t*>( data );
+
+            for ( rtl::size_t i = 0; i < size; ++i )
+                seed = ( seed ^ bytes[i] ) * fnv1a_prime;
+
+            return seed;
+        }
+    } // namespace hash
+} // namespace fjord
@@ -9,6 +9,8 @@
  * https://github.com/out61h/fjord/blob/master/LICENSE
  */
 #include "image.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
 
 #include <rtl/algorithm.hpp>
 #include <rtl/sys/debug.hpp>
@@ -17,8 +19,27 @@ using namespace fjord;
 
 void Image::init( const Rect& rect, Pixel* p )
 {
+    init( rect, p, rect.size.w );
+}
+
+void Image::init( const Rect& rect, Pixel* p, int stride )
+{
+    RTL_ASSERT( stride >= rect.size.w );
+
     rectangle = rect;
     pixels = p;
+    row_stride = stride;
+}
+
+Image Image::view( const Rect& rect ) const
+{
+    RTL_ASSERT( rect.left() >= 0 && rect.right() <= width() );
+    RTL_ASSERT( rect.top() >= 0 && rect.bottom() <= height() );
+
+    Image image;
+    image.init( rect, pixels + rect.top() * row_stride + rect.left(), row_stride );
+
+    return image;
 }
 
 void Image::generate( const Rect& window_rect, WindowFunction window_func )
@@ -31,14 +52,21 @@ void Image::generate( const Rect& window_rect, WindowFunction window_func )
 
     // NOTE: Scans point coordinates from 0x0 to NxM, where NxM - window function size
     // NOTE: Window coordinates clipped by \rect
-    for ( int y = origin.y; y < origin.y + height(); ++y )
+    for ( int y = origin.y; y < origin.y + height(); ++y, dst += row_stride - width() )
         for ( int x = origin.x; x < origin.x + width(); ++x )
             *dst++ = window_func( x, y, window_rect.size.w, window_rect.size.h );
 }
 
 void Image::clear()
 {
-    rtl::fill_n( pixels, rectangle.area(), Pixel( 0 ) );
+    if ( is_contiguous() )
+    {
+        simd::clear( pixels, rectangle.area() );
+        return;
+    }
+
+    for ( int y = 0; y < height(); ++y )
+        simd::clear( pixels + y * row_stride, width() );
 }
 
 void Image::add( const Image& image )
@@ -48,47 +76,65 @@ void Image::add( const Image& image )
     RTL_ASSERT( image.origin().x + image.width() <= width() );
     RTL_ASSERT( image.origin().y + image.height() <= height() );
 
-    const auto* src = image.data();
-
-    auto* dst = data() + image.origin().x + image.origin().y * width();
-    auto  dst_pad = width() - image.width();
+    const Point& origin = image.origin();
 
     for ( int y = 0; y < image.height(); ++y )
-    {
-        for ( int x = 0; x < image.width(); ++x )
-            *dst++ += *src++;
-
-        dst += dst_pad;
-    }
+        simd::add( &at( origin.x, origin.y + y ), &image.at( 0, y ), image.width() );
 }
 
 void Image::mul( const Image& image )
 {
     RTL_ASSERT( size() == image.size() );
 
-    auto* src = image.data();
-    auto* dst = data();
-    auto  dst_end = data() + rectangle.area();
-    for ( ; dst < dst_end; ++dst )
-        *dst = *dst * *src++;
+    for ( int y = 0; y < height(); ++y )
+        simd::mul( &at( 0, y ), &image.at( 0, y ), width() );
 }
 
-void fjord::image::expand_borders( const Image& source, Image& output )
+void fjord::image::expand_borders( const Rect& source_rect, Image& output )
 {
-    // TODO: implement +/- operators for Point
-    const Point origin = Point::create( ( output.origin().x - source.origin().x ),
-                                        ( output.origin().y - source.origin().y ) );
+    RTL_ASSERT( source_rect.area() > 0 );
+    RTL_ASSERT( source_rect.left() >= 0 && source_rect.right() <= output.width() );
+    RTL_ASSERT( source_rect.top() >= 0 && source_rect.bottom() <= output.height() );
 
-    RTL_ASSERT( source.rect().area() > 0 );
+    const int last_x = source_rect.right() - 1;
+    const int last_y = source_rect.bottom() - 1;
 
-    for ( int y = 0; y < output.height(); ++y )
+    // Replicating the boundary columns of the source rows
+    for ( int y = source_rect.top(); y <= last_y; ++y )
     {
-        for ( int x = 0; x < output.width(); ++x )
-        {
-            const int src_x = rtl::clamp( x + origin.x, 0, source.width() - 1 );
-            const int src_y = rtl::clamp( y + origin.y, 0, source.height() - 1 );
+        Pixel* row = &output.at( 0, y );
+
+        rtl::fill_n( row, source_rect.left(), row[source_rect.left()] );
+        rtl::fill_n( row + source_rect.right(), output.width() - source_rect.right(), row[last_x] );
+    }
+
+    // Replicating the boundary rows
+    for ( int y = 0; y < source_rect.top(); ++y )
+        rtl::copy_n( &output.at( 0, source_rect.top() ), output.width(), &output.at( 0, y ) );
 
-            output.at( x, y ) = source.at( src_x, src_y );
+    for ( int y = last_y + 1; y < output.height(); ++y )
+        rtl::copy_n( &output.at( 0, last_y ), output.width(), &output.at( 0, y ) );
+}
+
+void fjord::image::invert( Image& image )
+{
+    // NOTE: The raw reciprocal is one * one / raw, truncated like the fixed point division. The
+    // float quotient errs by less than 1 / raw, so it's never rounded across the integer and
+    // truncates to the same value, while the loop is vectorized
+    constexpr float one_squared = static_cast<float>( Pixel::one ) * Pixel::one;
+
+    static_assert( sizeof( Pixel ) == sizeof( rtl::int32_t ) );
+
+    const int width = image.width();
+
+    for ( int y = 0; y < image.height(); ++y )
+    {
+        auto* row = reinterpret_cast<rtl::int32_t*>( &image.at( 0, y ) );
+
+        for ( int x = 0; x < width; ++x )
+        {
+            const rtl::int32_t value = row[x] > 0 ? row[x] : Pixel::min().raw();
+            row[x] = static_cast<rtl::int32_t>( one_squared / static_cast<float>( value ) );
         }
     }
 }
@@ -160,33 +206,282 @@ void fjord::image::transform_affinity( const Image& source,
     }
 }
 
+namespace
+{
+    void init_taps( int                    crop_size,
+                    int                    output_size,
+                    image::Filter          filter,
+                    image::Resampler::Tap* taps )
+    {
+        for ( int i = 0; i < output_size; ++i )
+        {
+            auto& tap = taps[i];
+
+            if ( filter == image::Filter::nearest )
+            {
+                tap.index = i * crop_size / output_size;
+                tap.next = tap.index;
+                tap.weight = Pixel( 0 );
+                continue;
+            }
+
+            // NOTE: Center of the output sample is mapped to the crop, the samples beyond the
+            // centers of the edge samples of the crop are clamped to them
+            const rtl::int64_t center
+                = static_cast<rtl::int64_t>( 2 * i + 1 ) * crop_size * Pixel::one
+                      / ( 2 * output_size )
+                  - Pixel::one / 2;
+
+            const auto position = static_cast<rtl::int32_t>(
+                rtl::clamp<rtl::int64_t>( center, 0, ( crop_size - 1 ) * Pixel::one ) );
+
+            tap.index = position / Pixel::one;
+            tap.next = rtl::min( tap.index + 1, crop_size - 1 );
+            tap.weight = Pixel::from_raw( position % Pixel::one );
+        }
+    }
+
+    /**
+     * @brief Interpolates the raw pixels by the raw weight of the second one.
+     *
+     * @note The differences of the pixels fit 23 bits, so the products are in 32 bits and the
+     * loops are vectorized
+     */
+    [[nodiscard]] constexpr rtl::int32_t lerp( rtl::int32_t first,
+                                               rtl::int32_t second,
+                                               rtl::int32_t weight )
+    {
+        return first + ( ( ( second - first ) * weight ) >> 8 );
+    }
+} // namespace
+
+bool fjord::image::Resampler::init( const Size& crop, const Size& output, Filter resampling_filter )
+{
+    // NOTE: The sizes come from the image headers, so they are checked in the release builds too
+    if ( crop.w <= 0 || crop.h <= 0 || output.w <= 0 || output.h <= 0
+         || output.w > max_output_size || output.h > max_output_size
+         || crop.w > 2 * max_output_size )
+        return false;
+
+    crop_size = crop;
+    output_size = output;
+    filter = resampling_filter;
+
+    init_taps( crop.w, output.w, filter, columns );
+    init_taps( crop.h, output.h, filter, rows );
+
+    return true;
+}
+
 void fjord::image::crop_resize_adjust( const Image& source,
-                                       const Rect&  crop,
+                                       const Point& crop_origin,
+                                       Resampler&   resampler,
                                        Pixel        contrast,
                                        Pixel        brightness,
+                                       int          first_row,
                                        Image&       output )
 {
-    RTL_ASSERT( crop.area() > 0 );
-    RTL_ASSERT( crop.left() >= 0 );
-    RTL_ASSERT( crop.top() >= 0 );
-    RTL_ASSERT( crop.right() <= source.width() );
-    RTL_ASSERT( crop.bottom() <= source.height() );
+    FJORD_TRACE_ZONE( "image::crop_resize_adjust" );
+
+    RTL_ASSERT( crop_origin.x >= 0 );
+    RTL_ASSERT( crop_origin.y >= 0 );
+    RTL_ASSERT( crop_origin.x + resampler.crop_size.w <= source.width() );
+    RTL_ASSERT( crop_origin.y + resampler.crop_size.h <= source.height() );
+    RTL_ASSERT( output.width() == resampler.output_size.w );
+    RTL_ASSERT( first_row >= 0 && first_row + output.height() <= resampler.output_size.h );
 
-    auto* dst = output.data();
+    const Resampler::Tap* columns = resampler.columns;
+    rtl::int32_t*         blended_row = resampler.blended_row;
 
+    const int width = output.width();
+    const int crop_width = resampler.crop_size.w;
+
+    const rtl::int32_t contrast_raw = contrast.raw();
+    const rtl::int32_t brightness_raw = brightness.raw();
+
+    // NOTE: Taps are read from the tables, so the loops are free of the divisions and the branches
     for ( int y = 0; y < output.height(); ++y )
     {
-        for ( int x = 0; x < output.width(); ++x )
+        const Resampler::Tap& row_tap = resampler.rows[first_row + y];
+
+        const Pixel* row = &source.at( crop_origin.x, crop_origin.y + row_tap.index );
+        Pixel*       dst = &output.at( 0, y );
+
+        if ( resampler.filter == Filter::nearest )
         {
-            // TODO: Use bilinear filtering
-            const Pixel pixel = source.at( x * crop.size.w / output.width() + crop.origin.x,
-                                           y * crop.size.h / output.height() + crop.origin.y );
+            for ( int x = 0; x < width; ++x )
+                dst[x] = pixel::clamp( contrast * row[columns[x].index] + brightness );
+
+            continue;
+        }
+
+        const Pixel* next_row = &source.at( crop_origin.x, crop_origin.y + row_tap.next );
+
+        // NOTE: Interpolation and adjusting commute, so the rows are blended and adjusted over
+        // the contiguous pixels first, and only the columns are interpolated per output pixel
+        const rtl::int32_t row_weight = row_tap.weight.raw();
+
+        for ( int x = 0; x < crop_width; ++x )
+        {
+            const rtl::int32_t pixel = lerp( row[x].raw(), next_row[x].raw(), row_weight );
+            blended_row[x] = ( ( pixel * contrast_raw ) >> 8 ) + brightness_raw;
+        }
+
+        for ( int x = 0; x < width; ++x )
+        {
+            const Resampler::Tap& tap = columns[x];
+
+            const rtl::int32_t pixel
+                = lerp( blended_row[tap.index], blended_row[tap.next], tap.weight.raw() );
 
-            *dst++ = pixel::clamp( contrast * pixel + brightness );
+            dst[x] = pixel::clamp( Pixel::from_raw( pixel ) );
         }
     }
 }
 
+namespace
+{
+    /**
+     * @brief Converts YUV444 to the packed RGB pixels centered in the buffer.
+     *
+     * @param store_pixel Writes the blue, green and red components to the pixel
+     */
+    template <rtl::size_t pixel_size, typename StorePixel>
+    void convert_yuv444_to_packed_rgb( const Image&  y_image,
+                                       const Image&  u_image,
+                                       const Image&  v_image,
+                                       rtl::uint8_t* rgb_buffer,
+                                       int           rgb_buffer_width,
+                                       int           rgb_buffer_height,
+                                       rtl::size_t   rgb_buffer_stride,
+                                       StorePixel    store_pixel )
+    {
+        RTL_ASSERT( y_image.rect().area() == u_image.rect().area() );
+        RTL_ASSERT( u_image.rect().area() == v_image.rect().area() );
+
+        const int yuv_width = y_image.width();
+        const int yuv_height = y_image.height();
+
+        const int rgb_border_width
+            = rgb_buffer_width > yuv_width ? ( rgb_buffer_width - yuv_width ) / 2 : 0;
+        const int rgb_border_height
+            = rgb_buffer_height > yuv_height ? ( rgb_buffer_height - yuv_height ) / 2 : 0;
+
+        const size_t rgb_x_offset = rgb_border_width * pixel_size;
+        const size_t rgb_y_offset = rgb_border_height * rgb_buffer_stride;
+        const size_t rgb_padding = rgb_buffer_stride > (size_t)yuv_width * pixel_size
+                                       ? rgb_buffer_stride - yuv_width * pixel_size
+                                       : 0;
+        rgb_buffer += rgb_y_offset + rgb_x_offset;
+
+        const int yuv_scan_width = rtl::min( rgb_buffer_width, yuv_width );
+        const int yuv_scan_height = rtl::min( rgb_buffer_height, yuv_height );
+
+        const size_t y_padding = static_cast<size_t>( y_image.stride() - yuv_scan_width );
+        const size_t u_padding = static_cast<size_t>( u_image.stride() - yuv_scan_width );
+        const size_t v_padding = static_cast<size_t>( v_image.stride() - yuv_scan_width );
+
+        const auto* py = y_image.data();
+        const auto* pu = u_image.data();
+        const auto* pv = v_image.data();
+
+        for ( int cy = 0; cy < yuv_scan_height; ++cy )
+        {
+            for ( int cx = 0; cx < yuv_scan_width; ++cx )
+            {
+                const auto y = *py++;
+                const auto u = *pu++ - 0.5f;
+                const auto v = *pv++ - 0.5f;
+
+                store_pixel( rgb_buffer,
+                             pixel::to_uint8( y + u * 2.03211f ),
+                             pixel::to_uint8( y - u * 0.39465f - v * 0.58060f ),
+                             pixel::to_uint8( y + v * 1.13983f ) );
+
+                rgb_buffer += pixel_size;
+            }
+
+            py += y_padding;
+            pu += u_padding;
+            pv += v_padding;
+
+            rgb_buffer += rgb_padding;
+        }
+    }
+
+    /**
+     * @brief Copies the luma and every second chroma sample in both directions to the planes.
+     *
+     * @note The image is centered at the even offsets, so the chroma samples stay at the place
+     * of their luma samples
+     */
+    template <typename StoreChroma>
+    void convert_yuv444_to_planar( const Image&  y_image,
+                                   const Image&  u_image,
+                                   const Image&  v_image,
+                                   rtl::uint8_t* y_buffer,
+                                   rtl::uint8_t* chroma_buffer,
+                                   int           y_buffer_width,
+                                   int           y_buffer_height,
+                                   rtl::size_t   y_buffer_stride,
+                                   rtl::size_t   chroma_buffer_stride,
+                                   StoreChroma   store_chroma )
+    {
+        RTL_ASSERT( y_image.rect().area() == u_image.rect().area() );
+        RTL_ASSERT( u_image.rect().area() == v_image.rect().area() );
+
+        const int yuv_width = y_image.width();
+        const int yuv_height = y_image.height();
+
+        const int chroma_border_width
+            = y_buffer_width > yuv_width ? ( y_buffer_width - yuv_width ) / 4 : 0;
+        const int chroma_border_height
+            = y_buffer_height > yuv_height ? ( y_buffer_height - yuv_height ) / 4 : 0;
+
+        const int yuv_scan_width = rtl::min( y_buffer_width, yuv_width );
+        const int yuv_scan_height = rtl::min( y_buffer_height, yuv_height );
+
+        y_buffer += 2 * ( chroma_border_height * y_buffer_stride + chroma_border_width );
+        chroma_buffer += chroma_border_height * chroma_buffer_stride;
+
+        for ( int cy = 0; cy < yuv_scan_height; ++cy )
+        {
+            const Pixel* py = &y_image.at( 0, cy );
+
+            for ( int cx = 0; cx < yuv_scan_width; ++cx )
+                y_buffer[cx] = pixel::to_uint8( py[cx] );
+
+            y_buffer += y_buffer_stride;
+        }
+
+        for ( int cy = 0; cy < ( yuv_scan_height + 1 ) / 2; ++cy )
+        {
+            const Pixel* pu = &u_image.at( 0, cy * 2 );
+            const Pixel* pv = &v_image.at( 0, cy * 2 );
+
+            for ( int cx = 0; cx < ( yuv_scan_width + 1 ) / 2; ++cx )
+            {
+                store_chroma( chroma_buffer,
+                              chroma_border_width + cx,
+                              pixel::to_uint8( pu[cx * 2] ),
+                              pixel::to_uint8( pv[cx * 2] ) );
+            }
+
+            chroma_buffer += chroma_buffer_stride;
+        }
+    }
+
+    template <typename T>
+    void fill( rtl::uint8_t* pixels, int width, int height, rtl::size_t stride, T value )
+    {
+        for ( int y = 0; y < height; ++y, pixels += stride )
+            rtl::fill_n( reinterpret_cast<T*>( pixels ), width, value );
+    }
+
+    // Neutral chroma of the black borders
+    constexpr rtl::uint8_t chroma_zero = 128;
+} // namespace
+
 void fjord::image::convert_yuv444_to_rgb888( const Image&  y_image,
                                              const Image&  u_image,
                                              const Image&  v_image,
@@ -195,53 +490,199 @@ void fjord::image::convert_yuv444_to_rgb888( const Image&  y_image,
                                              int           rgb_buffer_height,
                                              rtl::size_t   rgb_buffer_stride )
 {
-    RTL_ASSERT( y_image.rect().area() == u_image.rect().area() );
-    RTL_ASSERT( u_image.rect().area() == v_image.rect().area() );
+    FJORD_TRACE_ZONE( "image::convert_yuv444_to_rgb888" );
+
+    convert_yuv444_to_packed_rgb<3>(
+        y_image,
+        u_image,
+        v_image,
+        rgb_buffer,
+        rgb_buffer_width,
+        rgb_buffer_height,
+        rgb_buffer_stride,
+        []( rtl::uint8_t* p, rtl::uint8_t b, rtl::uint8_t g, rtl::uint8_t r )
+        {
+            p[0] = b;
+            p[1] = g;
+            p[2] = r;
+        } );
+}
 
-    constexpr size_t rgb_pixel_size = 3;
+void fjord::image::convert_yuv444_to_bgra8888( const Image&  y_image,
+                                               const Image&  u_image,
+                                               const Image&  v_image,
+                                               rtl::uint8_t* bgra_buffer,
+                                               int           bgra_buffer_width,
+                                               int           bgra_buffer_height,
+                                               rtl::size_t   bgra_buffer_stride )
+{
+    FJORD_TRACE_ZONE( "image::convert_yuv444_to_bgra8888" );
+
+    convert_yuv444_to_packed_rgb<4>(
+        y_image,
+        u_image,
+        v_image,
+        bgra_buffer,
+        bgra_buffer_width,
+        bgra_buffer_height,
+        bgra_buffer_stride,
+        []( rtl::uint8_t* p, rtl::uint8_t b, rtl::uint8_t g, rtl::uint8_t r )
+        {
+            // NOTE: The whole pixel is stored at once
+            const rtl::uint8_t bgra[4] = { b, g, r, 0xff };
+            rtl::copy_n( bgra, 4, p );
+        } );
+}
 
-    const int yuv_width = y_image.width();
-    const int yuv_height = y_image.height();
+void fjord::image::convert_yuv444_to_rgba8888( const Image&  y_image,
+                                               const Image&  u_image,
+                                               const Image&  v_image,
+                                               rtl::uint8_t* rgba_buffer,
+                                               int           rgba_buffer_width,
+                                               int           rgba_buffer_height,
+                                               rtl::size_t   rgba_buffer_stride )
+{
+    FJORD_TRACE_ZONE( "image::convert_yuv444_to_rgba8888" );
+
+    convert_yuv444_to_packed_rgb<4>(
+        y_image,
+        u_image,
+        v_image,
+        rgba_buffer,
+        rgba_buffer_width,
+        rgba_buffer_height,
+        rgba_buffer_stride,
+        []( rtl::uint8_t* p, rtl::uint8_t b, rtl::uint8_t g, rtl::uint8_t r )
+        {
+            const rtl::uint8_t rgba[4] = { r, g, b, 0xff };
+            rtl::copy_n( rgba, 4, p );
+        } );
+}
 
-    const int rgb_border_width
-        = rgb_buffer_width > yuv_width ? ( rgb_buffer_width - yuv_width ) / 2 : 0;
-    const int rgb_border_height
-        = rgb_buffer_height > yuv_height ? ( rgb_buffer_height - yuv_height ) / 2 : 0;
+void fjord::image::convert_yuv444_to_rgb565( const Image&  y_image,
+                                             const Image&  u_image,
+                                             const Image&  v_image,
+                                             rtl::uint8_t* rgb_buffer,
+                                             int           rgb_buffer_width,
+                                             int           rgb_buffer_height,
+                                             rtl::size_t   rgb_buffer_stride )
+{
+    FJORD_TRACE_ZONE( "image::convert_yuv444_to_rgb565" );
+
+    convert_yuv444_to_packed_rgb<2>(
+        y_image,
+        u_image,
+        v_image,
+        rgb_buffer,
+        rgb_buffer_width,
+        rgb_buffer_height,
+        rgb_buffer_stride,
+        []( rtl::uint8_t* p, rtl::uint8_t b, rtl::uint8_t g, rtl::uint8_t r )
+        {
+            *reinterpret_cast<rtl::uint16_t*>( p ) = static_cast<rtl::uint16_t>(
+                ( ( r >> 3 ) << 11 ) | ( ( g >> 2 ) << 5 ) | ( b >> 3 ) );
+        } );
+}
 
-    const size_t rgb_x_offset = rgb_border_width * rgb_pixel_size;
-    const size_t rgb_y_offset = rgb_border_height * rgb_buffer_stride;
-    const size_t rgb_padding = rgb_buffer_stride > (size_t)yuv_width * rgb_pixel_size
-                                   ? rgb_buffer_stride - yuv_width * rgb_pixel_size
-                                   : 0;
-    rgb_buffer += rgb_y_offset + rgb_x_offset;
+void fjord::image::convert_yuv444_to_i420( const Image&  y_image,
+                                           const Image&  u_image,
+                                           const Image&  v_image,
+                                           rtl::uint8_t* yuv_buffer,
+                                           int           yuv_buffer_width,
+                                           int           yuv_buffer_height,
+                                           rtl::size_t   yuv_buffer_stride )
+{
+    FJORD_TRACE_ZONE( "image::convert_yuv444_to_i420" );
 
-    const int    yuv_scan_width = rtl::min( rgb_buffer_width, yuv_width );
-    const int    yuv_scan_height = rtl::min( rgb_buffer_height, yuv_height );
-    const size_t yuv_padding
-        = yuv_width > yuv_scan_width ? static_cast<size_t>( yuv_width - yuv_scan_width ) : 0;
+    const rtl::size_t chroma_stride = ( yuv_buffer_stride + 1 ) / 2;
+    const rtl::size_t chroma_size = chroma_stride * ( ( yuv_buffer_height + 1 ) / 2 );
 
-    const auto* py = y_image.data();
-    const auto* pu = u_image.data();
-    const auto* pv = v_image.data();
+    rtl::uint8_t* u_buffer = yuv_buffer + yuv_buffer_stride * yuv_buffer_height;
 
-    for ( int cy = 0; cy < yuv_scan_height; ++cy )
+    // NOTE: V plane follows U plane
+    const auto store_chroma
+        = [chroma_size]( rtl::uint8_t* p, int x, rtl::uint8_t u, rtl::uint8_t v )
     {
-        for ( int cx = 0; cx < yuv_scan_width; ++cx )
-        {
-            const auto y = *py++;
-            const auto u = *pu++ - 0.5f;
-            const auto v = *pv++ - 0.5f;
+        p[x] = u;
+        p[x + chroma_size] = v;
+    };
+
+    convert_yuv444_to_planar( y_image,
+                              u_image,
+                              v_image,
+                              yuv_buffer,
+                              u_buffer,
+                              yuv_buffer_width,
+                              yuv_buffer_height,
+                              yuv_buffer_stride,
+                              chroma_stride,
+                              store_chroma );
+}
 
-            *rgb_buffer++ = pixel::to_uint8( y + u * 2.03211f );
-            *rgb_buffer++ = pixel::to_uint8( y - u * 0.39465f - v * 0.58060f );
-            *rgb_buffer++ = pixel::to_uint8( y + v * 1.13983f );
-        }
+void fjord::image::convert_yuv444_to_nv12( const Image&  y_image,
+                                           const Image&  u_image,
+                                           const Image&  v_image,
+                                           rtl::uint8_t* yuv_buffer,
+                                           int           yuv_buffer_width,
+                                           int           yuv_buffer_height,
+                                           rtl::size_t   yuv_buffer_stride )
+{
+    FJORD_TRACE_ZONE( "image::convert_yuv444_to_nv12" );
+
+    RTL_ASSERT( yuv_buffer_stride >= nv12_min_stride( yuv_buffer_width ) );
+
+    rtl::uint8_t* uv_buffer = yuv_buffer + yuv_buffer_stride * yuv_buffer_height;
+
+    convert_yuv444_to_planar( y_image,
+                              u_image,
+                              v_image,
+                              yuv_buffer,
+                              uv_buffer,
+                              yuv_buffer_width,
+                              yuv_buffer_height,
+                              yuv_buffer_stride,
+                              yuv_buffer_stride,
+                              []( rtl::uint8_t* p, int x, rtl::uint8_t u, rtl::uint8_t v )
+                              {
+                                  p[x * 2] = u;
+                                  p[x * 2 + 1] = v;
+                              } );
+}
+
+void fjord::image::convert_y_to_gray8( const Image&  y_image,
+                                       rtl::uint8_t* gray_buffer,
+                                       int           gray_buffer_width,
+                                       int           gray_buffer_height,
+                                       rtl::size_t   gray_buffer_stride )
+{
+    FJORD_TRACE_ZONE( "image::convert_y_to_gray8" );
+
+    const int y_width = y_image.width();
+    const int y_height = y_image.height();
 
-        py += yuv_padding;
-        pu += yuv_padding;
-        pv += yuv_padding;
+    const int gray_border_width
+        = gray_buffer_width > y_width ? ( gray_buffer_width - y_width ) / 2 : 0;
+    const int gray_border_height
+        = gray_buffer_height > y_height ? ( gray_buffer_height - y_height ) / 2 : 0;
 
-        rgb_buffer += rgb_padding;
+    const size_t gray_padding
+        = gray_buffer_stride > (size_t)y_width ? gray_buffer_stride - y_width : 0;
+
+    gray_buffer += gray_border_height * gray_buffer_stride + gray_border_width;
+
+    const int    y_scan_width = rtl::min( gray_buffer_width, y_width );
+    const int    y_scan_height = rtl::min( gray_buffer_height, y_height );
+    const size_t y_padding = static_cast<size_t>( y_image.stride() - y_scan_width );
+
+    const auto* py = y_image.data();
+
+    for ( int cy = 0; cy < y_scan_height; ++cy )
+    {
+        for ( int cx = 0; cx < y_scan_width; ++cx )
+            *gray_buffer++ = pixel::to_uint8( *py++ );
+
+        py += y_padding;
+        gray_buffer += gray_padding;
     }
 }
 
@@ -280,3 +721,65 @@ void fjord::image::clear_rgb888( rtl::uint8_t* pixels, int width, int height, rt
         pixels += padding;
     }
 }
+
+void fjord::image::clear_gray8( rtl::uint8_t* pixels, int width, int height, rtl::size_t padding )
+{
+    for ( int y = 0; y < height; ++y )
+    {
+        for ( int x = 0; x < width; ++x )
+            *pixels++ = 0;
+
+        pixels += padding;
+    }
+}
+
+void fjord::image::clear_rgba8888( rtl::uint8_t* pixels,
+                                   int           width,
+                                   int           height,
+                                   rtl::size_t   padding )
+{
+    // NOTE: Opaque black is the same in both byte orders
+    const rtl::uint8_t black[4] = { 0, 0, 0, 0xff };
+
+    for ( int y = 0; y < height; ++y )
+    {
+        for ( int x = 0; x < width; ++x )
+        {
+            rtl::copy_n( black, 4, pixels );
+            pixels += 4;
+        }
+
+        pixels += padding;
+    }
+}
+
+void fjord::image::clear_rgb565( rtl::uint8_t* pixels, int width, int height, rtl::size_t padding )
+{
+    fill<rtl::uint16_t>( pixels, width, height, width * sizeof( rtl::uint16_t ) + padding, 0 );
+}
+
+void fjord::image::clear_i420( rtl::uint8_t* pixels, int width, int height, rtl::size_t stride )
+{
+    const rtl::size_t chroma_stride = ( stride + 1 ) / 2;
+    const int         chroma_width = ( width + 1 ) / 2;
+    const int         chroma_height = ( height + 1 ) / 2;
+
+    fill<rtl::uint8_t>( pixels, width, height, stride, 0 );
+    pixels += stride * height;
+
+    fill<rtl::uint8_t>( pixels, chroma_width, chroma_height * 2, chroma_stride, chroma_zero );
+}
+
+void fjord::image::clear_nv12( rtl::uint8_t* pixels, int width, int height, rtl::size_t stride )
+{
+    RTL_ASSERT( stride >= nv12_min_stride( width ) );
+
+    fill<rtl::uint8_t>( pixels, width, height, stride, 0 );
+    pixels += stride * height;
+
+    fill<rtl::uint8_t>( pixels,
+                        static_cast<int>( nv12_min_stride( width ) ),
+                        ( height + 1 ) / 2,
+                        stride,
+                        chroma_zero );
+}
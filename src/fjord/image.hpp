@@ -23,20 +23,74 @@ namespace fjord
 {
     using WindowFunction = Pixel( int x, int y, int w, int h );
 
+    /**
+     * @brief Pixels of the rectangle, row by row with the stride.
+     *
+     * The image doesn't own its pixels, so the view of the part of another image shares the
+     * pixels of the latter and keeps its stride.
+     */
     // TODO: constexpr
     struct Image final
     {
         void init( const Rect& rect, Pixel* pixels );
 
+        void init( const Rect& rect, Pixel* pixels, int stride );
+
         template<typename Allocator>
         bool init( const Rect& rect, Allocator& allocator )
         {
             rectangle = rect;
             pixels = allocator.allocate( static_cast<size_t>( rect.area() ) );
+            row_stride = rect.size.w;
 
             return pixels != nullptr;
         }
 
+        /**
+         * @brief Allocates the plane, whose rows start at the cache lines and are padded to the
+         * whole lines, so the vectorized kernels don't split the lines.
+         *
+         * @note Takes up to \aligned_padding pixels more than the area
+         */
+        template<typename Allocator>
+        bool init_aligned( const Rect& rect, Allocator& allocator )
+        {
+            constexpr int alignment_mask = row_alignment - 1;
+
+            const int stride = ( rect.size.w + alignment_mask ) & ~alignment_mask;
+
+            Pixel* p = allocator.allocate( static_cast<size_t>( stride * rect.size.h )
+                                           + alignment_mask );
+            if ( !p )
+                return false;
+
+            const auto address = reinterpret_cast<rtl::size_t>( p );
+            p += ( ( 0 - address ) & ( row_alignment * sizeof( Pixel ) - 1 ) ) / sizeof( Pixel );
+
+            init( rect, p, stride );
+
+            return true;
+        }
+
+        /**
+         * @brief Returns the pixels \init_aligned takes at most in excess of the area of the plane
+         * of the height.
+         */
+        [[nodiscard]] static constexpr rtl::size_t aligned_padding( rtl::size_t height )
+        {
+            return ( height + 1 ) * ( row_alignment - 1 );
+        }
+
+        static constexpr int row_alignment = 16; // in pixels, of the 64-byte cache line
+
+        /**
+         * @brief Returns the image of the part of this image.
+         *
+         * @param rect In the coordinates of this image, becomes the rect of the view, so the view
+         * is added back to its place by \add
+         */
+        [[nodiscard]] Image view( const Rect& rect ) const;
+
         /**
          * @brief Clear image pixels with zero pixel value
          */
@@ -58,6 +112,19 @@ namespace fjord
          */
         void mul( const Image& image );
 
+        /**
+         * @brief Applies the function to the pixels row by row.
+         */
+        template<typename Function>
+        void transform( Function function )
+        {
+            for ( int y = 0; y < height(); ++y )
+            {
+                Pixel* row = pixels + y * row_stride;
+                rtl::transform( row, row + width(), function );
+            }
+        }
+
         /**
          * @brief Fill image pixels with window function values
          */
@@ -73,14 +140,18 @@ namespace fjord
             return pixels;
         }
 
-        [[nodiscard]] constexpr Pixel* begin()
+        [[nodiscard]] constexpr int stride() const
         {
-            return pixels;
+            return row_stride;
         }
 
-        [[nodiscard]] constexpr Pixel* end()
+        /**
+         * @brief Returns true if the rows follow each other without gaps, e.g. to be copied at
+         * once.
+         */
+        [[nodiscard]] constexpr bool is_contiguous() const
         {
-            return pixels + rectangle.area();
+            return row_stride == rectangle.size.w;
         }
 
         [[nodiscard]] constexpr int width() const
@@ -110,16 +181,17 @@ namespace fjord
 
         [[nodiscard]] constexpr const Pixel& at( int x, int y ) const
         {
-            return *( pixels + y * width() + x );
+            return *( pixels + y * row_stride + x );
         }
 
         [[nodiscard]] constexpr Pixel& at( int x, int y )
         {
-            return *( pixels + y * width() + x );
+            return *( pixels + y * row_stride + x );
         }
 
         Rect   rectangle;
         Pixel* pixels;
+        int    row_stride; // in pixels
     };
 
     namespace image
@@ -131,12 +203,82 @@ namespace fjord
                                  Symmetry     symmetry,
                                  Image&       output );
 
-        void expand_borders( const Image& sorce, Image& output );
+        /**
+         * @brief Replicates the boundary pixels of the part of the image to the rest of it.
+         *
+         * @param source_rect In the coordinates of the image
+         */
+        void expand_borders( const Rect& source_rect, Image& output );
+
+        /**
+         * @brief Replaces the pixels with their reciprocals, the pixels are clamped to the
+         * smallest positive value first.
+         */
+        void invert( Image& image );
+
+        enum class Filter
+        {
+            nearest,
+            bilinear
+        };
+
+        /**
+         * @brief Source samples of the columns and the rows of the resized crop, computed once for
+         * the crop size, the output size and the filter.
+         */
+        struct Resampler final
+        {
+            /**
+             * @brief Two neighbour samples of the crop, the first one at the index and the second
+             * one weighted by the fraction. The second one is the first one at the last sample.
+             */
+            struct Tap final
+            {
+                int   index;
+                int   next;
+                Pixel weight;
+            };
+
+            static constexpr int max_output_size{ static_cast<int>(
+                format::constraints::max_image_size ) };
+
+            /**
+             * @return false if the sizes are empty or don't fit the tables
+             */
+            [[nodiscard]] bool init( const Size& crop,
+                                     const Size& output,
+                                     Filter      resampling_filter );
 
+            [[nodiscard]] constexpr bool is_prepared_for( const Size& crop,
+                                                          const Size& output,
+                                                          Filter      resampling_filter ) const
+            {
+                return crop_size == crop && output_size == output && filter == resampling_filter;
+            }
+
+            Size   crop_size;
+            Size   output_size;
+            Filter filter;
+            Tap    columns[max_output_size];
+            Tap    rows[max_output_size];
+
+            // NOTE: Crop of the luma is twice the output size at most
+            rtl::int32_t blended_row[2 * max_output_size];
+        };
+
+        /**
+         * @brief Writes the rows of the crop resized to the output size of the resampler from the
+         * first row on, as many as the output has, and adjusts them.
+         *
+         * @note The bilinear filter blends the rows in the resampler, so it's used by one thread
+         * at a time
+         */
         void crop_resize_adjust( const Image& source,
-                                 const Rect&  crop,
+                                 const Point& crop_origin,
+                                 Resampler&   resampler,
                                  Pixel        contrast,
                                  Pixel        brightness,
+                                 int          first_row,
                                  Image&       output );
 
         void convert_yuv444_to_rgb888( const Image&  y_image,
@@ -147,8 +289,99 @@ namespace fjord
                                        int           rgb_pixels_height,
                                        rtl::size_t   rgb_pixels_stride );
 
+        /**
+         * @brief Writes the pixels as B, G, R, A bytes with the opaque alpha.
+         */
+        void convert_yuv444_to_bgra8888( const Image&  y_image,
+                                         const Image&  u_image,
+                                         const Image&  v_image,
+                                         rtl::uint8_t* bgra_pixels,
+                                         int           bgra_pixels_width,
+                                         int           bgra_pixels_height,
+                                         rtl::size_t   bgra_pixels_stride );
+
+        /**
+         * @brief Writes the pixels as R, G, B, A bytes with the opaque alpha.
+         */
+        void convert_yuv444_to_rgba8888( const Image&  y_image,
+                                         const Image&  u_image,
+                                         const Image&  v_image,
+                                         rtl::uint8_t* rgba_pixels,
+                                         int           rgba_pixels_width,
+                                         int           rgba_pixels_height,
+                                         rtl::size_t   rgba_pixels_stride );
+
+        /**
+         * @brief Writes the pixels as the native 16-bit words, red in the high bits.
+         */
+        void convert_yuv444_to_rgb565( const Image&  y_image,
+                                       const Image&  u_image,
+                                       const Image&  v_image,
+                                       rtl::uint8_t* rgb_pixels,
+                                       int           rgb_pixels_width,
+                                       int           rgb_pixels_height,
+                                       rtl::size_t   rgb_pixels_stride );
+
+        /**
+         * @brief Writes the Y plane followed by the U and V planes of the half size and the
+         * half stride.
+         */
+        void convert_yuv444_to_i420( const Image&  y_image,
+                                     const Image&  u_image,
+                                     const Image&  v_image,
+                                     rtl::uint8_t* yuv_pixels,
+                                     int           yuv_pixels_width,
+                                     int           yuv_pixels_height,
+                                     rtl::size_t   yuv_pixels_stride );
+
+        /**
+         * @brief Returns the least stride of the NV12 buffer. The rows of the interleaved U and V
+         * hold the whole pairs, so it's the width rounded up to even.
+         */
+        [[nodiscard]] constexpr rtl::size_t nv12_min_stride( int width )
+        {
+            return static_cast<rtl::size_t>( ( width + 1 ) / 2 * 2 );
+        }
+
+        /**
+         * @brief Writes the Y plane followed by the plane of the interleaved U and V of the half
+         * size and the same stride, which is at least \nv12_min_stride.
+         */
+        void convert_yuv444_to_nv12( const Image&  y_image,
+                                     const Image&  u_image,
+                                     const Image&  v_image,
+                                     rtl::uint8_t* yuv_pixels,
+                                     int           yuv_pixels_width,
+                                     int           yuv_pixels_height,
+                                     rtl::size_t   yuv_pixels_stride );
+
+        /**
+         * @brief Writes the luma as the grayscale pixels, one byte per pixel.
+         */
+        void convert_y_to_gray8( const Image&  y_image,
+                                 rtl::uint8_t* gray_pixels,
+                                 int           gray_pixels_width,
+                                 int           gray_pixels_height,
+                                 rtl::size_t   gray_pixels_stride );
+
         void clear_rgb888( rtl::uint8_t* pixels, int width, int height, rtl::size_t padding );
 
+        void clear_gray8( rtl::uint8_t* pixels, int width, int height, rtl::size_t padding );
+
+        void clear_rgba8888( rtl::uint8_t* pixels, int width, int height, rtl::size_t padding );
+
+        void clear_rgb565( rtl::uint8_t* pixels, int width, int height, rtl::size_t padding );
+
+        /**
+         * @brief Clears the planes of the whole buffer to black.
+         */
+        void clear_i420( rtl::uint8_t* pixels, int width, int height, rtl::size_t stride );
+
+        /**
+         * @param stride At least \nv12_min_stride
+         */
+        void clear_nv12( rtl::uint8_t* pixels, int width, int height, rtl::size_t stride );
+
         void dim_region_rgb888( rtl::uint8_t* pixels,
                                 int           width,
                                 int           height,
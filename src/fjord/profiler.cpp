@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "profiler.hpp"
+
+#if defined( _WIN32 )
+
+// NOTE: Declared here instead of including <Windows.h> to prevent global namespace pollution
+extern "C" __declspec( dllimport ) int __stdcall QueryPerformanceCounter( rtl::int64_t* );
+extern "C" __declspec( dllimport ) int __stdcall QueryPerformanceFrequency( rtl::int64_t* );
+
+fjord::profiler::Ticks fjord::profiler::now()
+{
+    rtl::int64_t counter;
+    QueryPerformanceCounter( &counter );
+
+    return static_cast<Ticks>( counter );
+}
+
+fjord::profiler::Ticks fjord::profiler::frequency()
+{
+    rtl::int64_t frequency;
+    QueryPerformanceFrequency( &frequency );
+
+    return static_cast<Ticks>( frequency );
+}
+
+#else
+
+    #include <time.h>
+
+fjord::profiler::Ticks fjord::profiler::now()
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return static_cast<Ticks>( ts.tv_sec ) * 1000000000u + static_cast<Ticks>( ts.tv_nsec );
+}
+
+fjord::profiler::Ticks fjord::profiler::frequency()
+{
+    return 1000000000u;
+}
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <rtl/algorithm.hpp>
+#include <rtl/int.hpp>
+
+namespace fjord
+{
+    namespace profiler
+    {
+        using Ticks = rtl::uint64_t;
+
+        /**
+         * @brief Returns the current value of the high-resolution monotonic clock.
+         */
+        [[nodiscard]] Ticks now();
+
+        /**
+         * @brief Returns the number of clock ticks per second.
+         */
+        [[nodiscard]] Ticks frequency();
+
+        enum class Stage
+        {
+            load_headers,
+            load_blocks,
+            load_quadtree,
+            load_windows,
+            load_mask,
+            iterate,
+            convert_yuv420_to_yuv444,
+            convert_yuv444_to_rgb888,
+            count
+        };
+
+        struct Counters
+        {
+            Ticks       ticks[(int)Stage::count];
+            unsigned    calls[(int)Stage::count];
+            rtl::size_t allocated_bytes;
+            rtl::size_t allocated_bytes_peak;
+
+            void reset()
+            {
+                rtl::fill_n( ticks, (int)Stage::count, Ticks( 0 ) );
+                rtl::fill_n( calls, (int)Stage::count, 0u );
+            }
+
+            /**
+             * @brief Accumulates the counters of the other stages, e.g. of the decoding session.
+             */
+            void add( const Counters& other )
+            {
+                for ( int i = 0; i < (int)Stage::count; ++i )
+                {
+                    ticks[i] += other.ticks[i];
+                    calls[i] += other.calls[i];
+                }
+
+                allocated_bytes += other.allocated_bytes;
+                allocated_bytes_peak += other.allocated_bytes_peak;
+            }
+
+            [[nodiscard]] Ticks load_ticks() const
+            {
+                Ticks sum = 0;
+                for ( int i = (int)Stage::load_headers; i <= (int)Stage::load_mask; ++i )
+                    sum += ticks[i];
+
+                return sum;
+            }
+        };
+
+        /**
+         * @brief Accumulates the time spent in the scope to the stage counter.
+         */
+        class Scope final
+        {
+        public:
+            Scope( Counters& counters, Stage stage )
+                : m_counters( counters )
+                , m_stage( stage )
+                , m_start( now() )
+            {
+            }
+
+            ~Scope()
+            {
+                m_counters.ticks[(int)m_stage] += now() - m_start;
+                m_counters.calls[(int)m_stage]++;
+            }
+
+        private:
+            Scope( const Scope& ) = delete;
+            Scope& operator=( const Scope& ) = delete;
+
+            Counters& m_counters;
+            Stage     m_stage;
+            Ticks     m_start;
+        };
+
+        /**
+         * @brief Allocator adapter keeping track of the allocated memory and its high-water mark.
+         */
+        template<typename Allocator>
+        class CountingAllocator final
+        {
+        public:
+            auto allocate( rtl::size_t count )
+            {
+                auto* p = m_allocator.allocate( count );
+
+                if ( p )
+                {
+                    m_allocated += count * sizeof( *p );
+                    m_allocated_peak = rtl::max( m_allocated_peak, m_allocated );
+                }
+
+                return p;
+            }
+
+            void reset()
+            {
+                m_allocator.reset();
+                m_allocated = 0;
+            }
+
+            void reset_peak()
+            {
+                m_allocated_peak = m_allocated;
+            }
+
+            [[nodiscard]] rtl::size_t allocated() const
+            {
+                return m_allocated;
+            }
+
+            [[nodiscard]] rtl::size_t allocated_peak() const
+            {
+                return m_allocated_peak;
+            }
+
+        private:
+            Allocator   m_allocator;
+            rtl::size_t m_allocated;
+            rtl::size_t m_allocated_peak;
+        };
+    } // namespace profiler
+} // namespace fjord
+
+#if FJORD_ENABLE_PROFILER
+    #define FJORD_PROFILER_CONCAT_( a, b ) a##b
+    #define FJORD_PROFILER_CONCAT( a, b ) FJORD_PROFILER_CONCAT_( a, b )
+    #define FJORD_PROFILE( counters, stage )                                                       \
+        fjord::profiler::Scope FJORD_PROFILER_CONCAT( profiler_scope_, __LINE__ )(                 \
+            counters, fjord::profiler::Stage::stage )
+#else
+    #define FJORD_PROFILE( counters, stage )
+#endif
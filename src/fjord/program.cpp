@@ -0,0 +1,820 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "program.hpp"
+#include "quadtree.hpp"
+
+#include <rtl/algorithm.hpp>
+#include <rtl/math.hpp>
+#include <rtl/sys/debug.hpp>
+
+using namespace fjord;
+
+namespace
+{
+    template<int BitCount, typename Value>
+    [[nodiscard]] constexpr Value dequantize( int q_value, Value max_value )
+    {
+        static_assert( BitCount > 1 );
+        static_assert( BitCount < sizeof( q_value ) * 8 );
+
+        constexpr int quantizer = ( 1 << ( BitCount - 1 ) ) - 1;
+
+        return max_value * q_value / quantizer;
+    }
+} // namespace
+
+void Program::reset()
+{
+    m_status = Status::failed;
+    m_section = Section::image;
+    m_executor = Executor{ nullptr, nullptr };
+
+#if FJORD_ENABLE_PROFILER
+    m_allocator.reset();
+    m_allocator.reset_peak();
+    m_counters.reset();
+#endif
+}
+
+void Program::begin()
+{
+#if FJORD_ENABLE_PROFILER
+    m_counters.reset();
+#endif
+
+    m_status = Status::need_data;
+    m_section = Section::image;
+    m_unit_index = 0;
+    m_frame_index = 0;
+    m_pending_size = 0;
+}
+
+rtl::size_t Program::feed( const rtl::uint8_t* data, rtl::size_t size )
+{
+    FJORD_TRACE_ZONE( "Program::feed" );
+
+    if ( m_status == Status::frame_ready )
+    {
+        if ( !has_next_frame() )
+            return 0;
+
+#if FJORD_ENABLE_PROFILER
+        m_counters.reset();
+#endif
+
+        m_status = Status::need_data;
+        m_section = Section::frame;
+        m_unit_index = 0;
+        ++m_frame_index;
+    }
+
+    rtl::size_t consumed = 0;
+
+    while ( m_status == Status::need_data && consumed < size )
+    {
+        const rtl::size_t unit = unit_size();
+
+        if ( m_pending_size )
+        {
+            // Completing the unit split between the chunks
+            const rtl::size_t count = rtl::min( unit - m_pending_size, size - consumed );
+            rtl::copy_n( data + consumed, count, m_pending + m_pending_size );
+
+            consumed += count;
+            m_pending_size += count;
+
+            if ( m_pending_size < unit )
+                break;
+
+            m_pending_size = 0;
+
+            if ( !read_units( m_pending, 1 ) )
+                m_status = Status::failed;
+
+            continue;
+        }
+
+        const rtl::size_t count
+            = rtl::min( ( size - consumed ) / unit, unit_count() - m_unit_index );
+
+        if ( !count )
+        {
+            // The chunk ends in the middle of the unit
+            m_pending_size = size - consumed;
+            rtl::copy_n( data + consumed, m_pending_size, m_pending );
+
+            consumed = size;
+            break;
+        }
+
+        if ( !read_units( data + consumed, count ) )
+            m_status = Status::failed;
+
+        consumed += count * unit;
+    }
+
+    return consumed;
+}
+
+rtl::size_t Program::required() const
+{
+    switch ( m_status )
+    {
+    case Status::need_data:
+        return ( unit_count() - m_unit_index ) * unit_size() - m_pending_size;
+
+    case Status::frame_ready:
+        return has_next_frame() ? frame_header_size : 0;
+
+    case Status::failed:
+        break;
+    }
+
+    return 0;
+}
+
+unsigned Program::load( const rtl::uint8_t* data, rtl::size_t size )
+{
+    FJORD_TRACE_ZONE( "Program::load" );
+
+    begin();
+
+    const rtl::size_t consumed = feed( data, size );
+
+    if ( m_status != Status::frame_ready )
+        return 0;
+
+    m_next_frame_data = data + consumed;
+    m_next_frame_size = size - consumed;
+
+    return m_ifs_info.iteration_count;
+}
+
+unsigned Program::next_frame()
+{
+    FJORD_TRACE_ZONE( "Program::next_frame" );
+
+    if ( m_status != Status::frame_ready || !has_next_frame() )
+        return 0;
+
+    const rtl::size_t consumed = feed( m_next_frame_data, m_next_frame_size );
+
+    m_next_frame_data += consumed;
+    m_next_frame_size -= consumed;
+
+    return m_status == Status::frame_ready ? m_ifs_info.iteration_count : 0;
+}
+
+unsigned Program::frame_count( const rtl::uint8_t* data, rtl::size_t size )
+{
+    if ( size < sizeof( ImageInfo ) )
+        return 0;
+
+    const auto* image_info = reinterpret_cast<const ImageInfo*>( data );
+
+    return image_info->signature == format::signatures::pifs ? image_info->image_count : 0;
+}
+
+rtl::size_t Program::unit_size() const
+{
+    switch ( m_section )
+    {
+    case Section::image:
+        return sizeof( ImageInfo );
+
+    case Section::channels:
+        return sizeof( ChannelInfo );
+
+    case Section::frame:
+        return frame_header_size;
+
+    case Section::regions:
+        return region_size;
+
+    case Section::blocks:
+        return sizeof( format::Block );
+
+    case Section::nodes:
+        return sizeof( rtl::uint8_t );
+    }
+
+    return 0;
+}
+
+rtl::size_t Program::unit_count() const
+{
+    switch ( m_section )
+    {
+    case Section::image:
+    case Section::frame:
+        return 1;
+
+    case Section::channels:
+        return m_image_info.image_channels_count;
+
+    case Section::regions:
+        return shares_partition() ? 0 : m_ifs_info.region_count;
+
+    case Section::blocks:
+        return m_ifs_info.frame_flags & format::frame_flags::shared_blocks
+                   ? 0
+                   : m_ifs_info.block_count;
+
+    case Section::nodes:
+        return shares_partition() ? 0 : ( m_ifs_info.node_count + 7 ) / 8;
+    }
+
+    return 0;
+}
+
+bool Program::read_units( const rtl::uint8_t* data, rtl::size_t count )
+{
+    switch ( m_section )
+    {
+    case Section::image:
+        if ( !read_image_info( data ) )
+            return false;
+        break;
+
+    case Section::channels:
+    {
+        FJORD_PROFILE( m_counters, load_headers );
+
+        RTL_LOG( "Reading channels info..." );
+
+        rtl::copy_n( reinterpret_cast<const ChannelInfo*>( data ),
+                     count,
+                     m_channels_info + m_unit_index );
+        break;
+    }
+
+    case Section::frame:
+        if ( !read_frame_info( data ) )
+            return false;
+        break;
+
+    case Section::regions:
+        read_regions( data, count );
+        break;
+
+    case Section::blocks:
+        read_blocks( data, count );
+        break;
+
+    case Section::nodes:
+        read_nodes( data, count );
+        break;
+    }
+
+    m_unit_index += count;
+
+    if ( m_unit_index == unit_count() )
+        next_section();
+
+    return m_status != Status::failed;
+}
+
+void Program::next_section()
+{
+    m_unit_index = 0;
+
+    do
+    {
+        if ( m_section == Section::nodes )
+        {
+            m_status = prepare_frame() ? Status::frame_ready : Status::failed;
+            return;
+        }
+
+        m_section = static_cast<Section>( static_cast<int>( m_section ) + 1 );
+    } while ( !unit_count() );
+}
+
+bool Program::read_image_info( const rtl::uint8_t* data )
+{
+    FJORD_PROFILE( m_counters, load_headers );
+
+    RTL_LOG( "Reading image info..." );
+
+    rtl::copy_n(
+        data, sizeof( ImageInfo ), reinterpret_cast<rtl::uint8_t*>( &m_image_info ) );
+
+    if ( m_image_info.signature != format::signatures::pifs
+         || m_image_info.version != format::versions::v2
+         || m_image_info.codec != format::signatures::iyuv
+         || m_image_info.gamma != 65535 ) // TODO: define magic number as constant
+        return false;
+
+    // no channels or frames
+    if ( !m_image_info.image_channels_count
+         || m_image_info.image_channels_count > max_channels_count || !m_image_info.image_count )
+        return false;
+
+    // image empty or too big, the planes of the session are at most of the maximal size each way
+    if ( !m_image_info.image_width || !m_image_info.image_height
+         || m_image_info.image_width > max_image_size || m_image_info.image_height > max_image_size
+         || m_image_info.image_width * m_image_info.image_height > buffer_page_size )
+        return false;
+
+    RTL_LOG( "Size: %ix%i", m_image_info.image_width, m_image_info.image_height );
+    RTL_LOG( "Channels: %i (YUV420)", m_image_info.image_channels_count );
+    RTL_LOG( "Frames: %i", m_image_info.image_count );
+
+    return true;
+}
+
+bool Program::read_frame_info( const rtl::uint8_t* data )
+{
+    {
+        FJORD_PROFILE( m_counters, load_headers );
+
+        RTL_LOG( "Reading iterated function system format signature..." );
+
+        if ( *reinterpret_cast<const rtl::uint32_t*>( data ) != format::signatures::fjrd )
+            return false;
+
+        data += sizeof( rtl::uint32_t );
+
+        RTL_LOG( "Reading iterated function system info..." );
+
+        const FractalInfo previous_ifs_info = m_ifs_info;
+
+        rtl::copy_n(
+            data, sizeof( FractalInfo ), reinterpret_cast<rtl::uint8_t*>( &m_ifs_info ) );
+
+        // too many regions, blocks or nodes to fit in buffers
+        if ( m_ifs_info.region_count > max_regions_count
+             || m_ifs_info.block_count > max_blocks_count
+             || m_ifs_info.node_count > max_nodes_count )
+            return false;
+
+        // NOTE: The blocks of the deepest level are one pixel at least and the plane size fits
+        // the integer
+        if ( !m_ifs_info.block_count || !m_ifs_info.cols || !m_ifs_info.rows
+             || m_ifs_info.depth > m_ifs_info.step || m_ifs_info.step >= 16 )
+            return false;
+
+        m_ifs_block_size_ilog2 = m_ifs_info.step;
+
+        m_ifs_size.w = m_ifs_info.cols << m_ifs_block_size_ilog2;
+        m_ifs_size.h = m_ifs_info.rows << m_ifs_block_size_ilog2;
+
+        // NOTE: The plane holds the luma and the chroma side by side, so it's wider than the image
+        constexpr auto max_plane_size = static_cast<int>( 2 * max_image_size );
+
+        if ( m_ifs_size.w > max_plane_size || m_ifs_size.h > max_plane_size
+             || rtl::size_t( m_ifs_size.w ) * rtl::size_t( m_ifs_size.h ) > max_plane_area )
+            return false;
+
+        RTL_LOG( "Frame: %i (flags %i)", m_frame_index, m_ifs_info.frame_flags );
+        RTL_LOG( "Regions: %i", m_ifs_info.region_count );
+        RTL_LOG( "Blocks: %i", m_ifs_info.block_count );
+        RTL_LOG( "Nodes: %i", m_ifs_info.node_count );
+        RTL_LOG( "Iterations: %i", m_ifs_info.iteration_count );
+
+        RTL_LOG( "Grid size: %ix%i blocks", m_ifs_info.cols, m_ifs_info.rows );
+        RTL_LOG( "Block size: %ix%i", 1 << m_ifs_block_size_ilog2, 1 << m_ifs_block_size_ilog2 );
+        RTL_LOG( "Image size: %ix%i", m_ifs_size.w, m_ifs_size.h );
+
+        if ( !m_frame_index )
+        {
+            // nothing to share with
+            if ( m_ifs_info.frame_flags )
+                return false;
+        }
+        else
+        {
+            // NOTE: Iterations continue from the plane of the preceding frame
+            if ( m_ifs_info.cols != previous_ifs_info.cols
+                 || m_ifs_info.rows != previous_ifs_info.rows
+                 || m_ifs_info.step != previous_ifs_info.step )
+                return false;
+
+            if ( shares_partition()
+                 && ( m_ifs_info.depth != previous_ifs_info.depth
+                      || m_ifs_info.region_count != previous_ifs_info.region_count
+                      || m_ifs_info.block_count != previous_ifs_info.block_count
+                      || m_ifs_info.node_count != previous_ifs_info.node_count ) )
+                return false;
+        }
+    }
+
+    //----------------------------------------------------------------------------------------------
+    if ( !shares_partition() )
+    {
+        FJORD_PROFILE( m_counters, load_windows );
+
+        RTL_LOG( "Init mask buffer..." );
+
+        // NOTE: The plane geometry is known, so the mask is prepared while the blocks arrive
+        m_allocator.reset();
+
+        if ( !m_mask_image.init_aligned( Rect::create( 0, 0, m_ifs_size.w, m_ifs_size.h ),
+                                         m_allocator ) )
+            return false;
+
+        m_mask_image.clear();
+    }
+
+    return true;
+}
+
+void Program::read_regions( const rtl::uint8_t* data, rtl::size_t count )
+{
+    FJORD_PROFILE( m_counters, load_headers );
+
+    RTL_LOG( "Reading image regions..." );
+
+    // NOTE: Region geometry decoding is a bit tricky. All for the glory of the executable file
+    // size reducing
+    static_assert( sizeof( Rect ) / sizeof( int ) == 4 );
+    static_assert( region_size / sizeof( rtl::uint16_t ) == 4 );
+
+    // TODO: Use union of Rect and int[4]
+    int* regions = reinterpret_cast<int*>( m_regions + m_unit_index );
+
+    for ( rtl::size_t i = 0; i < count * 4; ++i )
+    {
+        const rtl::uint16_t value = *reinterpret_cast<const rtl::uint16_t*>( data );
+        regions[i] = value << m_ifs_block_size_ilog2;
+
+        data += sizeof( rtl::uint16_t );
+    }
+
+#if RTL_ENABLE_LOG
+    for ( rtl::size_t region_index = m_unit_index; region_index < m_unit_index + count;
+          ++region_index )
+    {
+        const auto& region = m_regions[region_index];
+
+        RTL_LOG( "Region #%zu: %i,%i %ix%i",
+                 region_index,
+                 region.left(),
+                 region.top(),
+                 region.size.w,
+                 region.size.h );
+    }
+#endif
+}
+
+void Program::read_blocks( const rtl::uint8_t* data, rtl::size_t count )
+{
+    FJORD_PROFILE( m_counters, load_blocks );
+
+    RTL_LOG( "Reading blocks..." );
+
+    const auto qx = static_cast<unsigned>( rtl::max( ( rtl::ceil_log2_i( m_ifs_size.w ) - 8 ), 1 ) );
+    const auto qy = static_cast<unsigned>( rtl::max( ( rtl::ceil_log2_i( m_ifs_size.h ) - 8 ), 1 ) );
+
+    RTL_LOG( "Block offset granularity: %ix%i", 1 << qx, 1 << qy );
+
+    for ( rtl::size_t block_index = m_unit_index; block_index < m_unit_index + count;
+          ++block_index )
+    {
+        auto& block = m_ifs_blocks[block_index];
+
+        const format::Block* b = reinterpret_cast<const format::Block*>( data );
+
+        block.transform.contrast = dequantize<contrast_bits>( b->contrast, Pixel( 1 ) );
+
+        block.transform.symmetry = static_cast<Symmetry>( b->transform );
+
+        const auto max_brightness = Pixel( 1 ) + rtl::abs( block.transform.contrast );
+        block.transform.brightness = dequantize<brightness_bits>( b->brightness, max_brightness );
+
+        block.transform.geometry.origin.x = static_cast<int>( b->offset_x << qx );
+        block.transform.geometry.origin.y = static_cast<int>( b->offset_y << qy );
+
+        data += sizeof( format::Block );
+    }
+}
+
+void Program::read_nodes( const rtl::uint8_t* data, rtl::size_t count )
+{
+    FJORD_PROFILE( m_counters, load_quadtree );
+
+    RTL_LOG( "Reading Q-tree partition nodes..." );
+
+    rtl::size_t node_index = m_unit_index * 8;
+
+    for ( rtl::size_t i = 0; i < count; ++i )
+    {
+        unsigned partition_mask = data[i];
+
+        for ( rtl::size_t bit_index = 0;
+              bit_index < 8 * sizeof( rtl::uint8_t ) && node_index < m_ifs_info.node_count;
+              ++bit_index )
+        {
+            // NOTE: We spend 4 bytes to store 1 bit flag but it's noticeably reduce the size of
+            // assembled code that works with this flag
+            m_ifs_nodes[node_index++] = partition_mask & 1u;
+            partition_mask >>= 1;
+        }
+    }
+}
+
+bool Program::prepare_frame()
+{
+    if ( shares_partition() )
+    {
+        // NOTE: Range blocks keep their images and windows, only the transforms could change
+        RTL_LOG( "Reusing the partition of the preceding frame..." );
+    }
+    else if ( !prepare_blocks() )
+    {
+        return false;
+    }
+
+    if ( !( m_ifs_info.frame_flags & format::frame_flags::shared_blocks ) && !prepare_domains() )
+        return false;
+
+    prepare_luma_blocks();
+
+#if FJORD_ENABLE_PROFILER
+    m_counters.allocated_bytes = m_allocator.allocated();
+    m_counters.allocated_bytes_peak = m_allocator.allocated_peak();
+#endif
+
+    return true;
+}
+
+bool Program::prepare_blocks()
+{
+    //----------------------------------------------------------------------------------------------
+    {
+        FJORD_PROFILE( m_counters, load_quadtree );
+
+        RTL_LOG( "Decoding block sizes from Q-tree partition nodes..." );
+
+        Quadtree quadtree;
+        if ( !quadtree.decode( m_ifs_nodes,
+                               m_ifs_info.node_count,
+                               m_ifs_info.cols,
+                               m_ifs_info.rows,
+                               1 << m_ifs_block_size_ilog2,
+                               m_ifs_info.depth,
+                               m_ifs_blocks,
+                               m_ifs_info.block_count ) )
+            return false;
+    }
+
+    //----------------------------------------------------------------------------------------------
+    {
+        FJORD_PROFILE( m_counters, load_windows );
+
+        RTL_LOG( "Preparing the decoding context for blocks..." );
+
+        Image& mask_image = m_mask_image;
+
+        m_max_window_area = 0;
+
+        for ( size_t block_index = 0; block_index < m_ifs_info.block_count; ++block_index )
+        {
+            RangeBlock& block = m_ifs_blocks[block_index];
+
+            // Preparing the window blurring the block boundaries
+
+            // Block geometry including border clipped by region boundaries and image area
+            Rect clipped_bordered_rect = Rect::create( 0, 0, 0, 0 );
+            {
+                // Block geometry including border with replicated pixels for blurring.
+                // The larger the block size, the more blurred its boundaries
+                const Rect bordered_rect = SmoothWindow::window_size( block.rect );
+
+                // Bordered block geometry clipped by image area
+                const Rect bordered_rect_clipped_by_image_area = bordered_rect & mask_image.rect();
+
+                // Clipping bordered block geometry by regions - to avoid interference of color
+                // components located in them.
+                for ( int i = 0; i < m_ifs_info.region_count; ++i )
+                {
+                    const Rect rect = bordered_rect_clipped_by_image_area & m_regions[i];
+
+                    // We are looking for a region in which most of the block area is located
+                    if ( rect.area() > clipped_bordered_rect.area() )
+                        clipped_bordered_rect = rect;
+                }
+
+                // No regions? Just use clipping by image area
+                if ( !clipped_bordered_rect.area() )
+                    clipped_bordered_rect = bordered_rect_clipped_by_image_area;
+
+                // NOTE: Sessions transform the range block in place of the window, which
+                // covers the block unless the regions are damaged
+                if ( ( clipped_bordered_rect & block.rect ).area() != block.rect.area() )
+                    return false;
+
+                // Allocating the window image, which is generated later
+                if ( !block.window_image.init( clipped_bordered_rect, m_allocator ) )
+                    return false;
+            }
+
+            // NOTE: Sessions transform the blocks one by one, so they need the scratch buffer of
+            // the largest window only
+            m_max_window_area
+                = rtl::max( m_max_window_area, rtl::size_t( clipped_bordered_rect.area() ) );
+        }
+
+        // NOTE: Windows don't overlap in memory, so they are generated concurrently
+        const int block_count = static_cast<int>( m_ifs_info.block_count );
+
+        auto generate_windows = [this, block_count]( int batch_index )
+        {
+            FJORD_TRACE_ZONE( "Program::prepare_blocks/windows" );
+
+            const int first = batch_index * windows_batch_size;
+            const int last = rtl::min( first + windows_batch_size, block_count );
+
+            for ( int block_index = first; block_index < last; ++block_index )
+            {
+                RangeBlock& block = m_ifs_blocks[block_index];
+
+                block.window_image.generate( SmoothWindow::window_size( block.rect ),
+                                             SmoothWindow::window_function );
+            }
+        };
+
+        m_executor.for_each( ( block_count + windows_batch_size - 1 ) / windows_batch_size,
+                             generate_windows );
+    }
+
+    //----------------------------------------------------------------------------------------------
+    {
+        FJORD_PROFILE( m_counters, load_mask );
+
+        RTL_LOG( "Accumulating and inverting the blur mask for deblocking..." );
+
+        auto prepare_tile = [this]( int tile_index ) { prepare_mask_tile( tile_index ); };
+
+        m_executor.for_each( ( m_mask_image.height() + mask_tile_height - 1 ) / mask_tile_height,
+                             prepare_tile );
+    }
+
+    return true;
+}
+
+void Program::prepare_mask_tile( int tile_index )
+{
+    FJORD_TRACE_ZONE( "Program::prepare_mask_tile" );
+
+    const Rect tile_rect
+        = Rect::create( 0, tile_index * mask_tile_height, m_mask_image.width(), mask_tile_height )
+          & m_mask_image.rect();
+
+    // Adding the bluring windows of the blocks to the mask, the rows of the tile only
+    for ( size_t block_index = 0; block_index < m_ifs_info.block_count; ++block_index )
+    {
+        const Image& window_image = m_ifs_blocks[block_index].window_image;
+
+        const Rect rect = window_image.rect() & tile_rect;
+        if ( !rect.area() )
+            continue;
+
+        Image part;
+        part.init( rect,
+                   const_cast<Pixel*>( &window_image.at( rect.left() - window_image.origin().x,
+                                                         rect.top() - window_image.origin().y ) ),
+                   window_image.stride() );
+
+        m_mask_image.add( part );
+    }
+
+    Image tile = m_mask_image.view( tile_rect );
+    image::invert( tile );
+}
+
+bool Program::prepare_domains()
+{
+    FJORD_PROFILE( m_counters, load_blocks );
+
+    for ( size_t block_index = 0; block_index < m_ifs_info.block_count; ++block_index )
+    {
+        RangeBlock& block = m_ifs_blocks[block_index];
+
+        // The size of a block's domain area is twice its own size
+        block.transform.geometry.size.w = block.rect.size.w << 1;
+        block.transform.geometry.size.h = block.rect.size.h << 1;
+
+#if FJORD_ENABLE_BLOCKS_DUMP
+        RTL_LOG( "Block #%i: %i:%i %ix%i %i %i*x+%i",
+                 block_index,
+                 block.transform.geometry.origin.x,
+                 block.transform.geometry.origin.y,
+                 block.transform.geometry.size.w,
+                 block.transform.geometry.size.h,
+                 block.transform.symmetry,
+                 block.transform.contrast,
+                 block.transform.brightness );
+#endif
+
+        // domain out of the plane
+        if ( block.transform.geometry.right() > m_ifs_size.w
+             || block.transform.geometry.bottom() > m_ifs_size.h )
+            return false;
+    }
+
+    return true;
+}
+
+void Program::prepare_luma_blocks()
+{
+    FJORD_PROFILE( m_counters, load_blocks );
+
+    RTL_LOG( "Selecting the blocks of the luma..." );
+
+    // NOTE: The plane is tracked by the cells, the block is required if its window covers the
+    // required cell. Rounding the rectangles out to the cells selects more blocks than needed,
+    // but never less
+    const int cols = ( m_ifs_size.w + luma_cell_size - 1 ) >> luma_cell_size_log2;
+    const int rows = ( m_ifs_size.h + luma_cell_size - 1 ) >> luma_cell_size_log2;
+
+    const auto for_each_cell = [cols]( const Rect& rect, auto&& function )
+    {
+        const int left = rect.left() >> luma_cell_size_log2;
+        const int top = rect.top() >> luma_cell_size_log2;
+        const int right = ( rect.right() + luma_cell_size - 1 ) >> luma_cell_size_log2;
+        const int bottom = ( rect.bottom() + luma_cell_size - 1 ) >> luma_cell_size_log2;
+
+        for ( int y = top; y < bottom; ++y )
+            for ( int x = left; x < right; ++x )
+                if ( function( y * cols + x ) )
+                    return true;
+
+        return false;
+    };
+
+    const auto require = [this]( int cell )
+    {
+        m_luma_cells[cell] = true;
+        return false;
+    };
+
+    const auto is_required = [this]( int cell )
+    {
+        return m_luma_cells[cell];
+    };
+
+    rtl::fill_n( m_luma_cells, static_cast<rtl::size_t>( cols * rows ), false );
+
+    // Luma geometry is the same as in Session::present
+    m_luma_rect = Rect::create( 0, 0, ( m_ifs_size.w / 3 ) << 1, ( m_ifs_size.h / 2 ) << 1 );
+
+    for_each_cell( m_luma_rect, require );
+
+    const auto unite = [this]( const Rect& rect )
+    {
+        const int l = rtl::min( m_luma_rect.left(), rect.left() );
+        const int t = rtl::min( m_luma_rect.top(), rect.top() );
+        const int r = rtl::max( m_luma_rect.right(), rect.right() );
+        const int b = rtl::max( m_luma_rect.bottom(), rect.bottom() );
+
+        m_luma_rect = Rect::create( l, t, r - l, b - t );
+    };
+
+    bool selected[max_blocks_count];
+    rtl::fill_n( selected, m_ifs_info.block_count, false );
+
+    m_luma_block_count = 0;
+
+    // Adding the blocks writing the required cells and their domains until nothing changes
+    for ( unsigned count = ~0u; count != m_luma_block_count; )
+    {
+        count = m_luma_block_count;
+
+        for ( unsigned block_index = 0; block_index < m_ifs_info.block_count; ++block_index )
+        {
+            const RangeBlock& block = m_ifs_blocks[block_index];
+
+            if ( selected[block_index]
+                 || !for_each_cell( block.window_image.rect(), is_required ) )
+                continue;
+
+            selected[block_index] = true;
+            ++m_luma_block_count;
+
+            for_each_cell( block.transform.geometry, require );
+
+            unite( block.window_image.rect() );
+            unite( block.transform.geometry );
+        }
+    }
+
+    // NOTE: Blocks are iterated in their order, which keeps the output of the full decoding
+    m_luma_block_count = 0;
+
+    for ( unsigned block_index = 0; block_index < m_ifs_info.block_count; ++block_index )
+    {
+        if ( selected[block_index] )
+            m_luma_blocks[m_luma_block_count++] = block_index;
+    }
+
+    RTL_LOG( "Luma blocks: %i of %i", m_luma_block_count, m_ifs_info.block_count );
+}
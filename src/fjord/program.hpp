@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <rtl/allocator.hpp>
+
+#include "block.hpp"
+#include "executor.hpp"
+#include "format.hpp"
+#include "image.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "windows.hpp"
+
+namespace fjord
+{
+    /**
+     * @brief Parsed image prepared for decoding: block transforms, windows and the blur mask.
+     *
+     * The program is read-only for the decoding, so any number of \Session instances, possibly
+     * running in different threads and decoding to different sizes, can share it. Only loading
+     * the image or the next frame of the sequence modifies the program, which must not overlap
+     * with the decoding.
+     *
+     * The image is parsed incrementally from the chunks of any size, e.g. as they are read from
+     * the file or the pipe. The headers are copied and the blocks are dequantized as soon as they
+     * arrive, so the program doesn't refer to the fed data. All sizes and counts are checked, the
+     * damaged or truncated data fails the parsing instead of reading out of its bounds.
+     */
+    class Program final
+    {
+    public:
+        /**
+         * @brief Constructor.
+         *
+         * @note Constructor is defaulting to make able the class instance to be declared as global
+         * static variable. Use \reset method for "cold" initialization.
+         */
+        Program() = default;
+
+        static constexpr auto overlap_factor_denominator = 4; // ~ 1/4 = 25% block overlap
+
+        using SmoothWindow = windows::Trapezoidal<overlap_factor_denominator>;
+
+        using ImageInfo = format::headers::Image;
+        using ChannelInfo = format::headers::Channel;
+        using FractalInfo = format::headers::IteratedFunctionSystem;
+
+        static constexpr auto max_image_size{ format::constraints::max_image_size };
+        static constexpr auto max_channels_count{ format::constraints::max_channels_count };
+        static constexpr auto buffer_page_size = max_image_size * max_image_size;
+
+        // NOTE: Planes are twice the image size at most each way, see \load_headers
+        static constexpr auto max_plane_padding = Image::aligned_padding( 2 * max_image_size );
+
+        // NOTE: The plane holds the luma and the chroma side by side, so it's half as large again
+        // as the image, and the blocks round it up. The planes of the largest image with the
+        // blocks up to 128 pixels fit, the larger planes are rejected
+        static constexpr auto max_plane_area = buffer_page_size * 7 / 4;
+
+        enum class Status
+        {
+            need_data,   // the frame is incomplete
+            frame_ready, // the frame is prepared for decoding
+            failed       // the data is damaged or not supported
+        };
+
+        void reset();
+
+        /**
+         * @brief Makes the preparation of the frames run on the executor, e.g. the thread pool of
+         * the application. The windows are generated and the mask is accumulated concurrently.
+         */
+        void set_executor( const Executor& executor )
+        {
+            m_executor = executor;
+        }
+
+        /**
+         * @brief Starts parsing the image fed by \feed.
+         */
+        void begin();
+
+        /**
+         * @brief Parses the next chunk of the image data.
+         *
+         * Chunks may split the headers and the blocks anywhere, the incomplete parts are kept
+         * until the following chunk. Parsing stops as soon as the frame is prepared, so it can be
+         * decoded before the next frame of the sequence is fed.
+         *
+         * @return The number of bytes parsed, less than the size if the frame got ready or the
+         * parsing failed. The rest of the chunk must be fed again to parse the next frame
+         */
+        rtl::size_t feed( const rtl::uint8_t* data, rtl::size_t size );
+
+        [[nodiscard]] Status status() const
+        {
+            return m_status;
+        }
+
+        /**
+         * @brief Returns the number of bytes completing the section being parsed, e.g. the whole
+         * table of the blocks, which is the reasonable size of the next read.
+         *
+         * @return 0 if the parsing failed or the last frame is ready
+         */
+        [[nodiscard]] rtl::size_t required() const;
+
+        /**
+         * @brief Returns true if the image has frames after the one being parsed.
+         */
+        [[nodiscard]] bool has_next_frame() const
+        {
+            return m_status != Status::failed && m_section != Section::image
+                   && m_frame_index + 1u < m_image_info.image_count;
+        }
+
+        [[nodiscard]] unsigned frame_index() const
+        {
+            return m_frame_index;
+        }
+
+        /**
+         * @brief Returns the number of iterations stored in the ready frame.
+         */
+        [[nodiscard]] unsigned iteration_count() const
+        {
+            return m_ifs_info.iteration_count;
+        }
+
+        /**
+         * @brief Parses the image and prepares its first frame.
+         *
+         * @note The data of the following frames is referenced by the program, so it must be kept
+         * alive until the last \next_frame call
+         *
+         * @return The number of iterations stored in the frame or 0 if the image is not supported
+         */
+        unsigned load( const rtl::uint8_t* data, rtl::size_t size );
+
+        /**
+         * @brief Returns the number of frames in the image data, 1 for the still image.
+         *
+         * @return 0 if the data is not the image
+         */
+        [[nodiscard]] static unsigned frame_count( const rtl::uint8_t* data, rtl::size_t size );
+
+        /**
+         * @brief Prepares the next frame of the sequence loaded by \load.
+         *
+         * The frames sharing the partition with the preceding one reuse its windows and mask.
+         *
+         * @return The number of iterations of the frame or 0 if there are no more frames or the
+         * frame doesn't match the sequence
+         */
+        unsigned next_frame();
+
+        [[nodiscard]] Size image_size() const
+        {
+            return Size::create( m_image_info.image_width, m_image_info.image_height );
+        }
+
+        [[nodiscard]] int channel_count() const
+        {
+            return m_image_info.image_channels_count;
+        }
+
+        [[nodiscard]] const ChannelInfo& channel( int index ) const
+        {
+            return m_channels_info[index];
+        }
+
+        /**
+         * @brief Returns the size of the plane holding all channels, which is iterated.
+         */
+        [[nodiscard]] const Size& plane_size() const
+        {
+            return m_ifs_size;
+        }
+
+        [[nodiscard]] unsigned block_count() const
+        {
+            return m_ifs_info.block_count;
+        }
+
+        [[nodiscard]] const RangeBlock& block( unsigned index ) const
+        {
+            return m_ifs_blocks[index];
+        }
+
+        /**
+         * @brief Returns the number of the blocks the luma channel depends on: the blocks writing
+         * the luma and the blocks writing their domains, recursively.
+         */
+        [[nodiscard]] unsigned luma_block_count() const
+        {
+            return m_luma_block_count;
+        }
+
+        [[nodiscard]] unsigned luma_block( unsigned index ) const
+        {
+            return m_luma_blocks[index];
+        }
+
+        /**
+         * @brief Returns the part of the plane written and read by the luma blocks.
+         */
+        [[nodiscard]] const Rect& luma_rect() const
+        {
+            return m_luma_rect;
+        }
+
+        /**
+         * @brief Returns the inverted sum of the block windows normalizing the iterated plane.
+         */
+        [[nodiscard]] const Image& mask() const
+        {
+            return m_mask_image;
+        }
+
+        /**
+         * @brief Returns the area of the largest block window, which is the scratch memory the
+         * session needs to transform the blocks.
+         */
+        [[nodiscard]] rtl::size_t max_window_area() const
+        {
+            return m_max_window_area;
+        }
+
+        /**
+         * @brief Returns the performance counters of the loading stages.
+         */
+        [[nodiscard]] const profiler::Counters& counters() const
+        {
+            return m_counters;
+        }
+
+    private:
+        // Sections of the image data in the order of parsing, every section is an array of units
+        enum class Section
+        {
+            image,    // image header
+            channels, // channel headers
+            frame,    // frame signature and header
+            regions,
+            blocks,
+            nodes, // eight quadtree nodes per byte
+        };
+
+        static constexpr rtl::size_t frame_header_size
+            = sizeof( rtl::uint32_t ) + sizeof( format::headers::IteratedFunctionSystem );
+
+        static constexpr rtl::size_t region_size = 4 * sizeof( rtl::uint16_t );
+
+        static constexpr rtl::size_t max_unit_size = frame_header_size;
+
+        [[nodiscard]] rtl::size_t unit_size() const;
+        [[nodiscard]] rtl::size_t unit_count() const;
+
+        /**
+         * @brief Parses the units of the current section.
+         *
+         * @return false if the data is damaged
+         */
+        bool read_units( const rtl::uint8_t* data, rtl::size_t count );
+
+        bool read_image_info( const rtl::uint8_t* data );
+        bool read_frame_info( const rtl::uint8_t* data );
+        void read_regions( const rtl::uint8_t* data, rtl::size_t count );
+        void read_blocks( const rtl::uint8_t* data, rtl::size_t count );
+        void read_nodes( const rtl::uint8_t* data, rtl::size_t count );
+
+        /**
+         * @brief Moves to the next non-empty section, preparing the frame after the last one.
+         */
+        void next_section();
+
+        /**
+         * @brief Prepares the parsed frame for decoding.
+         */
+        bool prepare_frame();
+
+        /**
+         * @brief Allocates the windows and prepares the range blocks of the parsed partition.
+         */
+        bool prepare_blocks();
+
+        /**
+         * @brief Accumulates the windows covering the tile of the mask rows and inverts the tile.
+         */
+        void prepare_mask_tile( int tile_index );
+
+        /**
+         * @brief Sizes the domains of the parsed blocks and checks them against the plane.
+         */
+        bool prepare_domains();
+
+        /**
+         * @brief Selects the blocks the luma channel depends on.
+         */
+        void prepare_luma_blocks();
+
+        [[nodiscard]] bool shares_partition() const
+        {
+            return m_ifs_info.frame_flags
+                   & ( format::frame_flags::shared_partition | format::frame_flags::shared_blocks );
+        }
+
+        static constexpr auto max_regions_count{ format::constraints::max_regions_count };
+        static constexpr auto brightness_bits{ format::Block::bits_per_brightness };
+        static constexpr auto contrast_bits{ format::Block::bits_per_contrast };
+
+        static constexpr auto max_blocks_count{ format::constraints::max_ifs_blocks_count };
+
+        // NOTE: Every split node has four children, so there are a third of the leaves at most
+        static constexpr auto max_nodes_count = max_blocks_count + max_blocks_count / 3;
+
+        static constexpr auto expand_factor
+            = overlap_factor_denominator * overlap_factor_denominator;
+
+        // NOTE: Windows overlap the neighbours by the fraction of the block on every side
+        static constexpr auto window_expand_factor
+            = ( overlap_factor_denominator + 2 ) * ( overlap_factor_denominator + 2 );
+
+        // Pixel buffers are the mask of the plane size and the smooth windows of the range blocks,
+        // the windows take the expanded area of the plane rounded up
+        static constexpr auto allocator_size
+            = max_plane_area + max_plane_padding
+              + ( max_plane_area * window_expand_factor + expand_factor - 1 ) / expand_factor;
+
+#if FJORD_ENABLE_PROFILER
+        using Allocator
+            = profiler::CountingAllocator<rtl::allocators::grow_only<Pixel, allocator_size>>;
+#else
+        using Allocator = rtl::allocators::grow_only<Pixel, allocator_size>;
+#endif
+
+        Allocator m_allocator;
+
+        ImageInfo   m_image_info;
+        ChannelInfo m_channels_info[max_channels_count];
+        Rect        m_regions[max_regions_count];
+
+        FractalInfo m_ifs_info;
+        Size        m_ifs_size;
+        RangeBlock  m_ifs_blocks[max_blocks_count];
+        unsigned    m_ifs_nodes[max_nodes_count];
+        int         m_ifs_block_size_ilog2;
+
+        static constexpr int  luma_cell_size_log2 = 4;
+        static constexpr int  luma_cell_size = 1 << luma_cell_size_log2;
+        static constexpr auto max_luma_cells_count
+            = ( ( 2 * max_image_size + luma_cell_size - 1 ) >> luma_cell_size_log2 )
+              * ( ( 2 * max_image_size + luma_cell_size - 1 ) >> luma_cell_size_log2 );
+
+        unsigned m_luma_blocks[max_blocks_count];
+        unsigned m_luma_block_count;
+        Rect     m_luma_rect;
+        bool     m_luma_cells[max_luma_cells_count];
+
+        // NOTE: Tiles are the bands of the mask rows, so the tasks don't write the same pixels
+        static constexpr int mask_tile_height = 32;
+        static constexpr int windows_batch_size = 64; // blocks per task
+
+        Image       m_mask_image;
+        rtl::size_t m_max_window_area;
+
+        Executor m_executor;
+
+        Status      m_status;
+        Section     m_section;
+        rtl::size_t m_unit_index; // in the section
+        unsigned    m_frame_index;
+
+        // NOTE: The unit split between the chunks is gathered here
+        alignas( rtl::uint32_t ) rtl::uint8_t m_pending[max_unit_size];
+        rtl::size_t                           m_pending_size;
+
+        const rtl::uint8_t* m_next_frame_data;
+        rtl::size_t         m_next_frame_size;
+
+        profiler::Counters m_counters;
+    };
+} // namespace fjord
@@ -15,50 +15,67 @@
 
 namespace fjord
 {
-    template<typename Allocator>
     class Quadtree final
     {
     public:
         Quadtree() = default;
 
-        void decode( Allocator*  pixels_allocator,
-                     unsigned*   nodes,
-                     int         col_count,
-                     int         row_count,
-                     int         block_size,
-                     int         max_depth,
-                     RangeBlock* blocks )
+        /**
+         * @brief Decodes the range blocks of the partition.
+         *
+         * @return false if the nodes don't match the number of the blocks
+         */
+        bool decode( const unsigned* nodes,
+                     unsigned        node_count,
+                     int             col_count,
+                     int             row_count,
+                     int             block_size,
+                     int             max_depth,
+                     RangeBlock*     blocks,
+                     unsigned        block_count )
         {
-            allocator = pixels_allocator;
             current_block = blocks;
             current_node = nodes;
+            blocks_end = blocks + block_count;
+            nodes_end = nodes + node_count;
+            damaged = false;
 
             walk( 0, 0, col_count, row_count, block_size, max_depth );
+
+            return !damaged && current_block == blocks_end && current_node == nodes_end;
         }
 
     private:
         void walk( int x0, int y0, int cols, int rows, int block_size, int level )
         {
-            for ( int y = y0; y < rows * block_size + y0; y += block_size )
+            for ( int y = y0; y < rows * block_size + y0 && !damaged; y += block_size )
             {
-                for ( int x = x0; x < cols * block_size + x0; x += block_size )
+                for ( int x = x0; x < cols * block_size + x0 && !damaged; x += block_size )
                 {
-                    if ( level && *current_node++ )
+                    if ( level && current_node == nodes_end )
+                    {
+                        damaged = true;
+                    }
+                    else if ( level && *current_node++ )
                     {
                         walk( x, y, 2, 2, block_size >> 1, level - 1 );
                     }
+                    else if ( current_block == blocks_end )
+                    {
+                        damaged = true;
+                    }
                     else
                     {
-                        ( current_block++ )
-                            ->original_image.init( Rect::create( x, y, block_size, block_size ),
-                                                   *allocator );
+                        ( current_block++ )->rect = Rect::create( x, y, block_size, block_size );
                     }
                 }
             }
         }
 
-        Allocator*  allocator;
-        RangeBlock* current_block;
-        unsigned*   current_node;
+        RangeBlock*       current_block;
+        const RangeBlock* blocks_end;
+        const unsigned*   current_node;
+        const unsigned*   nodes_end;
+        bool              damaged;
     };
 } // namespace fjord
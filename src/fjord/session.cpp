@@ -0,0 +1,745 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "session.hpp"
+
+#include <rtl/algorithm.hpp>
+#include <rtl/math.hpp>
+#include <rtl/sys/debug.hpp>
+
+using namespace fjord;
+
+namespace
+{
+    using PixelFormat = Session::PixelFormat;
+
+    [[nodiscard]] constexpr bool is_planar( PixelFormat fmt )
+    {
+        return fmt == PixelFormat::i420 || fmt == PixelFormat::nv12;
+    }
+
+    /**
+     * @brief Fills the buffer with black pixels, all planes of the planar formats.
+     */
+    void clear_pixels( PixelFormat   fmt,
+                       rtl::uint8_t* buffer_pixels,
+                       int           buffer_width,
+                       int           buffer_height,
+                       rtl::size_t   buffer_pitch )
+    {
+        const auto padding = [&]( rtl::size_t pixel_size_in_bytes )
+        { return buffer_pitch - buffer_width * pixel_size_in_bytes; };
+
+        switch ( fmt )
+        {
+        case PixelFormat::rgb888:
+            image::clear_rgb888( buffer_pixels, buffer_width, buffer_height, padding( 3 ) );
+            break;
+
+        case PixelFormat::gray8:
+            image::clear_gray8( buffer_pixels, buffer_width, buffer_height, padding( 1 ) );
+            break;
+
+        case PixelFormat::bgra8888:
+        case PixelFormat::rgba8888:
+            image::clear_rgba8888( buffer_pixels, buffer_width, buffer_height, padding( 4 ) );
+            break;
+
+        case PixelFormat::rgb565:
+            image::clear_rgb565( buffer_pixels, buffer_width, buffer_height, padding( 2 ) );
+            break;
+
+        case PixelFormat::i420:
+            image::clear_i420( buffer_pixels, buffer_width, buffer_height, buffer_pitch );
+            break;
+
+        case PixelFormat::nv12:
+            image::clear_nv12( buffer_pixels, buffer_width, buffer_height, buffer_pitch );
+            break;
+        }
+    }
+
+    /**
+     * @brief Converts the output planes to the pixels centered in the buffer.
+     */
+    void convert_pixels( PixelFormat   fmt,
+                         const Image&  y_image,
+                         const Image&  u_image,
+                         const Image&  v_image,
+                         rtl::uint8_t* buffer_pixels,
+                         int           buffer_width,
+                         int           buffer_height,
+                         rtl::size_t   buffer_pitch )
+    {
+        switch ( fmt )
+        {
+        case PixelFormat::rgb888:
+            RTL_LOG( "Converting YUV444 to RGB888..." );
+
+            image::convert_yuv444_to_rgb888( y_image,
+                                             u_image,
+                                             v_image,
+                                             buffer_pixels,
+                                             buffer_width,
+                                             buffer_height,
+                                             buffer_pitch );
+            break;
+
+        case PixelFormat::gray8:
+            RTL_LOG( "Converting Y to GRAY8..." );
+
+            image::convert_y_to_gray8(
+                y_image, buffer_pixels, buffer_width, buffer_height, buffer_pitch );
+            break;
+
+        case PixelFormat::bgra8888:
+            RTL_LOG( "Converting YUV444 to BGRA8888..." );
+
+            image::convert_yuv444_to_bgra8888( y_image,
+                                               u_image,
+                                               v_image,
+                                               buffer_pixels,
+                                               buffer_width,
+                                               buffer_height,
+                                               buffer_pitch );
+            break;
+
+        case PixelFormat::rgba8888:
+            RTL_LOG( "Converting YUV444 to RGBA8888..." );
+
+            image::convert_yuv444_to_rgba8888( y_image,
+                                               u_image,
+                                               v_image,
+                                               buffer_pixels,
+                                               buffer_width,
+                                               buffer_height,
+                                               buffer_pitch );
+            break;
+
+        case PixelFormat::rgb565:
+            RTL_LOG( "Converting YUV444 to RGB565..." );
+
+            image::convert_yuv444_to_rgb565( y_image,
+                                             u_image,
+                                             v_image,
+                                             buffer_pixels,
+                                             buffer_width,
+                                             buffer_height,
+                                             buffer_pitch );
+            break;
+
+        case PixelFormat::i420:
+            RTL_LOG( "Converting YUV444 to I420..." );
+
+            image::convert_yuv444_to_i420( y_image,
+                                           u_image,
+                                           v_image,
+                                           buffer_pixels,
+                                           buffer_width,
+                                           buffer_height,
+                                           buffer_pitch );
+            break;
+
+        case PixelFormat::nv12:
+            RTL_LOG( "Converting YUV444 to NV12..." );
+
+            image::convert_yuv444_to_nv12( y_image,
+                                           u_image,
+                                           v_image,
+                                           buffer_pixels,
+                                           buffer_width,
+                                           buffer_height,
+                                           buffer_pitch );
+            break;
+        }
+    }
+
+    /**
+     * @brief Solves the normal equations of the mixing coefficients.
+     *
+     * @param products The lower triangle of the symmetric matrix
+     * @param coefficients In the fixed point of \FractionBits
+     *
+     * @return false if the equations are ill-conditioned or the coefficients are too large to
+     * extrapolate safely
+     */
+    template<int Capacity, int FractionBits>
+    bool solve_mixing( const rtl::int64_t ( &products )[Capacity][Capacity],
+                       const rtl::int64_t ( &projections )[Capacity],
+                       int          count,
+                       double       max_coefficients_sum,
+                       rtl::int32_t ( &coefficients )[Capacity] )
+    {
+        double matrix[Capacity][Capacity];
+        double solution[Capacity];
+
+        double trace = 0;
+        for ( int j = 0; j < count; ++j )
+            trace += static_cast<double>( products[j][j] );
+
+        if ( trace <= 0 )
+            return false;
+
+        // NOTE: Regularization keeps the nearly dependent residuals from blowing the solution up
+        for ( int j = 0; j < count; ++j )
+        {
+            for ( int k = 0; k <= j; ++k )
+                matrix[j][k] = matrix[k][j] = static_cast<double>( products[j][k] );
+
+            matrix[j][j] += trace * 1e-9;
+            solution[j] = static_cast<double>( projections[j] );
+        }
+
+        // Gaussian elimination, which needs no pivoting for the positive definite matrix
+        for ( int j = 0; j < count; ++j )
+        {
+            if ( matrix[j][j] <= trace * 1e-12 )
+                return false;
+
+            for ( int i = j + 1; i < count; ++i )
+            {
+                const double factor = matrix[i][j] / matrix[j][j];
+
+                for ( int k = j; k < count; ++k )
+                    matrix[i][k] -= factor * matrix[j][k];
+
+                solution[i] -= factor * solution[j];
+            }
+        }
+
+        double sum = 0;
+
+        for ( int j = count - 1; j >= 0; --j )
+        {
+            for ( int k = j + 1; k < count; ++k )
+                solution[j] -= matrix[j][k] * solution[k];
+
+            solution[j] /= matrix[j][j];
+            sum += rtl::abs( solution[j] );
+        }
+
+        if ( sum > max_coefficients_sum )
+            return false;
+
+        for ( int j = 0; j < count; ++j )
+            coefficients[j] = static_cast<rtl::int32_t>( solution[j] * ( 1 << FractionBits ) );
+
+        return true;
+    }
+} // namespace
+
+void Session::reset()
+{
+    m_random.init( 1337 );
+    m_ifs_last_output_buffer = buffer_ifs_1st;
+    m_mode = Mode::full;
+    m_filter = image::Filter::nearest;
+    m_acceleration_depth = 0;
+    m_history_depth = 0;
+    m_history_count = 0;
+    m_history_next = 0;
+
+    // NOTE: No crop is empty, so the samples are computed by the first conversion
+    for ( image::Resampler& resampler : m_resamplers )
+        resampler.crop_size = Size::create( 0, 0 );
+
+#if FJORD_ENABLE_PROFILER
+    m_allocator.reset();
+    m_allocator.reset_peak();
+    m_counters.reset();
+#endif
+}
+
+bool Session::attach( const Program& program, const Size& target_size )
+{
+    FJORD_TRACE_ZONE( "Session::attach" );
+
+#if FJORD_ENABLE_PROFILER
+    m_counters.reset();
+#endif
+
+    m_program = &program;
+
+    const Size image_size = program.image_size();
+
+    //----------------------------------------------------------------------------------------------
+    {
+        FJORD_PROFILE( m_counters, load_headers );
+
+        RTL_LOG( "Fitting the image to the target size..." );
+
+        using Fixed = rtl::fix<rtl::int32_t, 16>;
+
+        const Fixed scale = rtl::min( Fixed::from_fraction( target_size.w, image_size.w ),
+                                      Fixed::from_fraction( target_size.h, image_size.h ) );
+
+        m_target_size = target_size;
+
+        RTL_LOG( "Target size: %ix%i", target_size.w, target_size.h );
+        // TODO: %f
+        RTL_LOG( "Target scale: %i/%i", static_cast<int>( scale ) * 256, 256 );
+
+        if ( scale < 1 )
+        {
+            m_output_image_size.w = static_cast<int>( scale * image_size.w );
+            m_output_image_size.h = static_cast<int>( scale * image_size.h );
+        }
+        else
+        {
+            m_output_image_size.w = image_size.w;
+            m_output_image_size.h = image_size.h;
+        }
+
+        if ( m_output_image_size.w <= 0 || m_output_image_size.h <= 0
+             || m_output_image_size.w > image::Resampler::max_output_size
+             || m_output_image_size.h > image::Resampler::max_output_size )
+            return false;
+
+        // TODO: Implement scaling modes:
+        // - original size
+        // - fit large images to specified size (with native pow2 downscaling)
+        // - fit small images to specified size (with native pow2 upscaling)
+        // - fit all images to specified size (with native pow2 scaling)
+
+        // TODO: native pow2 downscaling if image doesn't fit into decoder buffers
+        RTL_LOG( "Output size: %ix%i", m_output_image_size.w, m_output_image_size.h );
+    }
+
+    //----------------------------------------------------------------------------------------------
+    {
+        FJORD_PROFILE( m_counters, load_windows );
+
+        RTL_LOG( "Init image buffers..." );
+
+        m_allocator.reset();
+
+        // NOTE: Buffers are allocated first, so they get the same addresses for every frame. The
+        // IFS buffers keep the plane of the preceding frame to continue the iterations from it
+        const Size& plane_size = program.plane_size();
+
+        for ( int i = 0; i < buffer_ifs_count; ++i )
+        {
+            if ( !m_buffer_images[i].init_aligned(
+                     Rect::create( 0, 0, plane_size.w, plane_size.h ), m_allocator ) )
+                return false;
+        }
+
+        for ( int i = 0; i < program.channel_count(); ++i )
+        {
+            if ( !m_buffer_images[i + buffer_output_channel_base].init(
+                     Rect::create( 0, 0, m_output_image_size.w, m_output_image_size.h ),
+                     m_allocator ) )
+                return false;
+        }
+
+        // NOTE: History of the preceding frame doesn't describe the iterations of this one
+        m_history_depth = m_acceleration_depth;
+        m_history_count = 0;
+        m_history_next = 0;
+
+        for ( int i = 0; i < m_history_depth; ++i )
+        {
+            for ( Image& image : m_history_images[i] )
+            {
+                if ( !image.init_aligned( Rect::create( 0, 0, plane_size.w, plane_size.h ),
+                                          m_allocator ) )
+                    return false;
+            }
+        }
+
+        m_window_pixels = m_allocator.allocate( program.max_window_area() );
+
+        if ( !m_window_pixels )
+            return false;
+    }
+
+#if FJORD_ENABLE_PROFILER
+    m_counters.allocated_bytes = m_allocator.allocated();
+    m_counters.allocated_bytes_peak = m_allocator.allocated_peak();
+#endif
+
+    return true;
+}
+
+void Session::rewind()
+{
+    m_random.init( 1337 );
+    m_ifs_last_output_buffer = buffer_ifs_1st;
+    m_buffer_images[buffer_ifs_1st].clear();
+    m_history_count = 0;
+    m_history_next = 0;
+}
+
+const Image* Session::iterate( unsigned num_iterations )
+{
+    RTL_LOG( "Iterating the function system..." );
+
+    const Program& program = *m_program;
+    const Image&   mask_image = program.mask();
+
+    // NOTE: Luma blocks don't read the plane written by the rest of the blocks, so the luma is
+    // decoded exactly as in the full mode
+    const bool     luma_only = m_mode == Mode::luma;
+    const unsigned block_count = luma_only ? program.luma_block_count() : program.block_count();
+
+    // NOTE: The rest of the plane is neither cleared nor normalized in the luma mode
+    const Rect  active_rect = luma_only ? program.luma_rect() : mask_image.rect();
+    const Image active_mask_image = mask_image.view( active_rect );
+
+    const Image* result = nullptr;
+
+    for ( unsigned n = 0; n < num_iterations; ++n )
+    {
+        FJORD_PROFILE( m_counters, iterate );
+        FJORD_TRACE_ZONE( "Session::iterate" );
+
+        Image* input_image = &m_buffer_images[m_ifs_last_output_buffer];
+        Image* output_image = &m_buffer_images[buffer_ifs_2nd - m_ifs_last_output_buffer];
+
+        Image active_output_image = output_image->view( active_rect );
+
+        // Clearing the output buffer
+        active_output_image.clear();
+
+        for ( unsigned batch = 0; batch < block_count; batch += blocks_batch_size )
+        {
+            FJORD_TRACE_ZONE( "Session::iterate/blocks" );
+
+            const unsigned batch_end = rtl::min( batch + blocks_batch_size, block_count );
+
+            for ( unsigned i = batch; i < batch_end; ++i )
+            {
+                const RangeBlock& block = program.block( luma_only ? program.luma_block( i ) : i );
+
+                const Rect& window_rect = block.window_image.rect();
+
+                // NOTE: Blocks are transformed one by one through the scratch buffer, the range
+                // block is the view of its place in the bordered block
+                Image bordered_image;
+                bordered_image.init( window_rect, m_window_pixels );
+
+                const Rect range_rect = Rect::create( block.rect.left() - window_rect.left(),
+                                                      block.rect.top() - window_rect.top(),
+                                                      block.rect.size.w,
+                                                      block.rect.size.h );
+
+                Image range_image = bordered_image.view( range_rect );
+
+                // Crop, resize, adjust and transform the block of the input image
+                image::transform_affinity( *input_image,
+                                           block.transform.geometry,
+                                           block.transform.contrast,
+                                           block.transform.brightness,
+                                           block.transform.symmetry,
+                                           range_image );
+
+                // Expands image with a border replicating boundary pixels
+                image::expand_borders( range_rect, bordered_image );
+
+                // Bluring block boundaries (deblocking)
+                bordered_image.mul( block.window_image );
+
+                // Add bordered block to the output buffer
+                output_image->add( bordered_image );
+            }
+        }
+
+        // Normalize the output image after block boundaries bluring
+        active_output_image.mul( active_mask_image );
+
+        // Add some uniform noise to the output image for visual sharpening
+        // NOTE: Noise covers the whole plane in any mode to keep the random sequence
+        output_image->transform(
+            [this]( const Pixel& pix )
+            {
+                constexpr auto noise_intensivity = 1 << noise_intensivity_log2;
+                return pix
+                       + Pixel::from_fraction(
+                           (signed)( m_random.rand() & ( noise_intensivity - 1 ) )
+                               - noise_intensivity / 2,
+                           256 );
+            } );
+
+        // Extrapolating the iterations toward the attractor
+        // NOTE: Noise repeats with the cycle of the random generator, so it's a part of the
+        // iterated function rather than its error
+        if ( m_history_depth )
+            accelerate( input_image->view( active_rect ), active_output_image );
+
+        // Flip buffers
+        result = output_image;
+
+        m_ifs_last_output_buffer = static_cast<Buffer>( buffer_ifs_2nd - m_ifs_last_output_buffer );
+    }
+
+    return result;
+}
+
+void Session::accelerate( const Image& input_image, Image& output_image )
+{
+    FJORD_TRACE_ZONE( "Session::accelerate" );
+
+    const Rect& rect = output_image.rect();
+
+    const int count = m_history_count;
+
+    // The planes of the history iterations and their residuals
+    Image planes[history_capacity];
+    Image residuals[history_capacity];
+
+    for ( int j = 0; j < m_history_depth; ++j )
+    {
+        planes[j] = m_history_images[j][0].view( rect );
+        residuals[j] = m_history_images[j][1].view( rect );
+    }
+
+    // Least squares of the residual by its differences with the history residuals: the normal
+    // equations and the squared norm of the residual
+    rtl::int64_t products[history_capacity][history_capacity] = {};
+    rtl::int64_t projections[history_capacity] = {};
+    rtl::int64_t residual_norm = 0;
+
+    for ( int y = 0; y < rect.size.h; ++y )
+    {
+        for ( int x = 0; x < rect.size.w; ++x )
+        {
+            const rtl::int64_t residual
+                = output_image.at( x, y ).raw() - input_image.at( x, y ).raw();
+
+            residual_norm += residual * residual;
+
+            rtl::int64_t differences[history_capacity];
+
+            for ( int j = 0; j < count; ++j )
+            {
+                differences[j] = residual - residuals[j].at( x, y ).raw();
+                projections[j] += differences[j] * residual;
+
+                for ( int k = 0; k <= j; ++k )
+                    products[j][k] += differences[j] * differences[k];
+            }
+        }
+    }
+
+    // NOTE: The residual grows if the mixing is unstable, then the plain iteration is taken. Near
+    // the fixed point the residual is mostly the rounding of the pixels, which the mixing amplifies
+    rtl::int32_t coefficients[history_capacity]{};
+
+    const bool mixed = count > 0 && residual_norm < m_residual_norm
+                       && residual_norm >= rtl::int64_t( rect.area() ) * min_mixed_residual
+                       && solve_mixing<history_capacity, mixing_fraction_bits>(
+                           products, projections, count, max_mixing_sum, coefficients );
+
+    // NOTE: The plain iteration starts the history anew
+    if ( !mixed && count )
+    {
+        m_history_count = 0;
+        m_history_next = 0;
+    }
+
+    const int slot = m_history_next;
+
+    // Mixing the planes and replacing the oldest iteration of the history with this one
+    for ( int y = 0; y < rect.size.h; ++y )
+    {
+        for ( int x = 0; x < rect.size.w; ++x )
+        {
+            const Pixel value = output_image.at( x, y );
+
+            rtl::int64_t correction = 0;
+
+            if ( mixed )
+            {
+                for ( int j = 0; j < count; ++j )
+                    correction += rtl::int64_t( planes[j].at( x, y ).raw() - value.raw() )
+                                  * coefficients[j];
+            }
+
+            planes[slot].at( x, y ) = value;
+            residuals[slot].at( x, y ) = value - input_image.at( x, y );
+
+            output_image.at( x, y ) = Pixel::from_raw(
+                value.raw() + static_cast<rtl::int32_t>( correction >> mixing_fraction_bits ) );
+        }
+    }
+
+    m_history_count = rtl::min( m_history_count + 1, m_history_depth );
+    m_history_next = ( slot + 1 ) % m_history_depth;
+    m_residual_norm = residual_norm;
+}
+
+void Session::decode( unsigned      num_iterations,
+                      PixelFormat   fmt,
+                      rtl::uint8_t* buffer_pixels,
+                      int           buffer_width,
+                      int           buffer_height,
+                      rtl::size_t   buffer_pitch_in_bytes )
+{
+    // NOTE: Without iterations the output planes are left as they are, e.g. restored from snapshot
+    present( num_iterations ? iterate( num_iterations ) : nullptr,
+             fmt,
+             buffer_pixels,
+             buffer_width,
+             buffer_height,
+             buffer_pitch_in_bytes );
+}
+
+void Session::present( const Image*  decoded_image,
+                       PixelFormat   fmt,
+                       rtl::uint8_t* buffer_pixels,
+                       int           buffer_width,
+                       int           buffer_height,
+                       rtl::size_t   buffer_pitch_in_bytes )
+{
+    RTL_ASSERT( m_mode == Mode::full || fmt == PixelFormat::gray8 );
+
+    const bool extracted
+        = !decoded_image || extract_channels( *decoded_image, fmt, 0, m_output_image_size.h );
+
+    {
+        FJORD_PROFILE( m_counters, convert_yuv444_to_rgb888 );
+
+        clear_pixels( fmt, buffer_pixels, buffer_width, buffer_height, buffer_pitch_in_bytes );
+
+        if ( !extracted )
+            return;
+
+        convert_pixels( fmt,
+                        m_buffer_images[buffer_output_channel_y],
+                        m_buffer_images[buffer_output_channel_u],
+                        m_buffer_images[buffer_output_channel_v],
+                        buffer_pixels,
+                        buffer_width,
+                        buffer_height,
+                        buffer_pitch_in_bytes );
+    }
+}
+
+void Session::present_region( const Image*  decoded_image,
+                              PixelFormat   fmt,
+                              const Rect&   region,
+                              rtl::uint8_t* buffer_pixels,
+                              rtl::size_t   buffer_pitch_in_bytes )
+{
+    RTL_ASSERT( m_mode == Mode::full || fmt == PixelFormat::gray8 );
+    RTL_ASSERT( region.area() > 0 );
+    RTL_ASSERT( region.left() >= 0 && region.right() <= m_output_image_size.w );
+    RTL_ASSERT( region.top() >= 0 && region.bottom() <= m_output_image_size.h );
+
+    if ( decoded_image && !extract_channels( *decoded_image, fmt, region.top(), region.size.h ) )
+        return;
+
+    FJORD_PROFILE( m_counters, convert_yuv444_to_rgb888 );
+
+    // NOTE: Grayscale takes the luma only, the chroma planes may be absent
+    const bool  luma_only = fmt == PixelFormat::gray8;
+    const Image y_image = m_buffer_images[buffer_output_channel_y].view( region );
+    const Image u_image
+        = luma_only ? y_image : m_buffer_images[buffer_output_channel_u].view( region );
+    const Image v_image
+        = luma_only ? y_image : m_buffer_images[buffer_output_channel_v].view( region );
+
+    // NOTE: The buffer is of the region size, so the pixels aren't centered
+    convert_pixels( fmt,
+                    y_image,
+                    u_image,
+                    v_image,
+                    buffer_pixels,
+                    region.size.w,
+                    region.size.h,
+                    buffer_pitch_in_bytes );
+}
+
+bool Session::extract_channels( const Image& decoded_image,
+                                PixelFormat  fmt,
+                                int          first_row,
+                                int          row_count )
+{
+    FJORD_PROFILE( m_counters, convert_yuv420_to_yuv444 );
+
+    RTL_LOG( "Converting YUV420 to YUV444..." );
+
+    // NOTE: Grayscale is the luma channel, the chroma is neither extracted nor converted
+    const int channel_count = fmt == PixelFormat::gray8 ? 1 : m_program->channel_count();
+
+    // Extracting channel components from the decoded image
+    // +--------+-------+--------+
+    // | Y              | U      |
+    // |                |        |
+    // +        +       +--------+
+    // |                | V      |
+    // |                |        |
+    // +--------+-------+--------+
+    const auto half_width = decoded_image.width() / 3;
+    const auto half_height = decoded_image.height() / 2;
+
+    const fjord::Rect channel_rects[max_channels_count]{
+        Rect::create( 0, 0, half_width << 1, half_height << 1 ),
+        Rect::create( half_width << 1, 0, half_width, half_height ),
+        Rect::create( half_width << 1, half_height, half_width, half_height ) };
+
+    // TODO: use rtl::fix<rtl::uint16_t, 16>?
+    constexpr int uint16_max_value = ( ( 1 << sizeof( rtl::uint16_t ) * 8 ) - 1 );
+
+    const Rect rows_rect = Rect::create( 0, first_row, m_output_image_size.w, row_count );
+
+    for ( auto i = 0; i < channel_count; ++i )
+    {
+        const auto& channel_info = m_program->channel( i );
+
+        const Pixel output_contrast
+            = Pixel::from_fraction( channel_info.contrast_shift, uint16_max_value );
+
+        const Pixel output_brightness
+            = Pixel::from_fraction( channel_info.brightness_shift, uint16_max_value );
+
+        Image output_image = m_buffer_images[i + buffer_output_channel_base].view( rows_rect );
+
+        // TODO: %f for adjust
+        RTL_LOG( "Channel #%i: Crop(%i,%i %ix%i) -> Resize(%ix%i) -> Adjust(x*%i/256+%i)",
+                 i,
+                 channel_rects[i].left(),
+                 channel_rects[i].top(),
+                 channel_rects[i].size.w,
+                 channel_rects[i].size.h,
+                 m_output_image_size.w,
+                 m_output_image_size.h,
+                 static_cast<int>( output_contrast * 256 ),
+                 static_cast<int>( output_brightness * 256 ) );
+
+        image::Resampler& resampler = m_resamplers[i == 0 ? 0 : 1];
+
+        if ( !resampler.is_prepared_for( channel_rects[i].size, m_output_image_size, m_filter )
+             && !resampler.init( channel_rects[i].size, m_output_image_size, m_filter ) )
+            return false;
+
+        image::crop_resize_adjust( decoded_image,
+                                   channel_rects[i].origin,
+                                   resampler,
+                                   output_contrast,
+                                   output_brightness,
+                                   first_row,
+                                   output_image );
+    }
+
+    return true;
+}
+
+void Session::restore( const Size& target_size, const Size& output_size, Pixel* const* planes )
+{
+    m_target_size = target_size;
+    m_output_image_size = output_size;
+
+    for ( rtl::size_t i = 0; i < max_channels_count; ++i )
+    {
+        m_buffer_images[i + buffer_output_channel_base].init(
+            Rect::create( 0, 0, m_output_image_size.w, m_output_image_size.h ), planes[i] );
+    }
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <rtl/allocator.hpp>
+#include <rtl/random.hpp>
+
+#include "image.hpp"
+#include "profiler.hpp"
+#include "program.hpp"
+#include "trace.hpp"
+
+namespace fjord
+{
+    /**
+     * @brief Decoding of the \Program to the target size.
+     *
+     * The session owns the iterated planes, the output planes and the scratch buffer of a single
+     * block, everything else is referenced from the program. Sessions sharing the program may run
+     * concurrently.
+     */
+    class Session final
+    {
+    public:
+        /**
+         * @brief Constructor.
+         *
+         * @note Constructor is defaulting to make able the class instance to be declared as global
+         * static variable. Use \reset method for "cold" initialization.
+         */
+        Session() = default;
+
+        /**
+         * @brief Layout of the output pixels.
+         *
+         * The pitch is the distance between the rows of the pixels or of the Y plane in bytes.
+         * The planes of the planar formats follow each other in the buffer: the chroma planes
+         * are of the half width and height rounded up, I420 has U and V planes of the half pitch
+         * rounded up, NV12 has the single plane of the interleaved U and V of the full pitch.
+         */
+        enum class PixelFormat
+        {
+            rgb888,   // B, G, R bytes
+            gray8,    // luma only
+            bgra8888, // B, G, R, A bytes
+            rgba8888, // R, G, B, A bytes
+            rgb565,   // 16-bit words, red in the high bits
+            i420,     // Y, U, V planes
+            nv12      // Y plane, interleaved U and V plane
+        };
+
+        enum class Mode
+        {
+            full, // all channels
+            luma  // only the blocks the luma depends on, presented as \PixelFormat::gray8
+        };
+
+        void reset();
+
+        /**
+         * @brief Sets the channels being iterated, takes effect from the next iteration.
+         *
+         * @note The luma mode leaves the chroma of the plane undefined, so switching back to the
+         * full mode needs \rewind
+         */
+        void set_mode( Mode mode )
+        {
+            m_mode = mode;
+            m_history_count = 0;
+        }
+
+        [[nodiscard]] Mode mode() const
+        {
+            return m_mode;
+        }
+
+        /**
+         * @brief Sets the filter resizing the decoded channels to the output size, takes effect
+         * from the next conversion. The nearest sample is the default.
+         */
+        void set_filter( image::Filter filter )
+        {
+            m_filter = filter;
+        }
+
+        [[nodiscard]] image::Filter filter() const
+        {
+            return m_filter;
+        }
+
+#if FJORD_ENABLE_ACCELERATION
+        static constexpr int max_acceleration_depth = 3;
+#else
+        static constexpr int max_acceleration_depth = 0;
+#endif
+
+        /**
+         * @brief Sets the number of the preceding iterations mixed into the next one by the
+         * Anderson acceleration, 0 for the plain iterations. Takes effect from the next \attach.
+         *
+         * Every iteration of the history keeps two planes, see \history_size. The plain iteration
+         * is taken instead of the mixed one whenever the latter is unstable, e.g. the residual
+         * grows because of the blocks of the high contrast.
+         *
+         * @param depth Clamped to \max_acceleration_depth
+         */
+        void set_acceleration_depth( int depth )
+        {
+            m_acceleration_depth = rtl::clamp( depth, 0, max_acceleration_depth );
+        }
+
+        [[nodiscard]] int acceleration_depth() const
+        {
+            return m_acceleration_depth;
+        }
+
+        /**
+         * @brief Returns the number of bytes of the history planes allocated by \attach.
+         */
+        [[nodiscard]] rtl::size_t history_size() const
+        {
+            return static_cast<rtl::size_t>( m_history_depth ) * 2
+                   * static_cast<rtl::size_t>( m_buffer_images[buffer_ifs_1st].rect().area() )
+                   * sizeof( Pixel );
+        }
+
+        /**
+         * @brief Allocates the buffers to decode the program fitted to the target size.
+         *
+         * The iterated planes are kept if the plane size is not changed, so attaching the next
+         * frame of the sequence continues the iterations from the preceding one.
+         *
+         * @note The program is referenced by the session, so it must be kept alive and unchanged
+         * as long as the session is used
+         *
+         * @return false if the buffers don't fit into the session memory
+         */
+        bool attach( const Program& program, const Size& target_size );
+
+        /**
+         * @brief Makes the iterations start from scratch.
+         */
+        void rewind();
+
+        /**
+         * @brief Performs the iterations of the function system.
+         *
+         * @return The plane with the decoded channels after the last iteration or nullptr if no
+         * iterations were performed
+         */
+        const Image* iterate( unsigned num_iterations );
+
+        void decode( unsigned      num_iterations,
+                     PixelFormat   fmt,
+                     rtl::uint8_t* buffer_pixels,
+                     int           buffer_width,
+                     int           buffer_height,
+                     rtl::size_t   buffer_pitch );
+
+        /**
+         * @brief Converts the plane returned by \iterate to the output pixels.
+         *
+         * @param decoded_image nullptr to convert the output planes as they are, e.g. restored
+         * from the snapshot
+         */
+        void present( const Image*  decoded_image,
+                      PixelFormat   fmt,
+                      rtl::uint8_t* buffer_pixels,
+                      int           buffer_width,
+                      int           buffer_height,
+                      rtl::size_t   buffer_pitch );
+
+        /**
+         * @brief Converts the region of the plane returned by \iterate to the output pixels of
+         * the region size, e.g. the tile of the larger picture.
+         *
+         * Only the rows of the region are resized to the output planes. The chroma of the planar
+         * formats is subsampled from the region origin.
+         *
+         * @param region In the coordinates of the image of the \output_size
+         */
+        void present_region( const Image*  decoded_image,
+                             PixelFormat   fmt,
+                             const Rect&   region,
+                             rtl::uint8_t* buffer_pixels,
+                             rtl::size_t   buffer_pitch );
+
+        /**
+         * @brief Sets the output planes to the external pixels, e.g. of the snapshot.
+         */
+        void restore( const Size& target_size, const Size& output_size, Pixel* const* planes );
+
+        [[nodiscard]] const Size& target_size() const
+        {
+            return m_target_size;
+        }
+
+        /**
+         * @brief Returns the size of the decoded image fitted to the target size.
+         */
+        [[nodiscard]] const Size& output_size() const
+        {
+            return m_output_image_size;
+        }
+
+        [[nodiscard]] const Image& output_plane( int channel ) const
+        {
+            return m_buffer_images[channel + buffer_output_channel_base];
+        }
+
+        /**
+         * @brief Returns the performance counters of the decoding stages.
+         */
+        [[nodiscard]] const profiler::Counters& counters() const
+        {
+            return m_counters;
+        }
+
+    private:
+        /**
+         * @brief Crops the channels from the decoded plane and resizes the rows of them to the
+         * output planes.
+         *
+         * @return false if the sizes don't fit the resampler, the output planes are unchanged then
+         */
+        [[nodiscard]] bool extract_channels( const Image& decoded_image,
+                                             PixelFormat  fmt,
+                                             int          first_row,
+                                             int          row_count );
+
+        /**
+         * @brief Mixes the iterated plane with the history of the preceding iterations and adds
+         * it to the history.
+         *
+         * @param input_image The plane the iteration started from
+         * @param output_image The iterated plane, replaced with the mixed one
+         */
+        void accelerate( const Image& input_image, Image& output_image );
+
+        static constexpr auto noise_intensivity_log2 = 4; // [0..7]
+        static constexpr auto random_cycle_length = 4096;
+        static constexpr auto blocks_batch_size = 256; // blocks per trace zone
+
+        using RandomGenerator = rtl::random<random_cycle_length>;
+
+        static constexpr auto max_channels_count{ Program::max_channels_count };
+        static constexpr auto buffer_page_size{ Program::buffer_page_size };
+
+        enum Buffer
+        {
+            buffer_ifs_1st,
+            buffer_ifs_2nd,
+            buffer_ifs_count,
+
+            buffer_output_channel_base = buffer_ifs_count,
+            buffer_output_channel_y = buffer_ifs_count,
+            buffer_output_channel_u,
+            buffer_output_channel_v,
+
+            buffer_count,
+        };
+
+        static constexpr int history_capacity
+            = max_acceleration_depth > 0 ? max_acceleration_depth : 1;
+
+        // NOTE: Mixing coefficients are in the fixed point, the bound of their sum rejects the
+        // ill-conditioned history
+        static constexpr int    mixing_fraction_bits = 16;
+        static constexpr double max_mixing_sum = 8;
+        static constexpr int    min_mixed_residual = 16; // squared per pixel, of 1/256 steps
+
+        // Pixel buffers are the iterated and the history planes, the pages of the output channels
+        // and the scratch of the largest block, which is a fraction of the page. The iterated and
+        // the history planes are padded
+        static constexpr auto allocator_size
+            = ( Program::max_plane_area + Program::max_plane_padding )
+                  * ( buffer_ifs_count + 2 * max_acceleration_depth )
+              + buffer_page_size * ( max_channels_count + 1 );
+
+#if FJORD_ENABLE_PROFILER
+        using Allocator
+            = profiler::CountingAllocator<rtl::allocators::grow_only<Pixel, allocator_size>>;
+#else
+        using Allocator = rtl::allocators::grow_only<Pixel, allocator_size>;
+#endif
+
+        Allocator m_allocator;
+
+        const Program* m_program;
+
+        Mode m_mode;
+
+        // NOTE: Merging different images into the single array is reducing the size of the code
+        Image m_buffer_images[buffer_count];
+
+        Buffer m_ifs_last_output_buffer;
+
+        // NOTE: History is the ring of the iterated planes and of their residuals, the difference
+        // with the plane the iteration started from
+        Image m_history_images[history_capacity][2];
+        int   m_acceleration_depth;
+        int   m_history_depth; // allocated
+        int   m_history_count;
+        int   m_history_next;
+
+        rtl::int64_t m_residual_norm; // squared, of the last iteration
+
+        Pixel* m_window_pixels;
+
+        Size m_target_size;
+        Size m_output_image_size;
+
+        // NOTE: Luma is cropped from the plane twice the size of the chroma, so they have their
+        // own samples of the output
+        image::Filter    m_filter;
+        image::Resampler m_resamplers[2];
+
+        RandomGenerator m_random;
+
+        profiler::Counters m_counters;
+    };
+} // namespace fjord
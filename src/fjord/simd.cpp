@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "simd.hpp"
+
+#include <rtl/algorithm.hpp>
+
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+#define FJORD_SIMD_X86 1
+#else
+#define FJORD_SIMD_X86 0
+#endif
+
+#if FJORD_SIMD_X86
+#if defined( _MSC_VER ) && !defined( __clang__ )
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+// NOTE: The kernels of the wider instruction sets are compiled for them function by function, so
+// the rest of the library keeps the baseline instruction set of the target
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define FJORD_SIMD_TARGET( isa ) __attribute__( ( target( isa ) ) )
+#else
+#define FJORD_SIMD_TARGET( isa )
+#endif
+
+using namespace fjord;
+
+namespace
+{
+    constexpr int pixel_fraction_bits = 8;
+
+    static_assert( Pixel::one == 1 << pixel_fraction_bits );
+    static_assert( sizeof( Pixel ) == sizeof( rtl::int32_t ) );
+
+    struct Kernels final
+    {
+        void ( *clear )( Pixel* row, int count );
+        void ( *add )( Pixel* row, const Pixel* source, int count );
+        void ( *mul )( Pixel* row, const Pixel* source, int count );
+    };
+
+    void clear_scalar( Pixel* row, int count )
+    {
+        rtl::fill_n( row, count, Pixel( 0 ) );
+    }
+
+    void add_scalar( Pixel* row, const Pixel* source, int count )
+    {
+        for ( int x = 0; x < count; ++x )
+            row[x] += source[x];
+    }
+
+    void mul_scalar( Pixel* row, const Pixel* source, int count )
+    {
+        for ( int x = 0; x < count; ++x )
+            row[x] = row[x] * source[x];
+    }
+
+    constexpr Kernels scalar_kernels = { clear_scalar, add_scalar, mul_scalar };
+
+#if FJORD_SIMD_X86
+    // NOTE: Rows are loaded unaligned, the planes start at the cache lines, but their views and
+    // the block windows don't
+    FJORD_SIMD_TARGET( "sse2" ) void clear_sse2( Pixel* row, int count )
+    {
+        auto*         dst = reinterpret_cast<__m128i*>( row );
+        const __m128i zero = _mm_setzero_si128();
+
+        int x = 0;
+        for ( ; x + 4 <= count; x += 4 )
+            _mm_storeu_si128( dst++, zero );
+
+        clear_scalar( row + x, count - x );
+    }
+
+    FJORD_SIMD_TARGET( "sse2" ) void add_sse2( Pixel* row, const Pixel* source, int count )
+    {
+        int x = 0;
+        for ( ; x + 4 <= count; x += 4 )
+        {
+            auto*       dst = reinterpret_cast<__m128i*>( row + x );
+            const auto* src = reinterpret_cast<const __m128i*>( source + x );
+
+            _mm_storeu_si128( dst,
+                              _mm_add_epi32( _mm_loadu_si128( dst ), _mm_loadu_si128( src ) ) );
+        }
+
+        add_scalar( row + x, source + x, count - x );
+    }
+
+    /**
+     * @brief Returns the 32 bits of the signed 64-bit products above the fraction, like the
+     * multiplication of the fixed point pixels.
+     *
+     * SSE2 multiplies the unsigned even lanes only, the signed product differs from the unsigned
+     * one in the high half, which is corrected by the other factor of every negative factor.
+     */
+    FJORD_SIMD_TARGET( "sse2" ) __m128i mul_fixed_sse2( __m128i a, __m128i b )
+    {
+        const __m128i low_lanes = _mm_set_epi32( 0, -1, 0, -1 );
+        const __m128i high_lanes = _mm_set_epi32( -1, 0, -1, 0 );
+
+        const __m128i correction
+            = _mm_add_epi32( _mm_and_si128( _mm_srai_epi32( a, 31 ), b ),
+                             _mm_and_si128( _mm_srai_epi32( b, 31 ), a ) );
+
+        __m128i even = _mm_mul_epu32( a, b );
+        __m128i odd = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), _mm_srli_epi64( b, 32 ) );
+
+        even = _mm_sub_epi32( even, _mm_slli_epi64( correction, 32 ) );
+        odd = _mm_sub_epi32( odd, _mm_and_si128( correction, high_lanes ) );
+
+        even = _mm_and_si128( _mm_srli_epi64( even, pixel_fraction_bits ), low_lanes );
+        odd = _mm_slli_epi64( _mm_srli_epi64( odd, pixel_fraction_bits ), 32 );
+
+        return _mm_or_si128( even, odd );
+    }
+
+    FJORD_SIMD_TARGET( "sse2" ) void mul_sse2( Pixel* row, const Pixel* source, int count )
+    {
+        int x = 0;
+        for ( ; x + 4 <= count; x += 4 )
+        {
+            auto*       dst = reinterpret_cast<__m128i*>( row + x );
+            const auto* src = reinterpret_cast<const __m128i*>( source + x );
+
+            _mm_storeu_si128( dst,
+                              mul_fixed_sse2( _mm_loadu_si128( dst ), _mm_loadu_si128( src ) ) );
+        }
+
+        mul_scalar( row + x, source + x, count - x );
+    }
+
+    constexpr Kernels sse2_kernels = { clear_sse2, add_sse2, mul_sse2 };
+
+    FJORD_SIMD_TARGET( "avx2" ) void clear_avx2( Pixel* row, int count )
+    {
+        const __m256i zero = _mm256_setzero_si256();
+
+        int x = 0;
+        for ( ; x + 8 <= count; x += 8 )
+            _mm256_storeu_si256( reinterpret_cast<__m256i*>( row + x ), zero );
+
+        clear_scalar( row + x, count - x );
+    }
+
+    FJORD_SIMD_TARGET( "avx2" ) void add_avx2( Pixel* row, const Pixel* source, int count )
+    {
+        int x = 0;
+        for ( ; x + 8 <= count; x += 8 )
+        {
+            auto*       dst = reinterpret_cast<__m256i*>( row + x );
+            const auto* src = reinterpret_cast<const __m256i*>( source + x );
+
+            _mm256_storeu_si256(
+                dst, _mm256_add_epi32( _mm256_loadu_si256( dst ), _mm256_loadu_si256( src ) ) );
+        }
+
+        add_scalar( row + x, source + x, count - x );
+    }
+
+    FJORD_SIMD_TARGET( "avx2" ) __m256i mul_fixed_avx2( __m256i a, __m256i b )
+    {
+        const __m256i even = _mm256_mul_epi32( a, b );
+        const __m256i odd
+            = _mm256_mul_epi32( _mm256_srli_epi64( a, 32 ), _mm256_srli_epi64( b, 32 ) );
+
+        // NOTE: Products of the even lanes are in the low halves, of the odd ones in the high
+        return _mm256_blend_epi32(
+            _mm256_srli_epi64( even, pixel_fraction_bits ),
+            _mm256_slli_epi64( _mm256_srli_epi64( odd, pixel_fraction_bits ), 32 ),
+            0xAA );
+    }
+
+    FJORD_SIMD_TARGET( "avx2" ) void mul_avx2( Pixel* row, const Pixel* source, int count )
+    {
+        int x = 0;
+        for ( ; x + 8 <= count; x += 8 )
+        {
+            auto*       dst = reinterpret_cast<__m256i*>( row + x );
+            const auto* src = reinterpret_cast<const __m256i*>( source + x );
+
+            _mm256_storeu_si256(
+                dst, mul_fixed_avx2( _mm256_loadu_si256( dst ), _mm256_loadu_si256( src ) ) );
+        }
+
+        mul_scalar( row + x, source + x, count - x );
+    }
+
+    constexpr Kernels avx2_kernels = { clear_avx2, add_avx2, mul_avx2 };
+
+    [[nodiscard]] bool is_avx2_supported()
+    {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+        int registers[4];
+
+        __cpuid( registers, 0 );
+        if ( registers[0] < 7 )
+            return false;
+
+        // NOTE: The system must save the YMM registers on the context switches too
+        __cpuid( registers, 1 );
+        constexpr int osxsave_avx = ( 1 << 27 ) | ( 1 << 28 );
+        if ( ( registers[2] & osxsave_avx ) != osxsave_avx || ( _xgetbv( 0 ) & 6 ) != 6 )
+            return false;
+
+        __cpuidex( registers, 7, 0 );
+        return ( registers[1] & ( 1 << 5 ) ) != 0;
+#else
+        return __builtin_cpu_supports( "avx2" );
+#endif
+    }
+
+    [[nodiscard]] bool is_sse2_supported()
+    {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+        int registers[4];
+
+        __cpuid( registers, 1 );
+        return ( registers[3] & ( 1 << 26 ) ) != 0;
+#else
+        return __builtin_cpu_supports( "sse2" );
+#endif
+    }
+#endif
+
+    [[nodiscard]] Kernels kernels_of( simd::Level level )
+    {
+        switch ( level )
+        {
+#if FJORD_SIMD_X86
+        case simd::Level::avx2:
+            return avx2_kernels;
+
+        case simd::Level::sse2:
+            return sse2_kernels;
+#endif
+
+        default:
+            return scalar_kernels;
+        }
+    }
+
+    struct Selection final
+    {
+        Kernels     kernels;
+        simd::Level level;
+    };
+
+    [[nodiscard]] Selection& selection()
+    {
+        // NOTE: The initialization of the local static is thread-safe, so the kernels are selected
+        // once by the first thread using them and then they're only read
+        static Selection selected{ kernels_of( simd::supported_level() ),
+                                   simd::supported_level() };
+
+        return selected;
+    }
+} // namespace
+
+simd::Level simd::supported_level()
+{
+#if FJORD_SIMD_X86
+    if ( is_avx2_supported() )
+        return Level::avx2;
+
+    if ( is_sse2_supported() )
+        return Level::sse2;
+#endif
+
+    return Level::scalar;
+}
+
+bool simd::set_level( Level level )
+{
+    if ( static_cast<int>( level ) > static_cast<int>( supported_level() ) )
+        return false;
+
+    selection() = { kernels_of( level ), level };
+    return true;
+}
+
+simd::Level simd::level()
+{
+    return selection().level;
+}
+
+const char* simd::level_name( Level level )
+{
+    switch ( level )
+    {
+    case Level::sse2:
+        return "sse2";
+
+    case Level::avx2:
+        return "avx2";
+
+    default:
+        return "scalar";
+    }
+}
+
+void simd::clear( Pixel* row, int count )
+{
+    selection().kernels.clear( row, count );
+}
+
+void simd::add( Pixel* row, const Pixel* source, int count )
+{
+    selection().kernels.add( row, source, count );
+}
+
+void simd::mul( Pixel* row, const Pixel* source, int count )
+{
+    selection().kernels.mul( row, source, count );
+}
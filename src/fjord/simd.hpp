@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include "pixel.hpp"
+
+namespace fjord
+{
+    /**
+     * @brief Kernels of the rows of the planes, vectorized by the instruction set of the
+     * processor, which is detected at runtime.
+     *
+     * The results are the same at every level, so the level only changes the speed.
+     */
+    namespace simd
+    {
+        enum class Level
+        {
+            scalar,
+            sse2,
+            avx2
+        };
+
+        /**
+         * @brief Returns the best level supported by the processor.
+         */
+        [[nodiscard]] Level supported_level();
+
+        /**
+         * @brief Selects the kernels of the level, e.g. to compare them. The kernels of the best
+         * level are selected on the first use otherwise.
+         *
+         * @note Not thread-safe, the kernels must not be used by other threads meanwhile
+         *
+         * @return false if the processor doesn't support the level
+         */
+        bool set_level( Level level );
+
+        [[nodiscard]] Level level();
+
+        [[nodiscard]] const char* level_name( Level level );
+
+        void clear( Pixel* row, int count );
+
+        void add( Pixel* row, const Pixel* source, int count );
+
+        void mul( Pixel* row, const Pixel* source, int count );
+    } // namespace simd
+} // namespace fjord
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "trace.hpp"
+
+#if FJORD_ENABLE_TRACE
+
+    #include <rtl/algorithm.hpp>
+
+    #include <atomic>
+
+using namespace fjord;
+
+namespace
+{
+    constexpr rtl::size_t ring_buffer_capacity = 1 << 16;
+
+    struct Event
+    {
+        const char*     name;
+        profiler::Ticks begin;
+        profiler::Ticks end;
+    };
+
+    struct RingBuffer
+    {
+        RingBuffer*                next;
+        std::atomic<bool>          in_use;
+        unsigned                   thread_index;
+        std::atomic<rtl::uint64_t> head;
+        Event                      events[ring_buffer_capacity];
+    };
+
+    std::atomic<RingBuffer*> g_buffers{ nullptr };
+    std::atomic<unsigned>    g_thread_count{ 0 };
+
+    /**
+     * @brief Takes the buffer released by the exited thread or allocates the new one, so there
+     * are no more buffers than the threads alive at once.
+     */
+    RingBuffer* acquire_buffer()
+    {
+        const unsigned thread_index = g_thread_count.fetch_add( 1 );
+
+        for ( RingBuffer* buffer = g_buffers.load( std::memory_order_acquire ); buffer;
+              buffer = buffer->next )
+        {
+            bool in_use = false;
+            if ( buffer->in_use.compare_exchange_strong( in_use, true, std::memory_order_acquire ) )
+            {
+                // NOTE: The events of the exited thread are kept until now, e.g. for the dump
+                // after the workers are joined
+                buffer->thread_index = thread_index;
+                buffer->head.store( 0, std::memory_order_release );
+                return buffer;
+            }
+        }
+
+        auto* buffer = new RingBuffer;
+        buffer->in_use.store( true, std::memory_order_relaxed );
+        buffer->thread_index = thread_index;
+        buffer->head.store( 0, std::memory_order_relaxed );
+
+        // NOTE: Lock-free push to the list of buffers, which is never shrunk
+        buffer->next = g_buffers.load( std::memory_order_relaxed );
+        while ( !g_buffers.compare_exchange_weak(
+            buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed ) )
+        {
+        }
+
+        return buffer;
+    }
+
+    /**
+     * @brief Releases the buffer of the thread when it exits.
+     */
+    class Registration final
+    {
+    public:
+        Registration() = default;
+
+        ~Registration()
+        {
+            if ( buffer )
+                buffer->in_use.store( false, std::memory_order_release );
+        }
+
+        RingBuffer* buffer{ nullptr };
+
+    private:
+        Registration( const Registration& ) = delete;
+        Registration& operator=( const Registration& ) = delete;
+    };
+
+    thread_local Registration t_registration;
+
+    class Output final
+    {
+    public:
+        Output( trace::Writer writer, void* context )
+            : m_writer( writer )
+            , m_context( context )
+        {
+        }
+
+        ~Output()
+        {
+            flush();
+        }
+
+        void put( const char* str )
+        {
+            for ( ; *str; ++str )
+                put( *str );
+        }
+
+        void put( char c )
+        {
+            if ( m_size == sizeof( m_buffer ) )
+                flush();
+
+            m_buffer[m_size++] = c;
+        }
+
+        void put( rtl::uint64_t value )
+        {
+            char digits[20];
+            int  count = 0;
+
+            do
+            {
+                digits[count++] = static_cast<char>( '0' + value % 10 );
+                value /= 10;
+            } while ( value );
+
+            while ( count )
+                put( digits[--count] );
+        }
+
+        /**
+         * @brief Puts the clock ticks as microseconds.
+         */
+        void put_microseconds( profiler::Ticks ticks )
+        {
+            const auto frequency = profiler::frequency();
+
+            // NOTE: Splitting to avoid the overflow of 64-bit intermediate values
+            const rtl::uint64_t ns = ticks / frequency * 1000000000u
+                                     + ticks % frequency * 1000000000u / frequency;
+
+            put( ns / 1000 );
+            put( '.' );
+            put( static_cast<char>( '0' + ns / 100 % 10 ) );
+            put( static_cast<char>( '0' + ns / 10 % 10 ) );
+            put( static_cast<char>( '0' + ns % 10 ) );
+        }
+
+    private:
+        void flush()
+        {
+            if ( m_size )
+                m_writer( m_buffer, m_size, m_context );
+
+            m_size = 0;
+        }
+
+        trace::Writer m_writer;
+        void*         m_context;
+        char          m_buffer[4096];
+        rtl::size_t   m_size{ 0 };
+    };
+} // namespace
+
+void trace::record( const char* name, profiler::Ticks begin, profiler::Ticks end )
+{
+    RingBuffer*& buffer = t_registration.buffer;
+
+    if ( !buffer )
+        buffer = acquire_buffer();
+
+    const auto head = buffer->head.load( std::memory_order_relaxed );
+
+    Event& event = buffer->events[head % ring_buffer_capacity];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+
+    buffer->head.store( head + 1, std::memory_order_release );
+}
+
+void trace::dump( Writer writer, void* context )
+{
+    Output output( writer, context );
+
+    const RingBuffer* buffers = g_buffers.load( std::memory_order_acquire );
+
+    // NOTE: The earliest event is the origin of the timeline
+    profiler::Ticks start_ticks = ~profiler::Ticks( 0 );
+
+    for ( const RingBuffer* buffer = buffers; buffer; buffer = buffer->next )
+    {
+        const auto head = buffer->head.load( std::memory_order_acquire );
+        const auto tail = head > ring_buffer_capacity ? head - ring_buffer_capacity : 0;
+
+        for ( auto i = tail; i < head; ++i )
+            start_ticks = rtl::min( start_ticks, buffer->events[i % ring_buffer_capacity].begin );
+    }
+
+    output.put( "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" );
+
+    bool first = true;
+
+    for ( const RingBuffer* buffer = buffers; buffer; buffer = buffer->next )
+    {
+        const auto head = buffer->head.load( std::memory_order_acquire );
+        const auto tail = head > ring_buffer_capacity ? head - ring_buffer_capacity : 0;
+
+        for ( auto i = tail; i < head; ++i )
+        {
+            const Event& event = buffer->events[i % ring_buffer_capacity];
+
+            output.put( first ? "\n" : ",\n" );
+            first = false;
+
+            output.put( "{\"ph\":\"X\",\"pid\":1,\"tid\":" );
+            output.put( rtl::uint64_t( buffer->thread_index ) );
+            output.put( ",\"name\":\"" );
+            output.put( event.name );
+            output.put( "\",\"ts\":" );
+            output.put_microseconds( event.begin - start_ticks );
+            output.put( ",\"dur\":" );
+            output.put_microseconds( event.end - event.begin );
+            output.put( '}' );
+        }
+    }
+
+    output.put( "\n]}\n" );
+}
+
+#else
+
+void fjord::trace::record( const char*, profiler::Ticks, profiler::Ticks )
+{
+}
+
+void fjord::trace::dump( Writer writer, void* context )
+{
+    constexpr char empty_trace[] = "{\"traceEvents\":[]}\n";
+    writer( empty_trace, sizeof( empty_trace ) - 1, context );
+}
+
+#endif
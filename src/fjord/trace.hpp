@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <rtl/int.hpp>
+
+#include "profiler.hpp"
+
+namespace fjord
+{
+    /**
+     * @brief Timeline of the scoped zones in the Chrome trace event format.
+     *
+     * Every thread records its zones into its own ring buffer without locking, so only the most
+     * recent events are kept. The buffer of the exited thread is taken over by the next new one,
+     * so the pools don't pile up the buffers. The buffers are dumped as JSON, which can be opened
+     * with chrome://tracing or Perfetto UI.
+     */
+    namespace trace
+    {
+        /**
+         * @brief Destination of the dumped trace data.
+         */
+        using Writer = void ( * )( const char* data, rtl::size_t size, void* context );
+
+        /**
+         * @brief Records the zone event to the ring buffer of the calling thread.
+         *
+         * @param name Must be a string with static storage duration
+         */
+        void record( const char* name, profiler::Ticks begin, profiler::Ticks end );
+
+        /**
+         * @brief Writes the events recorded by all threads as Chrome trace JSON.
+         *
+         * @note Events recorded concurrently with the dumping may be lost or torn.
+         */
+        void dump( Writer writer, void* context );
+
+        class Zone final
+        {
+        public:
+            explicit Zone( const char* name )
+                : m_name( name )
+                , m_begin( profiler::now() )
+            {
+            }
+
+            ~Zone()
+            {
+                record( m_name, m_begin, profiler::now() );
+            }
+
+        private:
+            Zone( const Zone& ) = delete;
+            Zone& operator=( const Zone& ) = delete;
+
+            const char*     m_name;
+            profiler::Ticks m_begin;
+        };
+    } // namespace trace
+} // namespace fjord
+
+#if FJORD_ENABLE_TRACE
+    #define FJORD_TRACE_CONCAT_( a, b ) a##b
+    #define FJORD_TRACE_CONCAT( a, b ) FJORD_TRACE_CONCAT_( a, b )
+    #define FJORD_TRACE_ZONE( name )                                                               \
+        fjord::trace::Zone FJORD_TRACE_CONCAT( trace_zone_, __LINE__ )( name )
+#else
+    #define FJORD_TRACE_ZONE( name )
+#endif
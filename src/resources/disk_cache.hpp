@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <rtl/int.hpp>
+#include <rtl/sys/debug.hpp>
+#include <rtl/sys/filesystem.hpp>
+
+#include <fjord/decoder.hpp>
+
+#include "gallery.hpp"
+
+// NOTE: Declared here instead of including <Windows.h> to prevent global namespace pollution
+extern "C" __declspec( dllimport ) void* __stdcall CreateFileW( const wchar_t* file_name,
+                                                               unsigned long  desired_access,
+                                                               unsigned long  share_mode,
+                                                               void*          security_attributes,
+                                                               unsigned long  creation_disposition,
+                                                               unsigned long  flags_and_attributes,
+                                                               void*          template_file );
+extern "C" __declspec( dllimport ) int __stdcall GetFileSizeEx( void* file, rtl::int64_t* size );
+extern "C" __declspec( dllimport ) void* __stdcall CreateFileMappingW( void*          file,
+                                                                      void*          attributes,
+                                                                      unsigned long  protect,
+                                                                      unsigned long  size_high,
+                                                                      unsigned long  size_low,
+                                                                      const wchar_t* name );
+extern "C" __declspec( dllimport ) void* __stdcall MapViewOfFile( void*         mapping,
+                                                                 unsigned long desired_access,
+                                                                 unsigned long offset_high,
+                                                                 unsigned long offset_low,
+                                                                 rtl::size_t   size );
+extern "C" __declspec( dllimport ) int __stdcall UnmapViewOfFile( const void* base_address );
+extern "C" __declspec( dllimport ) int __stdcall CloseHandle( void* handle );
+extern "C" __declspec( dllimport ) int __stdcall MoveFileExW( const wchar_t* existing_file_name,
+                                                             const wchar_t* new_file_name,
+                                                             unsigned long  flags );
+extern "C" __declspec( dllimport ) int __stdcall DeleteFileW( const wchar_t* file_name );
+
+/**
+ * @brief Persistent cache of the decoded output planes snapshots.
+ *
+ * Snapshots are stored in the cache directory as separate files named by the snapshot key, see
+ * fjord::Decoder::snapshot_key. The cache is opt-in: nothing is read or written unless the cache
+ * directory exists.
+ *
+ * The snapshot files are mapped, so the restored output planes are the pages of the file. They are
+ * written to the temporary file first and renamed into place, so there's no partial snapshot even
+ * if the viewer is closed while writing.
+ */
+class DiskCache final
+{
+public:
+    /**
+     * @brief Maps the snapshot stored with the specified key.
+     *
+     * The pages are copied on write, so the restored planes never change the file.
+     *
+     * @return Empty picture if there is no such snapshot
+     */
+    static Picture load( rtl::uint64_t key )
+    {
+        Picture snapshot( unmap_deleter );
+
+        Path path;
+        make_path( key, extension, path );
+
+        void* f = CreateFileW( path,
+                               generic_read,
+                               file_share_read,
+                               nullptr,
+                               open_existing,
+                               file_attribute_normal,
+                               nullptr );
+
+        // NOTE: INVALID_HANDLE_VALUE
+        if ( f == reinterpret_cast<void*>( -1 ) )
+            return snapshot;
+
+        rtl::int64_t size = 0;
+
+        // NOTE: The empty file cannot be mapped
+        void* mapping = GetFileSizeEx( f, &size ) && size > 0
+                            ? CreateFileMappingW( f, nullptr, page_writecopy, 0, 0, nullptr )
+                            : nullptr;
+
+        // NOTE: The view keeps the mapping and the file open
+        const void* view = mapping ? MapViewOfFile( mapping, file_map_copy, 0, 0, 0 ) : nullptr;
+
+        if ( mapping )
+            CloseHandle( mapping );
+
+        CloseHandle( f );
+
+        if ( !view )
+            return snapshot;
+
+        snapshot.data.reset( static_cast<const rtl::uint8_t*>( view ) );
+        snapshot.size = static_cast<size_t>( size );
+
+        RTL_LOG( "Snapshot %S: %zu bytes mapped", path, snapshot.size );
+
+        return snapshot;
+    }
+
+    static void store( rtl::uint64_t key, const fjord::Decoder& decoder )
+    {
+        const size_t size = decoder.snapshot_size();
+
+        rtl::uint8_t* buffer = new rtl::uint8_t[size];
+
+        // NOTE: Nothing is written unless the snapshot is taken
+        if ( decoder.snapshot( key, buffer, size ) )
+        {
+            Path path;
+            make_path( key, extension, path );
+
+            Path temporary_path;
+            make_path( key, temporary_extension, temporary_path );
+
+            size_t bytes_written = 0;
+
+            {
+                file f = file::open(
+                    temporary_path, file::access::write_only, file::mode::create_always );
+                if ( f )
+                    bytes_written = f.write( buffer, size );
+            }
+
+            if ( bytes_written != size
+                 || !MoveFileExW( temporary_path, path, movefile_replace_existing ) )
+                DeleteFileW( temporary_path );
+
+            RTL_LOG( "Snapshot %S: %zu bytes written", path, bytes_written );
+        }
+
+        delete[] buffer;
+    }
+
+private:
+    using file = rtl::filesystem::file;
+
+    // NOTE: Directory name + separator + 16 hex digits + longest extension + terminator
+    using Path = wchar_t[40];
+
+    static constexpr wchar_t extension[] = L".fjdc";
+    static constexpr wchar_t temporary_extension[] = L".fjdc.tmp";
+
+    static constexpr unsigned long generic_read = 0x80000000;
+    static constexpr unsigned long file_share_read = 0x00000001;
+    static constexpr unsigned long open_existing = 3;
+    static constexpr unsigned long file_attribute_normal = 0x00000080;
+    static constexpr unsigned long page_writecopy = 0x08;
+    static constexpr unsigned long file_map_copy = 0x0001;
+    static constexpr unsigned long movefile_replace_existing = 0x00000001;
+
+    static void make_path( rtl::uint64_t key, const wchar_t* file_extension, Path& path )
+    {
+        constexpr wchar_t directory[] = L"fjord.cache\\";
+
+        wchar_t* p = path;
+
+        for ( const wchar_t* s = directory; *s; )
+            *p++ = *s++;
+
+        for ( int shift = 60; shift >= 0; shift -= 4 )
+            *p++ = L"0123456789abcdef"[( key >> shift ) & 0xf];
+
+        for ( const wchar_t* s = file_extension; *s; )
+            *p++ = *s++;
+
+        *p = L'\0';
+    }
+
+    static void unmap_deleter( const rtl::uint8_t* p )
+    {
+        UnmapViewOfFile( p );
+    }
+};
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <rtl/int.hpp>
+
+#include <fjord/size.hpp>
+
+/**
+ * @brief LRU cache of the final RGB888 frames.
+ *
+ * Frames are keyed by the hash of the picture data and the target size, so revisiting a picture
+ * costs only a blit instead of loading and iterating it again. Total size of the cached pixels
+ * is bounded by the byte budget, the least recently used frames are evicted first.
+ */
+class FrameCache final
+{
+public:
+    struct Key
+    {
+        rtl::uint64_t content_hash;
+        fjord::Size   target_size;
+
+        [[nodiscard]] constexpr bool operator==( const Key& rhs ) const
+        {
+            return content_hash == rhs.content_hash && target_size == rhs.target_size;
+        }
+    };
+
+    struct Frame
+    {
+        Key           key;
+        fjord::Size   source_size;
+        rtl::uint8_t* pixels;
+        rtl::size_t   size_in_bytes;
+
+        Frame* prev;
+        Frame* next;
+    };
+
+    struct Statistics
+    {
+        unsigned    hits;
+        unsigned    misses;
+        unsigned    evictions;
+        unsigned    frames;
+        rtl::size_t bytes;
+    };
+
+    explicit FrameCache( rtl::size_t budget_in_bytes )
+        : m_budget( budget_in_bytes )
+    {
+        for ( auto& frame : m_frames )
+            frame.pixels = nullptr;
+    }
+
+    ~FrameCache()
+    {
+        for ( auto& frame : m_frames )
+            delete[] frame.pixels;
+    }
+
+    /**
+     * @brief Looks up the frame and marks it as the most recently used.
+     *
+     * @return nullptr on miss. The frame pointer stays valid until the next \insert call.
+     */
+    const Frame* find( const Key& key )
+    {
+        for ( Frame* frame = m_head; frame; frame = frame->next )
+        {
+            if ( frame->key == key )
+            {
+                unlink( frame );
+                link_front( frame );
+
+                ++m_statistics.hits;
+                return frame;
+            }
+        }
+
+        ++m_statistics.misses;
+        return nullptr;
+    }
+
+    /**
+     * @brief Copies the frame into the cache evicting the least recently used frames if needed.
+     *
+     * @return false if the frame is larger than the whole budget
+     */
+    bool insert( const Key&          key,
+                 const fjord::Size&  source_size,
+                 const rtl::uint8_t* pixels,
+                 rtl::size_t         pitch_in_bytes )
+    {
+        const rtl::size_t row_size = static_cast<rtl::size_t>( key.target_size.w ) * rgb888_size;
+        const rtl::size_t size = row_size * static_cast<rtl::size_t>( key.target_size.h );
+
+        if ( size > m_budget )
+            return false;
+
+        while ( m_statistics.bytes + size > m_budget || m_statistics.frames == max_frames )
+            evict( m_tail );
+
+        Frame* frame = nullptr;
+        for ( auto& f : m_frames )
+        {
+            if ( !f.pixels )
+            {
+                frame = &f;
+                break;
+            }
+        }
+
+        frame->key = key;
+        frame->source_size = source_size;
+        frame->size_in_bytes = size;
+        frame->pixels = new rtl::uint8_t[size];
+
+        rtl::uint8_t* dst = frame->pixels;
+        for ( int y = 0; y < key.target_size.h; ++y )
+        {
+            for ( rtl::size_t x = 0; x < row_size; ++x )
+                *dst++ = pixels[x];
+
+            pixels += pitch_in_bytes;
+        }
+
+        link_front( frame );
+
+        m_statistics.frames++;
+        m_statistics.bytes += size;
+
+        return true;
+    }
+
+    static void blit( const Frame& frame, rtl::uint8_t* pixels, rtl::size_t pitch_in_bytes )
+    {
+        const rtl::size_t row_size
+            = static_cast<rtl::size_t>( frame.key.target_size.w ) * rgb888_size;
+
+        const rtl::uint8_t* src = frame.pixels;
+        for ( int y = 0; y < frame.key.target_size.h; ++y )
+        {
+            for ( rtl::size_t x = 0; x < row_size; ++x )
+                pixels[x] = *src++;
+
+            pixels += pitch_in_bytes;
+        }
+    }
+
+    [[nodiscard]] const Statistics& statistics() const
+    {
+        return m_statistics;
+    }
+
+private:
+    FrameCache( const FrameCache& ) = delete;
+    FrameCache& operator=( const FrameCache& ) = delete;
+
+    static constexpr rtl::size_t rgb888_size = 3;
+    static constexpr unsigned    max_frames = 64;
+
+    void link_front( Frame* frame )
+    {
+        frame->prev = nullptr;
+        frame->next = m_head;
+
+        if ( m_head )
+            m_head->prev = frame;
+        else
+            m_tail = frame;
+
+        m_head = frame;
+    }
+
+    void unlink( Frame* frame )
+    {
+        if ( frame->prev )
+            frame->prev->next = frame->next;
+        else
+            m_head = frame->next;
+
+        if ( frame->next )
+            frame->next->prev = frame->prev;
+        else
+            m_tail = frame->prev;
+    }
+
+    void evict( Frame* frame )
+    {
+        unlink( frame );
+
+        delete[] frame->pixels;
+        frame->pixels = nullptr;
+
+        m_statistics.frames--;
+        m_statistics.bytes -= frame->size_in_bytes;
+        m_statistics.evictions++;
+    }
+
+    rtl::size_t m_budget;
+    Frame       m_frames[max_frames];
+    Frame*      m_head{ nullptr };
+    Frame*      m_tail{ nullptr };
+    Statistics  m_statistics{};
+};
@@ -10,11 +10,15 @@
  */
 #pragma once
 
+#include <rtl/algorithm.hpp>
 #include <rtl/array.hpp>
 #include <rtl/int.hpp>
 #include <rtl/pair.hpp>
 #include <rtl/sys/filesystem.hpp>
 
+#include <fjord/format.hpp>
+#include <fjord/size.hpp>
+
 using PictureDataDeleter = void ( * )( const rtl::uint8_t* );
 using PictureData = rtl::unique_ptr<const rtl::uint8_t[], PictureDataDeleter>;
 
@@ -53,6 +57,14 @@ public:
             m_iterator = m_array.begin();
     }
 
+    void previous()
+    {
+        if ( m_iterator == m_array.begin() || m_iterator == m_array.end() )
+            m_iterator = m_array.end() - 1;
+        else
+            --m_iterator;
+    }
+
     Picture picture()
     {
         Picture picture( dummy_array_deleter );
@@ -67,6 +79,9 @@ public:
     }
 
 private:
+    Gallery( const Gallery& ) = delete;
+    Gallery& operator=( const Gallery& ) = delete;
+
     static void dummy_array_deleter( const rtl::uint8_t* )
     {
         // do nothing
@@ -88,40 +103,76 @@ class Gallery final
 public:
     Gallery()
     {
-        rewind();
+        refresh();
+    }
+
+    ~Gallery()
+    {
+        delete[] m_entries;
+        delete[] m_buckets;
     }
 
     void next()
     {
-        if ( m_iterator != Iterator() )
+        if ( m_index + 1 < m_count )
         {
-            ++m_iterator;
+            ++m_index;
+            return;
+        }
 
-            if ( advance() )
-                return;
+        // NOTE: Wrapping around is a good moment to pick up the changes of the directory
+        refresh();
+        m_index = 0;
+    }
+
+    void previous()
+    {
+        if ( m_index > 0 )
+        {
+            --m_index;
+            return;
         }
 
-        rewind();
+        refresh();
+        m_index = m_count ? m_count - 1 : 0;
+    }
+
+    void select( size_t index )
+    {
+        if ( index < m_count )
+            m_index = index;
+    }
+
+    [[nodiscard]] size_t count() const
+    {
+        return m_count;
+    }
+
+    [[nodiscard]] size_t index() const
+    {
+        return m_index;
     }
 
     Picture picture()
     {
         using rtl::filesystem::file;
 
-        if ( m_iterator == Iterator() )
+        if ( m_index >= m_count )
             return Picture( default_array_deleter );
 
-        const Entry& entry = *m_iterator;
+        const Entry& entry = m_entries[m_index];
 
-        const size_t file_size = static_cast<size_t>( entry.file_size() );
+        const size_t file_size = static_cast<size_t>( entry.file_size );
 
         // TODO: Replace %S by %s and use conversion wide string -> mb string
-        RTL_LOG( "Reading %i bytes from file '%S'...", file_size, entry.path().c_str() );
-
-        rtl::uint8_t* buffer = new rtl::uint8_t[file_size];
+        RTL_LOG( "Reading %i bytes from file '%S'...", file_size, entry.path.c_str() );
 
         file f = file::open(
-            entry.path().c_str(), file::access::read_only, file::mode::open_existing );
+            entry.path.c_str(), file::access::read_only, file::mode::open_existing );
+        if ( !f )
+            return Picture( default_array_deleter );
+
+        rtl::uint8_t* buffer = new rtl::uint8_t[file_size];
 
         [[maybe_unused]] auto bytes_read = f.read( buffer, file_size );
         RTL_ASSERT( bytes_read == file_size );
@@ -139,9 +190,47 @@ private:
 
     using Path = rtl::filesystem::path;
     using Iterator = rtl::filesystem::directory_iterator;
-    using Entry = rtl::filesystem::directory_entry;
+    using DirectoryEntry = rtl::filesystem::directory_entry;
+    using FileTime = rtl::filesystem::file_time_type;
+
+    /**
+     * @brief Index record of a single validated FJORD file.
+     *
+     * Holds everything the gallery needs to know about the file without touching the disk again:
+     * file attributes to detect the changes and header fields to describe the picture.
+     */
+    struct Entry
+    {
+        Path           path;
+        rtl::uintmax_t file_size;
+        FileTime       write_time;
+        rtl::size_t    path_hash;
+        fjord::Size    image_size;
+        rtl::uint32_t  block_count;
+        unsigned       iteration_count;
+    };
+
+    // NOTE: Image header + channels + IFS signature + IFS header
+    static constexpr size_t max_header_size
+        = sizeof( fjord::format::headers::Image )
+          + sizeof( fjord::format::headers::Channel )
+                * fjord::format::constraints::max_channels_count
+          + sizeof( rtl::uint32_t ) + sizeof( fjord::format::headers::IteratedFunctionSystem );
+
+    static constexpr size_t no_entry = ~size_t( 0 );
+
+    [[nodiscard]] static rtl::size_t hash( const wchar_t* str )
+    {
+        // FNV-1a
+        rtl::size_t h = 2166136261u;
+
+        for ( ; *str; ++str )
+            h = ( h ^ static_cast<rtl::size_t>( *str ) ) * 16777619u;
 
-    static bool is_fjord_file( const Entry& entry )
+        return h;
+    }
+
+    static bool is_fjord_candidate( const DirectoryEntry& entry )
     {
         if ( !entry.is_regular_file() )
             return false;
@@ -156,41 +245,178 @@ private:
         if ( file_size > fjord::format::constraints::max_file_size )
             return false;
 
-        rtl::uint32_t buffer;
+        return true;
+    }
+
+    /**
+     * @brief Reads and validates the file headers.
+     *
+     * @return false if the file is not a FJORD file that the decoder is able to load
+     */
+    static bool read_header( Entry& entry )
+    {
+        using namespace fjord::format;
 
         file f = file::open(
-            entry.path().c_str(), file::access::read_only, file::mode::open_existing );
+            entry.path.c_str(), file::access::read_only, file::mode::open_existing );
         if ( !f )
             return false;
 
-        [[maybe_unused]] auto bytes_read = f.read( &buffer, sizeof( buffer ) );
-        RTL_ASSERT( bytes_read == sizeof( buffer ) );
+        rtl::uint8_t buffer[max_header_size];
+
+        const size_t bytes_read
+            = f.read( buffer, rtl::min( sizeof( buffer ), size_t( entry.file_size ) ) );
+        if ( bytes_read < sizeof( headers::Image ) )
+            return false;
+
+        const auto* image_info = reinterpret_cast<const headers::Image*>( buffer );
+
+        if ( image_info->signature != signatures::pifs || image_info->version != versions::v2
+             || image_info->codec != signatures::iyuv
+             || image_info->image_channels_count > constraints::max_channels_count )
+            return false;
 
-        return buffer == fjord::format::signatures::pifs;
+        const size_t ifs_offset = sizeof( headers::Image )
+                                  + sizeof( headers::Channel ) * image_info->image_channels_count;
+
+        if ( bytes_read < ifs_offset + sizeof( rtl::uint32_t )
+                              + sizeof( headers::IteratedFunctionSystem ) )
+            return false;
+
+        if ( *reinterpret_cast<const rtl::uint32_t*>( buffer + ifs_offset ) != signatures::fjrd )
+            return false;
+
+        const auto* ifs_info = reinterpret_cast<const headers::IteratedFunctionSystem*>(
+            buffer + ifs_offset + sizeof( rtl::uint32_t ) );
+
+        if ( ifs_info->block_count > constraints::max_ifs_blocks_count )
+            return false;
+
+        if ( ifs_info->region_count > constraints::max_regions_count )
+            return false;
+
+        if ( (size_t)image_info->image_width * image_info->image_height
+             > constraints::max_image_size * constraints::max_image_size )
+            return false;
+
+        entry.image_size = fjord::Size::create( image_info->image_width, image_info->image_height );
+        entry.block_count = ifs_info->block_count;
+        entry.iteration_count = ifs_info->iteration_count;
+
+        return true;
+    }
+
+    /**
+     * @brief Looks up the entry of the current index by the file path.
+     *
+     * @return Index of the entry or \no_entry
+     */
+    [[nodiscard]] size_t find( const Path& path, rtl::size_t path_hash ) const
+    {
+        if ( !m_bucket_count )
+            return no_entry;
+
+        const size_t bucket_mask = m_bucket_count - 1;
+
+        for ( size_t i = path_hash & bucket_mask;; i = ( i + 1 ) & bucket_mask )
+        {
+            const size_t index = m_buckets[i];
+
+            if ( index == no_entry )
+                return no_entry;
+
+            const Entry& entry = m_entries[index];
+            if ( entry.path_hash == path_hash && entry.path == path )
+                return index;
+        }
     }
 
-    void rewind()
+    void rebuild_buckets()
     {
-        m_iterator = Iterator( Path( L"." ) );
-        advance();
+        delete[] m_buckets;
+
+        // NOTE: Power of two and load factor not above 1/2
+        m_bucket_count = 16;
+        while ( m_bucket_count < m_count * 2 )
+            m_bucket_count <<= 1;
+
+        m_buckets = new size_t[m_bucket_count];
+        rtl::fill_n( m_buckets, m_bucket_count, no_entry );
+
+        for ( size_t index = 0; index < m_count; ++index )
+        {
+            size_t i = m_entries[index].path_hash & ( m_bucket_count - 1 );
+            while ( m_buckets[i] != no_entry )
+                i = ( i + 1 ) & ( m_bucket_count - 1 );
+
+            m_buckets[i] = index;
+        }
     }
 
-    bool advance()
+    /**
+     * @brief Synchronizes the index with the directory contents.
+     *
+     * Only new files and files whose size or modification time have changed are opened to
+     * validate their headers, the rest of the entries are taken from the previous index.
+     */
+    void refresh()
     {
-        bool found = false;
+        size_t capacity = rtl::max( m_count, size_t( 16 ) );
+        size_t count = 0;
+        Entry* entries = new Entry[capacity];
+
+        [[maybe_unused]] size_t headers_read = 0;
 
-        for ( ; m_iterator != Iterator(); ++m_iterator )
+        for ( Iterator it( Path( L"." ) ); it != Iterator(); ++it )
         {
-            const Entry& entry = *m_iterator;
+            const DirectoryEntry& directory_entry = *it;
+
+            if ( !is_fjord_candidate( directory_entry ) )
+                continue;
 
-            if ( is_fjord_file( entry ) )
+            if ( count == capacity )
             {
-                found = true;
-                break;
+                capacity <<= 1;
+
+                Entry* grown = new Entry[capacity];
+                for ( size_t i = 0; i < count; ++i )
+                    grown[i] = entries[i];
+
+                delete[] entries;
+                entries = grown;
             }
+
+            Entry& entry = entries[count];
+            entry.path = directory_entry.path();
+            entry.path_hash = hash( entry.path.c_str() );
+            entry.file_size = directory_entry.file_size();
+            entry.write_time = directory_entry.last_write_time();
+
+            const size_t cached = find( entry.path, entry.path_hash );
+            if ( cached != no_entry && m_entries[cached].file_size == entry.file_size
+                 && m_entries[cached].write_time == entry.write_time )
+            {
+                entry = m_entries[cached];
+                ++count;
+                continue;
+            }
+
+            ++headers_read;
+
+            if ( read_header( entry ) )
+                ++count;
         }
 
-        return found;
+        RTL_LOG( "Gallery: %i files indexed, %i headers read", count, headers_read );
+
+        delete[] m_entries;
+        m_entries = entries;
+        m_count = count;
+
+        if ( m_index >= m_count )
+            m_index = 0;
+
+        rebuild_buckets();
     }
 
     static void default_array_deleter( const rtl::uint8_t* p )
@@ -198,7 +424,11 @@ private:
         delete[] p;
     }
 
-    Iterator m_iterator;
+    Entry*  m_entries{ nullptr };
+    size_t  m_count{ 0 };
+    size_t  m_index{ 0 };
+    size_t* m_buckets{ nullptr };
+    size_t  m_bucket_count{ 0 };
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include "int.hpp"
+
+namespace rtl
+{
+    template<typename T>
+    [[nodiscard]] constexpr const T& min( const T& a, const T& b )
+    {
+        return b < a ? b : a;
+    }
+
+    template<typename T>
+    [[nodiscard]] constexpr const T& max( const T& a, const T& b )
+    {
+        return a < b ? b : a;
+    }
+
+    template<typename T>
+    [[nodiscard]] constexpr const T& clamp( const T& value, const T& low, const T& high )
+    {
+        return value < low ? low : high < value ? high : value;
+    }
+
+    template<typename T>
+    [[nodiscard]] constexpr T abs( const T& value )
+    {
+        return value < T( 0 ) ? -value : value;
+    }
+
+    template<typename OutputIt, typename Size, typename T>
+    constexpr OutputIt fill_n( OutputIt first, Size count, const T& value )
+    {
+        for ( Size i = 0; i < count; ++i )
+            *first++ = value;
+
+        return first;
+    }
+
+    template<typename InputIt, typename Size, typename OutputIt>
+    constexpr OutputIt copy_n( InputIt first, Size count, OutputIt result )
+    {
+        for ( Size i = 0; i < count; ++i )
+            *result++ = *first++;
+
+        return result;
+    }
+
+    /**
+     * @brief Transforms the range in place.
+     */
+    template<typename ForwardIt, typename UnaryOperation>
+    constexpr void transform( ForwardIt first, ForwardIt last, UnaryOperation op )
+    {
+        for ( ; first != last; ++first )
+            *first = op( *first );
+    }
+} // namespace rtl
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include "int.hpp"
+
+namespace rtl
+{
+    namespace allocators
+    {
+        /**
+         * @brief Allocator of the fixed capacity, which is only able to free all its memory at once.
+         */
+        template<typename T, size_t Capacity>
+        class grow_only final
+        {
+        public:
+            [[nodiscard]] T* allocate( size_t count )
+            {
+                if ( count > Capacity - m_size )
+                    return nullptr;
+
+                T* p = m_storage + m_size;
+                m_size += count;
+
+                return p;
+            }
+
+            void reset()
+            {
+                m_size = 0;
+            }
+
+        private:
+            size_t m_size;
+            T      m_storage[Capacity];
+        };
+    } // namespace allocators
+} // namespace rtl
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include "int.hpp"
+
+#include <limits>
+
+namespace rtl
+{
+    /**
+     * @brief Fixed point number with \FractionBits bits of the fractional part.
+     */
+    template<typename T, int FractionBits>
+    class fix final
+    {
+    public:
+        using value_type = T;
+
+        static constexpr T one = T( 1 ) << FractionBits;
+
+        fix() = default;
+
+        constexpr explicit fix( int value )
+            : m_value( static_cast<T>( value * one ) )
+        {
+        }
+
+        constexpr explicit fix( float value )
+            : m_value( static_cast<T>( value * one ) )
+        {
+        }
+
+        [[nodiscard]] static constexpr fix from_raw( T value )
+        {
+            fix result;
+            result.m_value = value;
+            return result;
+        }
+
+        [[nodiscard]] static constexpr fix from_fraction( int numerator, int denominator )
+        {
+            // NOTE: The left shift of the negative value is undefined, so it's multiplied
+            return from_raw(
+                static_cast<T>( static_cast<int64_t>( numerator ) * one / denominator ) );
+        }
+
+        /**
+         * @brief The smallest positive value.
+         */
+        [[nodiscard]] static constexpr fix min()
+        {
+            return from_raw( 1 );
+        }
+
+        [[nodiscard]] static constexpr fix max()
+        {
+            return from_raw( std::numeric_limits<T>::max() );
+        }
+
+        [[nodiscard]] constexpr T raw() const
+        {
+            return m_value;
+        }
+
+        constexpr explicit operator int() const
+        {
+            return static_cast<int>( m_value / one );
+        }
+
+        constexpr explicit operator float() const
+        {
+            return static_cast<float>( m_value ) / one;
+        }
+
+        [[nodiscard]] constexpr fix operator-() const
+        {
+            return from_raw( -m_value );
+        }
+
+        constexpr fix& operator+=( fix rhs )
+        {
+            m_value += rhs.m_value;
+            return *this;
+        }
+
+        constexpr fix& operator-=( fix rhs )
+        {
+            m_value -= rhs.m_value;
+            return *this;
+        }
+
+        constexpr fix& operator*=( fix rhs )
+        {
+            m_value = static_cast<T>( ( static_cast<int64_t>( m_value ) * rhs.m_value )
+                                      >> FractionBits );
+            return *this;
+        }
+
+        constexpr fix& operator/=( fix rhs )
+        {
+            m_value = static_cast<T>( static_cast<int64_t>( m_value ) * one / rhs.m_value );
+            return *this;
+        }
+
+        [[nodiscard]] friend constexpr fix operator+( fix lhs, fix rhs )
+        {
+            return lhs += rhs;
+        }
+
+        [[nodiscard]] friend constexpr fix operator-( fix lhs, fix rhs )
+        {
+            return lhs -= rhs;
+        }
+
+        [[nodiscard]] friend constexpr fix operator*( fix lhs, fix rhs )
+        {
+            return lhs *= rhs;
+        }
+
+        [[nodiscard]] friend constexpr fix operator/( fix lhs, fix rhs )
+        {
+            return lhs /= rhs;
+        }
+
+        [[nodiscard]] friend constexpr fix operator*( fix lhs, int rhs )
+        {
+            return from_raw( static_cast<T>( lhs.m_value * rhs ) );
+        }
+
+        [[nodiscard]] friend constexpr fix operator*( int lhs, fix rhs )
+        {
+            return rhs * lhs;
+        }
+
+        [[nodiscard]] friend constexpr fix operator/( fix lhs, int rhs )
+        {
+            return from_raw( static_cast<T>( lhs.m_value / rhs ) );
+        }
+
+        [[nodiscard]] friend constexpr fix operator+( fix lhs, float rhs )
+        {
+            return lhs + fix( rhs );
+        }
+
+        [[nodiscard]] friend constexpr fix operator-( fix lhs, float rhs )
+        {
+            return lhs - fix( rhs );
+        }
+
+        [[nodiscard]] friend constexpr fix operator*( fix lhs, float rhs )
+        {
+            return from_raw( static_cast<T>( static_cast<float>( lhs.m_value ) * rhs ) );
+        }
+
+        [[nodiscard]] friend constexpr bool operator==( fix lhs, fix rhs )
+        {
+            return lhs.m_value == rhs.m_value;
+        }
+
+        [[nodiscard]] friend constexpr bool operator!=( fix lhs, fix rhs )
+        {
+            return lhs.m_value != rhs.m_value;
+        }
+
+        [[nodiscard]] friend constexpr bool operator<( fix lhs, fix rhs )
+        {
+            return lhs.m_value < rhs.m_value;
+        }
+
+        [[nodiscard]] friend constexpr bool operator>( fix lhs, fix rhs )
+        {
+            return lhs.m_value > rhs.m_value;
+        }
+
+        [[nodiscard]] friend constexpr bool operator<=( fix lhs, fix rhs )
+        {
+            return lhs.m_value <= rhs.m_value;
+        }
+
+        [[nodiscard]] friend constexpr bool operator>=( fix lhs, fix rhs )
+        {
+            return lhs.m_value >= rhs.m_value;
+        }
+
+        [[nodiscard]] friend constexpr bool operator<( fix lhs, int rhs )
+        {
+            return lhs < fix( rhs );
+        }
+
+        [[nodiscard]] friend constexpr bool operator>( fix lhs, int rhs )
+        {
+            return lhs > fix( rhs );
+        }
+
+    private:
+        T m_value;
+    };
+} // namespace rtl
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include "int.hpp"
+
+namespace rtl
+{
+    [[nodiscard]] constexpr uint32_t make_fourcc( char a, char b, char c, char d )
+    {
+        return static_cast<uint32_t>( static_cast<uint8_t>( a ) )
+               | static_cast<uint32_t>( static_cast<uint8_t>( b ) ) << 8
+               | static_cast<uint32_t>( static_cast<uint8_t>( c ) ) << 16
+               | static_cast<uint32_t>( static_cast<uint8_t>( d ) ) << 24;
+    }
+} // namespace rtl
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+// NOTE: The shim provides a portable subset of the rtl library used by the decoder core, so it
+// can be built with a standard toolchain on platforms the rtl library doesn't support.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace rtl
+{
+    using std::int16_t;
+    using std::int32_t;
+    using std::int64_t;
+    using std::int8_t;
+    using std::intmax_t;
+    using std::size_t;
+    using std::uint16_t;
+    using std::uint32_t;
+    using std::uint64_t;
+    using std::uint8_t;
+    using std::uintmax_t;
+} // namespace rtl
@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+namespace rtl
+{
+    /**
+     * @brief Returns the smallest n such that 2^n >= value.
+     */
+    [[nodiscard]] constexpr int ceil_log2_i( int value )
+    {
+        int n = 0;
+        while ( ( 1 << n ) < value )
+            ++n;
+
+        return n;
+    }
+} // namespace rtl
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include "int.hpp"
+
+namespace rtl
+{
+    /**
+     * @brief Pseudo-random numbers generator repeating the sequence every CycleLength numbers.
+     */
+    template<size_t CycleLength>
+    class random final
+    {
+    public:
+        void init( uint32_t seed )
+        {
+            for ( auto& value : m_values )
+            {
+                // NOTE: Numerical Recipes LCG
+                seed = seed * 1664525u + 1013904223u;
+                value = seed >> 8;
+            }
+
+            m_index = 0;
+        }
+
+        [[nodiscard]] uint32_t rand()
+        {
+            const uint32_t value = m_values[m_index];
+            m_index = ( m_index + 1 ) % CycleLength;
+
+            return value;
+        }
+
+    private:
+        uint32_t m_values[CycleLength];
+        size_t   m_index;
+    };
+} // namespace rtl
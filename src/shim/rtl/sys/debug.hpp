@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#if RTL_ENABLE_LOG || RTL_ENABLE_ASSERT
+    #include <cstdio>
+    #include <cstdlib>
+#endif
+
+#if RTL_ENABLE_LOG
+    #define RTL_LOG( ... )                                                                         \
+        do                                                                                         \
+        {                                                                                          \
+            std::fprintf( stderr, __VA_ARGS__ );                                                   \
+            std::fputc( '\n', stderr );                                                            \
+        } while ( false )
+#else
+    #define RTL_LOG( ... )                                                                         \
+        do                                                                                         \
+        {                                                                                          \
+        } while ( false )
+#endif
+
+#if RTL_ENABLE_ASSERT
+    #define RTL_ASSERT( expression )                                                               \
+        do                                                                                         \
+        {                                                                                          \
+            if ( !( expression ) )                                                                 \
+            {                                                                                      \
+                std::fprintf(                                                                      \
+                    stderr, "%s:%i: Assertion failed: %s\n", __FILE__, __LINE__, #expression );    \
+                std::abort();                                                                      \
+            }                                                                                      \
+        } while ( false )
+#else
+    #define RTL_ASSERT( expression )                                                               \
+        do                                                                                         \
+        {                                                                                          \
+        } while ( false )
+#endif
@@ -0,0 +1,741 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+// Benchmarks of the decoder.
+//
+// Micro-benchmarks measure the image kernels on synthetic planes, macro-benchmarks measure loading
+// and iterating the real files. Results are printed as JSON, every benchmark reports the time per
+// call and per processed pixel, so the numbers are comparable between the image sizes.
+
+#include <fjord/decoder.hpp>
+#include <fjord/image.hpp>
+#include <fjord/profiler.hpp>
+#include <fjord/program.hpp>
+#include <fjord/session.hpp>
+#include <fjord/simd.hpp>
+#include <fjord/windows.hpp>
+
+#include "files.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace fjord;
+
+namespace
+{
+    struct Options
+    {
+        std::vector<std::string> inputs;
+        std::string              output_path;
+        std::string              filter;
+        double                   min_time{ 0.25 }; // seconds per benchmark
+        int                      iterations{ -1 }; // iteration count stored in the file
+        unsigned                 threads{ std::max( 1u, std::thread::hardware_concurrency() ) };
+        bool                     micro{ true };
+        bool                     macro{ true };
+    };
+
+    struct Result
+    {
+        std::string name;
+        std::string params; // JSON object
+        double      pixels; // per call
+        unsigned    samples;
+        rtl::uint64_t calls;
+        double      ns_per_call_median;
+        double      ns_per_call_min;
+    };
+
+    class Runner final
+    {
+    public:
+        explicit Runner( const Options& options )
+            : m_options( options )
+        {
+        }
+
+        /**
+         * @brief Measures the function in batches of calls until the minimum time is reached.
+         *
+         * The batch size is calibrated so a batch lasts at least a few milliseconds, which hides
+         * the clock resolution. The median of the batches is reported as the most stable estimate.
+         */
+        template<typename Function>
+        void run( const char* name, const std::string& params, double pixels, Function fn )
+        {
+            if ( !m_options.filter.empty()
+                 && ( std::string( name ) + params ).find( m_options.filter ) == std::string::npos )
+                return;
+
+            const double frequency = static_cast<double>( profiler::frequency() );
+
+            const auto measure = [&]( rtl::uint64_t calls )
+            {
+                const auto start = profiler::now();
+
+                for ( rtl::uint64_t i = 0; i < calls; ++i )
+                    fn();
+
+                return static_cast<double>( profiler::now() - start ) * 1e9 / frequency;
+            };
+
+            // NOTE: Warming up the caches and calibrating the batch size
+            constexpr double min_batch_ns = 5e6;
+
+            rtl::uint64_t batch = 1;
+            for ( double ns = measure( batch ); ns < min_batch_ns && batch < ( 1u << 30 ); )
+            {
+                batch = ns > 0 ? std::max( batch * 2, static_cast<rtl::uint64_t>(
+                                                          batch * min_batch_ns / ns ) )
+                               : batch * 16;
+                ns = measure( batch );
+            }
+
+            constexpr unsigned min_samples = 5;
+
+            std::vector<double> samples;
+            double              total_ns = 0;
+
+            while ( samples.size() < min_samples || total_ns < m_options.min_time * 1e9 )
+            {
+                const double ns = measure( batch );
+
+                samples.push_back( ns / static_cast<double>( batch ) );
+                total_ns += ns;
+            }
+
+            std::sort( samples.begin(), samples.end() );
+
+            Result result;
+            result.name = name;
+            result.params = params;
+            result.pixels = pixels;
+            result.samples = static_cast<unsigned>( samples.size() );
+            result.calls = batch * samples.size();
+            result.ns_per_call_median = samples[samples.size() / 2];
+            result.ns_per_call_min = samples.front();
+
+            std::fprintf( stderr,
+                          "%-32s %-40s %12.1f ns/call %8.3f ns/pixel\n",
+                          name,
+                          params.c_str(),
+                          result.ns_per_call_median,
+                          result.ns_per_call_median / pixels );
+
+            m_results.push_back( result );
+        }
+
+        [[nodiscard]] const std::vector<Result>& results() const
+        {
+            return m_results;
+        }
+
+    private:
+        const Options&      m_options;
+        std::vector<Result> m_results;
+    };
+
+    /**
+     * @brief Image with its own storage filled with the deterministic pseudo-random pattern.
+     */
+    class Plane final
+    {
+    public:
+        explicit Plane( const Rect& rect )
+            : m_pixels( static_cast<size_t>( rect.area() ) )
+        {
+            image.init( rect, m_pixels.data() );
+
+            rtl::uint32_t seed = 12345;
+            for ( auto& pixel : m_pixels )
+            {
+                seed = seed * 1664525u + 1013904223u;
+                pixel = Pixel::from_raw( static_cast<rtl::int32_t>( seed >> 24 ) );
+            }
+        }
+
+        Image image;
+
+    private:
+        std::vector<Pixel> m_pixels;
+    };
+
+    // NOTE: The local static one is reported as set but not used
+    const void* volatile g_sink;
+
+    /**
+     * @brief Keeps the result alive, so the compiler doesn't throw the measured code away.
+     */
+    void do_not_optimize( const void* p )
+    {
+        g_sink = p;
+    }
+
+    std::string params( const char* format, ... )
+    {
+        char buffer[256];
+
+        va_list args;
+        va_start( args, format );
+        std::vsnprintf( buffer, sizeof( buffer ), format, args );
+        va_end( args );
+
+        return buffer;
+    }
+
+    const char* symmetry_name( Symmetry symmetry )
+    {
+        constexpr const char* names[] = { "identity",      "rotate_90",     "rotate_180",
+                                          "rotate_270",    "reflection_m1", "reflection_m2",
+                                          "reflection_m3", "reflection_m4" };
+
+        return names[static_cast<int>( symmetry )];
+    }
+
+    void run_micro( Runner& runner )
+    {
+        // NOTE: Range block sizes produced by the encoder, domain blocks are twice as large
+        constexpr int block_sizes[] = { 4, 8, 16, 32, 64 };
+
+        // NOTE: Same window as the decoder uses for deblocking
+        using SmoothWindow = windows::Trapezoidal<4>;
+
+        constexpr simd::Level simd_levels[]
+            = { simd::Level::scalar, simd::Level::sse2, simd::Level::avx2 };
+
+        Plane source( Rect::create( 0, 0, 256, 256 ) );
+
+        for ( int size : block_sizes )
+        {
+            Plane      block( Rect::create( 64, 64, size, size ) );
+            const Rect domain = Rect::create( 32, 32, size * 2, size * 2 );
+
+            for ( int s = 0; s < static_cast<int>( Symmetry::count ); ++s )
+            {
+                const auto symmetry = static_cast<Symmetry>( s );
+
+                runner.run( "image::transform_affinity",
+                            params( "{\"symmetry\":\"%s\",\"block\":%d}", symmetry_name( symmetry ), size ),
+                            size * size,
+                            [&]
+                            {
+                                image::transform_affinity(
+                                    source.image, domain, Pixel( 0.5f ), Pixel( 0.25f ), symmetry, block.image );
+                                do_not_optimize( block.image.data() );
+                            } );
+            }
+
+            const Rect bordered_rect = SmoothWindow::window_size( block.image.rect() );
+
+            Plane bordered( bordered_rect );
+
+            // NOTE: Range block is in place of the bordered block
+            const Rect block_rect = Rect::create( block.image.rect().left() - bordered_rect.left(),
+                                                  block.image.rect().top() - bordered_rect.top(),
+                                                  size,
+                                                  size );
+            Plane window( bordered_rect );
+            Plane negative_window( bordered_rect );
+
+            window.image.generate( bordered_rect, SmoothWindow::window_function );
+
+            for ( int i = 0; i < bordered_rect.area(); ++i )
+                negative_window.image.data()[i] = Pixel( 0 ) - window.image.data()[i];
+
+            runner.run( "image::expand_borders",
+                        params( "{\"block\":%d,\"bordered\":%d}", size, bordered_rect.size.w ),
+                        bordered_rect.area(),
+                        [&]
+                        {
+                            image::expand_borders( block_rect, bordered.image );
+                            do_not_optimize( bordered.image.data() );
+                        } );
+
+            for ( simd::Level level : simd_levels )
+            {
+                if ( !simd::set_level( level ) )
+                    continue;
+
+                runner.run( "Image::mul",
+                            params( "{\"block\":%d,\"bordered\":%d,\"simd\":\"%s\"}",
+                                    size,
+                                    bordered_rect.size.w,
+                                    simd::level_name( level ) ),
+                            bordered_rect.area(),
+                            [&]
+                            {
+                                bordered.image.mul( window.image );
+                                do_not_optimize( bordered.image.data() );
+                            } );
+
+                runner.run( "Image::add",
+                            params( "{\"block\":%d,\"bordered\":%d,\"simd\":\"%s\"}",
+                                    size,
+                                    bordered_rect.size.w,
+                                    simd::level_name( level ) ),
+                            bordered_rect.area() * 2,
+                            [&]
+                            {
+                                // NOTE: Adding the window and its negation keeps the sum in range
+                                source.image.add( window.image );
+                                source.image.add( negative_window.image );
+                                do_not_optimize( source.image.data() );
+                            } );
+            }
+
+            simd::set_level( simd::supported_level() );
+        }
+
+        // NOTE: Plane kernels of every iteration, on the plane of the typical image
+        {
+            Plane plane( Rect::create( 0, 0, 1024, 1024 ) );
+            Plane mask( Rect::create( 0, 0, 1024, 1024 ) );
+
+            const int pixels = plane.image.rect().area();
+
+            for ( simd::Level level : simd_levels )
+            {
+                if ( !simd::set_level( level ) )
+                    continue;
+
+                runner.run( "Image::clear",
+                            params( "{\"plane\":1024,\"simd\":\"%s\"}", simd::level_name( level ) ),
+                            pixels,
+                            [&]
+                            {
+                                plane.image.clear();
+                                do_not_optimize( plane.image.data() );
+                            } );
+
+                runner.run( "Image::mul",
+                            params( "{\"plane\":1024,\"simd\":\"%s\"}", simd::level_name( level ) ),
+                            pixels,
+                            [&]
+                            {
+                                plane.image.mul( mask.image );
+                                do_not_optimize( plane.image.data() );
+                            } );
+            }
+
+            simd::set_level( simd::supported_level() );
+        }
+
+        // NOTE: Output plane sizes of the typical screen resolutions
+        const Size output_sizes[] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+
+        Plane yuv_source( Rect::create( 0, 0, 1024, 1024 ) );
+
+        std::unique_ptr<image::Resampler> resampler( new image::Resampler );
+
+        for ( const Size& size : output_sizes )
+        {
+            const Rect rect = Rect::create( 0, 0, size.w, size.h );
+
+            Plane y( rect );
+            Plane u( rect );
+            Plane v( rect );
+
+            const int pixels = rect.area();
+
+            // NOTE: Samples are computed once per crop and output size, like in the session
+            const int crop_sizes[] = { 512, 1024 };
+
+            for ( int crop_size : crop_sizes )
+            {
+                for ( image::Filter filter : { image::Filter::nearest, image::Filter::bilinear } )
+                {
+                    const Rect crop = Rect::create( 0, 0, crop_size, crop_size );
+
+                    if ( !resampler->init( crop.size, size, filter ) )
+                        continue;
+
+                    runner.run(
+                        "image::crop_resize_adjust",
+                        params( "{\"source\":\"%dx%d\",\"output\":\"%dx%d\",\"filter\":\"%s\"}",
+                                crop_size,
+                                crop_size,
+                                size.w,
+                                size.h,
+                                filter == image::Filter::nearest ? "nearest" : "bilinear" ),
+                        pixels,
+                        [&]
+                        {
+                            image::crop_resize_adjust( yuv_source.image,
+                                                       crop.origin,
+                                                       *resampler,
+                                                       Pixel( 0.9f ),
+                                                       Pixel( 0.05f ),
+                                                       0,
+                                                       y.image );
+                            do_not_optimize( y.image.data() );
+                        } );
+                }
+            }
+
+            constexpr rtl::size_t rgb888_size = 3;
+
+            const rtl::size_t         pitch = static_cast<rtl::size_t>( size.w ) * rgb888_size;
+            std::vector<rtl::uint8_t> rgb( pitch * static_cast<rtl::size_t>( size.h ) );
+
+            runner.run( "image::convert_yuv444_to_rgb888",
+                        params( "{\"output\":\"%dx%d\"}", size.w, size.h ),
+                        pixels,
+                        [&]
+                        {
+                            image::convert_yuv444_to_rgb888(
+                                y.image, u.image, v.image, rgb.data(), size.w, size.h, pitch );
+                            do_not_optimize( rgb.data() );
+                        } );
+
+            using Converter = void ( * )( const Image&,
+                                          const Image&,
+                                          const Image&,
+                                          rtl::uint8_t*,
+                                          int,
+                                          int,
+                                          rtl::size_t );
+
+            const struct
+            {
+                const char* name;
+                Converter   convert;
+                rtl::size_t pixel_size; // of the Y plane for the planar formats
+            } converters[] = {
+                { "image::convert_yuv444_to_bgra8888", image::convert_yuv444_to_bgra8888, 4 },
+                { "image::convert_yuv444_to_rgb565", image::convert_yuv444_to_rgb565, 2 },
+                { "image::convert_yuv444_to_i420", image::convert_yuv444_to_i420, 1 },
+                { "image::convert_yuv444_to_nv12", image::convert_yuv444_to_nv12, 1 },
+            };
+
+            // NOTE: Large enough for any format
+            std::vector<rtl::uint8_t> buffer( static_cast<rtl::size_t>( pixels ) * 4 );
+
+            for ( const auto& converter : converters )
+            {
+                const rtl::size_t converter_pitch
+                    = static_cast<rtl::size_t>( size.w ) * converter.pixel_size;
+
+                runner.run( converter.name,
+                            params( "{\"output\":\"%dx%d\"}", size.w, size.h ),
+                            pixels,
+                            [&]
+                            {
+                                converter.convert( y.image,
+                                                   u.image,
+                                                   v.image,
+                                                   buffer.data(),
+                                                   size.w,
+                                                   size.h,
+                                                   converter_pitch );
+                                do_not_optimize( buffer.data() );
+                            } );
+            }
+        }
+    }
+
+    /**
+     * @brief Measures the sessions decoding the single program concurrently, one per thread.
+     */
+    void run_sessions( Runner&                          runner,
+                       const Options&                   options,
+                       const std::vector<std::uint8_t>& data,
+                       const std::string&               name,
+                       double                           pixels,
+                       unsigned                         iterations )
+    {
+        constexpr int max_image_size = static_cast<int>( format::constraints::max_image_size );
+
+        const Size target_size = Size::create( max_image_size, max_image_size );
+
+        std::unique_ptr<Program> program( new Program );
+        program->reset();
+
+        if ( !program->load( data.data(), data.size() ) )
+            return;
+
+        std::vector<std::unique_ptr<Session>> sessions( options.threads );
+
+        for ( auto& session : sessions )
+        {
+            session.reset( new Session );
+            session->reset();
+
+            if ( !session->attach( *program, target_size ) )
+                return;
+        }
+
+        runner.run( "Session::iterate",
+                    params( "{\"file\":\"%s\",\"iterations\":%u,\"threads\":%u}",
+                            name.c_str(),
+                            iterations,
+                            options.threads ),
+                    pixels * iterations * options.threads,
+                    [&]
+                    {
+                        std::vector<std::thread> threads;
+
+                        for ( auto& session : sessions )
+                        {
+                            threads.emplace_back(
+                                [&session, iterations]
+                                { do_not_optimize( session->iterate( iterations ) ); } );
+                        }
+
+                        for ( auto& thread : threads )
+                            thread.join();
+                    } );
+    }
+
+    void run_macro( Runner& runner, const Options& options )
+    {
+        constexpr int max_image_size = static_cast<int>( format::constraints::max_image_size );
+
+        const Size target_size = Size::create( max_image_size, max_image_size );
+
+        // NOTE: Decoder keeps all its buffers inside, one instance is reused for all the files
+        std::unique_ptr<Decoder> decoder( new Decoder );
+        decoder->reset();
+
+        for ( const auto& path : options.inputs )
+        {
+            std::vector<std::uint8_t> data;
+            if ( !tools::read_file( path, data ) )
+            {
+                std::fprintf( stderr, "%s: cannot read file\n", path.c_str() );
+                continue;
+            }
+
+            Size           source_size;
+            const unsigned file_iterations = decoder->load(
+                data.data(), data.size(), target_size, &source_size );
+
+            if ( file_iterations == 0 )
+            {
+                std::fprintf( stderr, "%s: unsupported file\n", path.c_str() );
+                continue;
+            }
+
+            const unsigned iterations = options.iterations < 0
+                                            ? file_iterations
+                                            : static_cast<unsigned>( options.iterations );
+
+            const double pixels = static_cast<double>( source_size.w ) * source_size.h;
+
+            // NOTE: Escaping is not needed for the paths of the benchmark inputs
+            const std::string name = std::strrchr( path.c_str(), '/' )
+                                         ? std::strrchr( path.c_str(), '/' ) + 1
+                                         : path;
+
+            runner.run( "Decoder::load",
+                        params( "{\"file\":\"%s\",\"size\":\"%dx%d\"}",
+                                name.c_str(),
+                                source_size.w,
+                                source_size.h ),
+                        pixels,
+                        [&] { decoder->load( data.data(), data.size(), target_size, nullptr ); } );
+
+            decoder->set_executor( tools::thread_executor( options.threads ) );
+
+            runner.run( "Decoder::load/parallel",
+                        params( "{\"file\":\"%s\",\"size\":\"%dx%d\",\"threads\":%u}",
+                                name.c_str(),
+                                source_size.w,
+                                source_size.h,
+                                options.threads ),
+                        pixels,
+                        [&] { decoder->load( data.data(), data.size(), target_size, nullptr ); } );
+
+            decoder->set_executor( Executor{ nullptr, nullptr } );
+
+            decoder->load( data.data(), data.size(), target_size, nullptr );
+
+            runner.run( "Decoder::iterate",
+                        params( "{\"file\":\"%s\",\"size\":\"%dx%d\",\"iterations\":%u}",
+                                name.c_str(),
+                                source_size.w,
+                                source_size.h,
+                                iterations ),
+                        pixels * iterations,
+                        [&] { do_not_optimize( decoder->iterate( iterations ) ); } );
+
+            // NOTE: Pixels are of the whole image to compare the throughput with the full mode
+            decoder->set_mode( Decoder::Mode::luma );
+
+            runner.run( "Decoder::iterate/luma",
+                        params( "{\"file\":\"%s\",\"size\":\"%dx%d\",\"iterations\":%u}",
+                                name.c_str(),
+                                source_size.w,
+                                source_size.h,
+                                iterations ),
+                        pixels * iterations,
+                        [&] { do_not_optimize( decoder->iterate( iterations ) ); } );
+
+            decoder->set_mode( Decoder::Mode::full );
+
+            run_sessions( runner, options, data, name, pixels, iterations );
+        }
+    }
+
+    void write_json( std::FILE* f, const std::vector<Result>& results )
+    {
+        std::fprintf( f, "{\n  \"decoder_version\": %u,\n", Decoder::version );
+        std::fprintf( f, "  \"benchmarks\": [" );
+
+        for ( size_t i = 0; i < results.size(); ++i )
+        {
+            const Result& r = results[i];
+
+            std::fprintf( f,
+                          "%s\n    {\"name\": \"%s\", \"params\": %s, \"pixels\": %.0f, "
+                          "\"samples\": %u, \"calls\": %llu, \"ns_per_call\": %.1f, "
+                          "\"ns_per_call_min\": %.1f, \"ns_per_pixel\": %.4f, "
+                          "\"pixels_per_second\": %.0f}",
+                          i ? "," : "",
+                          r.name.c_str(),
+                          r.params.c_str(),
+                          r.pixels,
+                          r.samples,
+                          static_cast<unsigned long long>( r.calls ),
+                          r.ns_per_call_median,
+                          r.ns_per_call_min,
+                          r.ns_per_call_median / r.pixels,
+                          r.pixels * 1e9 / r.ns_per_call_median );
+        }
+
+        std::fprintf( f, "\n  ]\n}\n" );
+    }
+
+    void print_usage()
+    {
+        std::fputs( "Usage: fjord_bench [options] [file.fjord...]\n"
+                    "\n"
+                    "Options:\n"
+                    "  -o <file>     write JSON results to the file (default: standard output)\n"
+                    "  -t <seconds>  minimum measuring time per benchmark (default: 0.25)\n"
+                    "  -i <count>    number of iterations (default: stored in the file)\n"
+                    "  -r <text>     run only the benchmarks whose name or parameters contain text\n"
+                    "  -j <count>    number of sessions decoding the shared program (default: number "
+                    "of cores)\n"
+                    "  -m            run only micro-benchmarks of the image kernels\n"
+                    "  -M            run only macro-benchmarks of the decoder\n"
+                    "\n"
+                    "Macro-benchmarks use res/fire.fjord and res/deer.fjord if no files given.\n",
+                    stderr );
+    }
+
+    bool parse_options( int argc, char** argv, Options& options )
+    {
+        for ( int i = 1; i < argc; ++i )
+        {
+            const char* arg = argv[i];
+
+            if ( arg[0] != '-' || arg[1] == '\0' )
+            {
+                options.inputs.emplace_back( arg );
+                continue;
+            }
+
+            if ( arg[2] != '\0' )
+                return false;
+
+            if ( arg[1] == 'm' || arg[1] == 'M' )
+            {
+                options.micro = arg[1] == 'm';
+                options.macro = arg[1] == 'M';
+                continue;
+            }
+
+            if ( i + 1 == argc )
+                return false;
+
+            const char* value = argv[++i];
+
+            switch ( arg[1] )
+            {
+            case 'o':
+                options.output_path = value;
+                break;
+
+            case 'r':
+                options.filter = value;
+                break;
+
+            case 't':
+                options.min_time = std::atof( value );
+                if ( options.min_time <= 0 )
+                    return false;
+                break;
+
+            case 'i':
+                options.iterations = std::atoi( value );
+                if ( options.iterations < 0 )
+                    return false;
+                break;
+
+            case 'j':
+                options.threads = static_cast<unsigned>( std::atoi( value ) );
+                if ( options.threads == 0 )
+                    return false;
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        if ( options.inputs.empty() )
+            options.inputs = { "res/fire.fjord", "res/deer.fjord" };
+
+        return true;
+    }
+} // namespace
+
+int main( int argc, char** argv )
+{
+    Options options;
+
+    if ( !parse_options( argc, argv, options ) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    Runner runner( options );
+
+    if ( options.micro )
+        run_micro( runner );
+
+    if ( options.macro )
+        run_macro( runner, options );
+
+    std::FILE* f = options.output_path.empty() ? stdout : std::fopen( options.output_path.c_str(), "w" );
+    if ( !f )
+    {
+        std::fprintf( stderr, "%s: cannot write file\n", options.output_path.c_str() );
+        return EXIT_FAILURE;
+    }
+
+    write_json( f, runner.results() );
+
+    if ( f != stdout )
+        std::fclose( f );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+// Checks of the decoder limits and of the incremental parser.
+//
+// The images of the large sizes are written with the layouts of the tools and loaded, the ones
+// within the limits of the decoder must be taken and the others rejected.
+//
+// The images given on the command line, along with the synthetic still image and sequence, are
+// fed to the decoder byte by byte and by the chunks the parser requires, and the frames must be
+// the same as the ones of the image loaded at once. The truncated images must be incomplete either
+// way, and the images with the damaged bytes must be taken or rejected the same way.
+//
+// Every failed check is printed and the exit code tells whether all of them passed.
+
+#include <fjord/decoder.hpp>
+#include <fjord/format.hpp>
+#include <fjord/program.hpp>
+
+#include "files.hpp"
+#include "writer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace fjord;
+
+namespace
+{
+    struct LoadCase
+    {
+        int  size;
+        int  step;
+        bool loads;
+    };
+
+    // NOTE: The planes of the 2048x2048 images are 3072x2048, the ones of the largest image fit
+    // with the blocks up to 128 pixels only
+    constexpr LoadCase load_cases[] = {
+        { 1024, 6, true },
+        { 2048, 7, true },
+        { 2048, 8, true },
+        { static_cast<int>( format::constraints::max_image_size ), 6, true },
+        { static_cast<int>( format::constraints::max_image_size ), 7, true },
+        { static_cast<int>( format::constraints::max_image_size ), 8, false },
+    };
+
+    constexpr int max_image_size = static_cast<int>( format::constraints::max_image_size );
+
+    // NOTE: Truncating the headers is checked byte by byte, the rest of the image at the steps
+    constexpr size_t truncated_header_size = 256;
+    constexpr size_t truncation_steps = 64;
+
+    // NOTE: Every byte of the headers is damaged, the rest of the image at the random positions
+    constexpr size_t mutated_header_size = 128;
+    constexpr size_t random_mutations = 64;
+
+    /**
+     * @brief Returns the fractal of the top level blocks mapping the corner of the plane.
+     */
+    tools::Fractal flat_fractal( const Size& size, int step )
+    {
+        tools::Fractal fractal;
+        fractal.image_size = size;
+        fractal.layout = tools::Layout::create( size, step );
+        fractal.region_count = format::constraints::max_regions_count;
+        fractal.depth = 0;
+        fractal.iteration_count = 1;
+
+        fractal.channel_count = 3;
+        fractal.channels[0] = { 0, 65535 };
+        fractal.channels[1] = { 16384, 32768 };
+        fractal.channels[2] = { 16384, 32768 };
+
+        fractal.blocks.assign(
+            static_cast<size_t>( fractal.layout.cols ) * static_cast<size_t>( fractal.layout.rows ),
+            format::Block{} );
+
+        return fractal;
+    }
+
+    /**
+     * @brief Frames of the image as the decoder takes them.
+     */
+    struct Outcome
+    {
+        std::vector<unsigned>                  iterations; // of every frame taken
+        std::vector<std::vector<std::uint8_t>> pixels;     // of every frame, if decoded
+        bool                                   complete{ false }; // every frame is taken
+
+        [[nodiscard]] bool operator==( const Outcome& other ) const
+        {
+            return iterations == other.iterations && pixels == other.pixels
+                   && complete == other.complete;
+        }
+
+        [[nodiscard]] bool operator!=( const Outcome& other ) const
+        {
+            return !( *this == other );
+        }
+    };
+
+    void take_frame( Decoder& decoder, unsigned iterations, bool decode, Outcome& outcome )
+    {
+        outcome.iterations.push_back( iterations );
+
+        if ( !decode )
+            return;
+
+        const Size& output_size = decoder.output_size();
+        const auto  pitch = static_cast<size_t>( output_size.w ) * 3;
+
+        std::vector<std::uint8_t> pixels( pitch * static_cast<size_t>( output_size.h ) );
+
+        decoder.decode( iterations,
+                        Decoder::PixelFormat::rgb888,
+                        pixels.data(),
+                        output_size.w,
+                        output_size.h,
+                        pitch );
+
+        outcome.pixels.push_back( std::move( pixels ) );
+    }
+
+    /**
+     * @brief Takes the frames of the image loaded at once.
+     */
+    Outcome load( Decoder& decoder, const std::uint8_t* data, size_t size, bool decode )
+    {
+        const Size target_size = Size::create( max_image_size, max_image_size );
+
+        Outcome outcome;
+
+        unsigned iterations = decoder.load( data, size, target_size, nullptr );
+        if ( !iterations )
+            return outcome;
+
+        // NOTE: Iterations start from scratch, not from the plane of the preceding image
+        decoder.rewind();
+        take_frame( decoder, iterations, decode, outcome );
+
+        while ( decoder.has_next_frame() )
+        {
+            iterations = decoder.next_frame();
+            if ( !iterations )
+                return outcome;
+
+            take_frame( decoder, iterations, decode, outcome );
+        }
+
+        outcome.complete = true;
+        return outcome;
+    }
+
+    /**
+     * @brief Takes the frames of the image fed by the chunks of the size, or of the size the
+     * parser requires if it's 0.
+     *
+     * @return nullptr or the reason why the parser misbehaves
+     */
+    const char* feed( Decoder&            decoder,
+                      const std::uint8_t* data,
+                      size_t              size,
+                      size_t              chunk_size,
+                      bool                decode,
+                      Outcome&            outcome )
+    {
+        const Size target_size = Size::create( max_image_size, max_image_size );
+
+        outcome = Outcome{};
+
+        decoder.begin( target_size );
+
+        size_t offset = 0;
+
+        while ( decoder.status() != Program::Status::failed )
+        {
+            const size_t required = decoder.required();
+
+            if ( !required )
+            {
+                if ( decoder.status() != Program::Status::frame_ready || decoder.has_next_frame() )
+                    return "nothing required before the last frame";
+
+                outcome.complete = true;
+                break;
+            }
+
+            // NOTE: The image is truncated
+            if ( offset == size )
+                break;
+
+            const size_t chunk = std::min( chunk_size ? chunk_size : required, size - offset );
+
+            size_t         consumed;
+            const unsigned iterations = decoder.feed( data + offset, chunk, &consumed );
+
+            if ( !consumed && decoder.status() == Program::Status::need_data )
+                return "the chunk isn't parsed";
+
+            offset += consumed;
+
+            if ( iterations )
+            {
+                if ( outcome.iterations.empty() )
+                    decoder.rewind();
+
+                take_frame( decoder, iterations, decode, outcome );
+            }
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Checks that feeding the image gives the same frames as loading it.
+     *
+     * @return nullptr or the reason why the check failed
+     */
+    const char* check_feed( Decoder&            decoder,
+                            const std::uint8_t* data,
+                            size_t              size,
+                            bool                decode,
+                            Outcome&            loaded )
+    {
+        loaded = load( decoder, data, size, decode );
+
+        Outcome fed;
+
+        for ( const size_t chunk_size : { size_t( 1 ), size_t( 0 ) } )
+        {
+            if ( const char* reason = feed( decoder, data, size, chunk_size, decode, fed ) )
+                return reason;
+
+            if ( fed != loaded )
+                return chunk_size ? "fed byte by byte, the frames differ from the loaded ones"
+                                  : "fed by the required chunks, the frames differ from the "
+                                    "loaded ones";
+        }
+
+        return nullptr;
+    }
+
+    bool check_parser( Decoder& decoder, const std::string& name, std::vector<std::uint8_t> data )
+    {
+        bool passed = true;
+
+        auto fail = [&]( const char* reason, const char* what, size_t offset )
+        {
+            std::fprintf( stderr, "%s: %s %zu: %s\n", name.c_str(), what, offset, reason );
+            passed = false;
+        };
+
+        Outcome whole;
+        if ( const char* reason = check_feed( decoder, data.data(), data.size(), true, whole ) )
+        {
+            fail( reason, "size", data.size() );
+            return passed;
+        }
+
+        if ( !whole.complete )
+        {
+            std::fprintf( stderr, "%s: not loaded\n", name.c_str() );
+            return false;
+        }
+
+        // Truncating the image anywhere leaves it incomplete
+        const size_t step = std::max<size_t>( data.size() / truncation_steps, 1 );
+
+        for ( size_t size = 0; size < data.size();
+              size += size < truncated_header_size ? 1 : step )
+        {
+            Outcome truncated;
+            if ( const char* reason = check_feed( decoder, data.data(), size, false, truncated ) )
+                fail( reason, "truncated to", size );
+            else if ( truncated.complete )
+                fail( "complete", "truncated to", size );
+        }
+
+        // Damaging the bytes anywhere makes the image taken or rejected the same way
+        std::mt19937 rng( 1 );
+
+        std::vector<size_t> offsets;
+
+        for ( size_t offset = 0; offset < std::min( data.size(), mutated_header_size ); ++offset )
+            offsets.push_back( offset );
+
+        for ( size_t i = 0; i < random_mutations; ++i )
+            offsets.push_back(
+                std::uniform_int_distribution<size_t>( 0, data.size() - 1 )( rng ) );
+
+        for ( const size_t offset : offsets )
+        {
+            const std::uint8_t original = data[offset];
+
+            data[offset] = static_cast<std::uint8_t>(
+                original ^ std::uniform_int_distribution<int>( 1, 255 )( rng ) );
+
+            Outcome     mutated;
+            const char* reason = check_feed( decoder, data.data(), data.size(), false, mutated );
+
+            if ( reason )
+                fail( reason, "damaged at", offset );
+
+            data[offset] = original;
+        }
+
+        return passed;
+    }
+
+    bool check_loads( Decoder& decoder )
+    {
+        bool passed = true;
+
+        std::vector<std::uint8_t> data;
+
+        for ( const LoadCase& load_case : load_cases )
+        {
+            const Size size = Size::create( load_case.size, load_case.size );
+
+            const tools::Fractal fractal = flat_fractal( size, load_case.step );
+            tools::write_fractal( fractal, data );
+
+            const bool loads = decoder.load( data.data(), data.size(), size, nullptr ) != 0;
+
+            if ( loads != load_case.loads )
+            {
+                std::fprintf( stderr,
+                              "load %dx%d, plane %dx%d: %s\n",
+                              size.w,
+                              size.h,
+                              fractal.layout.plane_size().w,
+                              fractal.layout.plane_size().h,
+                              loads ? "taken beyond the limits" : "rejected" );
+                passed = false;
+            }
+        }
+
+        return passed;
+    }
+} // namespace
+
+int main( int argc, char** argv )
+{
+    // NOTE: Decoder keeps all its buffers inside, one instance is reused for all the checks
+    std::unique_ptr<Decoder> decoder( new Decoder );
+    decoder->reset();
+
+    bool passed = true;
+
+    passed = check_loads( *decoder ) && passed;
+
+    std::vector<std::uint8_t> data;
+
+    tools::write_fractal( flat_fractal( Size::create( 256, 192 ), 5 ), data );
+    passed = check_parser( *decoder, "synthetic still image", data ) && passed;
+
+    // NOTE: The second frame takes the partition of the first one
+    std::vector<tools::Fractal> frames( 2, flat_fractal( Size::create( 256, 192 ), 5 ) );
+    frames[1].frame_flags = format::frame_flags::shared_partition;
+
+    for ( format::Block& block : frames[1].blocks )
+        block.brightness = 16;
+
+    tools::write_sequence( frames, data );
+    passed = check_parser( *decoder, "synthetic sequence", data ) && passed;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( !tools::read_file( argv[i], data ) )
+        {
+            std::fprintf( stderr, "%s: cannot read file\n", argv[i] );
+            passed = false;
+            continue;
+        }
+
+        passed = check_parser( *decoder, argv[i], data ) && passed;
+    }
+
+    std::printf( "%s\n", passed ? "all checks passed" : "some checks failed" );
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
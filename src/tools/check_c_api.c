@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+/*
+ * Checks of the C interface, built as C to see the header the way the hosts do.
+ *
+ * The context is created in the memory of the host at the misaligned address, the regions out of
+ * the output image and the buffers of too small pitch must be rejected by fjord_render, and
+ * fjord_frame_size must follow the formulas of the header for the odd sizes. The planar frames of
+ * the odd regions are rendered into the buffers of exactly that size, followed by the guard bytes
+ * which must be left untouched.
+ */
+
+#include <fjord/c_api.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    guard_size = 64,
+    guard_value = 0xA5,
+    max_odd_size = 7
+};
+
+static int g_failed = 0;
+
+static void check( int condition, const char* what )
+{
+    if ( condition )
+        return;
+
+    fprintf( stderr, "failed: %s\n", what );
+    ++g_failed;
+}
+
+static unsigned char* read_file( const char* path, size_t* size )
+{
+    FILE* file = fopen( path, "rb" );
+    if ( !file )
+        return NULL;
+
+    unsigned char* data = NULL;
+
+    if ( fseek( file, 0, SEEK_END ) == 0 )
+    {
+        const long length = ftell( file );
+
+        if ( length > 0 && fseek( file, 0, SEEK_SET ) == 0 )
+        {
+            data = (unsigned char*)malloc( (size_t)length );
+
+            if ( data && fread( data, 1, (size_t)length, file ) != (size_t)length )
+            {
+                free( data );
+                data = NULL;
+            }
+
+            *size = (size_t)length;
+        }
+    }
+
+    fclose( file );
+    return data;
+}
+
+/* The formulas of the header, written again */
+static size_t expected_frame_size( fjord_pixel_format format, size_t w, size_t h, size_t pitch )
+{
+    switch ( format )
+    {
+    case FJORD_PIXEL_FORMAT_I420:
+        return pitch < w ? 0 : pitch * h + 2 * ( ( pitch + 1 ) / 2 ) * ( ( h + 1 ) / 2 );
+
+    case FJORD_PIXEL_FORMAT_NV12:
+        return pitch < ( w + 1 ) / 2 * 2 ? 0 : pitch * ( h + ( h + 1 ) / 2 );
+
+    case FJORD_PIXEL_FORMAT_GRAY8:
+        return pitch < w ? 0 : pitch * h;
+
+    case FJORD_PIXEL_FORMAT_RGB565:
+        return pitch < 2 * w ? 0 : pitch * h;
+
+    case FJORD_PIXEL_FORMAT_RGB888:
+        return pitch < 3 * w ? 0 : pitch * h;
+
+    default:
+        return pitch < 4 * w ? 0 : pitch * h;
+    }
+}
+
+static void check_frame_sizes( void )
+{
+    for ( int format = FJORD_PIXEL_FORMAT_RGB888; format <= FJORD_PIXEL_FORMAT_NV12; ++format )
+    {
+        for ( size_t w = 1; w <= max_odd_size; ++w )
+        {
+            for ( size_t h = 1; h <= max_odd_size; ++h )
+            {
+                for ( size_t pitch = 0; pitch <= 4 * w + 2; ++pitch )
+                {
+                    const size_t size = fjord_frame_size(
+                        (fjord_pixel_format)format, (int32_t)w, (int32_t)h, pitch );
+
+                    if ( size != expected_frame_size( (fjord_pixel_format)format, w, h, pitch ) )
+                    {
+                        fprintf( stderr,
+                                 "failed: frame size of format %d, %zux%zu, pitch %zu: %zu\n",
+                                 format,
+                                 w,
+                                 h,
+                                 pitch,
+                                 size );
+                        ++g_failed;
+                    }
+                }
+            }
+        }
+    }
+
+    check( fjord_frame_size( FJORD_PIXEL_FORMAT_RGB888, 0, 1, 3 ) == 0, "frame size of no width" );
+    check( fjord_frame_size( FJORD_PIXEL_FORMAT_RGB888, 1, -1, 3 ) == 0,
+           "frame size of no height" );
+    check( fjord_frame_size( (fjord_pixel_format)99, 1, 1, 4 ) == 0, "frame size of no format" );
+}
+
+static fjord_status render_region( fjord_context* context,
+                                   int32_t        x,
+                                   int32_t        y,
+                                   int32_t        w,
+                                   int32_t        h )
+{
+    unsigned char pixel[4];
+
+    const fjord_rect region = { x, y, w, h };
+    return fjord_render( context, FJORD_PIXEL_FORMAT_RGB888, &region, pixel, 3 );
+}
+
+static void check_regions( fjord_context* context, const fjord_image_info* info )
+{
+    const int32_t w = info->output_width;
+    const int32_t h = info->output_height;
+
+    unsigned char pixel[4];
+
+    check( render_region( context, 0, 0, 1, 1 ) == FJORD_OK, "region of the first pixel" );
+    check( render_region( context, w - 1, h - 1, 1, 1 ) == FJORD_OK, "region of the last pixel" );
+
+    check( render_region( context, -1, 0, 1, 1 ) == FJORD_ERROR_ARGUMENT, "region left" );
+    check( render_region( context, 0, -1, 1, 1 ) == FJORD_ERROR_ARGUMENT, "region above" );
+    check( render_region( context, w, 0, 1, 1 ) == FJORD_ERROR_ARGUMENT, "region right" );
+    check( render_region( context, 0, h, 1, 1 ) == FJORD_ERROR_ARGUMENT, "region below" );
+    check( render_region( context, 0, 0, 0, 1 ) == FJORD_ERROR_ARGUMENT, "region of no width" );
+    check( render_region( context, 0, 0, 1, 0 ) == FJORD_ERROR_ARGUMENT, "region of no height" );
+    check( render_region( context, 0, 0, -1, 1 ) == FJORD_ERROR_ARGUMENT, "region of minus width" );
+    check( render_region( context, w - 1, 0, 2, 1 ) == FJORD_ERROR_ARGUMENT, "region over right" );
+    check( render_region( context, 0, h - 1, 1, 2 ) == FJORD_ERROR_ARGUMENT, "region over bottom" );
+
+    /* The right and bottom edges overflow */
+    check( render_region( context, INT32_MAX, 0, 1, 1 ) == FJORD_ERROR_ARGUMENT,
+           "region of the largest left" );
+    check( render_region( context, 1, 0, INT32_MAX, 1 ) == FJORD_ERROR_ARGUMENT,
+           "region of the largest width" );
+    check( render_region( context, 0, 1, 1, INT32_MAX ) == FJORD_ERROR_ARGUMENT,
+           "region of the largest height" );
+
+    const fjord_rect region = { 0, 0, 1, 1 };
+
+    check( fjord_render( context, FJORD_PIXEL_FORMAT_RGB888, &region, NULL, 3 )
+               == FJORD_ERROR_ARGUMENT,
+           "render to no pixels" );
+    check( fjord_render( context, FJORD_PIXEL_FORMAT_RGB888, &region, pixel, 2 )
+               == FJORD_ERROR_ARGUMENT,
+           "render to the pitch less than the row" );
+    check( fjord_render( context, (fjord_pixel_format)99, &region, pixel, 4 )
+               == FJORD_ERROR_ARGUMENT,
+           "render to no format" );
+
+    /* The pairs of the NV12 chroma are whole, so the pitch of the odd width is even */
+    const fjord_rect odd_region = { 0, 0, 3, 1 };
+    unsigned char    nv12[8];
+
+    check( fjord_render( context, FJORD_PIXEL_FORMAT_NV12, &odd_region, nv12, 3 )
+               == FJORD_ERROR_ARGUMENT,
+           "render NV12 of odd width to the pitch of the width" );
+    check( fjord_render( context, FJORD_PIXEL_FORMAT_NV12, &odd_region, nv12, 4 ) == FJORD_OK,
+           "render NV12 of odd width to the even pitch" );
+}
+
+static void check_planar_regions( fjord_context* context, const fjord_image_info* info )
+{
+    const fjord_pixel_format formats[] = { FJORD_PIXEL_FORMAT_I420, FJORD_PIXEL_FORMAT_NV12 };
+
+    for ( size_t i = 0; i < sizeof( formats ) / sizeof( formats[0] ); ++i )
+    {
+        for ( int32_t w = 1; w <= max_odd_size && w <= info->output_width; ++w )
+        {
+            for ( int32_t h = 1; h <= max_odd_size && h <= info->output_height; ++h )
+            {
+                /* The least pitch, the region starts at the odd pixel and row */
+                const size_t pitch
+                    = formats[i] == FJORD_PIXEL_FORMAT_NV12 ? (size_t)( w + 1 ) / 2 * 2 : (size_t)w;
+
+                const size_t size = fjord_frame_size( formats[i], w, h, pitch );
+
+                unsigned char* buffer = (unsigned char*)malloc( size + guard_size );
+                if ( !buffer )
+                {
+                    check( 0, "memory of the planar frame" );
+                    return;
+                }
+
+                memset( buffer + size, guard_value, guard_size );
+
+                const fjord_rect region = { 1, 1, w, h };
+
+                int guarded = 1;
+
+                if ( region.x + w <= info->output_width && region.y + h <= info->output_height )
+                {
+                    check( fjord_render( context, formats[i], &region, buffer, pitch ) == FJORD_OK,
+                           "render of the odd planar region" );
+
+                    for ( size_t j = 0; j < guard_size; ++j )
+                        guarded = guarded && buffer[size + j] == guard_value;
+                }
+
+                if ( !guarded )
+                {
+                    fprintf( stderr,
+                             "failed: %s region %dx%d written beyond its frame size %zu\n",
+                             formats[i] == FJORD_PIXEL_FORMAT_NV12 ? "NV12" : "I420",
+                             (int)w,
+                             (int)h,
+                             size );
+                    ++g_failed;
+                }
+
+                free( buffer );
+            }
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    if ( argc != 2 )
+    {
+        fputs( "Usage: fjord_check_c_api <file.fjord>\n", stderr );
+        return EXIT_FAILURE;
+    }
+
+    size_t         data_size = 0;
+    unsigned char* data = read_file( argv[1], &data_size );
+
+    if ( !data )
+    {
+        fprintf( stderr, "%s: cannot read file\n", argv[1] );
+        return EXIT_FAILURE;
+    }
+
+    check( fjord_api_version() == FJORD_API_VERSION, "version of the library" );
+
+    check_frame_sizes();
+
+    /* The context is aligned within the memory of the host, whatever its address */
+    const size_t   context_size = fjord_context_size();
+    unsigned char* memory = (unsigned char*)malloc( context_size + 1 );
+
+    fjord_context* context = NULL;
+
+    if ( !memory )
+    {
+        check( 0, "memory of the context" );
+    }
+    else
+    {
+        check( fjord_context_init( memory + 1, context_size - 1, &context ) == FJORD_ERROR_MEMORY
+                   && !context,
+               "init in the memory less than the context size" );
+
+        check( fjord_context_init( memory + 1, context_size, &context ) == FJORD_OK && context,
+               "init at the misaligned address" );
+    }
+
+    if ( context )
+    {
+        fjord_image_info info;
+        unsigned char    pixel[3];
+
+        const fjord_rect region = { 0, 0, 1, 1 };
+
+        check( fjord_render( context, FJORD_PIXEL_FORMAT_RGB888, &region, pixel, 3 )
+                   == FJORD_ERROR_STATE,
+               "render before the load" );
+
+        /* The target of the odd size makes the odd output */
+        if ( fjord_load( context, data, data_size, 301, 217, &info ) != FJORD_OK )
+        {
+            check( 0, "load of the image" );
+        }
+        else
+        {
+            check( fjord_step( context, 2 ) == FJORD_OK, "step of the iterations" );
+
+            check_regions( context, &info );
+            check_planar_regions( context, &info );
+        }
+
+        fjord_context_destroy( context );
+    }
+
+    free( memory );
+    free( data );
+
+    printf( "%s\n", g_failed ? "some checks failed" : "all checks passed" );
+    return g_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
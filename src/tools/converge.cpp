@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+// Quality versus time convergence harness.
+//
+// Every file is decoded once with many iterations to get the reference image. Then the file is
+// decoded again iteration by iteration in every decoding mode, and the luma PSNR and SSIM against
+// the reference are recorded together with the time spent iterating. The curves show how many
+// iterations an image actually needs, compared to the count stored in its header. The luma mode
+// is compared with the luma of the reference as the decoder presents it in grayscale.
+
+#include <fjord/decoder.hpp>
+#include <fjord/profiler.hpp>
+
+#include "files.hpp"
+#include "metrics.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace fjord;
+
+namespace
+{
+    constexpr int    max_image_size = static_cast<int>( format::constraints::max_image_size );
+    constexpr size_t rgb888_size = 3;
+
+    struct Options
+    {
+        std::vector<std::string> inputs;
+        std::string              output_path;
+        Size                     target_size{ max_image_size, max_image_size };
+        unsigned                 reference_iterations{ 100 };
+        unsigned                 iterations{ 0 };   // 0 - twice the count stored in the file
+        double                   target_psnr{ 50 }; // dB, visually lossless
+    };
+
+    /**
+     * @brief Decoding mode under test.
+     */
+    struct Mode
+    {
+        const char*          name;
+        unsigned             threads;
+        Decoder::Mode        decoder_mode;
+        Decoder::PixelFormat format;
+        int                  acceleration_depth;
+    };
+
+    constexpr Mode modes[] = {
+        { "baseline", 1, Decoder::Mode::full, Decoder::PixelFormat::rgb888, 0 },
+        { "luma", 1, Decoder::Mode::luma, Decoder::PixelFormat::gray8, 0 },
+        { "anderson1", 1, Decoder::Mode::full, Decoder::PixelFormat::rgb888, 1 },
+        { "anderson2", 1, Decoder::Mode::full, Decoder::PixelFormat::rgb888, 2 },
+        { "anderson3", 1, Decoder::Mode::full, Decoder::PixelFormat::rgb888, 3 } };
+
+    struct Sample
+    {
+        std::string file;
+        const char* mode;
+        unsigned    threads;
+        unsigned    iteration;
+        double      time_ms;
+        double      psnr;
+        double      ssim;
+    };
+
+    class Frame final
+    {
+    public:
+        explicit Frame( const Size& size )
+            : m_size( size )
+            , m_pixels( pitch() * static_cast<size_t>( size.h ) )
+        {
+        }
+
+        void present( Decoder& decoder, const Image* decoded_image, Decoder::PixelFormat format )
+        {
+            decoder.present( decoded_image, format, m_pixels.data(), m_size.w, m_size.h, pitch() );
+
+            if ( format == Decoder::PixelFormat::gray8 )
+                tools::extract_gray( m_pixels.data(), m_size.w, m_size.h, pitch(), luma );
+            else
+                tools::extract_luma( m_pixels.data(), m_size.w, m_size.h, pitch(), luma );
+        }
+
+        tools::LumaPlane luma;
+
+    private:
+        [[nodiscard]] size_t pitch() const
+        {
+            return static_cast<size_t>( m_size.w ) * rgb888_size;
+        }
+
+        Size                      m_size;
+        std::vector<std::uint8_t> m_pixels;
+    };
+
+    /**
+     * @return false if the file can't be decoded
+     */
+    bool measure( const Options&       options,
+                  const std::string&   path,
+                  Decoder&             decoder,
+                  std::vector<Sample>& samples )
+    {
+        std::vector<std::uint8_t> data;
+        if ( !tools::read_file( path, data ) )
+        {
+            std::fprintf( stderr, "%s: cannot read file\n", path.c_str() );
+            return false;
+        }
+
+        // NOTE: Reference is decoded by the plain iterations
+        decoder.set_acceleration_depth( 0 );
+
+        const unsigned file_iterations
+            = decoder.load( data.data(), data.size(), options.target_size, nullptr );
+        if ( file_iterations == 0 )
+        {
+            std::fprintf( stderr, "%s: unsupported file\n", path.c_str() );
+            return false;
+        }
+
+        const Size size = decoder.output_size();
+
+        decoder.set_mode( Decoder::Mode::full );
+        decoder.rewind();
+
+        Frame reference( size );
+        Frame gray_reference( size );
+        {
+            const Image* decoded_image = decoder.iterate( options.reference_iterations );
+
+            reference.present( decoder, decoded_image, Decoder::PixelFormat::rgb888 );
+            gray_reference.present( decoder, decoded_image, Decoder::PixelFormat::gray8 );
+        }
+
+        const unsigned iterations = options.iterations ? options.iterations : file_iterations * 2;
+        const double   frequency = static_cast<double>( profiler::frequency() );
+
+        Frame frame( size );
+
+        for ( const Mode& mode : modes )
+        {
+            if ( mode.acceleration_depth > Session::max_acceleration_depth )
+                continue;
+
+            decoder.set_acceleration_depth( mode.acceleration_depth );
+            decoder.load( data.data(), data.size(), options.target_size, nullptr );
+            decoder.set_mode( mode.decoder_mode );
+            decoder.rewind();
+
+            const Frame& mode_reference
+                = mode.format == Decoder::PixelFormat::gray8 ? gray_reference : reference;
+
+            const size_t first = samples.size();
+
+            profiler::Ticks ticks = 0;
+
+            for ( unsigned i = 1; i <= iterations; ++i )
+            {
+                const auto   start = profiler::now();
+                const Image* decoded_image = decoder.iterate( 1 );
+                ticks += profiler::now() - start;
+
+                frame.present( decoder, decoded_image, mode.format );
+
+                samples.push_back( { path,
+                                     mode.name,
+                                     mode.threads,
+                                     i,
+                                     static_cast<double>( ticks ) * 1e3 / frequency,
+                                     tools::psnr( frame.luma, mode_reference.luma ),
+                                     tools::ssim( frame.luma, mode_reference.luma ) } );
+            }
+
+            // NOTE: Converged when PSNR reaches the target and stays there
+            size_t converged = samples.size();
+            while ( converged > first && samples[converged - 1].psnr >= options.target_psnr )
+                --converged;
+
+            const Sample& at_header = samples[first + std::min( file_iterations, iterations ) - 1];
+
+            std::fprintf( stderr,
+                          "%s [%s x%u]: header %u iterations %.2f dB %.4f SSIM %.1f ms",
+                          path.c_str(),
+                          mode.name,
+                          mode.threads,
+                          file_iterations,
+                          at_header.psnr,
+                          at_header.ssim,
+                          at_header.time_ms );
+
+            if ( mode.acceleration_depth )
+                std::fprintf( stderr,
+                              ", history %.1f MiB",
+                              static_cast<double>( decoder.history_size() ) / ( 1 << 20 ) );
+
+            if ( converged == samples.size() )
+            {
+                std::fprintf( stderr, ", %.1f dB not reached\n", options.target_psnr );
+                continue;
+            }
+
+            const Sample& at_converged = samples[converged];
+
+            std::fprintf( stderr,
+                          ", %.1f dB after %u iterations %.2f dB %.4f SSIM %.1f ms\n",
+                          options.target_psnr,
+                          at_converged.iteration,
+                          at_converged.psnr,
+                          at_converged.ssim,
+                          at_converged.time_ms );
+        }
+
+        return true;
+    }
+
+    void write_csv( std::FILE* f, const std::vector<Sample>& samples )
+    {
+        std::fputs( "file,mode,threads,iteration,time_ms,psnr_y,ssim_y\n", f );
+
+        for ( const auto& s : samples )
+            std::fprintf( f,
+                          "%s,%s,%u,%u,%.3f,%.3f,%.5f\n",
+                          s.file.c_str(),
+                          s.mode,
+                          s.threads,
+                          s.iteration,
+                          s.time_ms,
+                          s.psnr,
+                          s.ssim );
+    }
+
+    void write_json( std::FILE* f, const std::vector<Sample>& samples )
+    {
+        std::fputs( "{\n  \"samples\": [", f );
+
+        for ( size_t i = 0; i < samples.size(); ++i )
+        {
+            const auto& s = samples[i];
+
+            // NOTE: JSON has no infinity, identical images are reported as null PSNR
+            char psnr[32];
+            if ( std::isinf( s.psnr ) )
+                std::snprintf( psnr, sizeof( psnr ), "null" );
+            else
+                std::snprintf( psnr, sizeof( psnr ), "%.3f", s.psnr );
+
+            std::fprintf( f,
+                          "%s\n    {\"file\": \"%s\", \"mode\": \"%s\", \"threads\": %u, "
+                          "\"iteration\": %u, \"time_ms\": %.3f, \"psnr_y\": %s, \"ssim_y\": %.5f}",
+                          i ? "," : "",
+                          s.file.c_str(),
+                          s.mode,
+                          s.threads,
+                          s.iteration,
+                          s.time_ms,
+                          psnr,
+                          s.ssim );
+        }
+
+        std::fputs( "\n  ]\n}\n", f );
+    }
+
+    void print_usage()
+    {
+        std::fputs( "Usage: fjord_converge [options] <file.fjord>...\n"
+                    "\n"
+                    "Options:\n"
+                    "  -o <file>     write the curves to the file, JSON if the extension is .json,\n"
+                    "                CSV otherwise (default: CSV to standard output)\n"
+                    "  -s <WxH>      fit the images to the target size (default: original size)\n"
+                    "  -r <count>    number of iterations of the reference image (default: 100)\n"
+                    "  -i <count>    number of measured iterations (default: twice the count\n"
+                    "                stored in the file)\n"
+                    "  -q <dB>       PSNR considered as converged (default: 50)\n",
+                    stderr );
+    }
+
+    bool parse_options( int argc, char** argv, Options& options )
+    {
+        for ( int i = 1; i < argc; ++i )
+        {
+            const char* arg = argv[i];
+
+            if ( arg[0] != '-' || arg[1] == '\0' )
+            {
+                options.inputs.emplace_back( arg );
+                continue;
+            }
+
+            if ( arg[2] != '\0' || i + 1 == argc )
+                return false;
+
+            const char* value = argv[++i];
+
+            switch ( arg[1] )
+            {
+            case 'o':
+                options.output_path = value;
+                break;
+
+            case 's':
+                if ( std::sscanf( value, "%dx%d", &options.target_size.w, &options.target_size.h )
+                         != 2
+                     || options.target_size.w <= 0 || options.target_size.h <= 0
+                     || options.target_size.w > max_image_size
+                     || options.target_size.h > max_image_size )
+                    return false;
+                break;
+
+            case 'r':
+                options.reference_iterations = static_cast<unsigned>( std::atoi( value ) );
+                if ( options.reference_iterations == 0 )
+                    return false;
+                break;
+
+            case 'i':
+                options.iterations = static_cast<unsigned>( std::atoi( value ) );
+                if ( options.iterations == 0 )
+                    return false;
+                break;
+
+            case 'q':
+                options.target_psnr = std::atof( value );
+                if ( options.target_psnr <= 0 )
+                    return false;
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        return !options.inputs.empty();
+    }
+
+    bool ends_with( const std::string& s, const char* suffix )
+    {
+        const size_t length = std::strlen( suffix );
+        return s.size() >= length && s.compare( s.size() - length, length, suffix ) == 0;
+    }
+} // namespace
+
+int main( int argc, char** argv )
+{
+    Options options;
+
+    if ( !parse_options( argc, argv, options ) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // NOTE: Decoder keeps all its buffers inside, one instance is reused for all the files
+    std::unique_ptr<Decoder> decoder( new Decoder );
+    decoder->reset();
+
+    std::vector<Sample> samples;
+    int                 failed = 0;
+
+    for ( const auto& path : options.inputs )
+        if ( !measure( options, path, *decoder, samples ) )
+            ++failed;
+
+    std::FILE* f = options.output_path.empty() ? stdout
+                                               : std::fopen( options.output_path.c_str(), "w" );
+    if ( !f )
+    {
+        std::fprintf( stderr, "%s: cannot write file\n", options.output_path.c_str() );
+        return EXIT_FAILURE;
+    }
+
+    if ( ends_with( options.output_path, ".json" ) )
+        write_json( f, samples );
+    else
+        write_csv( f, samples );
+
+    if ( f != stdout )
+        std::fclose( f );
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
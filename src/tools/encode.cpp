@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+// Encoder of the images to .fjord files.
+//
+// The encoded file is decoded back to report the quality. With the baseline option the image is
+// encoded once more with the exhaustive domain search, which is the reference of the speed and the
+// quality of the indexed search.
+//
+// Several images are encoded to the sequence. The following frames keep the partition of the first
+// one and are decoded starting from the preceding frame, so they need a few iterations only.
+
+#include <fjord/decoder.hpp>
+
+#include "encoder.hpp"
+#include "files.hpp"
+#include "metrics.hpp"
+#include "raster.hpp"
+#include "writer.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace fjord;
+
+namespace
+{
+    struct Options
+    {
+        std::vector<std::string> input_paths;
+        std::string              output_path;
+        tools::EncoderOptions    encoder;
+        unsigned                 frame_iterations{ 2 };
+        bool                     baseline{ false };
+    };
+
+    void print_usage()
+    {
+        std::fputs( "Usage: fjord_encode [options] <image.ppm>... <output.fjord>\n"
+                    "\n"
+                    "Options:\n"
+                    "  -b <step>   log2 of the top level block size (default: by the image size)\n"
+                    "  -d <depth>  quadtree depth (default: 3)\n"
+                    "  -e <rms>    block error in 8-bit units to stop splitting (default: 4)\n"
+                    "  -i <count>  number of iterations stored in the file (default: 16)\n"
+                    "  -j <count>  number of threads (default: number of cores)\n"
+                    "  -k <count>  nearest domains examined per range block (default: 8)\n"
+                    "  -l <count>  index leaves visited per search (default: 32)\n"
+                    "  -r          keep the domains in the region of the range block, which makes\n"
+                    "              the luma preview iterate the luma blocks only\n"
+                    "  -w <count>  number of iterations of the following frames (default: 2)\n"
+                    "  -x          use the exhaustive domain search\n"
+                    "  -B          compare with the exhaustive domain search baseline\n",
+                    stderr );
+    }
+
+    bool parse_options( int argc, char** argv, Options& options )
+    {
+        options.encoder.threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+        std::vector<const char*> paths;
+
+        for ( int i = 1; i < argc; ++i )
+        {
+            const char* arg = argv[i];
+
+            if ( arg[0] != '-' || arg[1] == '\0' )
+            {
+                paths.push_back( arg );
+                continue;
+            }
+
+            if ( arg[2] != '\0' )
+                return false;
+
+            if ( arg[1] == 'x' )
+            {
+                options.encoder.search = tools::DomainSearch::exhaustive;
+                continue;
+            }
+
+            if ( arg[1] == 'r' )
+            {
+                options.encoder.local_domains = true;
+                continue;
+            }
+
+            if ( arg[1] == 'B' )
+            {
+                options.baseline = true;
+                continue;
+            }
+
+            if ( i + 1 == argc )
+                return false;
+
+            const char* value = argv[++i];
+
+            switch ( arg[1] )
+            {
+            case 'b':
+                options.encoder.step = std::atoi( value );
+                break;
+
+            case 'd':
+                options.encoder.depth = std::atoi( value );
+                break;
+
+            case 'e':
+                options.encoder.tolerance = std::atof( value );
+                break;
+
+            case 'i':
+                options.encoder.iterations = static_cast<unsigned>( std::atoi( value ) );
+                if ( options.encoder.iterations == 0 || options.encoder.iterations > 255 )
+                    return false;
+                break;
+
+            case 'j':
+                options.encoder.threads = static_cast<unsigned>( std::atoi( value ) );
+                if ( options.encoder.threads == 0 )
+                    return false;
+                break;
+
+            case 'k':
+                options.encoder.candidates = static_cast<unsigned>( std::atoi( value ) );
+                break;
+
+            case 'l':
+                options.encoder.max_leaves = static_cast<unsigned>( std::atoi( value ) );
+                break;
+
+            case 'w':
+                options.frame_iterations = static_cast<unsigned>( std::atoi( value ) );
+                if ( options.frame_iterations == 0 || options.frame_iterations > 255 )
+                    return false;
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        // NOTE: The frame count is limited by the image header
+        if ( paths.size() < 2 || paths.size() > 256 )
+            return false;
+
+        options.input_paths.assign( paths.begin(), paths.end() - 1 );
+        options.output_path = paths.back();
+
+        return true;
+    }
+
+    using Frames = std::vector<std::vector<std::uint8_t>>;
+
+    /**
+     * @brief Decodes the file and compares the luma of its frames with the source images.
+     *
+     * @return PSNR in dB per frame, a negative value if the frame can't be decoded
+     */
+    std::vector<double> measure_psnr( const std::vector<std::uint8_t>& data,
+                                      const Frames&                    frames,
+                                      int                              width,
+                                      int                              height )
+    {
+        std::vector<double> result( frames.size(), -1 );
+
+        std::unique_ptr<Decoder> decoder( new Decoder );
+        decoder->reset();
+
+        const Size size = Size::create( width, height );
+        unsigned   iterations = decoder->load( data.data(), data.size(), size, nullptr );
+
+        if ( !( decoder->output_size() == size ) )
+            return result;
+
+        decoder->rewind();
+
+        const size_t pitch = static_cast<size_t>( width ) * 3;
+
+        std::vector<std::uint8_t> decoded( pitch * static_cast<size_t>( height ) );
+        std::vector<std::uint8_t> bgr( decoded.size() );
+
+        for ( size_t frame = 0; frame < frames.size() && iterations; ++frame )
+        {
+            decoder->decode( iterations,
+                             Decoder::PixelFormat::rgb888,
+                             decoded.data(),
+                             width,
+                             height,
+                             pitch );
+
+            // NOTE: The decoder produces B, G, R byte order
+            const auto& rgb = frames[frame];
+            for ( size_t i = 0; i < rgb.size(); i += 3 )
+            {
+                bgr[i + 0] = rgb[i + 2];
+                bgr[i + 1] = rgb[i + 1];
+                bgr[i + 2] = rgb[i + 0];
+            }
+
+            tools::LumaPlane source_luma;
+            tools::LumaPlane decoded_luma;
+            tools::extract_luma( bgr.data(), width, height, pitch, source_luma );
+            tools::extract_luma( decoded.data(), width, height, pitch, decoded_luma );
+
+            result[frame] = tools::psnr( source_luma, decoded_luma );
+
+            iterations = decoder->next_frame();
+        }
+
+        return result;
+    }
+
+    /**
+     * @return false if the image can't be encoded
+     */
+    bool run( const char*                  name,
+              const Options&               options,
+              const tools::EncoderOptions& encoder_options,
+              const Frames&                frames,
+              int                          width,
+              int                          height,
+              std::vector<std::uint8_t>&   data )
+    {
+        std::vector<tools::Fractal>           fractals( frames.size() );
+        std::vector<tools::EncoderStatistics> statistics( frames.size() );
+
+        for ( size_t i = 0; i < frames.size(); ++i )
+        {
+            tools::EncoderOptions frame_options = encoder_options;
+            if ( i )
+                frame_options.iterations = options.frame_iterations;
+
+            if ( !tools::encode( frames[i].data(),
+                                 width,
+                                 height,
+                                 frame_options,
+                                 i ? &fractals[i - 1] : nullptr,
+                                 fractals[i],
+                                 &statistics[i] ) )
+                return false;
+        }
+
+        if ( fractals.size() == 1 )
+            tools::write_fractal( fractals.front(), data );
+        else
+            tools::write_sequence( fractals, data );
+
+        const std::vector<double> psnr = measure_psnr( data, frames, width, height );
+
+        const double megapixels = static_cast<double>( width ) * height * 1e-6;
+
+        for ( size_t i = 0; i < frames.size(); ++i )
+        {
+            if ( frames.size() > 1 )
+                std::printf( "frame %zu%s ", i, fractals[i].frame_flags ? " (shared)" : "" );
+
+            std::printf( "%-10s %8.3f s %8.3f MP/s, %zu blocks, %llu domains, %llu comparisons, "
+                         "%zu bytes, estimated RMS error %.2f, PSNR %.2f dB\n",
+                         name,
+                         statistics[i].seconds,
+                         megapixels / statistics[i].seconds,
+                         fractals[i].blocks.size(),
+                         static_cast<unsigned long long>( statistics[i].domain_count ),
+                         static_cast<unsigned long long>( statistics[i].block_evaluations ),
+                         data.size(),
+                         statistics[i].estimated_rms_error,
+                         psnr[i] );
+        }
+
+        return true;
+    }
+} // namespace
+
+int main( int argc, char** argv )
+{
+    Options options;
+
+    if ( !parse_options( argc, argv, options ) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    Frames frames( options.input_paths.size() );
+    int    width = 0;
+    int    height = 0;
+
+    for ( size_t i = 0; i < frames.size(); ++i )
+    {
+        const std::string& path = options.input_paths[i];
+
+        int frame_width = 0;
+        int frame_height = 0;
+
+        if ( !tools::read_ppm( path, frames[i], &frame_width, &frame_height ) )
+        {
+            std::fprintf( stderr, "%s: cannot read PPM image\n", path.c_str() );
+            return EXIT_FAILURE;
+        }
+
+        if ( i && ( frame_width != width || frame_height != height ) )
+        {
+            std::fprintf( stderr, "%s: frame size differs from the first frame\n", path.c_str() );
+            return EXIT_FAILURE;
+        }
+
+        width = frame_width;
+        height = frame_height;
+    }
+
+    std::vector<std::uint8_t> data;
+
+    const char* name
+        = options.encoder.search == tools::DomainSearch::indexed ? "indexed" : "exhaustive";
+
+    if ( !run( name, options, options.encoder, frames, width, height, data ) )
+    {
+        std::fprintf( stderr,
+                      "%s: image doesn't fit the decoder constraints\n",
+                      options.input_paths.front().c_str() );
+        return EXIT_FAILURE;
+    }
+
+    if ( !tools::write_file( options.output_path, data.data(), data.size() ) )
+    {
+        std::fprintf( stderr, "%s: cannot write file\n", options.output_path.c_str() );
+        return EXIT_FAILURE;
+    }
+
+    if ( options.baseline && options.encoder.search != tools::DomainSearch::exhaustive )
+    {
+        tools::EncoderOptions baseline = options.encoder;
+        baseline.search = tools::DomainSearch::exhaustive;
+
+        std::vector<std::uint8_t> baseline_data;
+        run( "exhaustive", options, baseline, frames, width, height, baseline_data );
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,810 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "encoder.hpp"
+
+#include <fjord/symmetry.hpp>
+
+#include "kdtree.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+using namespace fjord;
+
+namespace
+{
+    constexpr auto max_blocks_count = format::constraints::max_ifs_blocks_count;
+
+    constexpr int symmetry_count = static_cast<int>( Symmetry::count );
+
+    // NOTE: Smaller blocks have no room for the deblocking window border
+    constexpr int min_block_size_log2 = 2;
+    constexpr int min_step = 5;
+    constexpr int max_step = 8;
+
+    constexpr int contrast_quantizer = ( 1 << ( format::Block::bits_per_contrast - 1 ) ) - 1;
+    constexpr int brightness_quantizer = ( 1 << ( format::Block::bits_per_brightness - 1 ) ) - 1;
+
+    // NOTE: Contrast of 1 is representable, but the function system must be contractive
+    constexpr int max_contrast = contrast_quantizer - 1;
+
+    // NOTE: Blocks are split in batches, so the children are encoded in parallel
+    constexpr size_t split_batch_size = 64;
+
+    constexpr int feature_size = 4; // features are 4x4 block averages
+    static_assert( feature_size * feature_size == tools::KdTree::dimensions );
+
+    /**
+     * @brief Destination of the domain pixel (x, y) in the range block for every symmetry.
+     *
+     * dst_x = x * m[0] + y * m[1] + m[4] * (size - 1)
+     * dst_y = x * m[2] + y * m[3] + m[5] * (size - 1)
+     *
+     * @note Must match the matrices of image::transform_affinity
+     */
+    constexpr int symmetry_matrices[symmetry_count][6] = {
+        { 1, 0, 0, 1, 0, 0 },    { 0, -1, 1, 0, 1, 0 },  { -1, 0, 0, -1, 1, 1 },
+        { 0, 1, -1, 0, 0, 1 },   { -1, 0, 0, 1, 1, 0 },  { 0, 1, 1, 0, 0, 0 },
+        { 1, 0, 0, -1, 0, 1 },   { 0, -1, -1, 0, 1, 1 } };
+
+    struct Plane
+    {
+        int                width;
+        int                height;
+        std::vector<float> samples;
+
+        void init( int w, int h )
+        {
+            width = w;
+            height = h;
+            samples.assign( static_cast<size_t>( w ) * static_cast<size_t>( h ), 0.0f );
+        }
+
+        [[nodiscard]] float at( int x, int y ) const
+        {
+            return samples[static_cast<size_t>( y ) * static_cast<size_t>( width ) + x];
+        }
+
+        float& at( int x, int y )
+        {
+            return samples[static_cast<size_t>( y ) * static_cast<size_t>( width ) + x];
+        }
+    };
+
+    /**
+     * @brief Resamples the plane, averaging the covered pixels on downscaling and interpolating
+     * bilinearly on upscaling.
+     */
+    void resample( const Plane& source, Plane& output )
+    {
+        const double sx = static_cast<double>( source.width ) / output.width;
+        const double sy = static_cast<double>( source.height ) / output.height;
+
+        for ( int y = 0; y < output.height; ++y )
+        {
+            for ( int x = 0; x < output.width; ++x )
+            {
+                if ( sx > 1 || sy > 1 )
+                {
+                    const int x0 = static_cast<int>( x * sx );
+                    const int y0 = static_cast<int>( y * sy );
+                    const int x1 = std::max( x0 + 1, static_cast<int>( ( x + 1 ) * sx ) );
+                    const int y1 = std::max( y0 + 1, static_cast<int>( ( y + 1 ) * sy ) );
+
+                    double sum = 0;
+                    for ( int v = y0; v < y1; ++v )
+                        for ( int u = x0; u < x1; ++u )
+                            sum += source.at( std::min( u, source.width - 1 ),
+                                              std::min( v, source.height - 1 ) );
+
+                    output.at( x, y ) = static_cast<float>( sum / ( ( x1 - x0 ) * ( y1 - y0 ) ) );
+                }
+                else
+                {
+                    const double fx = std::max( 0.0, ( x + 0.5 ) * sx - 0.5 );
+                    const double fy = std::max( 0.0, ( y + 0.5 ) * sy - 0.5 );
+
+                    const int x0 = std::min( static_cast<int>( fx ), source.width - 1 );
+                    const int y0 = std::min( static_cast<int>( fy ), source.height - 1 );
+                    const int x1 = std::min( x0 + 1, source.width - 1 );
+                    const int y1 = std::min( y0 + 1, source.height - 1 );
+
+                    const double ax = fx - x0;
+                    const double ay = fy - y0;
+
+                    output.at( x, y ) = static_cast<float>(
+                        ( source.at( x0, y0 ) * ( 1 - ax ) + source.at( x1, y0 ) * ax ) * ( 1 - ay )
+                        + ( source.at( x0, y1 ) * ( 1 - ax ) + source.at( x1, y1 ) * ax ) * ay );
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Builds the IFS plane with the channels normalized to the full range.
+     *
+     * Channel headers restore the original range on output: value = contrast * plane + brightness.
+     *
+     * @param fixed_channels Normalize with the given channel headers, e.g. of the sequence
+     */
+    void build_plane( const std::uint8_t*       pixels,
+                      int                       width,
+                      int                       height,
+                      const tools::Layout&      layout,
+                      bool                      fixed_channels,
+                      Plane&                    plane,
+                      format::headers::Channel* channels )
+    {
+        // NOTE: Inverse of the conversion of image::convert_yuv444_to_rgb888, chroma is centered
+        // around 0.5 as the decoder expects
+        Plane yuv[3];
+        for ( auto& channel : yuv )
+            channel.init( width, height );
+
+        for ( int y = 0; y < height; ++y )
+        {
+            for ( int x = 0; x < width; ++x )
+            {
+                const std::uint8_t* p = pixels + ( static_cast<size_t>( y ) * width + x ) * 3;
+
+                const float r = p[0] / 255.0f;
+                const float g = p[1] / 255.0f;
+                const float b = p[2] / 255.0f;
+
+                const float luma = 0.299f * r + 0.587f * g + 0.114f * b;
+
+                yuv[0].at( x, y ) = luma;
+                yuv[1].at( x, y ) = std::clamp( ( b - luma ) / 2.03211f + 0.5f, 0.0f, 1.0f );
+                yuv[2].at( x, y ) = std::clamp( ( r - luma ) / 1.13983f + 0.5f, 0.0f, 1.0f );
+            }
+        }
+
+        const Size plane_size = layout.plane_size();
+        plane.init( plane_size.w, plane_size.h );
+
+        for ( int i = 0; i < 3; ++i )
+        {
+            const Rect region = Rect::create( layout.regions[i].origin.x << layout.step,
+                                              layout.regions[i].origin.y << layout.step,
+                                              layout.regions[i].size.w << layout.step,
+                                              layout.regions[i].size.h << layout.step );
+
+            // NOTE: The decoder stretches every region over the whole output image
+            Plane channel;
+            channel.init( region.size.w, region.size.h );
+            resample( yuv[i], channel );
+
+            constexpr float uint16_max_value = 65535;
+
+            if ( !fixed_channels )
+            {
+                const auto range
+                    = std::minmax_element( channel.samples.begin(), channel.samples.end() );
+
+                const float range_min = *range.first;
+                const float range_scale = std::max( *range.second - range_min, 1.0f / 255 );
+
+                channels[i].brightness_shift
+                    = static_cast<rtl::uint16_t>( std::lround( range_min * uint16_max_value ) );
+                channels[i].contrast_shift = static_cast<rtl::uint16_t>(
+                    std::lround( std::min( range_scale, 1.0f ) * uint16_max_value ) );
+            }
+
+            // NOTE: Normalizing with the quantized values, as the decoder restores them
+            const float min = channels[i].brightness_shift / uint16_max_value;
+            const float scale
+                = std::max( channels[i].contrast_shift / uint16_max_value, 1.0f / 255 );
+
+            for ( int y = 0; y < region.size.h; ++y )
+                for ( int x = 0; x < region.size.w; ++x )
+                    plane.at( region.origin.x + x, region.origin.y + y )
+                        = std::clamp( ( channel.at( x, y ) - min ) / scale, 0.0f, 1.0f );
+        }
+    }
+
+    /**
+     * @brief Averages the block to the feature_size x feature_size grid, removes the mean and
+     * normalizes the result to the unit length. Flat blocks give the zero vector.
+     */
+    template<typename Sample>
+    void extract_feature( int size, Sample sample, float* feature )
+    {
+        const int cell = size / feature_size;
+
+        float mean = 0;
+
+        for ( int j = 0; j < feature_size; ++j )
+        {
+            for ( int i = 0; i < feature_size; ++i )
+            {
+                float sum = 0;
+                for ( int y = 0; y < cell; ++y )
+                    for ( int x = 0; x < cell; ++x )
+                        sum += sample( i * cell + x, j * cell + y );
+
+                feature[j * feature_size + i] = sum;
+                mean += sum;
+            }
+        }
+
+        mean /= tools::KdTree::dimensions;
+
+        float norm = 0;
+        for ( int i = 0; i < tools::KdTree::dimensions; ++i )
+        {
+            feature[i] -= mean;
+            norm += feature[i] * feature[i];
+        }
+
+        norm = std::sqrt( norm );
+
+        for ( int i = 0; i < tools::KdTree::dimensions; ++i )
+            feature[i] = norm > 1e-4f ? feature[i] / norm : 0.0f;
+    }
+
+    /**
+     * @brief Domain blocks of the single range block size and their index.
+     */
+    struct DomainPool
+    {
+        int range_size;
+        int step_x; // lattice step in pixels, a multiple of the offset granularity
+        int step_y;
+        int cols;
+        int rows;
+
+        std::vector<float> features; // per domain and symmetry
+        tools::KdTree      index;
+
+        [[nodiscard]] std::uint32_t count() const
+        {
+            return static_cast<std::uint32_t>( cols * rows );
+        }
+
+        [[nodiscard]] Point origin( std::uint32_t domain ) const
+        {
+            return Point::create( static_cast<int>( domain % cols ) * step_x,
+                                  static_cast<int>( domain / cols ) * step_y );
+        }
+
+        void init( const Plane& plane, const tools::Layout& layout, int size )
+        {
+            range_size = size;
+
+            // NOTE: Half-block lattice is the usual trade-off between the quality and the pool size
+            const int granularity_x = 1 << layout.offset_shift_x();
+            const int granularity_y = 1 << layout.offset_shift_y();
+
+            step_x = std::max( granularity_x, size / 2 / granularity_x * granularity_x );
+            step_y = std::max( granularity_y, size / 2 / granularity_y * granularity_y );
+
+            cols = ( plane.width - 2 * size ) / step_x + 1;
+            rows = ( plane.height - 2 * size ) / step_y + 1;
+        }
+
+        void build_index( const Plane& plane, unsigned threads )
+        {
+            constexpr int dimensions = tools::KdTree::dimensions;
+
+            features.resize( static_cast<size_t>( count() ) * symmetry_count * dimensions );
+
+            tools::parallel_for(
+                count(),
+                threads,
+                [&]( size_t domain )
+                {
+                    const Point o = origin( static_cast<std::uint32_t>( domain ) );
+
+                    // NOTE: The decoder shrinks the domain block by taking every second pixel
+                    float base[dimensions];
+                    extract_feature( range_size,
+                                     [&]( int x, int y ) { return plane.at( o.x + 2 * x, o.y + 2 * y ); },
+                                     base );
+
+                    // NOTE: Averaging commutes with the symmetries, so the averaged grid is
+                    // transformed instead of the block
+                    for ( int s = 0; s < symmetry_count; ++s )
+                    {
+                        const int* m = symmetry_matrices[s];
+                        float*     feature = features.data()
+                                         + ( domain * symmetry_count + s ) * dimensions;
+
+                        for ( int y = 0; y < feature_size; ++y )
+                        {
+                            for ( int x = 0; x < feature_size; ++x )
+                            {
+                                const int dx = x * m[0] + y * m[1] + m[4] * ( feature_size - 1 );
+                                const int dy = x * m[2] + y * m[3] + m[5] * ( feature_size - 1 );
+
+                                feature[dy * feature_size + dx] = base[y * feature_size + x];
+                            }
+                        }
+                    }
+                } );
+
+            index.build( features.data(), count() * symmetry_count );
+        }
+    };
+
+    struct Code
+    {
+        format::Block block;
+        double        error; // sum of squared differences
+    };
+
+    struct RangeSums
+    {
+        double sum;
+        double sum_squares;
+        int    count;
+    };
+
+    /**
+     * @brief Finds the quantized contrast and brightness minimizing the error and the error.
+     */
+    void fit( const RangeSums& r, double sd, double sdd, double sdr, Code& code )
+    {
+        const double n = r.count;
+        const double denominator = n * sdd - sd * sd;
+
+        double contrast = denominator > 1e-12 ? ( n * sdr - sd * r.sum ) / denominator : 0.0;
+
+        const int qc = std::clamp(
+            static_cast<int>( std::lround( contrast * contrast_quantizer ) ), -max_contrast, max_contrast );
+        contrast = static_cast<double>( qc ) / contrast_quantizer;
+
+        const double max_brightness = 1 + std::fabs( contrast );
+        double       brightness = ( r.sum - contrast * sd ) / n;
+
+        const int qb = std::clamp(
+            static_cast<int>( std::lround( brightness / max_brightness * brightness_quantizer ) ),
+            -brightness_quantizer,
+            brightness_quantizer );
+        brightness = max_brightness * qb / brightness_quantizer;
+
+        code.error = r.sum_squares + contrast * contrast * sdd + n * brightness * brightness
+                     - 2 * contrast * sdr - 2 * brightness * r.sum + 2 * contrast * brightness * sd;
+
+        code.block.contrast = qc;
+        code.block.brightness = qb;
+    }
+
+    class BlockEncoder final
+    {
+    public:
+        BlockEncoder( const Plane&                 plane,
+                      const tools::Layout&         layout,
+                      const tools::EncoderOptions& options )
+            : m_plane( plane )
+            , m_layout( layout )
+            , m_options( options )
+        {
+        }
+
+        Code encode( int x, int y, const DomainPool& pool, std::uint64_t& evaluations ) const
+        {
+            const int size = pool.range_size;
+
+            RangeSums r{ 0, 0, size * size };
+            for ( int v = 0; v < size; ++v )
+            {
+                for ( int u = 0; u < size; ++u )
+                {
+                    const double value = m_plane.at( x + u, y + v );
+                    r.sum += value;
+                    r.sum_squares += value * value;
+                }
+            }
+
+            // NOTE: Flat approximation with zero contrast is the fallback for any range block
+            Code best{};
+            fit( r, 0, 0, 0, best );
+
+            const Rect region = region_of( x, y );
+
+            const auto evaluate = [&]( std::uint32_t domain, int symmetry )
+            {
+                // NOTE: Domains kept in the region make the luma decodable without the chroma
+                if ( m_options.local_domains )
+                {
+                    const Point o = pool.origin( domain );
+                    const Rect  domain_rect = Rect::create( o.x, o.y, size * 2, size * 2 );
+
+                    if ( ( domain_rect & region ).area() != domain_rect.area() )
+                        return;
+                }
+
+                Code code{};
+                compare( x, y, pool, domain, symmetry, r, code );
+                ++evaluations;
+
+                if ( code.error < best.error )
+                    best = code;
+            };
+
+            if ( m_options.search == tools::DomainSearch::exhaustive )
+            {
+                for ( std::uint32_t domain = 0; domain < pool.count(); ++domain )
+                    for ( int symmetry = 0; symmetry < symmetry_count; ++symmetry )
+                        evaluate( domain, symmetry );
+
+                return best;
+            }
+
+            float feature[tools::KdTree::dimensions];
+            extract_feature(
+                size, [&]( int u, int v ) { return m_plane.at( x + u, y + v ); }, feature );
+
+            // NOTE: Flat range blocks are the best approximated with zero contrast
+            if ( feature[0] == 0 && std::all_of( feature, feature + tools::KdTree::dimensions,
+                                                 []( float f ) { return f == 0; } ) )
+                return best;
+
+            std::vector<std::uint32_t> candidates;
+
+            // NOTE: Negated feature finds the domains matching with the negative contrast
+            for ( int sign = 0; sign < 2; ++sign )
+            {
+                pool.index.search( feature, m_options.candidates, m_options.max_leaves, candidates );
+
+                for ( std::uint32_t candidate : candidates )
+                    evaluate( candidate / symmetry_count, static_cast<int>( candidate % symmetry_count ) );
+
+                for ( auto& f : feature )
+                    f = -f;
+            }
+
+            return best;
+        }
+
+    private:
+        [[nodiscard]] Rect region_of( int x, int y ) const
+        {
+            for ( const Rect& cells : m_layout.regions )
+            {
+                const Rect region = Rect::create( cells.origin.x << m_layout.step,
+                                                  cells.origin.y << m_layout.step,
+                                                  cells.size.w << m_layout.step,
+                                                  cells.size.h << m_layout.step );
+
+                if ( region.contains( Point::create( x, y ) ) )
+                    return region;
+            }
+
+            return Rect::create( 0, 0, 0, 0 );
+        }
+
+        void compare( int               x,
+                      int               y,
+                      const DomainPool& pool,
+                      std::uint32_t     domain,
+                      int               symmetry,
+                      const RangeSums&  r,
+                      Code&             code ) const
+        {
+            const int   size = pool.range_size;
+            const Point o = pool.origin( domain );
+            const int*  m = symmetry_matrices[symmetry];
+
+            const int m4 = m[4] * ( size - 1 );
+            const int m5 = m[5] * ( size - 1 );
+
+            double sd = 0, sdd = 0, sdr = 0;
+
+            for ( int v = 0; v < size; ++v )
+            {
+                for ( int u = 0; u < size; ++u )
+                {
+                    const double d = m_plane.at( o.x + 2 * u, o.y + 2 * v );
+                    const double value = m_plane.at( x + u * m[0] + v * m[1] + m4,
+                                                     y + u * m[2] + v * m[3] + m5 );
+                    sd += d;
+                    sdd += d * d;
+                    sdr += d * value;
+                }
+            }
+
+            fit( r, sd, sdd, sdr, code );
+
+            code.block.transform = static_cast<unsigned>( symmetry );
+            code.block.offset_x = static_cast<unsigned>( o.x >> m_layout.offset_shift_x() );
+            code.block.offset_y = static_cast<unsigned>( o.y >> m_layout.offset_shift_y() );
+        }
+
+        const Plane&                 m_plane;
+        const tools::Layout&         m_layout;
+        const tools::EncoderOptions& m_options;
+    };
+
+    struct Node
+    {
+        int  x;
+        int  y;
+        int  level; // index of the block size, 0 - the top level
+        int  children; // index of the first of four children or -1
+        Code code;
+    };
+
+    void walk( const std::vector<Node>& nodes, size_t index, int depth, tools::Fractal& fractal )
+    {
+        const Node& node = nodes[index];
+
+        if ( node.level < depth )
+            fractal.nodes.push_back( node.children >= 0 );
+
+        if ( node.children < 0 )
+        {
+            fractal.blocks.push_back( node.code.block );
+            return;
+        }
+
+        for ( int i = 0; i < 4; ++i )
+            walk( nodes, static_cast<size_t>( node.children + i ), depth, fractal );
+    }
+
+    /**
+     * @brief Splits the node as the split flags written by \walk say.
+     *
+     * @return false if the flags are exhausted
+     */
+    bool split_as( const std::vector<bool>& flags,
+                   size_t&                  flag,
+                   size_t                   index,
+                   int                      depth,
+                   int                      block_size,
+                   std::vector<Node>&       nodes )
+    {
+        if ( nodes[index].level >= depth )
+            return true;
+
+        if ( flag >= flags.size() )
+            return false;
+
+        if ( !flags[flag++] )
+            return true;
+
+        const int level = nodes[index].level + 1;
+        const int half = block_size >> level;
+
+        const size_t children = nodes.size();
+        nodes[index].children = static_cast<int>( children );
+
+        for ( int i = 0; i < 4; ++i )
+            nodes.push_back(
+                { nodes[index].x + ( i & 1 ) * half, nodes[index].y + ( i >> 1 ) * half, level, -1, {} } );
+
+        for ( size_t i = 0; i < 4; ++i )
+            if ( !split_as( flags, flag, children + i, depth, block_size, nodes ) )
+                return false;
+
+        return true;
+    }
+} // namespace
+
+bool tools::encode( const std::uint8_t*   pixels,
+                    int                   width,
+                    int                   height,
+                    const EncoderOptions& options,
+                    const Fractal*        previous_frame,
+                    Fractal&              fractal,
+                    EncoderStatistics*    statistics )
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    constexpr int max_image_size = static_cast<int>( format::constraints::max_image_size );
+
+    if ( width <= 0 || height <= 0 || width > max_image_size || height > max_image_size )
+        return false;
+
+    if ( previous_frame && !( previous_frame->image_size == Size::create( width, height ) ) )
+        return false;
+
+    // NOTE: The smallest top level block size leaving the room for the splits
+    int step = previous_frame ? previous_frame->layout.step : options.step;
+    if ( !step )
+    {
+        for ( step = min_step; step < max_step; ++step )
+        {
+            const Layout layout = Layout::create( Size::create( width, height ), step );
+            if ( static_cast<size_t>( layout.cols * layout.rows ) <= max_blocks_count / 4 )
+                break;
+        }
+    }
+
+    const int depth = previous_frame ? previous_frame->depth : options.depth;
+
+    if ( step - depth < min_block_size_log2 || step > max_step || depth < 0 )
+        return false;
+
+    fractal.image_size = Size::create( width, height );
+    fractal.layout = Layout::create( fractal.image_size, step );
+    fractal.channel_count = 3;
+    fractal.region_count = 3;
+    fractal.depth = depth;
+    fractal.iteration_count = options.iterations;
+    fractal.frame_flags = 0;
+
+    // NOTE: Frames of the sequence share the channel headers of the image
+    if ( previous_frame )
+        std::copy( std::begin( previous_frame->channels ),
+                   std::end( previous_frame->channels ),
+                   std::begin( fractal.channels ) );
+
+    const Layout& layout = fractal.layout;
+
+    if ( static_cast<size_t>( layout.cols * layout.rows ) > max_blocks_count )
+        return false;
+
+    Plane plane;
+    build_plane( pixels, width, height, layout, previous_frame, plane, fractal.channels );
+
+    std::vector<DomainPool> pools( static_cast<size_t>( depth ) + 1 );
+
+    std::uint64_t domain_count = 0;
+
+    for ( int level = 0; level <= depth; ++level )
+    {
+        auto& pool = pools[static_cast<size_t>( level )];
+        pool.init( plane, layout, layout.block_size() >> level );
+
+        if ( options.search == DomainSearch::indexed )
+            pool.build_index( plane, options.threads );
+
+        domain_count += pool.count();
+    }
+
+    const BlockEncoder encoder( plane, layout, options );
+
+    std::atomic<std::uint64_t> evaluations{ 0 };
+
+    std::vector<Node> nodes;
+    for ( int row = 0; row < layout.rows; ++row )
+        for ( int col = 0; col < layout.cols; ++col )
+            nodes.push_back( { col << step, row << step, 0, -1, {} } );
+
+    const size_t top_count = nodes.size();
+
+    const auto encode_nodes = [&]( size_t first, size_t last )
+    {
+        parallel_for( last - first,
+                      options.threads,
+                      [&]( size_t i )
+                      {
+                          Node&         node = nodes[first + i];
+                          std::uint64_t count = 0;
+
+                          if ( node.children >= 0 )
+                              return;
+
+                          node.code = encoder.encode(
+                              node.x, node.y, pools[static_cast<size_t>( node.level )], count );
+
+                          evaluations += count;
+                      } );
+    };
+
+    // NOTE: The frame of the sequence keeps the partition of the preceding frame, so the decoder
+    // reuses the prepared range blocks
+    if ( previous_frame )
+    {
+        size_t flag = 0;
+
+        for ( size_t i = 0; i < top_count; ++i )
+            if ( !split_as( previous_frame->nodes, flag, i, depth, layout.block_size(), nodes ) )
+                return false;
+
+        fractal.frame_flags = format::frame_flags::shared_partition;
+    }
+
+    encode_nodes( 0, nodes.size() );
+
+    // NOTE: The worst blocks are split first, until the error is tolerable or the limits of the
+    // decoder are reached
+    using Candidate = std::pair<double, size_t>; // error, node
+    std::priority_queue<Candidate> candidates;
+
+    const double tolerance = options.tolerance / 255;
+
+    const auto push_candidate = [&]( size_t index )
+    {
+        const Node&  node = nodes[index];
+        const int    size = layout.block_size() >> node.level;
+        const double threshold = tolerance * tolerance * size * size;
+
+        if ( node.level < depth && node.code.error > threshold )
+            candidates.push( { node.code.error, index } );
+    };
+
+    if ( !previous_frame )
+        for ( size_t i = 0; i < top_count; ++i )
+            push_candidate( i );
+
+    size_t leaf_count = top_count;
+    size_t flag_count = depth > 0 ? top_count : 0;
+
+    while ( !candidates.empty() )
+    {
+        const size_t first_child = nodes.size();
+
+        for ( size_t batch = 0; batch < split_batch_size && !candidates.empty(); ++batch )
+        {
+            const size_t index = candidates.top().second;
+            const int    level = nodes[index].level + 1;
+
+            const size_t flags = level < depth ? 4 : 0;
+
+            if ( leaf_count + 3 > max_blocks_count || flag_count + flags > max_blocks_count )
+            {
+                candidates = {};
+                break;
+            }
+
+            candidates.pop();
+
+            const int half = layout.block_size() >> level;
+
+            nodes[index].children = static_cast<int>( nodes.size() );
+
+            // NOTE: Z-order, the same as the decoder walks the children
+            for ( int i = 0; i < 4; ++i )
+                nodes.push_back( { nodes[index].x + ( i & 1 ) * half,
+                                   nodes[index].y + ( i >> 1 ) * half,
+                                   level,
+                                   -1,
+                                   {} } );
+
+            leaf_count += 3;
+            flag_count += flags;
+        }
+
+        encode_nodes( first_child, nodes.size() );
+
+        for ( size_t i = first_child; i < nodes.size(); ++i )
+            push_candidate( i );
+    }
+
+    fractal.nodes.clear();
+    fractal.blocks.clear();
+
+    double error = 0;
+
+    for ( size_t i = 0; i < top_count; ++i )
+        walk( nodes, i, depth, fractal );
+
+    if ( previous_frame && fractal.blocks.size() == previous_frame->blocks.size()
+         && std::equal( fractal.blocks.begin(),
+                        fractal.blocks.end(),
+                        previous_frame->blocks.begin(),
+                        []( const format::Block& a, const format::Block& b )
+                        { return std::memcmp( &a, &b, sizeof( a ) ) == 0; } ) )
+        fractal.frame_flags |= format::frame_flags::shared_blocks;
+
+    for ( const auto& node : nodes )
+        if ( node.children < 0 )
+            error += node.code.error;
+
+    if ( statistics )
+    {
+        statistics->seconds
+            = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        statistics->domain_count = domain_count;
+        statistics->block_evaluations = evaluations;
+        statistics->estimated_rms_error
+            = std::sqrt( error / static_cast<double>( plane.samples.size() ) ) * 255;
+    }
+
+    return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include "writer.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace fjord
+{
+    namespace tools
+    {
+        enum class DomainSearch
+        {
+            indexed,   // nearest neighbours of the normalized block features
+            exhaustive // every domain block in every symmetry
+        };
+
+        struct EncoderOptions
+        {
+            int          step{ 0 };  // log2 of the top level block size, 0 - chosen by image size
+            int          depth{ 3 }; // quadtree depth
+            double       tolerance{ 4 }; // RMS error of the block in 8-bit units to stop splitting
+            unsigned     iterations{ 16 };
+            unsigned     threads{ 1 };
+            DomainSearch search{ DomainSearch::indexed };
+            unsigned     candidates{ 8 };  // nearest neighbours per query
+            unsigned     max_leaves{ 32 }; // index leaves visited per query
+            bool         local_domains{ false }; // domains in the region of the range block
+        };
+
+        struct EncoderStatistics
+        {
+            double        seconds;
+            std::uint64_t domain_count;       // over all block sizes
+            std::uint64_t block_evaluations;  // range-domain pairs compared exactly
+            double        estimated_rms_error; // of the IFS plane, in 8-bit units
+        };
+
+        /**
+         * @brief Encodes the image to the fractal, which can be written with \write_fractal.
+         *
+         * The image is converted to YUV420 planes laid out as the decoder expects. The planes are
+         * partitioned by the quadtree: the blocks with the largest error are split first, until
+         * the error is within the tolerance or the block limits of the decoder are reached.
+         *
+         * @param pixels R, G, B byte triples without padding
+         * @param previous_frame The preceding frame of the sequence or nullptr. The frame keeps
+         * its layout, channels and partition, only the blocks are encoded anew
+         *
+         * @return false if the image doesn't fit the decoder constraints
+         */
+        bool encode( const std::uint8_t*   pixels,
+                     int                   width,
+                     int                   height,
+                     const EncoderOptions& options,
+                     const Fractal*        previous_frame,
+                     Fractal&              fractal,
+                     EncoderStatistics*    statistics );
+    } // namespace tools
+} // namespace fjord
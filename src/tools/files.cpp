@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "files.hpp"
+
+#include <fjord/container.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace fjord;
+
+bool tools::read_file( const std::string& path, std::vector<std::uint8_t>& data )
+{
+    std::FILE* f = std::fopen( path.c_str(), "rb" );
+    if ( !f )
+        return false;
+
+    bool ok = std::fseek( f, 0, SEEK_END ) == 0;
+
+    const long size = ok ? std::ftell( f ) : -1;
+    ok = size >= 0 && std::fseek( f, 0, SEEK_SET ) == 0;
+
+    if ( ok )
+    {
+        data.resize( static_cast<size_t>( size ) );
+        ok = std::fread( data.data(), 1, data.size(), f ) == data.size();
+    }
+
+    std::fclose( f );
+    return ok;
+}
+
+bool tools::read_file_range( const std::string&         path,
+                             std::uint64_t              offset,
+                             size_t                     size,
+                             std::vector<std::uint8_t>& data )
+{
+    std::FILE* f = std::fopen( path.c_str(), "rb" );
+    if ( !f )
+        return false;
+
+    bool ok = std::fseek( f, static_cast<long>( offset ), SEEK_SET ) == 0;
+
+    if ( ok )
+    {
+        data.resize( size );
+        ok = std::fread( data.data(), 1, data.size(), f ) == data.size();
+    }
+
+    std::fclose( f );
+    return ok;
+}
+
+bool tools::read_container_header( const std::string& path, std::vector<std::uint8_t>& data )
+{
+    // NOTE: RIFF header, form type and the table of contents chunk header
+    constexpr size_t prefix_size = sizeof( format::headers::Chunk ) * 2 + sizeof( std::uint32_t );
+
+    if ( !read_file_range( path, 0, prefix_size, data ) )
+        return false;
+
+    const size_t size = Container::header_size( data.data(), data.size() );
+
+    return size && read_file_range( path, 0, size, data );
+}
+
+bool tools::write_file( const std::string& path, const std::uint8_t* data, size_t size )
+{
+    // NOTE: Writing to the temporary file first, so readers never see partially written files
+    const std::string temporary_path = path + ".tmp";
+
+    std::FILE* f = std::fopen( temporary_path.c_str(), "wb" );
+    if ( !f )
+        return false;
+
+    bool ok = std::fwrite( data, 1, size, f ) == size;
+    ok = std::fclose( f ) == 0 && ok;
+
+    if ( ok )
+    {
+        std::remove( path.c_str() );
+        ok = std::rename( temporary_path.c_str(), path.c_str() ) == 0;
+    }
+
+    if ( !ok )
+        std::remove( temporary_path.c_str() );
+
+    return ok;
+}
+
+std::vector<std::filesystem::path> tools::collect_files( const std::vector<std::string>& inputs,
+                                                         const std::vector<std::string>& extensions )
+{
+    namespace fs = std::filesystem;
+
+    std::vector<fs::path> paths;
+
+    for ( const auto& input : inputs )
+    {
+        std::error_code error;
+
+        if ( !fs::is_directory( input, error ) )
+        {
+            paths.emplace_back( input );
+            continue;
+        }
+
+        std::vector<fs::path> files;
+        for ( const auto& entry : fs::directory_iterator( input, error ) )
+        {
+            if ( entry.is_regular_file( error )
+                 && std::find( extensions.begin(),
+                               extensions.end(),
+                               entry.path().extension().string() )
+                        != extensions.end() )
+                files.push_back( entry.path() );
+        }
+
+        std::sort( files.begin(), files.end() );
+        paths.insert( paths.end(), files.begin(), files.end() );
+    }
+
+    return paths;
+}
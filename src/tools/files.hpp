@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fjord
+{
+    namespace tools
+    {
+        /**
+         * @brief Reads the whole file.
+         *
+         * @return false if the file cannot be read
+         */
+        bool read_file( const std::string& path, std::vector<std::uint8_t>& data );
+
+        /**
+         * @brief Reads the part of the file with a single seek.
+         *
+         * @return false if the file cannot be read or it's shorter than the range end
+         */
+        bool read_file_range( const std::string&         path,
+                              std::uint64_t              offset,
+                              size_t                     size,
+                              std::vector<std::uint8_t>& data );
+
+        /**
+         * @brief Reads the prefix of the container file holding its table of contents.
+         *
+         * @return false if the file is not the container
+         */
+        bool read_container_header( const std::string& path, std::vector<std::uint8_t>& data );
+
+        /**
+         * @brief Writes the data to the file replacing it atomically.
+         *
+         * @return false on I/O error
+         */
+        bool write_file( const std::string& path, const std::uint8_t* data, size_t size );
+
+        /**
+         * @brief Expands the directories to the sorted lists of the files with the extensions.
+         *
+         * Other inputs are passed as they are.
+         */
+        std::vector<std::filesystem::path> collect_files( const std::vector<std::string>& inputs,
+                                                          const std::vector<std::string>& extensions );
+    } // namespace tools
+} // namespace fjord
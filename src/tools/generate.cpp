@@ -0,0 +1,546 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+// Generator of the synthetic .fjord files.
+//
+// The files have the requested geometry and random, but legal, partition trees and block
+// transforms, so they can be used to see how the decoder scales with the image size, the number
+// of blocks and the tree depth. Contrast of the transforms is kept below 1, so the function
+// systems are contractive and the iterations converge to some texture.
+
+#include <fjord/decoder.hpp>
+#include <fjord/format.hpp>
+#include <fjord/program.hpp>
+#include <fjord/symmetry.hpp>
+
+#include "files.hpp"
+#include "writer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace fjord;
+
+namespace
+{
+    constexpr int max_image_size = static_cast<int>( format::constraints::max_image_size );
+    constexpr auto max_blocks_count = format::constraints::max_ifs_blocks_count;
+
+    // NOTE: Smaller blocks have no room for the deblocking window border
+    constexpr int min_block_size_log2 = 2;
+
+    // NOTE: Larger blocks don't leave the domain offsets range in the small planes
+    constexpr int max_block_size_log2 = 8;
+
+    // NOTE: Quantized contrast 12/15 = 0.8 keeps the function system contractive
+    constexpr int max_contrast = 12;
+    constexpr int max_brightness = ( 1 << ( format::Block::bits_per_brightness - 1 ) ) - 1;
+
+    struct Options
+    {
+        std::vector<Size>     sizes;
+        std::string           output_directory{ "." };
+        int                   step{ 5 }; // the smallest one for the sweep
+        bool                  sweep{ false };
+        int                   depth{ 2 };
+        unsigned              blocks{ 0 };         // 0 - split the nodes with the probability
+        double                split_probability{ 0.5 };
+        unsigned              regions{ 3 };
+        unsigned              iterations{ 16 };
+        unsigned              count{ 1 };
+        unsigned              seed{ 1 };
+        std::vector<Symmetry> symmetries;
+    };
+
+    struct Node
+    {
+        int x;
+        int y;
+        int size;
+        int level; // remaining depth
+        int children; // index of the first of four children or -1
+    };
+
+    /**
+     * @brief Partition of the IFS plane into the range blocks.
+     */
+    class Partition final
+    {
+    public:
+        Partition( const tools::Layout& layout, int depth )
+        {
+            for ( int row = 0; row < layout.rows; ++row )
+                for ( int col = 0; col < layout.cols; ++col )
+                    m_nodes.push_back( { col << layout.step,
+                                         row << layout.step,
+                                         layout.block_size(),
+                                         depth,
+                                         -1 } );
+
+            m_top_count = m_nodes.size();
+            m_leaf_count = m_top_count;
+            m_flag_count = depth > 0 ? m_top_count : 0;
+        }
+
+        [[nodiscard]] size_t leaf_count() const
+        {
+            return m_leaf_count;
+        }
+
+        /**
+         * @brief Returns the number of the split flags, one per node above the last level.
+         */
+        [[nodiscard]] size_t flag_count() const
+        {
+            return m_flag_count;
+        }
+
+        /**
+         * @brief Splits the randomly chosen leaves until the block count is reached or the number
+         * of the split flags would exceed the limit.
+         */
+        void split_to_count( size_t block_count, size_t max_flag_count, std::mt19937& rng )
+        {
+            std::vector<size_t> splittable;
+            for ( size_t i = 0; i < m_nodes.size(); ++i )
+                if ( m_nodes[i].level > 0 )
+                    splittable.push_back( i );
+
+            while ( m_leaf_count + 3 <= block_count && m_flag_count + 4 <= max_flag_count
+                    && !splittable.empty() )
+            {
+                const size_t pick = std::uniform_int_distribution<size_t>(
+                    0, splittable.size() - 1 )( rng );
+
+                const size_t index = splittable[pick];
+                splittable[pick] = splittable.back();
+                splittable.pop_back();
+
+                split( index );
+
+                for ( size_t i = m_nodes.size() - 4; i < m_nodes.size(); ++i )
+                    if ( m_nodes[i].level > 0 )
+                        splittable.push_back( i );
+            }
+        }
+
+        /**
+         * @brief Splits every node with the probability.
+         */
+        void split_randomly( double probability, std::mt19937& rng )
+        {
+            std::bernoulli_distribution split_node( probability );
+
+            // NOTE: Children are appended to the end, so they are visited by this loop as well
+            for ( size_t i = 0; i < m_nodes.size(); ++i )
+                if ( m_nodes[i].level > 0 && split_node( rng ) )
+                    split( i );
+        }
+
+        /**
+         * @brief Visits the nodes in the decoder traversal order.
+         */
+        template<typename NodeVisitor, typename LeafVisitor>
+        void walk( NodeVisitor on_node, LeafVisitor on_leaf ) const
+        {
+            for ( size_t i = 0; i < m_top_count; ++i )
+                walk( i, on_node, on_leaf );
+        }
+
+    private:
+        void split( size_t index )
+        {
+            // NOTE: Copying, as the vector may be reallocated
+            const Node parent = m_nodes[index];
+            const int  half = parent.size / 2;
+
+            m_nodes[index].children = static_cast<int>( m_nodes.size() );
+
+            // NOTE: Z-order, the same as the decoder walks the children
+            for ( int i = 0; i < 4; ++i )
+                m_nodes.push_back( { parent.x + ( i & 1 ) * half,
+                                     parent.y + ( i >> 1 ) * half,
+                                     half,
+                                     parent.level - 1,
+                                     -1 } );
+
+            m_leaf_count += 3;
+            m_flag_count += parent.level > 1 ? 4 : 0;
+        }
+
+        template<typename NodeVisitor, typename LeafVisitor>
+        void walk( size_t index, NodeVisitor& on_node, LeafVisitor& on_leaf ) const
+        {
+            const Node& node = m_nodes[index];
+
+            if ( node.level > 0 )
+                on_node( node.children >= 0 );
+
+            if ( node.children < 0 )
+            {
+                on_leaf( node );
+                return;
+            }
+
+            for ( int i = 0; i < 4; ++i )
+                walk( static_cast<size_t>( node.children + i ), on_node, on_leaf );
+        }
+
+        std::vector<Node> m_nodes;
+        size_t            m_top_count;
+        size_t            m_leaf_count;
+        size_t            m_flag_count;
+    };
+
+    format::Block random_block( const tools::Layout&         layout,
+                                const Node&                  node,
+                                const std::vector<Symmetry>& symmetries,
+                                std::mt19937&                rng )
+    {
+        const Size plane_size = layout.plane_size();
+
+        // NOTE: Domain block is twice as large as the range block and must fit into the plane
+        const int domain_size = node.size * 2;
+        const int max_offset_x = ( plane_size.w - domain_size ) >> layout.offset_shift_x();
+        const int max_offset_y = ( plane_size.h - domain_size ) >> layout.offset_shift_y();
+
+        auto uniform = [&rng]( int min, int max )
+        { return std::uniform_int_distribution<int>( min, max )( rng ); };
+
+        format::Block block{};
+        block.contrast = uniform( -max_contrast, max_contrast );
+        block.brightness = uniform( -max_brightness, max_brightness );
+        block.transform = static_cast<unsigned>(
+            symmetries[static_cast<size_t>( uniform( 0, (int)symmetries.size() - 1 ) )] );
+        block.offset_x = static_cast<unsigned>( uniform( 0, max_offset_x ) );
+        block.offset_y = static_cast<unsigned>( uniform( 0, max_offset_y ) );
+
+        return block;
+    }
+
+    /**
+     * @return nullptr on success or the reason why the file can't be generated
+     */
+    const char* generate( const Options&             options,
+                          const Size&                size,
+                          int                        step,
+                          std::mt19937&              rng,
+                          std::vector<std::uint8_t>& data,
+                          tools::Fractal&            fractal )
+    {
+        fractal.image_size = size;
+        fractal.layout = tools::Layout::create( size, step );
+        fractal.region_count = options.regions;
+        fractal.depth = options.depth;
+        fractal.iteration_count = options.iterations;
+
+        // NOTE: Full range luma and chroma centered around the middle gray
+        fractal.channel_count = 3;
+        fractal.channels[0] = { 0, 65535 };
+        fractal.channels[1] = { 16384, 32768 };
+        fractal.channels[2] = { 16384, 32768 };
+
+        Partition partition( fractal.layout, options.depth );
+
+        if ( partition.leaf_count() > max_blocks_count || partition.flag_count() > max_blocks_count )
+            return "too many top level blocks, increase the block size";
+
+        if ( options.blocks )
+            partition.split_to_count(
+                std::min<size_t>( options.blocks, max_blocks_count ), max_blocks_count, rng );
+        else
+            partition.split_randomly( options.split_probability, rng );
+
+        fractal.nodes.clear();
+        fractal.blocks.clear();
+
+        partition.walk( [&]( bool split ) { fractal.nodes.push_back( split ); },
+                        [&]( const Node& node )
+                        {
+                            fractal.blocks.push_back(
+                                random_block( fractal.layout, node, options.symmetries, rng ) );
+                        } );
+
+        if ( fractal.blocks.size() > max_blocks_count || fractal.nodes.size() > max_blocks_count )
+            return "too many blocks, decrease the depth or the split probability";
+
+        tools::write_fractal( fractal, data );
+        return nullptr;
+    }
+
+    /**
+     * @return nullptr if the decoder takes the file or the reason why it doesn't
+     */
+    const char* check( Decoder&                         decoder,
+                       const tools::Fractal&            fractal,
+                       const std::vector<std::uint8_t>& data )
+    {
+        const Size plane_size = fractal.layout.plane_size();
+
+        if ( static_cast<size_t>( plane_size.w ) * static_cast<size_t>( plane_size.h )
+             > Program::max_plane_area )
+            return "plane is beyond the decoder limit, decrease the block size";
+
+        if ( !decoder.load( data.data(), data.size(), fractal.image_size, nullptr ) )
+            return "rejected by the decoder";
+
+        return nullptr;
+    }
+
+    void print_usage()
+    {
+        std::fputs( "Usage: fjord_generate [options]\n"
+                    "\n"
+                    "Options:\n"
+                    "  -s <WxH,...>    image sizes or 'sweep' for 64x64 up to the maximal size\n"
+                    "                  (default: 256x256)\n"
+                    "  -o <directory>  output directory (default: current directory)\n"
+                    "  -b <step>       log2 of the top level block size, the smallest one for\n"
+                    "                  the sweep, which takes larger blocks for the large\n"
+                    "                  images (default: 5)\n"
+                    "  -d <depth>      quadtree depth (default: 2)\n"
+                    "  -n <count>      split the blocks until the count is reached\n"
+                    "  -p <0..1>       otherwise split every block with the probability\n"
+                    "                  (default: 0.5)\n"
+                    "  -r <0..3>       number of regions (default: 3)\n"
+                    "  -t <0..7,...>   allowed symmetries (default: all)\n"
+                    "  -i <count>      number of iterations stored in the file (default: 16)\n"
+                    "  -c <count>      number of files per size (default: 1)\n"
+                    "  -S <seed>       random seed (default: 1)\n",
+                    stderr );
+    }
+
+    bool parse_sizes( const char* value, std::vector<Size>& sizes, bool& sweep )
+    {
+        if ( std::strcmp( value, "sweep" ) == 0 )
+        {
+            sweep = true;
+
+            for ( int size = 64; size < max_image_size; size *= 2 )
+                sizes.push_back( Size::create( size, size ) );
+
+            sizes.push_back( Size::create( max_image_size, max_image_size ) );
+            return true;
+        }
+
+        for ( const char* p = value; *p; )
+        {
+            Size size;
+            int  length = 0;
+
+            if ( std::sscanf( p, "%dx%d%n", &size.w, &size.h, &length ) != 2 || size.w <= 0
+                 || size.h <= 0 || size.w > max_image_size || size.h > max_image_size )
+                return false;
+
+            sizes.push_back( size );
+
+            p += length;
+            if ( *p == ',' )
+                ++p;
+        }
+
+        return !sizes.empty();
+    }
+
+    bool parse_symmetries( const char* value, std::vector<Symmetry>& symmetries )
+    {
+        for ( const char* p = value; *p; )
+        {
+            char*      end;
+            const long index = std::strtol( p, &end, 10 );
+
+            if ( end == p || index < 0 || index >= static_cast<long>( Symmetry::count ) )
+                return false;
+
+            symmetries.push_back( static_cast<Symmetry>( index ) );
+
+            p = *end == ',' ? end + 1 : end;
+        }
+
+        return !symmetries.empty();
+    }
+
+    bool parse_options( int argc, char** argv, Options& options )
+    {
+        for ( int i = 1; i < argc; ++i )
+        {
+            const char* arg = argv[i];
+
+            if ( arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || i + 1 == argc )
+                return false;
+
+            const char* value = argv[++i];
+
+            switch ( arg[1] )
+            {
+            case 's':
+                if ( !parse_sizes( value, options.sizes, options.sweep ) )
+                    return false;
+                break;
+
+            case 'o':
+                options.output_directory = value;
+                break;
+
+            case 'b':
+                options.step = std::atoi( value );
+                break;
+
+            case 'd':
+                options.depth = std::atoi( value );
+                break;
+
+            case 'n':
+                options.blocks = static_cast<unsigned>( std::atoi( value ) );
+                break;
+
+            case 'p':
+                options.split_probability = std::atof( value );
+                break;
+
+            case 'r':
+                options.regions = static_cast<unsigned>( std::atoi( value ) );
+                break;
+
+            case 't':
+                if ( !parse_symmetries( value, options.symmetries ) )
+                    return false;
+                break;
+
+            case 'i':
+                options.iterations = static_cast<unsigned>( std::atoi( value ) );
+                break;
+
+            case 'c':
+                options.count = static_cast<unsigned>( std::atoi( value ) );
+                break;
+
+            case 'S':
+                options.seed = static_cast<unsigned>( std::strtoul( value, nullptr, 10 ) );
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        if ( options.sizes.empty() )
+            options.sizes.push_back( Size::create( 256, 256 ) );
+
+        if ( options.symmetries.empty() )
+            for ( int i = 0; i < static_cast<int>( Symmetry::count ); ++i )
+                options.symmetries.push_back( static_cast<Symmetry>( i ) );
+
+        return options.step - options.depth >= min_block_size_log2
+               && options.step <= max_block_size_log2
+               && options.depth >= 0 && options.split_probability >= 0
+               && options.split_probability <= 1
+               && options.regions <= format::constraints::max_regions_count
+               && options.iterations > 0 && options.iterations <= 255 && options.count > 0;
+    }
+} // namespace
+
+int main( int argc, char** argv )
+{
+    Options options;
+
+    if ( !parse_options( argc, argv, options ) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories( options.output_directory, error );
+
+    std::mt19937 rng( options.seed );
+
+    std::vector<std::uint8_t> data;
+    tools::Fractal            fractal;
+
+    // NOTE: Decoder keeps all its buffers inside, one instance checks all the files
+    std::unique_ptr<Decoder> decoder( new Decoder );
+    decoder->reset();
+
+    int failed = 0;
+
+    for ( const Size& size : options.sizes )
+    {
+        for ( unsigned i = 0; i < options.count; ++i )
+        {
+            // NOTE: The sweep takes the smallest blocks the file is generated and decoded with,
+            // the large images have too many small blocks and their planes are rounded up by the
+            // large ones
+            const int max_step = options.sweep ? max_block_size_log2 : options.step;
+
+            int         step = options.step;
+            const char* reason = nullptr;
+
+            for ( ; step <= max_step; ++step )
+            {
+                reason = generate( options, size, step, rng, data, fractal );
+
+                if ( !reason )
+                    reason = check( *decoder, fractal, data );
+
+                if ( !reason )
+                    break;
+            }
+
+            char name[96];
+            std::snprintf( name,
+                           sizeof( name ),
+                           "synthetic_%dx%d_b%d_d%d_s%u_%u.fjord",
+                           size.w,
+                           size.h,
+                           std::min( step, max_step ),
+                           options.depth,
+                           options.seed,
+                           i );
+
+            const std::string path
+                = ( std::filesystem::path( options.output_directory ) / name ).string();
+
+            if ( reason )
+            {
+                std::fprintf( stderr, "%s: %s\n", path.c_str(), reason );
+                ++failed;
+                continue;
+            }
+
+            if ( !tools::write_file( path, data.data(), data.size() ) )
+            {
+                std::fprintf( stderr, "%s: cannot write file\n", path.c_str() );
+                ++failed;
+                continue;
+            }
+
+            std::printf( "%s: %dx%d, plane %dx%d, %zu blocks, %zu nodes, %zu bytes\n",
+                         path.c_str(),
+                         size.w,
+                         size.h,
+                         fractal.layout.plane_size().w,
+                         fractal.layout.plane_size().h,
+                         fractal.blocks.size(),
+                         fractal.nodes.size(),
+                         data.size() );
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
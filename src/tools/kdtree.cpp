@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "kdtree.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+using namespace fjord;
+
+void tools::KdTree::build( const float* points, std::uint32_t count )
+{
+    m_points = points;
+
+    m_order.resize( count );
+    for ( std::uint32_t i = 0; i < count; ++i )
+        m_order[i] = i;
+
+    m_nodes.clear();
+    m_nodes.reserve( 2 * ( count / leaf_size + 1 ) );
+
+    if ( count )
+        build_node( 0, count );
+}
+
+std::uint32_t tools::KdTree::build_node( std::uint32_t begin, std::uint32_t end )
+{
+    const auto index = static_cast<std::uint32_t>( m_nodes.size() );
+    m_nodes.push_back( { -1, 0, { 0, 0 }, begin, end } );
+
+    if ( end - begin <= leaf_size )
+        return index;
+
+    // NOTE: Splitting along the dimension of the largest spread
+    float min[dimensions];
+    float max[dimensions];
+    std::fill_n( min, dimensions, m_points[m_order[begin] * dimensions] );
+    std::fill_n( max, dimensions, m_points[m_order[begin] * dimensions] );
+
+    for ( std::uint32_t i = begin; i < end; ++i )
+    {
+        const float* p = m_points + static_cast<size_t>( m_order[i] ) * dimensions;
+
+        for ( int d = 0; d < dimensions; ++d )
+        {
+            min[d] = std::min( min[d], p[d] );
+            max[d] = std::max( max[d], p[d] );
+        }
+    }
+
+    int dimension = 0;
+    for ( int d = 1; d < dimensions; ++d )
+        if ( max[d] - min[d] > max[dimension] - min[dimension] )
+            dimension = d;
+
+    if ( max[dimension] == min[dimension] )
+        return index;
+
+    const std::uint32_t middle = begin + ( end - begin ) / 2;
+
+    std::nth_element( m_order.begin() + begin,
+                      m_order.begin() + middle,
+                      m_order.begin() + end,
+                      [this, dimension]( std::uint32_t a, std::uint32_t b )
+                      {
+                          return m_points[static_cast<size_t>( a ) * dimensions + dimension]
+                                 < m_points[static_cast<size_t>( b ) * dimensions + dimension];
+                      } );
+
+    const float split = m_points[static_cast<size_t>( m_order[middle] ) * dimensions + dimension];
+
+    const std::uint32_t left = build_node( begin, middle );
+    const std::uint32_t right = build_node( middle, end );
+
+    // NOTE: Recursion may reallocate the nodes
+    Node& node = m_nodes[index];
+    node.dimension = dimension;
+    node.split = split;
+    node.children[0] = left;
+    node.children[1] = right;
+
+    return index;
+}
+
+float tools::KdTree::distance( const float* query, std::uint32_t point ) const
+{
+    const float* p = m_points + static_cast<size_t>( point ) * dimensions;
+
+    float sum = 0;
+    for ( int d = 0; d < dimensions; ++d )
+    {
+        const float delta = query[d] - p[d];
+        sum += delta * delta;
+    }
+
+    return sum;
+}
+
+void tools::KdTree::search( const float*                query,
+                            unsigned                    k,
+                            unsigned                    max_leaves,
+                            std::vector<std::uint32_t>& result ) const
+{
+    result.clear();
+
+    if ( m_nodes.empty() || k == 0 )
+        return;
+
+    using Candidate = std::pair<float, std::uint32_t>; // distance, point or node
+
+    // NOTE: Max-heap of the best points found so far, the worst one is on the top
+    std::vector<Candidate> best;
+    best.reserve( k + 1 );
+
+    // NOTE: Min-heap of the branches to visit ordered by the distance to the splitting plane
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> branches;
+    branches.push( { 0.0f, 0 } );
+
+    for ( unsigned leaves = 0; !branches.empty() && leaves < max_leaves; )
+    {
+        const Candidate branch = branches.top();
+        branches.pop();
+
+        if ( best.size() == k && branch.first >= best.front().first )
+            break;
+
+        std::uint32_t index = branch.second;
+
+        // NOTE: Descending to the leaf, the farther children are left for later
+        while ( m_nodes[index].dimension >= 0 )
+        {
+            const Node& node = m_nodes[index];
+
+            const float delta = query[node.dimension] - node.split;
+            const int   nearer = delta < 0 ? 0 : 1;
+
+            branches.push( { std::max( branch.first, delta * delta ), node.children[1 - nearer] } );
+            index = node.children[nearer];
+        }
+
+        const Node& leaf = m_nodes[index];
+        ++leaves;
+
+        for ( std::uint32_t i = leaf.begin; i < leaf.end; ++i )
+        {
+            const float d = distance( query, m_order[i] );
+
+            if ( best.size() < k )
+            {
+                best.push_back( { d, m_order[i] } );
+                std::push_heap( best.begin(), best.end() );
+            }
+            else if ( d < best.front().first )
+            {
+                std::pop_heap( best.begin(), best.end() );
+                best.back() = { d, m_order[i] };
+                std::push_heap( best.begin(), best.end() );
+            }
+        }
+    }
+
+    std::sort_heap( best.begin(), best.end() );
+
+    for ( const auto& candidate : best )
+        result.push_back( candidate.second );
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fjord
+{
+    namespace tools
+    {
+        /**
+         * @brief Approximate nearest neighbour index of the fixed dimension feature vectors.
+         *
+         * The search is the best bin first traversal of the k-d tree limited by the number of the
+         * visited leaves, so it trades the accuracy for the time.
+         */
+        class KdTree final
+        {
+        public:
+            static constexpr int dimensions = 16;
+
+            using Feature = float[dimensions];
+
+            /**
+             * @brief Builds the tree over the points.
+             *
+             * @param points \count vectors of \dimensions values, must outlive the tree
+             */
+            void build( const float* points, std::uint32_t count );
+
+            /**
+             * @brief Finds up to \k points closest to the query.
+             *
+             * @param max_leaves Maximal number of the visited leaves
+             * @param result Indices of the found points, the closest first
+             */
+            void search( const float*                query,
+                         unsigned                    k,
+                         unsigned                    max_leaves,
+                         std::vector<std::uint32_t>& result ) const;
+
+        private:
+            static constexpr std::uint32_t leaf_size = 8;
+
+            struct Node
+            {
+                int           dimension; // -1 for leaves
+                float         split;
+                std::uint32_t children[2];
+                std::uint32_t begin;
+                std::uint32_t end;
+            };
+
+            std::uint32_t build_node( std::uint32_t begin, std::uint32_t end );
+
+            [[nodiscard]] float distance( const float* query, std::uint32_t point ) const;
+
+            const float*               m_points{ nullptr };
+            std::vector<std::uint32_t> m_order;
+            std::vector<Node>          m_nodes;
+        };
+    } // namespace tools
+} // namespace fjord
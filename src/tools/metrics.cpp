@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "metrics.hpp"
+
+#include <cmath>
+#include <limits>
+
+using namespace fjord;
+
+void tools::extract_luma( const std::uint8_t* pixels,
+                          int                 width,
+                          int                 height,
+                          size_t              pitch,
+                          LumaPlane&          luma )
+{
+    luma.width = width;
+    luma.height = height;
+    luma.samples.resize( static_cast<size_t>( width ) * static_cast<size_t>( height ) );
+
+    float* dst = luma.samples.data();
+
+    for ( int y = 0; y < height; ++y, pixels += pitch )
+    {
+        for ( int x = 0; x < width; ++x )
+        {
+            const std::uint8_t* p = pixels + x * 3;
+            *dst++ = 0.114f * p[0] + 0.587f * p[1] + 0.299f * p[2];
+        }
+    }
+}
+
+void tools::extract_gray( const std::uint8_t* pixels,
+                          int                 width,
+                          int                 height,
+                          size_t              pitch,
+                          LumaPlane&          luma )
+{
+    luma.width = width;
+    luma.height = height;
+    luma.samples.resize( static_cast<size_t>( width ) * static_cast<size_t>( height ) );
+
+    float* dst = luma.samples.data();
+
+    for ( int y = 0; y < height; ++y, pixels += pitch )
+    {
+        for ( int x = 0; x < width; ++x )
+            *dst++ = pixels[x];
+    }
+}
+
+double tools::psnr( const LumaPlane& a, const LumaPlane& b )
+{
+    double sum = 0;
+
+    for ( size_t i = 0; i < a.samples.size(); ++i )
+    {
+        const double d = static_cast<double>( a.samples[i] ) - b.samples[i];
+        sum += d * d;
+    }
+
+    if ( sum == 0 )
+        return std::numeric_limits<double>::infinity();
+
+    const double mse = sum / static_cast<double>( a.samples.size() );
+    return 10 * std::log10( 255.0 * 255.0 / mse );
+}
+
+double tools::ssim( const LumaPlane& a, const LumaPlane& b )
+{
+    constexpr int    window_size = 8;
+    constexpr int    window_step = 4;
+    constexpr double c1 = ( 0.01 * 255 ) * ( 0.01 * 255 );
+    constexpr double c2 = ( 0.03 * 255 ) * ( 0.03 * 255 );
+    constexpr double n = window_size * window_size;
+
+    double sum = 0;
+    int    count = 0;
+
+    for ( int y = 0; y + window_size <= a.height; y += window_step )
+    {
+        for ( int x = 0; x + window_size <= a.width; x += window_step )
+        {
+            double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+
+            for ( int j = 0; j < window_size; ++j )
+            {
+                const size_t row = static_cast<size_t>( y + j ) * static_cast<size_t>( a.width ) + x;
+
+                for ( int i = 0; i < window_size; ++i )
+                {
+                    const double va = a.samples[row + i];
+                    const double vb = b.samples[row + i];
+
+                    sa += va;
+                    sb += vb;
+                    saa += va * va;
+                    sbb += vb * vb;
+                    sab += va * vb;
+                }
+            }
+
+            const double ma = sa / n;
+            const double mb = sb / n;
+            const double va = saa / n - ma * ma;
+            const double vb = sbb / n - mb * mb;
+            const double cov = sab / n - ma * mb;
+
+            sum += ( 2 * ma * mb + c1 ) * ( 2 * cov + c2 )
+                   / ( ( ma * ma + mb * mb + c1 ) * ( va + vb + c2 ) );
+            ++count;
+        }
+    }
+
+    return count ? sum / count : 1.0;
+}
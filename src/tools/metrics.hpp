@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fjord
+{
+    namespace tools
+    {
+        /**
+         * @brief Luma plane in the range [0;255], row by row without padding.
+         */
+        struct LumaPlane
+        {
+            int                width;
+            int                height;
+            std::vector<float> samples;
+        };
+
+        /**
+         * @brief Extracts BT.601 luma from the pixels produced by the decoder in rgb888 format.
+         *
+         * @note The decoder stores rgb888 pixels in B, G, R byte order.
+         */
+        void extract_luma( const std::uint8_t* pixels,
+                           int                 width,
+                           int                 height,
+                           size_t              pitch,
+                           LumaPlane&          luma );
+
+        /**
+         * @brief Copies the luma produced by the decoder in gray8 format.
+         */
+        void extract_gray( const std::uint8_t* pixels,
+                           int                 width,
+                           int                 height,
+                           size_t              pitch,
+                           LumaPlane&          luma );
+
+        /**
+         * @brief Peak signal-to-noise ratio in dB. Identical planes give infinity.
+         *
+         * @note Planes must be the same size
+         */
+        [[nodiscard]] double psnr( const LumaPlane& a, const LumaPlane& b );
+
+        /**
+         * @brief Mean structural similarity index over the 8x8 windows with the step of 4 pixels.
+         *
+         * @note Planes must be the same size
+         */
+        [[nodiscard]] double ssim( const LumaPlane& a, const LumaPlane& b );
+    } // namespace tools
+} // namespace fjord
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+// Packer of the .fjord files to the .fjar container.
+//
+// Every image is stored with its metadata and optionally with the thumbnail, which is the image
+// decoded to the thumbnail size and encoded again. The container can be listed and the single
+// image can be extracted from it, reading the table of contents and the image chunk only.
+
+#include <fjord/container.hpp>
+#include <fjord/decoder.hpp>
+
+#include "encoder.hpp"
+#include "files.hpp"
+#include "writer.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace fjord;
+
+namespace
+{
+    constexpr int max_image_size = static_cast<int>( format::constraints::max_image_size );
+
+    enum class Mode
+    {
+        pack,
+        list,
+        extract
+    };
+
+    struct Options
+    {
+        Mode                     mode{ Mode::pack };
+        std::vector<std::string> inputs;
+        std::string              output_path;
+        Size                     thumbnail_size{ 0, 0 }; // no thumbnails
+        unsigned                 image{ 0 };             // to extract
+        unsigned                 threads{ std::max( 1u, std::thread::hardware_concurrency() ) };
+    };
+
+    void print_usage()
+    {
+        std::fputs( "Usage: fjord_pack [options] -o <archive.fjar> <file.fjord|directory>...\n"
+                    "       fjord_pack -l <archive.fjar>\n"
+                    "       fjord_pack -x <index> -o <file.fjord> <archive.fjar>\n"
+                    "\n"
+                    "Options:\n"
+                    "  -o <file>   output file\n"
+                    "  -t <WxH>    add the thumbnails fitted to the size\n"
+                    "  -j <count>  number of threads encoding the thumbnails (default: number of "
+                    "cores)\n"
+                    "  -l          list the table of contents of the container\n"
+                    "  -x <index>  extract the image from the container\n",
+                    stderr );
+    }
+
+    bool parse_options( int argc, char** argv, Options& options )
+    {
+        for ( int i = 1; i < argc; ++i )
+        {
+            const char* arg = argv[i];
+
+            if ( arg[0] != '-' || arg[1] == '\0' )
+            {
+                options.inputs.emplace_back( arg );
+                continue;
+            }
+
+            if ( arg[2] != '\0' )
+                return false;
+
+            if ( arg[1] == 'l' )
+            {
+                options.mode = Mode::list;
+                continue;
+            }
+
+            if ( i + 1 == argc )
+                return false;
+
+            const char* value = argv[++i];
+
+            switch ( arg[1] )
+            {
+            case 'o':
+                options.output_path = value;
+                break;
+
+            case 't':
+                if ( std::sscanf(
+                         value, "%dx%d", &options.thumbnail_size.w, &options.thumbnail_size.h )
+                         != 2
+                     || options.thumbnail_size.w <= 0 || options.thumbnail_size.h <= 0
+                     || options.thumbnail_size.w > max_image_size
+                     || options.thumbnail_size.h > max_image_size )
+                    return false;
+                break;
+
+            case 'j':
+                options.threads = static_cast<unsigned>( std::atoi( value ) );
+                if ( options.threads == 0 )
+                    return false;
+                break;
+
+            case 'x':
+                options.mode = Mode::extract;
+                options.image = static_cast<unsigned>( std::atoi( value ) );
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        switch ( options.mode )
+        {
+        case Mode::pack:
+            return !options.inputs.empty() && !options.output_path.empty();
+
+        case Mode::list:
+            return options.inputs.size() == 1;
+
+        case Mode::extract:
+            return options.inputs.size() == 1 && !options.output_path.empty();
+        }
+
+        return false;
+    }
+
+    std::string fourcc( rtl::uint32_t id )
+    {
+        std::string text( 4, ' ' );
+        for ( size_t i = 0; i < text.size(); ++i )
+            text[i] = static_cast<char>( ( id >> ( i * 8 ) ) & 0xff );
+
+        return text;
+    }
+
+    /**
+     * @brief Decodes the image fitted to the thumbnail size and encodes the result.
+     *
+     * @return false if the image can't be decoded or encoded
+     */
+    bool make_thumbnail( Decoder&                         decoder,
+                         const std::vector<std::uint8_t>& data,
+                         const Options&                   options,
+                         std::vector<std::uint8_t>&       thumbnail )
+    {
+        const unsigned iterations = decoder.load(
+            data.data(), data.size(), options.thumbnail_size, nullptr );
+        if ( !iterations )
+            return false;
+
+        // NOTE: Thumbnails must not depend on the previously packed images
+        decoder.rewind();
+
+        const Size   size = decoder.output_size();
+        const size_t pitch = static_cast<size_t>( size.w ) * 3;
+
+        std::vector<std::uint8_t> pixels( pitch * static_cast<size_t>( size.h ) );
+        decoder.decode(
+            iterations, Decoder::PixelFormat::rgb888, pixels.data(), size.w, size.h, pitch );
+
+        // NOTE: The decoder produces B, G, R byte order, the encoder takes R, G, B
+        for ( size_t i = 0; i < pixels.size(); i += 3 )
+            std::swap( pixels[i], pixels[i + 2] );
+
+        tools::EncoderOptions encoder_options;
+        encoder_options.threads = options.threads;
+
+        tools::Fractal fractal;
+        if ( !tools::encode( pixels.data(), size.w, size.h, encoder_options, nullptr, fractal, nullptr ) )
+            return false;
+
+        tools::write_fractal( fractal, thumbnail );
+        return true;
+    }
+
+    int pack( const Options& options )
+    {
+        const auto inputs = tools::collect_files( options.inputs, { ".fjord" } );
+
+        std::unique_ptr<Decoder> decoder;
+        if ( options.thumbnail_size.w )
+        {
+            decoder.reset( new Decoder );
+            decoder->reset();
+        }
+
+        std::vector<tools::ContainerChunk> chunks;
+
+        rtl::uint32_t image = 0;
+
+        for ( const auto& input : inputs )
+        {
+            std::vector<std::uint8_t> data;
+
+            if ( !tools::read_file( input.string(), data )
+                 || data.size() < sizeof( format::headers::Image ) )
+            {
+                std::fprintf( stderr, "%s: cannot read file\n", input.string().c_str() );
+                return EXIT_FAILURE;
+            }
+
+            const auto* info = reinterpret_cast<const format::headers::Image*>( data.data() );
+
+            if ( info->signature != format::signatures::pifs )
+            {
+                std::fprintf( stderr, "%s: unsupported file\n", input.string().c_str() );
+                return EXIT_FAILURE;
+            }
+
+            const std::string metadata = "name=" + input.filename().string() + "\n"
+                                         + "width=" + std::to_string( info->image_width ) + "\n"
+                                         + "height=" + std::to_string( info->image_height ) + "\n"
+                                         + "frames=" + std::to_string( info->image_count ) + "\n";
+
+            chunks.push_back( { format::signatures::pifs, image, std::move( data ) } );
+            chunks.push_back( { format::signatures::metadata,
+                                image,
+                                std::vector<std::uint8_t>( metadata.begin(), metadata.end() ) } );
+
+            if ( decoder )
+            {
+                std::vector<std::uint8_t> thumbnail;
+
+                // NOTE: Images too small for the encoder are packed without the thumbnail
+                if ( make_thumbnail( *decoder, chunks[chunks.size() - 2].data, options, thumbnail ) )
+                    chunks.push_back( { format::signatures::thumbnail, image, std::move( thumbnail ) } );
+                else
+                    std::fprintf( stderr, "%s: no thumbnail\n", input.string().c_str() );
+            }
+
+            ++image;
+        }
+
+        std::vector<std::uint8_t> container;
+        tools::write_container( chunks, container );
+
+        if ( !tools::write_file( options.output_path, container.data(), container.size() ) )
+        {
+            std::fprintf( stderr, "%s: cannot write file\n", options.output_path.c_str() );
+            return EXIT_FAILURE;
+        }
+
+        std::printf( "%s: %u images, %zu chunks, %zu bytes\n",
+                     options.output_path.c_str(),
+                     image,
+                     chunks.size(),
+                     container.size() );
+
+        return EXIT_SUCCESS;
+    }
+
+    int list( const Options& options )
+    {
+        const std::string& path = options.inputs.front();
+
+        std::vector<std::uint8_t> header;
+        Container                 container;
+
+        if ( !tools::read_container_header( path, header )
+             || !container.open( header.data(), header.size() ) )
+        {
+            std::fprintf( stderr, "%s: damaged container\n", path.c_str() );
+            return EXIT_FAILURE;
+        }
+
+        std::printf( "%u images, %zu chunks\n", container.image_count(), container.entry_count() );
+
+        for ( size_t i = 0; i < container.entry_count(); ++i )
+        {
+            const auto& entry = container.entry( i );
+
+            std::printf( "%6zu %s image %6u offset %10u size %8u\n",
+                         i,
+                         fourcc( entry.id ).c_str(),
+                         entry.image,
+                         entry.offset,
+                         entry.size );
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    int extract( const Options& options )
+    {
+        const std::string& path = options.inputs.front();
+
+        std::vector<std::uint8_t> header;
+        Container                 container;
+
+        if ( !tools::read_container_header( path, header )
+             || !container.open( header.data(), header.size() ) )
+        {
+            std::fprintf( stderr, "%s: damaged container\n", path.c_str() );
+            return EXIT_FAILURE;
+        }
+
+        const size_t index = container.find( format::signatures::pifs, options.image );
+        if ( index == container.entry_count() )
+        {
+            std::fprintf( stderr, "%s: no image %u\n", path.c_str(), options.image );
+            return EXIT_FAILURE;
+        }
+
+        const auto&               entry = container.entry( index );
+        std::vector<std::uint8_t> data;
+
+        if ( !tools::read_file_range( path, entry.offset, entry.size, data )
+             || !tools::write_file( options.output_path, data.data(), data.size() ) )
+        {
+            std::fprintf( stderr, "%s: cannot extract image %u\n", path.c_str(), options.image );
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+} // namespace
+
+int main( int argc, char** argv )
+{
+    Options options;
+
+    if ( !parse_options( argc, argv, options ) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    switch ( options.mode )
+    {
+    case Mode::pack:
+        return pack( options );
+
+    case Mode::list:
+        return list( options );
+
+    case Mode::extract:
+        return extract( options );
+    }
+
+    return EXIT_FAILURE;
+}
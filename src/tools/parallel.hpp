@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <fjord/executor.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace fjord
+{
+    namespace tools
+    {
+        /**
+         * @brief Calls the function for every index in [0;count) using the specified number of
+         * threads. Indices are handed out one by one, so the uneven work is balanced.
+         */
+        template<typename Function>
+        void parallel_for( size_t count, unsigned threads, Function fn )
+        {
+            std::atomic<size_t> next{ 0 };
+
+            const auto worker = [&]
+            {
+                for ( size_t i = next++; i < count; i = next++ )
+                    fn( i );
+            };
+
+            const unsigned extra_threads
+                = static_cast<unsigned>( std::min<size_t>( std::max( threads, 1u ), count ) )
+                  - ( count ? 1 : 0 );
+
+            std::vector<std::thread> pool;
+            for ( unsigned i = 0; i < extra_threads; ++i )
+                pool.emplace_back( worker );
+
+            // NOTE: The calling thread is one of the workers
+            worker();
+
+            for ( auto& thread : pool )
+                thread.join();
+        }
+
+        /**
+         * @brief Returns the executor running the decoder tasks by \parallel_for.
+         *
+         * @param threads Must outlive the executor
+         */
+        inline Executor thread_executor( const unsigned& threads )
+        {
+            const Executor::Function function
+                = []( void* context, Executor::Task task, void* task_context, int count )
+            {
+                parallel_for( static_cast<size_t>( count ),
+                              *static_cast<const unsigned*>( context ),
+                              [=]( size_t i ) { task( task_context, static_cast<int>( i ) ); } );
+            };
+
+            return Executor{ function, const_cast<unsigned*>( &threads ) };
+        }
+    } // namespace tools
+} // namespace fjord
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "protocol.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace fjord;
+
+namespace
+{
+    constexpr const char* format_names[] = { "rgb888", "gray8", "bgra8888", "rgba8888",
+                                             "rgb565", "i420",  "nv12" };
+
+    constexpr int format_count
+        = static_cast<int>( sizeof( format_names ) / sizeof( *format_names ) );
+
+    static_assert( static_cast<int>( Decoder::PixelFormat::nv12 ) == format_count - 1 );
+} // namespace
+
+void tools::protocol::frame_layout( Decoder::PixelFormat format,
+                                    int                  width,
+                                    int                  height,
+                                    size_t*              pitch,
+                                    size_t*              size )
+{
+    const auto w = static_cast<size_t>( width );
+    const auto h = static_cast<size_t>( height );
+
+    switch ( format )
+    {
+    case Decoder::PixelFormat::gray8:
+        *pitch = w;
+        *size = w * h;
+        break;
+
+    case Decoder::PixelFormat::bgra8888:
+    case Decoder::PixelFormat::rgba8888:
+        *pitch = w * 4;
+        *size = *pitch * h;
+        break;
+
+    case Decoder::PixelFormat::rgb565:
+        *pitch = w * 2;
+        *size = *pitch * h;
+        break;
+
+    case Decoder::PixelFormat::i420:
+        *pitch = w;
+        *size = w * h + 2 * ( ( w + 1 ) / 2 ) * ( ( h + 1 ) / 2 );
+        break;
+
+    case Decoder::PixelFormat::nv12:
+        // NOTE: The rows of the odd width end with the whole pair of the chroma samples
+        *pitch = image::nv12_min_stride( width );
+        *size = *pitch * ( h + ( h + 1 ) / 2 );
+        break;
+
+    default:
+        *pitch = w * 3;
+        *size = *pitch * h;
+        break;
+    }
+}
+
+const char* tools::protocol::format_name( Decoder::PixelFormat format )
+{
+    const int index = static_cast<int>( format );
+
+    return index >= 0 && index < format_count ? format_names[index] : "unknown";
+}
+
+bool tools::protocol::parse_format( const char* name, Decoder::PixelFormat* format )
+{
+    for ( int i = 0; i < format_count; ++i )
+    {
+        if ( std::strcmp( name, format_names[i] ) == 0 )
+        {
+            *format = static_cast<Decoder::PixelFormat>( i );
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* tools::protocol::status_name( Status status )
+{
+    constexpr const char* names[]
+        = { "ok", "busy", "bad request", "cannot read", "cannot decode", "cannot map" };
+
+    const auto index = static_cast<size_t>( status );
+
+    return index < sizeof( names ) / sizeof( *names ) ? names[index] : "unknown";
+}
+
+bool tools::protocol::send_message( int socket, const void* message, size_t size, int fd )
+{
+    iovec vector;
+    vector.iov_base = const_cast<void*>( message );
+    vector.iov_len = size;
+
+    alignas( cmsghdr ) char control[CMSG_SPACE( sizeof( int ) )];
+
+    msghdr header{};
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+
+    if ( fd >= 0 )
+    {
+        std::memset( control, 0, sizeof( control ) );
+
+        header.msg_control = control;
+        header.msg_controllen = sizeof( control );
+
+        cmsghdr* control_header = CMSG_FIRSTHDR( &header );
+        control_header->cmsg_level = SOL_SOCKET;
+        control_header->cmsg_type = SCM_RIGHTS;
+        control_header->cmsg_len = CMSG_LEN( sizeof( int ) );
+        std::memcpy( CMSG_DATA( control_header ), &fd, sizeof( int ) );
+    }
+
+    // NOTE: The peer may be gone, which is reported instead of raising SIGPIPE
+    ssize_t sent;
+    do
+        sent = sendmsg( socket, &header, MSG_NOSIGNAL );
+    while ( sent < 0 && errno == EINTR );
+
+    return sent == static_cast<ssize_t>( size );
+}
+
+bool tools::protocol::receive_message( int socket, void* message, size_t size, int* fd )
+{
+    *fd = -1;
+
+    iovec vector;
+    vector.iov_base = message;
+    vector.iov_len = size;
+
+    alignas( cmsghdr ) char control[CMSG_SPACE( sizeof( int ) )];
+
+    msghdr header{};
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof( control );
+
+    ssize_t received;
+    do
+        received = recvmsg( socket, &header, MSG_CMSG_CLOEXEC );
+    while ( received < 0 && errno == EINTR );
+
+    for ( cmsghdr* control_header = CMSG_FIRSTHDR( &header ); control_header;
+          control_header = CMSG_NXTHDR( &header, control_header ) )
+    {
+        if ( control_header->cmsg_level == SOL_SOCKET && control_header->cmsg_type == SCM_RIGHTS
+             && *fd < 0 )
+            std::memcpy( fd, CMSG_DATA( control_header ), sizeof( int ) );
+    }
+
+    // NOTE: The truncated message is of the wrong size, so it's rejected along with its descriptor
+    if ( received != static_cast<ssize_t>( size ) || ( header.msg_flags & MSG_TRUNC ) )
+    {
+        if ( *fd >= 0 )
+            close( *fd );
+
+        *fd = -1;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <fjord/decoder.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fjord
+{
+    namespace tools
+    {
+        /**
+         * @brief Messages of the decode server, which are exchanged over the Unix domain socket
+         * of the sequenced packets, one message per packet.
+         *
+         * The input file and the decoded frame are passed as the file descriptors along with the
+         * messages, so the pixels are never copied through the socket.
+         */
+        namespace protocol
+        {
+            constexpr std::uint32_t request_signature = rtl::make_fourcc( 'F', 'J', 'R', 'Q' );
+            constexpr std::uint32_t response_signature = rtl::make_fourcc( 'F', 'J', 'R', 'S' );
+
+            constexpr size_t max_path_size = 512;
+
+            enum class Status : std::uint32_t
+            {
+                ok,
+                busy,           // the queue is full, the request may be retried later
+                bad_request,    // malformed message or parameters
+                cannot_read,    // the input file cannot be read
+                cannot_decode,  // the input is not a supported image
+                cannot_map      // the frame buffer cannot be allocated
+            };
+
+            /**
+             * @brief Asks to decode the file of the path, or of the descriptor attached to the
+             * message if the path is empty.
+             */
+            struct Request
+            {
+                std::uint32_t signature;
+                std::uint32_t id; // echoed in the response
+                std::uint16_t target_width;
+                std::uint16_t target_height;
+                std::uint32_t format;     // \Decoder::PixelFormat
+                std::int32_t  iterations; // negative for the count stored in the file
+                char          path[max_path_size];
+            };
+
+            /**
+             * @brief Tells the result of the request, the frame of the size bytes is in the
+             * memory file attached to the message if the status is ok.
+             *
+             * Times are in microseconds: waiting in the queue, reading the input, loading the
+             * program and iterating with the conversion to the pixel format.
+             */
+            struct Response
+            {
+                std::uint32_t signature;
+                std::uint32_t id;
+                Status        status;
+                std::uint16_t width;
+                std::uint16_t height;
+                std::uint64_t pitch;
+                std::uint64_t size;
+                std::uint32_t iterations;
+                std::uint32_t queue_us;
+                std::uint32_t read_us;
+                std::uint32_t load_us;
+                std::uint32_t decode_us;
+                std::uint32_t pad;
+            };
+
+            /**
+             * @brief Returns the pitch and the size in bytes of the frame of the pixel format.
+             */
+            void frame_layout( Decoder::PixelFormat format,
+                               int                  width,
+                               int                  height,
+                               size_t*              pitch,
+                               size_t*              size );
+
+            [[nodiscard]] const char* format_name( Decoder::PixelFormat format );
+
+            /**
+             * @brief Finds the pixel format by its name.
+             *
+             * @return false if there's no such format
+             */
+            bool parse_format( const char* name, Decoder::PixelFormat* format );
+
+            [[nodiscard]] const char* status_name( Status status );
+
+            /**
+             * @brief Sends the message with the descriptor attached, or without it if the
+             * descriptor is negative.
+             *
+             * @return false if the peer is gone
+             */
+            bool send_message( int socket, const void* message, size_t size, int fd );
+
+            /**
+             * @brief Receives the message of the exact size and the descriptor attached to it,
+             * which is set to -1 if there's none.
+             *
+             * @return false if the peer is gone or the message is of another size
+             */
+            bool receive_message( int socket, void* message, size_t size, int* fd );
+        } // namespace protocol
+    } // namespace tools
+} // namespace fjord
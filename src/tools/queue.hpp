@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace fjord
+{
+    namespace tools
+    {
+        /**
+         * @brief Multi-producer multi-consumer queue of the limited capacity.
+         *
+         * Producers are blocked while the queue is full, so the slow stage of a pipeline throttles
+         * the fast ones instead of accumulating unbounded amount of data.
+         */
+        template<typename T>
+        class BoundedQueue final
+        {
+        public:
+            explicit BoundedQueue( size_t capacity )
+                : m_capacity( capacity )
+            {
+            }
+
+            /**
+             * @brief Blocks while the queue is full.
+             *
+             * @return false if the queue is closed
+             */
+            bool push( T value )
+            {
+                std::unique_lock<std::mutex> lock( m_mutex );
+                m_not_full.wait( lock, [this] { return m_closed || m_items.size() < m_capacity; } );
+
+                if ( m_closed )
+                    return false;
+
+                m_items.push_back( std::move( value ) );
+                m_not_empty.notify_one();
+
+                return true;
+            }
+
+            /**
+             * @brief Doesn't block, fails if the queue is full.
+             *
+             * @return false if the queue is full or closed
+             */
+            bool try_push( T& value )
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+
+                if ( m_closed || m_items.size() >= m_capacity )
+                    return false;
+
+                m_items.push_back( std::move( value ) );
+                m_not_empty.notify_one();
+
+                return true;
+            }
+
+            /**
+             * @brief Blocks while the queue is empty.
+             *
+             * @return false if the queue is closed and drained
+             */
+            bool pop( T& value )
+            {
+                std::unique_lock<std::mutex> lock( m_mutex );
+                m_not_empty.wait( lock, [this] { return m_closed || !m_items.empty(); } );
+
+                if ( m_items.empty() )
+                    return false;
+
+                value = std::move( m_items.front() );
+                m_items.pop_front();
+                m_not_full.notify_one();
+
+                return true;
+            }
+
+            /**
+             * @brief Wakes up all waiting threads. Remaining items still can be popped.
+             */
+            void close()
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+
+                m_closed = true;
+                m_not_empty.notify_all();
+                m_not_full.notify_all();
+            }
+
+            [[nodiscard]] size_t size() const
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+                return m_items.size();
+            }
+
+        private:
+            mutable std::mutex      m_mutex;
+            std::condition_variable m_not_empty;
+            std::condition_variable m_not_full;
+            std::deque<T>           m_items;
+            size_t                  m_capacity;
+            bool                    m_closed{ false };
+        };
+    } // namespace tools
+} // namespace fjord
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "raster.hpp"
+
+#include "files.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#if FJORD_HAVE_ZLIB
+    #include <zlib.h>
+#endif
+
+using namespace fjord;
+
+namespace
+{
+    constexpr size_t rgb888_size = 3;
+
+    void put_u32_be( std::vector<std::uint8_t>& out, std::uint32_t value )
+    {
+        out.push_back( static_cast<std::uint8_t>( value >> 24 ) );
+        out.push_back( static_cast<std::uint8_t>( value >> 16 ) );
+        out.push_back( static_cast<std::uint8_t>( value >> 8 ) );
+        out.push_back( static_cast<std::uint8_t>( value ) );
+    }
+
+    std::uint32_t crc32( const std::uint8_t* data, size_t size, std::uint32_t crc = 0 )
+    {
+        static const auto table = []
+        {
+            struct Table
+            {
+                std::uint32_t entries[256];
+            } t{};
+
+            for ( std::uint32_t n = 0; n < 256; ++n )
+            {
+                std::uint32_t c = n;
+                for ( int k = 0; k < 8; ++k )
+                    c = c & 1 ? 0xedb88320u ^ ( c >> 1 ) : c >> 1;
+
+                t.entries[n] = c;
+            }
+
+            return t;
+        }();
+
+        crc = ~crc;
+        for ( size_t i = 0; i < size; ++i )
+            crc = table.entries[( crc ^ data[i] ) & 0xff] ^ ( crc >> 8 );
+
+        return ~crc;
+    }
+
+    void put_chunk( std::vector<std::uint8_t>& out,
+                    const char*                type,
+                    const std::uint8_t*        data,
+                    size_t                     size )
+    {
+        put_u32_be( out, static_cast<std::uint32_t>( size ) );
+
+        const size_t type_offset = out.size();
+        out.insert( out.end(), type, type + 4 );
+        out.insert( out.end(), data, data + size );
+
+        put_u32_be( out, crc32( out.data() + type_offset, size + 4 ) );
+    }
+
+    /**
+     * @brief Packs the filtered scanlines into zlib stream.
+     *
+     * Without zlib the data is stored in uncompressed deflate blocks, which is a valid, although
+     * not compact, PNG.
+     */
+    bool deflate( const std::vector<std::uint8_t>& in, std::vector<std::uint8_t>& out )
+    {
+#if FJORD_HAVE_ZLIB
+        // NOTE: Fast compression level, the transcoder is throughput bound
+        uLongf size = compressBound( static_cast<uLong>( in.size() ) );
+        out.resize( size );
+
+        if ( compress2( out.data(), &size, in.data(), static_cast<uLong>( in.size() ), 1 ) != Z_OK )
+            return false;
+
+        out.resize( size );
+        return true;
+#else
+        constexpr size_t max_block_size = 65535;
+
+        out.clear();
+        out.reserve( in.size() + in.size() / max_block_size * 5 + 11 );
+
+        // NOTE: CM = 8 (deflate), CINFO = 7 (32K window), FCHECK makes the header divisible by 31
+        out.push_back( 0x78 );
+        out.push_back( 0x01 );
+
+        size_t offset = 0;
+        do
+        {
+            const size_t size = std::min( max_block_size, in.size() - offset );
+            const bool   last = offset + size == in.size();
+
+            out.push_back( last ? 1 : 0 );
+            out.push_back( static_cast<std::uint8_t>( size ) );
+            out.push_back( static_cast<std::uint8_t>( size >> 8 ) );
+            out.push_back( static_cast<std::uint8_t>( ~size ) );
+            out.push_back( static_cast<std::uint8_t>( ~size >> 8 ) );
+            out.insert( out.end(), in.data() + offset, in.data() + offset + size );
+
+            offset += size;
+        } while ( offset < in.size() );
+
+        // NOTE: Adler-32 checksum of the uncompressed data
+        std::uint32_t a = 1, b = 0;
+        for ( size_t i = 0; i < in.size(); )
+        {
+            // NOTE: 5552 is the largest block size for which the sums don't overflow
+            const size_t end = std::min( in.size(), i + 5552 );
+
+            for ( ; i < end; ++i )
+            {
+                a += in[i];
+                b += a;
+            }
+
+            a %= 65521;
+            b %= 65521;
+        }
+
+        put_u32_be( out, ( b << 16 ) | a );
+        return true;
+#endif
+    }
+
+    bool write_ppm( const std::string&  path,
+                    const std::uint8_t* pixels,
+                    int                 width,
+                    int                 height,
+                    size_t              pitch )
+    {
+        char header[32];
+        const int header_size = std::snprintf( header, sizeof( header ), "P6\n%d %d\n255\n", width, height );
+
+        const size_t row_size = static_cast<size_t>( width ) * rgb888_size;
+
+        std::vector<std::uint8_t> out( header_size + row_size * height );
+        std::memcpy( out.data(), header, header_size );
+
+        std::uint8_t* dst = out.data() + header_size;
+        for ( int y = 0; y < height; ++y, pixels += pitch )
+        {
+            for ( size_t x = 0; x < row_size; x += rgb888_size )
+            {
+                *dst++ = pixels[x + 2];
+                *dst++ = pixels[x + 1];
+                *dst++ = pixels[x + 0];
+            }
+        }
+
+        return tools::write_file( path, out.data(), out.size() );
+    }
+
+    bool write_png( const std::string&  path,
+                    const std::uint8_t* pixels,
+                    int                 width,
+                    int                 height,
+                    size_t              pitch )
+    {
+        const size_t row_size = static_cast<size_t>( width ) * rgb888_size;
+
+        // NOTE: Every scanline is prefixed with the filter type, 0 means no filtering
+        std::vector<std::uint8_t> scanlines( ( row_size + 1 ) * height );
+
+        std::uint8_t* dst = scanlines.data();
+        for ( int y = 0; y < height; ++y, pixels += pitch )
+        {
+            *dst++ = 0;
+
+            for ( size_t x = 0; x < row_size; x += rgb888_size )
+            {
+                *dst++ = pixels[x + 2];
+                *dst++ = pixels[x + 1];
+                *dst++ = pixels[x + 0];
+            }
+        }
+
+        std::vector<std::uint8_t> compressed;
+        if ( !deflate( scanlines, compressed ) )
+            return false;
+
+        std::vector<std::uint8_t> out;
+        out.reserve( compressed.size() + 64 );
+
+        constexpr std::uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        out.insert( out.end(), signature, signature + sizeof( signature ) );
+
+        std::vector<std::uint8_t> ihdr;
+        put_u32_be( ihdr, static_cast<std::uint32_t>( width ) );
+        put_u32_be( ihdr, static_cast<std::uint32_t>( height ) );
+        ihdr.push_back( 8 ); // bit depth
+        ihdr.push_back( 2 ); // color type: truecolor
+        ihdr.push_back( 0 ); // compression method
+        ihdr.push_back( 0 ); // filter method
+        ihdr.push_back( 0 ); // interlace method
+
+        put_chunk( out, "IHDR", ihdr.data(), ihdr.size() );
+        put_chunk( out, "IDAT", compressed.data(), compressed.size() );
+        put_chunk( out, "IEND", nullptr, 0 );
+
+        return tools::write_file( path, out.data(), out.size() );
+    }
+} // namespace
+
+bool tools::write_raster( const std::string&  path,
+                          RasterFormat        format,
+                          const std::uint8_t* pixels,
+                          int                 width,
+                          int                 height,
+                          size_t              pitch )
+{
+    switch ( format )
+    {
+    case RasterFormat::ppm:
+        return write_ppm( path, pixels, width, height, pitch );
+
+    case RasterFormat::png:
+        return write_png( path, pixels, width, height, pitch );
+    }
+
+    return false;
+}
+
+bool tools::read_ppm( const std::string&         path,
+                      std::vector<std::uint8_t>& pixels,
+                      int*                       width,
+                      int*                       height )
+{
+    std::vector<std::uint8_t> data;
+    if ( !read_file( path, data ) )
+        return false;
+
+    if ( data.size() < 2 || data[0] != 'P' || data[1] != '6' )
+        return false;
+
+    size_t offset = 2;
+
+    // NOTE: Header fields are separated by whitespaces and may be interleaved with comments
+    const auto next_field = [&]() -> long
+    {
+        while ( offset < data.size() )
+        {
+            if ( data[offset] == '#' )
+            {
+                while ( offset < data.size() && data[offset] != '\n' )
+                    ++offset;
+            }
+            else if ( std::isspace( data[offset] ) )
+            {
+                ++offset;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        long value = -1;
+
+        for ( ; offset < data.size() && std::isdigit( data[offset] ) && value < 65536; ++offset )
+            value = ( value < 0 ? 0 : value * 10 ) + ( data[offset] - '0' );
+
+        return value;
+    };
+
+    const long w = next_field();
+    const long h = next_field();
+    const long max_value = next_field();
+
+    if ( w <= 0 || h <= 0 || w > 65535 || h > 65535 || max_value != 255 )
+        return false;
+
+    // NOTE: Single whitespace separates the header from the samples
+    ++offset;
+
+    const size_t size = static_cast<size_t>( w ) * static_cast<size_t>( h ) * rgb888_size;
+    if ( offset > data.size() || data.size() - offset < size )
+        return false;
+
+    pixels.assign( data.begin() + static_cast<std::ptrdiff_t>( offset ),
+                   data.begin() + static_cast<std::ptrdiff_t>( offset + size ) );
+
+    *width = static_cast<int>( w );
+    *height = static_cast<int>( h );
+
+    return true;
+}
+
+const char* tools::raster_extension( RasterFormat format )
+{
+    return format == RasterFormat::png ? ".png" : ".ppm";
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fjord
+{
+    namespace tools
+    {
+        enum class RasterFormat
+        {
+            ppm,
+            png
+        };
+
+        /**
+         * @brief Writes the pixels produced by the decoder in rgb888 format to the file.
+         *
+         * @note The decoder stores rgb888 pixels in B, G, R byte order, as the Windows screen
+         * buffer does, so the channels are swapped on writing.
+         *
+         * @return false on I/O error
+         */
+        bool write_raster( const std::string&  path,
+                           RasterFormat        format,
+                           const std::uint8_t* pixels,
+                           int                 width,
+                           int                 height,
+                           size_t              pitch );
+
+        /**
+         * @brief Reads the binary PPM (P6) image with 8-bit samples as R, G, B byte triples.
+         *
+         * @return false if the file cannot be read or its format isn't supported
+         */
+        bool read_ppm( const std::string&         path,
+                       std::vector<std::uint8_t>& pixels,
+                       int*                       width,
+                       int*                       height );
+
+        [[nodiscard]] const char* raster_extension( RasterFormat format );
+    } // namespace tools
+} // namespace fjord
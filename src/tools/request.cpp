@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+// Client of the decode server.
+//
+// Every file is sent to the server as the request, either as the descriptor of the opened file or
+// as the path, and the frame of the response is mapped from the memory file it comes in. The
+// timing of the server is printed along with the round trip time of every request, and the frames
+// are optionally written as the raster images.
+
+#include <fjord/decoder.hpp>
+
+#include "protocol.hpp"
+#include "raster.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace fjord;
+using namespace fjord::tools;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int max_image_size = static_cast<int>( format::constraints::max_image_size );
+
+    struct Options
+    {
+        std::string              socket_path;
+        std::vector<std::string> inputs;
+        std::string              output_directory; // frames aren't written
+        Size                     target_size{ max_image_size, max_image_size };
+        Decoder::PixelFormat     format{ Decoder::PixelFormat::rgb888 };
+        int                      iterations{ -1 }; // iteration count stored in the file
+        unsigned                 repeat{ 1 };
+        bool                     send_path{ false };
+    };
+
+    void print_usage()
+    {
+        std::fputs( "Usage: fjord_request [options] <socket> <file.fjord>...\n"
+                    "\n"
+                    "Options:\n"
+                    "  -o <directory>  write the rgb888 frames as PNG images to the directory\n"
+                    "  -s <WxH>        fit the images to the target size (default: original size)\n"
+                    "  -f <format>     rgb888|gray8|bgra8888|rgba8888|rgb565|i420|nv12 (default: "
+                    "rgb888)\n"
+                    "  -i <count>      number of iterations (default: stored in the file)\n"
+                    "  -n <count>      send every request the number of times (default: 1)\n"
+                    "  -p              send the paths instead of the opened files\n",
+                    stderr );
+    }
+
+    bool parse_options( int argc, char** argv, Options& options )
+    {
+        for ( int i = 1; i < argc; ++i )
+        {
+            const char* arg = argv[i];
+
+            if ( arg[0] != '-' )
+            {
+                if ( options.socket_path.empty() )
+                    options.socket_path = arg;
+                else
+                    options.inputs.emplace_back( arg );
+                continue;
+            }
+
+            if ( arg[1] == '\0' || arg[2] != '\0' )
+                return false;
+
+            if ( arg[1] == 'p' )
+            {
+                options.send_path = true;
+                continue;
+            }
+
+            if ( i + 1 == argc )
+                return false;
+
+            const char* value = argv[++i];
+
+            switch ( arg[1] )
+            {
+            case 'o':
+                options.output_directory = value;
+                break;
+
+            case 's':
+                if ( std::sscanf( value, "%dx%d", &options.target_size.w, &options.target_size.h )
+                         != 2
+                     || options.target_size.w <= 0 || options.target_size.h <= 0
+                     || options.target_size.w > max_image_size
+                     || options.target_size.h > max_image_size )
+                    return false;
+                break;
+
+            case 'f':
+                if ( !protocol::parse_format( value, &options.format ) )
+                    return false;
+                break;
+
+            case 'i':
+                options.iterations = std::atoi( value );
+                if ( options.iterations < 0 )
+                    return false;
+                break;
+
+            case 'n':
+                options.repeat = static_cast<unsigned>( std::atoi( value ) );
+                if ( options.repeat == 0 )
+                    return false;
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        return !options.inputs.empty();
+    }
+
+    int connect_socket( const std::string& path )
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+
+        if ( path.size() >= sizeof( address.sun_path ) )
+            return -1;
+
+        std::memcpy( address.sun_path, path.c_str(), path.size() + 1 );
+
+        const int fd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+        if ( fd < 0 )
+            return -1;
+
+        if ( connect( fd, reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) ) != 0 )
+        {
+            close( fd );
+            return -1;
+        }
+
+        return fd;
+    }
+
+    /**
+     * @brief Sends the request and waits for its response, the busy server is asked again after
+     * the growing pause, for ten seconds at most.
+     *
+     * @return false if the server is gone
+     */
+    bool exchange( int                      socket,
+                   const protocol::Request& request,
+                   int                      input_fd,
+                   protocol::Response&      response,
+                   int*                     frame_fd )
+    {
+        constexpr int  max_attempts = 100;
+        constexpr auto max_pause = std::chrono::milliseconds( 100 );
+
+        auto pause = std::chrono::milliseconds( 1 );
+
+        for ( int attempt = 0;; ++attempt )
+        {
+            if ( !protocol::send_message( socket, &request, sizeof( request ), input_fd )
+                 || !protocol::receive_message( socket, &response, sizeof( response ), frame_fd ) )
+                return false;
+
+            if ( response.signature != protocol::response_signature )
+                return false;
+
+            if ( response.status != protocol::Status::busy || attempt + 1 == max_attempts )
+                return true;
+
+            std::this_thread::sleep_for( pause );
+            pause = std::min( pause * 2, max_pause );
+        }
+    }
+} // namespace
+
+int main( int argc, char** argv )
+{
+    Options options;
+
+    if ( !parse_options( argc, argv, options ) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    const int socket = connect_socket( options.socket_path );
+
+    if ( socket < 0 )
+    {
+        std::fprintf( stderr,
+                      "Cannot connect to %s: %s\n",
+                      options.socket_path.c_str(),
+                      std::strerror( errno ) );
+        return EXIT_FAILURE;
+    }
+
+    const bool write_frames = !options.output_directory.empty();
+
+    if ( write_frames )
+    {
+        std::error_code error;
+        std::filesystem::create_directories( options.output_directory, error );
+    }
+
+    int failures = 0;
+
+    std::uint32_t id = 0;
+
+    for ( const std::string& input : options.inputs )
+    {
+        for ( unsigned n = 0; n < options.repeat; ++n )
+        {
+            protocol::Request request{};
+            request.signature = protocol::request_signature;
+            request.id = ++id;
+            request.target_width = static_cast<std::uint16_t>( options.target_size.w );
+            request.target_height = static_cast<std::uint16_t>( options.target_size.h );
+            request.format = static_cast<std::uint32_t>( options.format );
+            request.iterations = options.iterations;
+
+            int input_fd = -1;
+
+            if ( options.send_path )
+            {
+                // NOTE: The server resolves the relative paths against its own directory
+                const std::string path = std::filesystem::absolute( input ).string();
+
+                if ( path.size() >= sizeof( request.path ) )
+                {
+                    std::fprintf( stderr, "%s: path is too long\n", input.c_str() );
+                    ++failures;
+                    break;
+                }
+
+                std::memcpy( request.path, path.c_str(), path.size() + 1 );
+            }
+            else
+            {
+                input_fd = open( input.c_str(), O_RDONLY | O_CLOEXEC );
+
+                if ( input_fd < 0 )
+                {
+                    std::fprintf( stderr, "%s: %s\n", input.c_str(), std::strerror( errno ) );
+                    ++failures;
+                    break;
+                }
+            }
+
+            const auto start = Clock::now();
+
+            protocol::Response response;
+            int                frame_fd = -1;
+
+            const bool exchanged = exchange( socket, request, input_fd, response, &frame_fd );
+
+            const double round_trip_ms
+                = std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+
+            if ( input_fd >= 0 )
+                close( input_fd );
+
+            if ( !exchanged )
+            {
+                std::fprintf( stderr, "Server is gone\n" );
+                return EXIT_FAILURE;
+            }
+
+            if ( response.status != protocol::Status::ok || frame_fd < 0 )
+            {
+                std::fprintf( stderr,
+                              "%s: %s\n",
+                              input.c_str(),
+                              protocol::status_name( response.status ) );
+
+                if ( frame_fd >= 0 )
+                    close( frame_fd );
+
+                ++failures;
+                continue;
+            }
+
+            std::printf( "%s: %ux%u %s, %u iterations, queue %.3f ms, read %.3f ms, load %.3f ms, "
+                         "decode %.3f ms, round trip %.3f ms\n",
+                         input.c_str(),
+                         response.width,
+                         response.height,
+                         protocol::format_name( options.format ),
+                         response.iterations,
+                         response.queue_us * 1e-3,
+                         response.read_us * 1e-3,
+                         response.load_us * 1e-3,
+                         response.decode_us * 1e-3,
+                         round_trip_ms );
+
+            if ( write_frames && n == 0 && options.format == Decoder::PixelFormat::rgb888 )
+            {
+                void* pixels = mmap( nullptr, response.size, PROT_READ, MAP_SHARED, frame_fd, 0 );
+
+                const std::string path
+                    = ( std::filesystem::path( options.output_directory )
+                        / std::filesystem::path( input ).stem() )
+                          .string()
+                      + tools::raster_extension( RasterFormat::png );
+
+                if ( pixels == MAP_FAILED
+                     || !tools::write_raster( path,
+                                              RasterFormat::png,
+                                              static_cast<const std::uint8_t*>( pixels ),
+                                              response.width,
+                                              response.height,
+                                              response.pitch ) )
+                {
+                    std::fprintf( stderr, "%s: cannot write %s\n", input.c_str(), path.c_str() );
+                    ++failures;
+                }
+
+                if ( pixels != MAP_FAILED )
+                    munmap( pixels, response.size );
+            }
+
+            close( frame_fd );
+        }
+    }
+
+    close( socket );
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,535 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+// Decode server keeping the pool of the warm decoders.
+//
+// Clients connect to the Unix domain socket and send the requests to decode the file of the path
+// or of the descriptor passed along with the request. Every worker owns the decoder allocated once
+// at the start, so the requests pay neither the process startup nor the allocation of the decoder
+// buffers. The frame is written to the memory file, whose descriptor is passed with the response,
+// so the pixels are never copied through the socket.
+//
+// The requests wait for the workers in the bounded queue. The request which doesn't fit into the
+// queue is answered as busy at once, so the clients see the backpressure and retry later instead
+// of piling up the requests in the server.
+//
+//   accept, receive -> queue -> worker: read, load, iterate -> memory file -> response
+
+#include <fjord/decoder.hpp>
+
+#include "files.hpp"
+#include "protocol.hpp"
+#include "queue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace fjord;
+using namespace fjord::tools;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int max_image_size = static_cast<int>( format::constraints::max_image_size );
+
+    struct Options
+    {
+        std::string socket_path;
+        unsigned    workers{ std::max( 1u, std::thread::hardware_concurrency() ) };
+        size_t      queue_capacity{ 0 };   // twice the workers
+        int         max_iterations{ 256 }; // above the count any image stores
+    };
+
+    /**
+     * @brief Socket of the client, which is closed when neither the server loop nor the queued
+     * requests refer to it.
+     */
+    class Connection final
+    {
+    public:
+        explicit Connection( int socket )
+            : m_socket( socket )
+        {
+        }
+
+        ~Connection()
+        {
+            close( m_socket );
+        }
+
+        [[nodiscard]] int socket() const
+        {
+            return m_socket;
+        }
+
+    private:
+        Connection( const Connection& ) = delete;
+        Connection& operator=( const Connection& ) = delete;
+
+        int m_socket;
+    };
+
+    struct Job
+    {
+        std::shared_ptr<Connection> connection;
+        protocol::Request           request;
+        int                         input_fd{ -1 };
+        Clock::time_point           received;
+    };
+
+    std::atomic<bool> stop_requested{ false };
+
+    void print_usage()
+    {
+        std::fputs( "Usage: fjord_serve [options] <socket>\n"
+                    "\n"
+                    "Options:\n"
+                    "  -j <count>  number of workers with their own decoders (default: number of "
+                    "cores)\n"
+                    "  -q <count>  number of requests waiting for the workers (default: twice the "
+                    "workers)\n"
+                    "  -n <count>  maximal number of iterations of the request (default: 256)\n",
+                    stderr );
+    }
+
+    bool parse_options( int argc, char** argv, Options& options )
+    {
+        for ( int i = 1; i < argc; ++i )
+        {
+            const char* arg = argv[i];
+
+            if ( arg[0] != '-' )
+            {
+                if ( !options.socket_path.empty() )
+                    return false;
+
+                options.socket_path = arg;
+                continue;
+            }
+
+            if ( arg[1] == '\0' || arg[2] != '\0' || i + 1 == argc )
+                return false;
+
+            const int value = std::atoi( argv[++i] );
+
+            switch ( arg[1] )
+            {
+            case 'j':
+                if ( value <= 0 )
+                    return false;
+                options.workers = static_cast<unsigned>( value );
+                break;
+
+            case 'q':
+                if ( value <= 0 )
+                    return false;
+                options.queue_capacity = static_cast<size_t>( value );
+                break;
+
+            case 'n':
+                if ( value <= 0 )
+                    return false;
+                options.max_iterations = value;
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        return !options.socket_path.empty();
+    }
+
+    [[nodiscard]] std::uint32_t microseconds( Clock::duration duration )
+    {
+        return static_cast<std::uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>( duration ).count() );
+    }
+
+    /**
+     * @brief Reads the whole file of the descriptor from its beginning.
+     */
+    bool read_descriptor( int fd, std::vector<std::uint8_t>& data )
+    {
+        struct stat status;
+        if ( fstat( fd, &status ) != 0 || status.st_size < 0 )
+            return false;
+
+        data.resize( static_cast<size_t>( status.st_size ) );
+
+        for ( size_t offset = 0; offset < data.size(); )
+        {
+            const ssize_t count = pread(
+                fd, data.data() + offset, data.size() - offset, static_cast<off_t>( offset ) );
+
+            if ( count < 0 && errno == EINTR )
+                continue;
+
+            if ( count <= 0 )
+                return false;
+
+            offset += static_cast<size_t>( count );
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Creates the memory file of the frame and decodes the frame into it.
+     *
+     * @return The descriptor of the file, or -1 if it cannot be created
+     */
+    int decode_frame( Decoder&             decoder,
+                      unsigned             iterations,
+                      Decoder::PixelFormat format,
+                      protocol::Response&  response )
+    {
+        const Size& size = decoder.output_size();
+
+        size_t pitch;
+        size_t frame_size;
+        protocol::frame_layout( format, size.w, size.h, &pitch, &frame_size );
+
+        const int fd = memfd_create( "fjord-frame", MFD_CLOEXEC );
+        if ( fd < 0 )
+            return -1;
+
+        void* pixels = MAP_FAILED;
+
+        if ( ftruncate( fd, static_cast<off_t>( frame_size ) ) == 0 )
+            pixels = mmap( nullptr, frame_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+
+        if ( pixels == MAP_FAILED )
+        {
+            close( fd );
+            return -1;
+        }
+
+        decoder.decode(
+            iterations, format, static_cast<std::uint8_t*>( pixels ), size.w, size.h, pitch );
+
+        munmap( pixels, frame_size );
+
+        response.width = static_cast<std::uint16_t>( size.w );
+        response.height = static_cast<std::uint16_t>( size.h );
+        response.pitch = pitch;
+        response.size = frame_size;
+
+        return fd;
+    }
+
+    /**
+     * @brief Serves the request and sends the response with the frame.
+     *
+     * @param data Buffer of the input reused by the worker
+     */
+    void serve( Job& job, Decoder& decoder, std::vector<std::uint8_t>& data )
+    {
+        const protocol::Request& request = job.request;
+
+        protocol::Response response{};
+        response.signature = protocol::response_signature;
+        response.id = request.id;
+        response.status = protocol::Status::ok;
+
+        auto time = Clock::now();
+        response.queue_us = microseconds( time - job.received );
+
+        int frame_fd = -1;
+
+        const bool has_path = request.path[0] != '\0';
+
+        if ( has_path ? !tools::read_file( request.path, data )
+                      : !read_descriptor( job.input_fd, data ) )
+        {
+            response.status = protocol::Status::cannot_read;
+        }
+        else
+        {
+            response.read_us = microseconds( Clock::now() - time );
+            time = Clock::now();
+
+            const auto format = static_cast<Decoder::PixelFormat>( request.format );
+
+            // NOTE: Grayscale frames take the luma only, so only the luma blocks are iterated
+            decoder.set_mode( format == Decoder::PixelFormat::gray8 ? Decoder::Mode::luma
+                                                                    : Decoder::Mode::full );
+
+            const Size target_size = Size::create( request.target_width, request.target_height );
+
+            const unsigned stored_iterations
+                = decoder.load( data.data(), data.size(), target_size, nullptr );
+
+            if ( stored_iterations == 0 )
+            {
+                response.status = protocol::Status::cannot_decode;
+            }
+            else
+            {
+                // NOTE: Pooled decoders must not depend on the previous requests
+                decoder.rewind();
+
+                response.iterations = request.iterations < 0
+                                          ? stored_iterations
+                                          : static_cast<std::uint32_t>( request.iterations );
+                response.load_us = microseconds( Clock::now() - time );
+                time = Clock::now();
+
+                frame_fd = decode_frame( decoder, response.iterations, format, response );
+
+                if ( frame_fd < 0 )
+                    response.status = protocol::Status::cannot_map;
+
+                response.decode_us = microseconds( Clock::now() - time );
+            }
+        }
+
+        protocol::send_message(
+            job.connection->socket(), &response, sizeof( response ), frame_fd );
+
+        if ( frame_fd >= 0 )
+            close( frame_fd );
+    }
+
+    /**
+     * @brief Answers the request which isn't queued.
+     */
+    void reject( const Connection& connection, std::uint32_t id, protocol::Status status )
+    {
+        protocol::Response response{};
+        response.signature = protocol::response_signature;
+        response.id = id;
+        response.status = status;
+
+        protocol::send_message( connection.socket(), &response, sizeof( response ), -1 );
+    }
+
+    /**
+     * @brief Checks the request before it's queued. The iterations are capped, so one request
+     * doesn't take the warm decoder for good.
+     */
+    [[nodiscard]] bool is_valid( const protocol::Request& request,
+                                 int                      input_fd,
+                                 const Options&           options )
+    {
+        const bool has_path = request.path[0] != '\0';
+
+        return request.signature == protocol::request_signature
+               && request.format <= static_cast<std::uint32_t>( Decoder::PixelFormat::nv12 )
+               && request.target_width > 0 && request.target_width <= max_image_size
+               && request.target_height > 0 && request.target_height <= max_image_size
+               && request.iterations <= options.max_iterations
+               && std::memchr( request.path, '\0', sizeof( request.path ) ) != nullptr
+               && ( has_path || input_fd >= 0 );
+    }
+
+    int open_socket( const std::string& path )
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+
+        if ( path.size() >= sizeof( address.sun_path ) )
+            return -1;
+
+        std::memcpy( address.sun_path, path.c_str(), path.size() + 1 );
+
+        const int fd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+        if ( fd < 0 )
+            return -1;
+
+        // NOTE: The socket left by the server which was killed is replaced
+        unlink( path.c_str() );
+
+        if ( bind( fd, reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) ) != 0
+             || listen( fd, SOMAXCONN ) != 0 )
+        {
+            close( fd );
+            return -1;
+        }
+
+        return fd;
+    }
+} // namespace
+
+int main( int argc, char** argv )
+{
+    Options options;
+
+    if ( !parse_options( argc, argv, options ) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if ( options.queue_capacity == 0 )
+        options.queue_capacity = options.workers * 2;
+
+    const int listener = open_socket( options.socket_path );
+
+    if ( listener < 0 )
+    {
+        std::fprintf( stderr,
+                      "Cannot listen on %s: %s\n",
+                      options.socket_path.c_str(),
+                      std::strerror( errno ) );
+        return EXIT_FAILURE;
+    }
+
+    const auto stop = []( int ) { stop_requested = true; };
+
+    std::signal( SIGINT, stop );
+    std::signal( SIGTERM, stop );
+
+    BoundedQueue<Job> queue( options.queue_capacity );
+
+    std::atomic<unsigned long long> served{ 0 };
+    std::atomic<unsigned long long> rejected{ 0 };
+
+    // NOTE: Decoder keeps all its buffers inside, so the instances are allocated once and reused
+    std::vector<std::unique_ptr<Decoder>> decoders;
+
+    for ( unsigned i = 0; i < options.workers; ++i )
+    {
+        decoders.emplace_back( new Decoder );
+        decoders.back()->reset();
+    }
+
+    std::vector<std::thread> workers;
+
+    for ( auto& decoder : decoders )
+    {
+        workers.emplace_back(
+            [&queue, &served, decoder = decoder.get()]
+            {
+                std::vector<std::uint8_t> data;
+
+                Job job;
+                while ( queue.pop( job ) )
+                {
+                    serve( job, *decoder, data );
+
+                    if ( job.input_fd >= 0 )
+                        close( job.input_fd );
+
+                    job = {};
+                    ++served;
+                }
+            } );
+    }
+
+    std::fprintf( stderr,
+                  "Serving on %s with %u workers, %zu requests queued at most\n",
+                  options.socket_path.c_str(),
+                  options.workers,
+                  options.queue_capacity );
+
+    // NOTE: The first descriptor is the listener, the rest are the clients
+    std::vector<pollfd>                      descriptors{ { listener, POLLIN, 0 } };
+    std::vector<std::shared_ptr<Connection>> connections{ nullptr };
+
+    constexpr int poll_timeout_ms = 200; // to notice the stop request
+
+    while ( !stop_requested )
+    {
+        if ( poll( descriptors.data(), descriptors.size(), poll_timeout_ms ) <= 0 )
+            continue;
+
+        for ( size_t i = descriptors.size(); i-- > 1; )
+        {
+            if ( !descriptors[i].revents )
+                continue;
+
+            Job job;
+            job.connection = connections[i];
+
+            const bool received = ( descriptors[i].revents & POLLIN )
+                                  && protocol::receive_message( connections[i]->socket(),
+                                                                &job.request,
+                                                                sizeof( job.request ),
+                                                                &job.input_fd );
+
+            // NOTE: Clients sending the malformed messages are disconnected as the closed ones
+            if ( !received )
+            {
+                descriptors.erase( descriptors.begin() + static_cast<std::ptrdiff_t>( i ) );
+                connections.erase( connections.begin() + static_cast<std::ptrdiff_t>( i ) );
+                continue;
+            }
+
+            job.received = Clock::now();
+
+            const std::uint32_t id = job.request.id;
+
+            if ( !is_valid( job.request, job.input_fd, options ) )
+            {
+                reject( *job.connection, id, protocol::Status::bad_request );
+            }
+            else if ( !queue.try_push( job ) )
+            {
+                reject( *job.connection, id, protocol::Status::busy );
+                ++rejected;
+            }
+            else
+            {
+                continue;
+            }
+
+            if ( job.input_fd >= 0 )
+                close( job.input_fd );
+        }
+
+        if ( descriptors[0].revents & POLLIN )
+        {
+            const int client = accept4( listener, nullptr, nullptr, SOCK_CLOEXEC );
+
+            if ( client >= 0 )
+            {
+                descriptors.push_back( { client, POLLIN, 0 } );
+                connections.push_back( std::make_shared<Connection>( client ) );
+            }
+        }
+    }
+
+    // NOTE: Queued requests are still served
+    queue.close();
+
+    for ( auto& worker : workers )
+        worker.join();
+
+    close( listener );
+    unlink( options.socket_path.c_str() );
+
+    std::fprintf( stderr,
+                  "Served %llu requests, %llu rejected as busy\n",
+                  served.load(),
+                  rejected.load() );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,730 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+
+// Batch transcoder of .fjord files to raster images.
+//
+// Files are passed through the pipeline of the stages, every stage is served by its own workers:
+//
+//   read -> load -> iterate -> encode
+//
+// The queues between the stages are bounded and the decoders are taken from the fixed pool for
+// the time between loading and the end of the iterations, so the memory footprint doesn't depend
+// on the number of the input files.
+//
+// Every frame of the sequence is written to its own file with the frame number appended to the
+// name. Sequences are not cached, as the snapshot holds the single frame.
+//
+// Every image of the container is a job of its own, the image chunk is read with a single seek
+// using the table of contents.
+//
+// The image streamed from the standard input bypasses the pipeline: it's parsed while it's being
+// read and every frame is decoded as soon as its last byte arrives.
+
+#include <fjord/container.hpp>
+#include <fjord/decoder.hpp>
+
+#include "files.hpp"
+#include "queue.hpp"
+#include "raster.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace fjord;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int    max_image_size = static_cast<int>( format::constraints::max_image_size );
+    constexpr size_t rgb888_size = 3;
+
+    struct Options
+    {
+        std::vector<std::string> inputs;
+        std::string              output_directory{ "." };
+        std::string              cache_directory;
+        Size                     target_size{ max_image_size, max_image_size };
+        tools::RasterFormat      format{ tools::RasterFormat::png };
+        image::Filter            filter{ image::Filter::nearest };
+        unsigned                 jobs{ std::max( 1u, std::thread::hardware_concurrency() ) };
+        int                      iterations{ -1 }; // iteration count stored in the file
+    };
+
+    struct Job
+    {
+        std::string               input_path;
+        std::string               output_path;
+        std::string               display_name;
+        bool                      in_container{ false };
+        std::uint64_t             chunk_offset{ 0 };
+        size_t                    chunk_size{ 0 };
+        std::string               snapshot_path;
+        std::vector<std::uint8_t> data;
+        std::vector<std::uint8_t> snapshot;
+        std::vector<std::uint8_t> pixels;
+        Decoder*                  decoder{ nullptr };
+        rtl::uint64_t             snapshot_key{ 0 };
+        bool                      restored{ false };
+        unsigned                  iterations{ 0 };
+        unsigned                  frame_count{ 1 };
+        Size                      size{ 0, 0 };
+        const char*               error{ nullptr };
+        Clock::time_point         start;
+    };
+
+    using JobPtr = std::unique_ptr<Job>;
+    using JobQueue = tools::BoundedQueue<JobPtr>;
+
+    /**
+     * @brief Set of the workers running the same function on the jobs taken from the input queue.
+     *
+     * The output queue is closed when the last worker finishes, which propagates the end of the
+     * input down the pipeline. Failed jobs are passed through untouched.
+     */
+    class Stage final
+    {
+    public:
+        template<typename Function>
+        Stage( const char* name, unsigned workers, JobQueue& input, JobQueue& output, Function fn )
+            : m_name( name )
+            , m_running( workers )
+        {
+            for ( unsigned i = 0; i < workers; ++i )
+            {
+                m_threads.emplace_back(
+                    [this, &input, &output, fn]
+                    {
+                        JobPtr job;
+                        while ( input.pop( job ) )
+                        {
+                            const auto start = Clock::now();
+
+                            if ( !job->error )
+                                fn( *job );
+
+                            m_busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             Clock::now() - start )
+                                             .count();
+
+                            output.push( std::move( job ) );
+                        }
+
+                        if ( --m_running == 0 )
+                            output.close();
+                    } );
+            }
+        }
+
+        void join()
+        {
+            for ( auto& thread : m_threads )
+                thread.join();
+        }
+
+        [[nodiscard]] const char* name() const
+        {
+            return m_name;
+        }
+
+        [[nodiscard]] double busy_seconds() const
+        {
+            return static_cast<double>( m_busy_ns.load() ) * 1e-9;
+        }
+
+    private:
+        Stage( const Stage& ) = delete;
+        Stage& operator=( const Stage& ) = delete;
+
+        const char*              m_name;
+        std::atomic<unsigned>    m_running;
+        std::atomic<long long>   m_busy_ns{ 0 };
+        std::vector<std::thread> m_threads;
+    };
+} // namespace
+
+namespace
+{
+    void print_usage()
+    {
+        std::fputs( "Usage: fjord_transcode [options] <file.fjord|file.fjar|directory>...\n"
+                    "       fjord_transcode [options] - < file.fjord\n"
+                    "\n"
+                    "Options:\n"
+                    "  -o <directory>  output directory (default: current directory)\n"
+                    "  -f <ppm|png>    output format (default: png)\n"
+                    "  -s <WxH>        fit the images to the target size (default: original size)\n"
+                    "  -r <filter>     resize by nearest|bilinear filter (default: nearest)\n"
+                    "  -i <count>      number of iterations (default: stored in the file)\n"
+                    "  -j <count>      number of workers per stage (default: number of cores)\n"
+                    "  -c <directory>  cache the decoded snapshots in the directory\n",
+                    stderr );
+    }
+
+    bool parse_options( int argc, char** argv, Options& options )
+    {
+        for ( int i = 1; i < argc; ++i )
+        {
+            const char* arg = argv[i];
+
+            if ( arg[0] != '-' || arg[1] == '\0' )
+            {
+                options.inputs.emplace_back( arg );
+                continue;
+            }
+
+            if ( arg[2] != '\0' || i + 1 == argc )
+                return false;
+
+            const char* value = argv[++i];
+
+            switch ( arg[1] )
+            {
+            case 'o':
+                options.output_directory = value;
+                break;
+
+            case 'c':
+                options.cache_directory = value;
+                break;
+
+            case 'f':
+                if ( std::strcmp( value, "png" ) == 0 )
+                    options.format = tools::RasterFormat::png;
+                else if ( std::strcmp( value, "ppm" ) == 0 )
+                    options.format = tools::RasterFormat::ppm;
+                else
+                    return false;
+                break;
+
+            case 's':
+                if ( std::sscanf( value, "%dx%d", &options.target_size.w, &options.target_size.h )
+                         != 2
+                     || options.target_size.w <= 0 || options.target_size.h <= 0
+                     || options.target_size.w > max_image_size
+                     || options.target_size.h > max_image_size )
+                    return false;
+                break;
+
+            case 'r':
+                if ( std::strcmp( value, "nearest" ) == 0 )
+                    options.filter = image::Filter::nearest;
+                else if ( std::strcmp( value, "bilinear" ) == 0 )
+                    options.filter = image::Filter::bilinear;
+                else
+                    return false;
+                break;
+
+            case 'i':
+                options.iterations = std::atoi( value );
+                if ( options.iterations < 0 )
+                    return false;
+                break;
+
+            case 'j':
+                options.jobs = static_cast<unsigned>( std::atoi( value ) );
+                if ( options.jobs == 0 )
+                    return false;
+                break;
+
+            default:
+                return false;
+            }
+        }
+
+        return !options.inputs.empty();
+    }
+
+    std::string snapshot_path( const std::string& directory, rtl::uint64_t key )
+    {
+        char name[32];
+        std::snprintf( name, sizeof( name ), "%016llx.fjdc", static_cast<unsigned long long>( key ) );
+
+        return ( std::filesystem::path( directory ) / name ).string();
+    }
+
+    /**
+     * @brief Returns the output path of the frame, the frames of the sequence are numbered.
+     */
+    std::string frame_path( const Job& job, unsigned frame )
+    {
+        if ( job.frame_count == 1 )
+            return job.output_path;
+
+        const std::filesystem::path path( job.output_path );
+
+        char suffix[16];
+        std::snprintf( suffix, sizeof( suffix ), "_%04u", frame );
+
+        return ( path.parent_path()
+                 / ( path.stem().string() + suffix + path.extension().string() ) )
+            .string();
+    }
+
+    double percentile( const std::vector<double>& sorted, unsigned p )
+    {
+        if ( sorted.empty() )
+            return 0;
+
+        const size_t index = std::min( sorted.size() - 1, sorted.size() * p / 100 );
+        return sorted[index];
+    }
+
+    /**
+     * @brief Transcodes the image streamed from the standard input.
+     */
+    int transcode_stream( const Options& options )
+    {
+        constexpr size_t max_read_size = 64 * 1024;
+
+        std::unique_ptr<Decoder> decoder( new Decoder );
+        decoder->reset();
+        decoder->set_filter( options.filter );
+        decoder->begin( options.target_size );
+
+        Job job;
+        job.display_name = "stdin";
+        job.output_path = ( std::filesystem::path( options.output_directory ) / "stdin" ).string()
+                          + tools::raster_extension( options.format );
+
+        const auto start = Clock::now();
+
+        std::vector<std::uint8_t> chunk;
+        size_t                    chunk_offset = 0; // of the bytes not fed yet
+        unsigned                  frame = 0;
+
+        while ( decoder->status() != Program::Status::failed )
+        {
+            if ( chunk_offset == chunk.size() )
+            {
+                // NOTE: Reading no more than the parser needs, so it goes on while the rest of the
+                // data is in flight
+                chunk.resize( std::clamp<size_t>( decoder->required(), 1, max_read_size ) );
+                chunk.resize( std::fread( chunk.data(), 1, chunk.size(), stdin ) );
+                chunk_offset = 0;
+
+                if ( chunk.empty() )
+                    break;
+            }
+
+            size_t         consumed = 0;
+            const unsigned iterations = decoder->feed(
+                chunk.data() + chunk_offset, chunk.size() - chunk_offset, &consumed );
+
+            chunk_offset += consumed;
+
+            if ( !iterations )
+                continue;
+
+            if ( !frame )
+            {
+                job.frame_count = decoder->has_next_frame() ? 2 : 1; // numbered or not
+                job.size = decoder->output_size();
+
+                decoder->rewind();
+            }
+
+            const size_t pitch = static_cast<size_t>( job.size.w ) * rgb888_size;
+            job.pixels.resize( pitch * static_cast<size_t>( job.size.h ) );
+
+            decoder->decode( options.iterations < 0 ? iterations
+                                                    : static_cast<unsigned>( options.iterations ),
+                             Decoder::PixelFormat::rgb888,
+                             job.pixels.data(),
+                             job.size.w,
+                             job.size.h,
+                             pitch );
+
+            if ( !tools::write_raster( frame_path( job, frame ),
+                                       options.format,
+                                       job.pixels.data(),
+                                       job.size.w,
+                                       job.size.h,
+                                       pitch ) )
+            {
+                std::fprintf( stderr, "%s: cannot write file\n", job.display_name.c_str() );
+                return EXIT_FAILURE;
+            }
+
+            ++frame;
+
+            if ( !decoder->has_next_frame() )
+                break;
+        }
+
+        if ( !frame || decoder->has_next_frame() || decoder->status() == Program::Status::failed )
+        {
+            std::fprintf( stderr,
+                          "%s: %s\n",
+                          job.display_name.c_str(),
+                          decoder->status() == Program::Status::failed ? "unsupported file"
+                                                                       : "truncated file" );
+            return EXIT_FAILURE;
+        }
+
+        const double elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+
+        std::printf( "frames: %u transcoded\n", frame );
+        std::printf( "time: %.3f s\n", elapsed );
+
+        return EXIT_SUCCESS;
+    }
+} // namespace
+
+int main( int argc, char** argv )
+{
+    Options options;
+
+    if ( !parse_options( argc, argv, options ) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    const auto inputs = tools::collect_files( options.inputs, { ".fjord", ".fjar" } );
+
+    std::error_code error;
+    std::filesystem::create_directories( options.output_directory, error );
+
+    if ( !options.cache_directory.empty() )
+        std::filesystem::create_directories( options.cache_directory, error );
+
+    if ( options.inputs.size() == 1 && options.inputs.front() == "-" )
+        return transcode_stream( options );
+
+    // NOTE: Decoder keeps all its buffers inside, so the instances are allocated once and reused
+    const unsigned pool_size = options.jobs;
+
+    std::vector<std::unique_ptr<Decoder>> decoders;
+    tools::BoundedQueue<Decoder*>         pool( pool_size );
+
+    for ( unsigned i = 0; i < pool_size; ++i )
+    {
+        decoders.emplace_back( new Decoder );
+        decoders.back()->reset();
+        decoders.back()->set_filter( options.filter );
+        pool.push( decoders.back().get() );
+    }
+
+    const size_t queue_capacity = options.jobs;
+
+    JobQueue pending( queue_capacity );
+    JobQueue read( queue_capacity );
+    JobQueue loaded( queue_capacity );
+    JobQueue decoded( queue_capacity );
+    JobQueue done( queue_capacity );
+
+    const bool use_cache = !options.cache_directory.empty();
+
+    const auto release_decoder = [&pool]( Job& job )
+    {
+        if ( job.decoder )
+            pool.push( job.decoder );
+
+        job.decoder = nullptr;
+    };
+
+    // NOTE: Reading is I/O bound, a couple of workers is enough to keep the pipeline fed
+    Stage read_stage( "read",
+                      std::min( options.jobs, 2u ),
+                      pending,
+                      read,
+                      [&]( Job& job )
+                      {
+                          const bool read
+                              = job.in_container
+                                    ? tools::read_file_range(
+                                        job.input_path, job.chunk_offset, job.chunk_size, job.data )
+                                    : tools::read_file( job.input_path, job.data );
+
+                          if ( !read )
+                          {
+                              job.error = "cannot read file";
+                              return;
+                          }
+
+                          if ( job.data.size() < sizeof( format::headers::Image ) )
+                          {
+                              job.error = "unsupported file";
+                              return;
+                          }
+
+                          job.frame_count
+                              = Decoder::frame_count( job.data.data(), job.data.size() );
+
+                          if ( !use_cache || job.frame_count > 1 )
+                              return;
+
+                          job.snapshot_key = Decoder::snapshot_key( job.data.data(),
+                                                                    job.data.size(),
+                                                                    options.target_size,
+                                                                    options.filter );
+                          job.snapshot_path
+                              = snapshot_path( options.cache_directory, job.snapshot_key );
+
+                          if ( !tools::read_file( job.snapshot_path, job.snapshot ) )
+                              job.snapshot.clear();
+                      } );
+
+    Stage load_stage( "load",
+                      options.jobs,
+                      read,
+                      loaded,
+                      [&]( Job& job )
+                      {
+                          pool.pop( job.decoder );
+
+                          Size source_size;
+
+                          if ( !job.snapshot.empty()
+                               && job.decoder->restore( job.snapshot_key,
+                                                        job.snapshot.data(),
+                                                        job.snapshot.size(),
+                                                        options.target_size,
+                                                        &source_size ) )
+                          {
+                              job.restored = true;
+                              job.iterations = 0;
+                          }
+                          else
+                          {
+                              job.snapshot.clear();
+
+                              const unsigned iterations
+                                  = job.decoder->load( job.data.data(),
+                                                       job.data.size(),
+                                                       options.target_size,
+                                                       &source_size );
+
+                              if ( iterations == 0 )
+                              {
+                                  job.error = "unsupported file";
+                                  release_decoder( job );
+                                  return;
+                              }
+
+                              // NOTE: The iterations of the pooled decoder start from the plane
+                              // of its previous file otherwise, so the output would depend on
+                              // the order of the jobs
+                              job.decoder->rewind();
+
+                              job.iterations = options.iterations < 0
+                                                   ? iterations
+                                                   : static_cast<unsigned>( options.iterations );
+                          }
+
+                          job.size = job.decoder->output_size();
+                      } );
+
+    Stage iterate_stage( "iterate",
+                         options.jobs,
+                         loaded,
+                         decoded,
+                         [&]( Job& job )
+                         {
+                             const size_t pitch = static_cast<size_t>( job.size.w ) * rgb888_size;
+                             const size_t frame_size = pitch * static_cast<size_t>( job.size.h );
+
+                             if ( job.restored )
+                                 job.frame_count = 1;
+
+                             job.pixels.resize( frame_size * job.frame_count );
+
+                             for ( unsigned frame = 0; frame < job.frame_count; ++frame )
+                             {
+                                 if ( frame )
+                                 {
+                                     // NOTE: Iterations continue from the preceding frame
+                                     const unsigned iterations = job.decoder->next_frame();
+
+                                     if ( iterations == 0 )
+                                     {
+                                         job.error = "damaged frame";
+                                         break;
+                                     }
+
+                                     job.iterations
+                                         = options.iterations < 0
+                                               ? iterations
+                                               : static_cast<unsigned>( options.iterations );
+                                 }
+
+                                 job.decoder->decode( job.iterations,
+                                                      Decoder::PixelFormat::rgb888,
+                                                      job.pixels.data() + frame_size * frame,
+                                                      job.size.w,
+                                                      job.size.h,
+                                                      pitch );
+                             }
+
+                             if ( use_cache && !job.restored && job.frame_count == 1 )
+                             {
+                                 job.snapshot.resize( job.decoder->snapshot_size() );
+                                 job.snapshot.resize( job.decoder->snapshot(
+                                     job.snapshot_key, job.snapshot.data(), job.snapshot.size() ) );
+                             }
+
+                             release_decoder( job );
+
+                             // NOTE: The input data is referenced by the decoder until this point
+                             job.data = {};
+                         } );
+
+    Stage encode_stage( "encode",
+                        options.jobs,
+                        decoded,
+                        done,
+                        [&]( Job& job )
+                        {
+                            const size_t pitch = static_cast<size_t>( job.size.w ) * rgb888_size;
+                            const size_t frame_size = pitch * static_cast<size_t>( job.size.h );
+
+                            for ( unsigned frame = 0; frame < job.frame_count; ++frame )
+                            {
+                                if ( !tools::write_raster( frame_path( job, frame ),
+                                                           options.format,
+                                                           job.pixels.data() + frame_size * frame,
+                                                           job.size.w,
+                                                           job.size.h,
+                                                           pitch ) )
+                                {
+                                    job.error = "cannot write file";
+                                    return;
+                                }
+                            }
+
+                            if ( use_cache && !job.restored && !job.snapshot.empty() )
+                                tools::write_file(
+                                    job.snapshot_path, job.snapshot.data(), job.snapshot.size() );
+                        } );
+
+    const auto start = Clock::now();
+
+    // NOTE: Feeding the pipeline from the separate thread, so the results can be collected here
+    std::thread feeder(
+        [&]
+        {
+            for ( const auto& input : inputs )
+            {
+                const std::string output_stem
+                    = ( std::filesystem::path( options.output_directory ) / input.stem() ).string();
+
+                if ( input.extension() != ".fjar" )
+                {
+                    JobPtr job( new Job );
+                    job->input_path = input.string();
+                    job->display_name = job->input_path;
+                    job->output_path = output_stem + tools::raster_extension( options.format );
+                    job->start = Clock::now();
+
+                    pending.push( std::move( job ) );
+                    continue;
+                }
+
+                std::vector<std::uint8_t> header;
+                Container                 container;
+
+                if ( !tools::read_container_header( input.string(), header )
+                     || !container.open( header.data(), header.size() ) )
+                {
+                    JobPtr job( new Job );
+                    job->input_path = input.string();
+                    job->display_name = job->input_path;
+                    job->error = "damaged container";
+                    job->start = Clock::now();
+
+                    pending.push( std::move( job ) );
+                    continue;
+                }
+
+                for ( rtl::uint32_t image = 0; image < container.image_count(); ++image )
+                {
+                    const auto& entry
+                        = container.entry( container.find( format::signatures::pifs, image ) );
+
+                    char suffix[16];
+                    std::snprintf( suffix, sizeof( suffix ), "_%04u", image );
+
+                    JobPtr job( new Job );
+                    job->input_path = input.string();
+                    job->display_name = job->input_path + '#' + std::to_string( image );
+                    job->output_path
+                        = output_stem + suffix + tools::raster_extension( options.format );
+                    job->in_container = true;
+                    job->chunk_offset = entry.offset;
+                    job->chunk_size = entry.size;
+                    job->start = Clock::now();
+
+                    pending.push( std::move( job ) );
+                }
+            }
+
+            pending.close();
+        } );
+
+    std::vector<double> latencies;
+    unsigned            failed = 0;
+    unsigned            restored = 0;
+
+    JobPtr job;
+    while ( done.pop( job ) )
+    {
+        if ( job->error )
+        {
+            std::fprintf( stderr, "%s: %s\n", job->display_name.c_str(), job->error );
+            ++failed;
+            continue;
+        }
+
+        restored += job->restored ? 1 : 0;
+
+        latencies.push_back(
+            std::chrono::duration<double, std::milli>( Clock::now() - job->start ).count() );
+    }
+
+    const double elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+
+    feeder.join();
+
+    Stage* stages[] = { &read_stage, &load_stage, &iterate_stage, &encode_stage };
+    for ( Stage* stage : stages )
+        stage->join();
+
+    std::sort( latencies.begin(), latencies.end() );
+
+    std::printf( "files: %zu transcoded, %u restored from cache, %u failed\n",
+                 latencies.size(),
+                 restored,
+                 failed );
+    std::printf( "time: %.3f s, %.2f files/s, %u workers per stage\n",
+                 elapsed,
+                 elapsed > 0 ? static_cast<double>( latencies.size() ) / elapsed : 0.0,
+                 options.jobs );
+    std::printf( "latency: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+                 percentile( latencies, 50 ),
+                 percentile( latencies, 90 ),
+                 percentile( latencies, 99 ),
+                 latencies.empty() ? 0.0 : latencies.back() );
+
+    for ( Stage* stage : stages )
+        std::printf( "stage %-8s busy %.3f s\n", stage->name(), stage->busy_seconds() );
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
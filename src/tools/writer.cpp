@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#include "writer.hpp"
+
+#include <rtl/algorithm.hpp>
+#include <rtl/math.hpp>
+
+using namespace fjord;
+
+namespace
+{
+    // NOTE: Values of the sample files produced by the reference encoder
+    constexpr rtl::uint32_t ifs_version = 4;
+    constexpr rtl::uint32_t ifs_profile_level = 0x00020000;
+    constexpr rtl::uint16_t linear_gamma = 65535;
+
+    template<typename T>
+    void put( std::vector<std::uint8_t>& data, const T& value )
+    {
+        const auto* p = reinterpret_cast<const std::uint8_t*>( &value );
+        data.insert( data.end(), p, p + sizeof( value ) );
+    }
+
+    void write_image( const tools::Fractal&      fractal,
+                      unsigned                   frame_count,
+                      std::vector<std::uint8_t>& data )
+    {
+        format::headers::Image image{};
+        image.signature = format::signatures::pifs;
+        image.version = format::versions::v2;
+        image.codec = format::signatures::iyuv;
+        image.image_width = static_cast<rtl::uint16_t>( fractal.image_size.w );
+        image.image_height = static_cast<rtl::uint16_t>( fractal.image_size.h );
+        image.image_channels_count = static_cast<rtl::uint8_t>( fractal.channel_count );
+        image.image_count = static_cast<rtl::uint8_t>( frame_count );
+        image.gamma = linear_gamma;
+        put( data, image );
+
+        for ( unsigned i = 0; i < fractal.channel_count; ++i )
+            put( data, fractal.channels[i] );
+    }
+
+    void write_frame( const tools::Fractal& fractal, std::vector<std::uint8_t>& data )
+    {
+        const bool shared_blocks = fractal.frame_flags & format::frame_flags::shared_blocks;
+        const bool shared_partition
+            = shared_blocks || ( fractal.frame_flags & format::frame_flags::shared_partition );
+
+        put( data, format::signatures::fjrd );
+
+        format::headers::IteratedFunctionSystem ifs{};
+        ifs.version = ifs_version;
+        ifs.profile_level = ifs_profile_level;
+        ifs.cols = static_cast<rtl::uint16_t>( fractal.layout.cols );
+        ifs.rows = static_cast<rtl::uint16_t>( fractal.layout.rows );
+        ifs.step = static_cast<rtl::uint8_t>( fractal.layout.step );
+        ifs.depth = static_cast<rtl::uint8_t>( fractal.depth );
+        ifs.iteration_count = static_cast<rtl::uint8_t>( fractal.iteration_count );
+        ifs.frame_flags = static_cast<rtl::uint8_t>( fractal.frame_flags );
+        ifs.region_count = static_cast<rtl::uint16_t>( fractal.region_count );
+        ifs.block_count = static_cast<rtl::uint32_t>( fractal.blocks.size() );
+        ifs.node_count = static_cast<rtl::uint32_t>( fractal.nodes.size() );
+        put( data, ifs );
+
+        if ( !shared_partition )
+        {
+            for ( unsigned i = 0; i < fractal.region_count; ++i )
+            {
+                const Rect& region = fractal.layout.regions[i];
+
+                put( data, static_cast<rtl::uint16_t>( region.origin.x ) );
+                put( data, static_cast<rtl::uint16_t>( region.origin.y ) );
+                put( data, static_cast<rtl::uint16_t>( region.size.w ) );
+                put( data, static_cast<rtl::uint16_t>( region.size.h ) );
+            }
+        }
+
+        if ( !shared_blocks )
+        {
+            for ( const auto& block : fractal.blocks )
+                put( data, block );
+        }
+
+        if ( !shared_partition )
+        {
+            // NOTE: Node flags are packed starting from the least significant bit
+            for ( size_t i = 0; i < fractal.nodes.size(); i += 8 )
+            {
+                rtl::uint8_t mask = 0;
+
+                for ( size_t bit = 0; bit < 8 && i + bit < fractal.nodes.size(); ++bit )
+                    mask |= static_cast<rtl::uint8_t>( fractal.nodes[i + bit] ) << bit;
+
+                data.push_back( mask );
+            }
+        }
+    }
+} // namespace
+
+tools::Layout tools::Layout::create( const Size& image_size, int step )
+{
+    const int block_size = 1 << step;
+
+    // NOTE: Chroma planes are half of the image size rounded up to the whole blocks
+    const int half_cols = ( ( image_size.w + 1 ) / 2 + block_size - 1 ) / block_size;
+    const int half_rows = ( ( image_size.h + 1 ) / 2 + block_size - 1 ) / block_size;
+
+    Layout layout;
+    layout.step = step;
+    layout.cols = half_cols * 3;
+    layout.rows = half_rows * 2;
+    layout.regions[0] = Rect::create( 0, 0, half_cols * 2, half_rows * 2 );
+    layout.regions[1] = Rect::create( half_cols * 2, 0, half_cols, half_rows );
+    layout.regions[2] = Rect::create( half_cols * 2, half_rows, half_cols, half_rows );
+
+    return layout;
+}
+
+int tools::Layout::offset_shift_x() const
+{
+    return rtl::max( rtl::ceil_log2_i( cols << step ) - 8, 1 );
+}
+
+int tools::Layout::offset_shift_y() const
+{
+    return rtl::max( rtl::ceil_log2_i( rows << step ) - 8, 1 );
+}
+
+void tools::write_fractal( const Fractal& fractal, std::vector<std::uint8_t>& data )
+{
+    data.clear();
+
+    write_image( fractal, 1, data );
+    write_frame( fractal, data );
+}
+
+void tools::write_sequence( const std::vector<Fractal>& frames, std::vector<std::uint8_t>& data )
+{
+    data.clear();
+
+    if ( frames.empty() )
+        return;
+
+    write_image( frames.front(), static_cast<unsigned>( frames.size() ), data );
+
+    for ( const auto& frame : frames )
+        write_frame( frame, data );
+}
+
+void tools::write_container( const std::vector<ContainerChunk>& chunks,
+                             std::vector<std::uint8_t>&         data )
+{
+    using format::headers::Chunk;
+    using format::headers::ContentsEntry;
+
+    data.clear();
+
+    const auto contents_size = static_cast<rtl::uint32_t>( chunks.size() * sizeof( ContentsEntry ) );
+
+    // NOTE: The table of contents follows the RIFF header and the form type
+    rtl::uint32_t offset = sizeof( Chunk ) * 2 + sizeof( rtl::uint32_t ) + contents_size;
+
+    std::vector<ContentsEntry> entries;
+    entries.reserve( chunks.size() );
+
+    for ( const auto& chunk : chunks )
+    {
+        const auto size = static_cast<rtl::uint32_t>( chunk.data.size() );
+
+        entries.push_back( { chunk.id, chunk.image, offset + rtl::uint32_t( sizeof( Chunk ) ), size } );
+
+        // NOTE: Chunks are padded to the even size
+        offset += sizeof( Chunk ) + size + ( size & 1 );
+    }
+
+    put( data, Chunk{ format::signatures::riff, offset - rtl::uint32_t( sizeof( Chunk ) ) } );
+    put( data, format::signatures::fjar );
+    put( data, Chunk{ format::signatures::toc, contents_size } );
+
+    for ( const auto& entry : entries )
+        put( data, entry );
+
+    for ( const auto& chunk : chunks )
+    {
+        put( data, Chunk{ chunk.id, static_cast<rtl::uint32_t>( chunk.data.size() ) } );
+        data.insert( data.end(), chunk.data.begin(), chunk.data.end() );
+
+        if ( chunk.data.size() & 1 )
+            data.push_back( 0 );
+    }
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2016-2022 Konstantin Polevik
+ * All rights reserved
+ *
+ * This file is part of the FJORD. Redistribution and use in source and
+ * binary forms, with or without modification, are permitted exclusively
+ * under the terms of the MIT license. You should have received a copy of the
+ * license with this file. If not, please visit:
+ * https://github.com/out61h/fjord/blob/master/LICENSE
+ */
+#pragma once
+
+#include <fjord/format.hpp>
+#include <fjord/rect.hpp>
+#include <fjord/size.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace fjord
+{
+    namespace tools
+    {
+        /**
+         * @brief Geometry of the IFS plane holding the YUV420 channels of the image.
+         *
+         * The plane is a grid of the top level blocks, the Y channel is on the left, the U and V
+         * channels are stacked on the right, as the decoder expects:
+         *
+         * +----------------+--------+
+         * | Y              | U      |
+         * |                +--------+
+         * |                | V      |
+         * +----------------+--------+
+         */
+        struct Layout
+        {
+            int  step; // log2 of the top level block size
+            int  cols;
+            int  rows;
+            Rect regions[format::constraints::max_regions_count]; // in top level blocks
+
+            [[nodiscard]] static Layout create( const Size& image_size, int step );
+
+            [[nodiscard]] int block_size() const
+            {
+                return 1 << step;
+            }
+
+            [[nodiscard]] Size plane_size() const
+            {
+                return Size::create( cols << step, rows << step );
+            }
+
+            /**
+             * @brief Returns log2 of the domain offsets granularity along the axes.
+             */
+            [[nodiscard]] int offset_shift_x() const;
+            [[nodiscard]] int offset_shift_y() const;
+        };
+
+        /**
+         * @brief Content of the .fjord file in the form convenient for the producers.
+         */
+        struct Fractal
+        {
+            Size                    image_size;
+            format::headers::Channel channels[format::constraints::max_channels_count];
+            unsigned                channel_count;
+            Layout                  layout;
+            unsigned                region_count;
+            int                     depth;
+            unsigned                iteration_count;
+
+            /// Quadtree split flags in the decoder traversal order: top level blocks row by row,
+            /// children of the split block in Z-order, a flag per block above the last level.
+            std::vector<bool> nodes;
+
+            /// Range blocks in the same traversal order
+            std::vector<format::Block> blocks;
+
+            /// format::frame_flags of the sequence frame, the shared tables are not written
+            unsigned frame_flags{ 0 };
+        };
+
+        /**
+         * @brief Serializes the fractal as the v2 PIFS image with FJRD function system.
+         */
+        void write_fractal( const Fractal& fractal, std::vector<std::uint8_t>& data );
+
+        /**
+         * @brief Serializes the frames as the v2 PIFS image sequence.
+         *
+         * The image header and the channels are taken from the first frame, the other frames must
+         * have the same layout and channels.
+         */
+        void write_sequence( const std::vector<Fractal>& frames, std::vector<std::uint8_t>& data );
+
+        struct ContainerChunk
+        {
+            std::uint32_t             id; // format::signatures of the container chunks
+            std::uint32_t             image;
+            std::vector<std::uint8_t> data;
+        };
+
+        /**
+         * @brief Serializes the chunks as the RIFF container with the table of contents.
+         *
+         * @note Images must be listed in the order of their indices, see \Container
+         */
+        void write_container( const std::vector<ContainerChunk>& chunks,
+                              std::vector<std::uint8_t>&         data );
+    } // namespace tools
+} // namespace fjord